@@ -96,6 +96,34 @@ bool mlua_get_buffer(lua_State* ls, int arg, MLuaBuffer* buf);
 // pointer and size. Also accepts a string.
 bool mlua_get_ro_buffer(lua_State* ls, int arg, MLuaBuffer* buf);
 
+// Get a range of a string or buffer argument. The offset (default: 0) and
+// length (default: the rest of the data) of the range are at the two following
+// argument indexes. Non-raw buffers are copied to a temporary userdata, which
+// is pushed onto the stack. Returns a pointer to the range and sets *len to its
+// length, and *off to its offset if off is non-NULL.
+void const* mlua_check_ro_range(lua_State* ls, int arg, size_t* len,
+                                lua_Unsigned* off);
+
+// An export vtable, used to transfer objects between interpreters.
+typedef struct MLuaExportVt {
+    // Push an object for the given handle. The reference held by the handle is
+    // transferred to the object.
+    void (*import)(lua_State* ls, void* handle);
+
+    // Release the reference held by a handle that won't be imported. If the
+    // handle wasn't committed, the exported object keeps its state.
+    void (*release)(void* handle);
+
+    // Commit the transfer of a handle, once it can no longer fail. This is
+    // called before the handle is made available to the receiver. Optional.
+    void (*commit)(void* handle);
+} MLuaExportVt;
+
+// Apply the export protocol to the given argument. Returns the export vtable
+// and sets "handle" to a new reference to the object, or returns NULL if the
+// argument cannot be exported.
+MLuaExportVt const* mlua_export(lua_State* ls, int arg, void** handle);
+
 // Read from a buffer.
 static inline void mlua_buffer_read(MLuaBuffer const* buf, lua_Unsigned off,
                                     lua_Unsigned len, void* dest) {
@@ -141,6 +169,16 @@ static inline lua_Unsigned mlua_buffer_find(
 // Push a failure and an error message, and return the number of pushed values.
 int mlua_push_fail(lua_State* ls, char const* err);
 
+// The maximum size of a number formatted by mlua_number_to_string(), including
+// the trailing '\0'.
+#define MLUA_MAX_NUMBER_STR_SIZE 48
+
+// Convert a float to a string, with the precision of LUA_NUMBER_FMT if it
+// converts back to the same value, and the shortest precision that does
+// otherwise. Integral values are marked with ".0", like tostring(). Return the
+// length of the result.
+int mlua_number_to_string(lua_Number value, char* s, size_t size);
+
 // Return the result of comparing two values for equality, similar to
 // lua_compare(..., LUA_OPEQ), but always call the __eq metamethod if one is
 // available on either value.
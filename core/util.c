@@ -3,6 +3,9 @@
 
 #include "mlua/util.h"
 
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 int mlua_cont_return_results(lua_State* ls, int status, lua_KContext ctx) {
@@ -77,12 +80,75 @@ bool mlua_get_ro_buffer(lua_State* ls, int arg, MLuaBuffer* buf) {
     return mlua_get_buffer(ls, arg, buf);
 }
 
+void const* mlua_check_ro_range(lua_State* ls, int arg, size_t* len,
+                                lua_Unsigned* off) {
+    MLuaBuffer src;
+    luaL_argexpected(ls, mlua_get_ro_buffer(ls, arg, &src), arg,
+                     "string or buffer");
+    lua_Unsigned o = luaL_optinteger(ls, arg + 1, 0);
+    luaL_argcheck(ls, o <= src.size, arg + 1, "out of bounds");
+    lua_Unsigned n;
+    if (src.size != SIZE_MAX && lua_isnoneornil(ls, arg + 2)) {
+        n = src.size - o;
+    } else {
+        n = luaL_checkinteger(ls, arg + 2);
+        luaL_argcheck(ls, n <= src.size - o, arg + 2, "out of bounds");
+    }
+    *len = n;
+    if (off != NULL) *off = o;
+    if (src.vt == NULL) return (char const*)src.ptr + o;
+    void* data = lua_newuserdatauv(ls, n, 0);
+    mlua_buffer_read(&src, o, n, data);
+    return data;
+}
+
+MLuaExportVt const* mlua_export(lua_State* ls, int arg, void** handle) {
+    arg = lua_absindex(ls, arg);
+    if (luaL_getmetafield(ls, arg, "__export") == LUA_TNIL) return NULL;
+    lua_pushvalue(ls, arg);
+    lua_call(ls, 1, 2);
+    MLuaExportVt const* vt = lua_touserdata(ls, -1);
+    *handle = lua_touserdata(ls, -2);
+    lua_pop(ls, 2);
+    return vt;
+}
+
 int mlua_push_fail(lua_State* ls, char const* err) {
     luaL_pushfail(ls);
     lua_pushstring(ls, err);
     return 2;
 }
 
+// The range of significant digits to try when converting a lua_Number to a
+// string. The maximum guarantees a round trip.
+#define NUMBER_MIN_DIGITS (sizeof(lua_Number) == sizeof(float) ? FLT_DIG \
+                           : sizeof(lua_Number) == sizeof(double) ? DBL_DIG \
+                           : LDBL_DIG)
+#define NUMBER_MAX_DIGITS (sizeof(lua_Number) == sizeof(float) \
+                             ? FLT_DECIMAL_DIG \
+                           : sizeof(lua_Number) == sizeof(double) \
+                             ? DBL_DECIMAL_DIG : LDBL_DECIMAL_DIG)
+
+int mlua_number_to_string(lua_Number value, char* s, size_t size) {
+    int len = lua_number2str(s, size, value);
+    if (value == value && lua_str2number(s, NULL) != value) {
+        for (int prec = NUMBER_MIN_DIGITS;; ++prec) {
+            len = snprintf(s, size, "%.*" LUA_NUMBER_FRMLEN "g", prec,
+                           (LUAI_UACNUMBER)value);
+            if (prec >= (int)NUMBER_MAX_DIGITS
+                    || lua_str2number(s, NULL) == value) {
+                break;
+            }
+        }
+    }
+    if (s[strspn(s, "-0123456789")] == '\0' && (size_t)len + 2 < size) {
+        s[len++] = '.';
+        s[len++] = '0';
+        s[len] = '\0';
+    }
+    return len;
+}
+
 bool mlua_compare_eq(lua_State* ls, int arg1, int arg2) {
     int t1 = lua_type(ls, arg1), t2 = lua_type(ls, arg2);
     if (t1 == LUA_TNONE || t2 == LUA_TNONE) return false;
@@ -0,0 +1,48 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#ifndef _MLUA_LIB_COMMON_MLUA_ARRAY_H
+#define _MLUA_LIB_COMMON_MLUA_ARRAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lua.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The kinds of Array elements.
+typedef enum MLuaArrayKind {
+    MLUA_ARRAY_INT,
+    MLUA_ARRAY_UINT,
+    MLUA_ARRAY_FLOAT,
+    MLUA_ARRAY_STRING,
+} MLuaArrayKind;
+
+// The layout of the elements of an Array. Elements are stored contiguously in
+// native byte order. 64-bit integer elements are always reported as signed.
+typedef struct MLuaArrayInfo {
+    void* data;
+    size_t size;
+    lua_Integer len;
+    MLuaArrayKind kind;
+} MLuaArrayInfo;
+
+// Get the element layout of the Array at the given stack index. Returns false
+// iff the value isn't an Array.
+bool mlua_array_info(lua_State* ls, int arg, MLuaArrayInfo* info);
+
+// Push a new Array of "len" elements of the given kind and size, and return a
+// pointer to its element data. Returns NULL and pushes nothing if the
+// combination of kind and size isn't supported. The mlua.array module must
+// have been loaded.
+void* mlua_push_array(lua_State* ls, MLuaArrayKind kind, size_t size,
+                      lua_Integer len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #ifndef _MLUA_LIB_COMMON_MLUA_BLOCK_H
 #define _MLUA_LIB_COMMON_MLUA_BLOCK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "lua.h"
@@ -13,8 +14,37 @@
 extern "C" {
 #endif
 
+struct MLuaEvent;
+
 // A block device.
 typedef struct MLuaBlockDev MLuaBlockDev;
+
+// The type of an asynchronous block device operation.
+typedef enum MLuaBlockOp {
+    MLUA_BLOCK_READ,
+    MLUA_BLOCK_WRITE,
+    MLUA_BLOCK_ERASE,
+    MLUA_BLOCK_SYNC,
+} MLuaBlockOp;
+
+// Asynchronous operations on a block device. At most one operation can be
+// pending on a device at any time. Synchronous operations wait for the pending
+// asynchronous operation to complete.
+typedef struct MLuaBlockAsync {
+    // Start an operation. For writes, the data is copied before the function
+    // returns. Returns MLUA_EBUSY if another operation is pending.
+    int (*start)(MLuaBlockDev* dev, MLuaBlockOp op, uint64_t off,
+                 void const* src, size_t size);
+
+    // Return true iff the pending operation has completed, and set "result" to
+    // its result. For reads, "data" is set to the data that was read. It
+    // remains valid until the next operation is started.
+    bool (*poll)(MLuaBlockDev* dev, int* result, void const** data);
+
+    // Return the event that is set when the pending operation completes.
+    struct MLuaEvent* (*event)(MLuaBlockDev* dev);
+} MLuaBlockAsync;
+
 struct MLuaBlockDev {
     // Read from the block device. "off" and "size" must be multiples of
     // "read_size".
@@ -42,6 +72,10 @@ struct MLuaBlockDev {
 
     // The minimum size of an erase. All erases must be multiples of this value.
     uint32_t erase_size;
+
+    // The asynchronous operations of the device, or NULL if the device only
+    // supports synchronous operations.
+    MLuaBlockAsync const* async;
 };
 
 // Push a BlockDev value to the stack.
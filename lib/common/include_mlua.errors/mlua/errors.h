@@ -31,6 +31,7 @@ extern "C" {
     MLUA_ERR(ENOTDIR, 13, "not a directory") \
     MLUA_ERR(ENOTEMPTY, 14, "directory not empty") \
     MLUA_ERR(EROFS, 15, "read-only filesystem") \
+    MLUA_ERR(ETIMEDOUT, 18, "timed out") \
 
 // Error codes.
 typedef enum MLuaErrno {
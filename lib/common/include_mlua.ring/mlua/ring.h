@@ -0,0 +1,118 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#ifndef _MLUA_LIB_COMMON_MLUA_RING_H
+#define _MLUA_LIB_COMMON_MLUA_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mlua/thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// When true, producers of multi-producer rings reserve space with atomic
+// compare-and-swap operations. A producer must then not be interrupted by
+// another producer of the same ring, e.g. an IRQ handler on the same core. When
+// false, multi-producer writes are serialized with the event lock.
+#ifndef MLUA_RING_MP_LOCK_FREE
+#define MLUA_RING_MP_LOCK_FREE (ATOMIC_INT_LOCK_FREE == 2)
+#endif
+
+// Ring flags.
+#define MLUA_RING_MULTI_PRODUCER (1u << 0)
+#define MLUA_RING_RECORDS (1u << 1)
+
+// The size of the length prefix of records.
+#define MLUA_RING_RECORD_HEADER 2u
+
+// The maximum length of a record.
+#define MLUA_RING_RECORD_MAX 0xffffu
+
+// A ring buffer, with a single consumer and one or more producers. Writes and
+// reads are lock-free, and can be done from IRQ handlers and from other cores
+// or OS threads. The positions are free-running counters, and are reduced
+// modulo the capacity when accessing the data.
+typedef struct MLuaRing {
+    atomic_uint head;     // The read position, updated by the consumer
+    atomic_uint tail;     // The committed write position
+    atomic_uint reserve;  // The reserved write position
+    atomic_bool rwait;    // True iff the consumer waits for data
+    atomic_bool wwait;    // True iff a producer waits for space
+    unsigned int mask;    // The capacity minus one
+    unsigned int flags;
+    MLuaEvent read_event;   // Set when data is committed
+    MLuaEvent write_event;  // Set when space is freed
+    uint8_t data[];
+} MLuaRing;
+
+// Return the size of a ring with the given capacity, which must be a power of
+// two.
+static inline size_t mlua_ring_size(unsigned int cap) {
+    return sizeof(MLuaRing) + cap;
+}
+
+// Initialize a ring with the given capacity, which must be a power of two. The
+// events are initialized, but not enabled.
+void mlua_ring_init(MLuaRing* r, unsigned int cap, unsigned int flags);
+
+// Return the capacity of a ring.
+static inline unsigned int mlua_ring_cap(MLuaRing const* r) {
+    return r->mask + 1;
+}
+
+// Return the number of bytes available for reading.
+static inline unsigned int mlua_ring_len(MLuaRing* r) {
+    return atomic_load_explicit(&r->tail, memory_order_acquire)
+           - atomic_load_explicit(&r->head, memory_order_relaxed);
+}
+
+// Return the number of bytes available for writing.
+static inline unsigned int mlua_ring_free(MLuaRing* r) {
+    return mlua_ring_cap(r)
+           - (atomic_load_explicit(&r->reserve, memory_order_relaxed)
+              - atomic_load_explicit(&r->head, memory_order_acquire));
+}
+
+// Write up to "len" bytes to the ring, and return the number of bytes written.
+unsigned int mlua_ring_write(MLuaRing* r, void const* src, unsigned int len);
+
+// Write "len" bytes to the ring, or nothing if there isn't enough space.
+// Returns true iff the data was written.
+bool mlua_ring_write_all(MLuaRing* r, void const* src, unsigned int len);
+
+// Read up to "len" bytes from the ring, and return the number of bytes read.
+// Must only be called by the consumer.
+unsigned int mlua_ring_read(MLuaRing* r, void* dest, unsigned int len);
+
+// Write a record to the ring, or nothing if there isn't enough space. Returns
+// true iff the record was written.
+bool mlua_ring_push_record(MLuaRing* r, void const* src, unsigned int len);
+
+// Return the length of the next record, or -1 if the ring is empty. Must only
+// be called by the consumer.
+int mlua_ring_peek_record(MLuaRing* r);
+
+// Read the next record, copying at most "size" bytes to "dest", and return the
+// length of the record. The ring must not be empty. Must only be called by the
+// consumer.
+unsigned int mlua_ring_pop_record(MLuaRing* r, void* dest, unsigned int size);
+
+// Prepare the consumer for waiting until at least "len" bytes are available.
+// Returns true iff the data isn't available yet, in which case the read event
+// will be set once data is committed.
+bool mlua_ring_wait_readable(MLuaRing* r, unsigned int len);
+
+// Prepare a producer for waiting until at least "len" bytes can be written.
+// Returns true iff the space isn't available yet, in which case the write
+// event will be set once space is freed.
+bool mlua_ring_wait_writable(MLuaRing* r, unsigned int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
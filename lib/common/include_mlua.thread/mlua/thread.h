@@ -52,6 +52,11 @@ static inline int mlua_thread_yield(lua_State* ls, int nresults,
 int mlua_thread_suspend(lua_State* ls, lua_KFunction cont, lua_KContext ctx,
                         int index);
 
+// Called by the scheduler before it waits for events while no thread is
+// active. The default implementation does nothing, and can be overridden by
+// defining a non-weak function with the same name.
+void mlua_thread_idle(lua_State* ls);
+
 // Return the given argument as a thread. Raises an error if the argument is not
 // a thread.
 lua_State* mlua_check_thread(lua_State* ls, int arg);
@@ -6,6 +6,7 @@
 #include <stdalign.h>
 #include <string.h>
 
+#include "mlua/array.h"
 #include "mlua/int64.h"
 #include "mlua/module.h"
 #include "mlua/util.h"
@@ -264,6 +265,19 @@ static inline ArrayVT const* number_vt(size_t size) {
     }
 }
 
+static Array* new_array(lua_State* ls, ArrayVT const* vt, size_t size,
+                        lua_Integer len, lua_Integer cap) {
+    Array* arr = lua_newuserdatauv(ls, sizeof(Array) + cap * size, 0);
+    luaL_getmetatable(ls, array_name);
+    lua_setmetatable(ls, -2);
+    arr->vt = vt;
+    arr->data = arr->d64;
+    arr->size = size;
+    arr->len = len;
+    arr->cap = cap;
+    return arr;
+}
+
 static int array___new(lua_State* ls) {
     lua_remove(ls, 1);  // Remove class
     char const* fmt = luaL_checkstring(ls, 1);
@@ -303,18 +317,49 @@ static int array___new(lua_State* ls) {
     luaL_argcheck(ls, cap >= 0 && (lua_Unsigned)cap <= SIZE_MAX / size, 3,
                   "invalid capacity");
     luaL_argcheck(ls, len >= 0 && len <= cap, 2, "invalid length");
-
-    Array* arr = lua_newuserdatauv(ls, sizeof(Array) + cap * size, 0);
-    luaL_getmetatable(ls, array_name);
-    lua_setmetatable(ls, -2);
-    arr->vt = vt;
-    arr->data = arr->d64;
-    arr->size = size;
-    arr->len = len;
-    arr->cap = cap;
+    new_array(ls, vt, size, len, cap);
     return 1;
 }
 
+bool mlua_array_info(lua_State* ls, int arg, MLuaArrayInfo* info) {
+    Array* arr = luaL_testudata(ls, arg, array_name);
+    if (arr == NULL) return false;
+    ArrayVT const* vt = arr->vt;
+    info->data = arr->data;
+    info->size = arr->size;
+    info->len = arr->len;
+    if (vt == &vt_uint8 || vt == &vt_uint16 || vt == &vt_uint32
+            || vt == &vt_uint) {
+        info->kind = MLUA_ARRAY_UINT;
+    } else if (vt == &vt_float || vt == &vt_double
+#if HAS_LDOUBLE
+               || vt == &vt_ldouble
+#endif
+            ) {
+        info->kind = MLUA_ARRAY_FLOAT;
+    } else if (vt == &vt_string) {
+        info->kind = MLUA_ARRAY_STRING;
+    } else {
+        info->kind = MLUA_ARRAY_INT;
+    }
+    return true;
+}
+
+void* mlua_push_array(lua_State* ls, MLuaArrayKind kind, size_t size,
+                      lua_Integer len) {
+    ArrayVT const* vt = NULL;
+    switch (kind) {
+    case MLUA_ARRAY_INT: vt = int_vt(size); break;
+    case MLUA_ARRAY_UINT: vt = uint_vt(size); break;
+    case MLUA_ARRAY_FLOAT: vt = number_vt(size); break;
+    case MLUA_ARRAY_STRING: if (size > 0) vt = &vt_string; break;
+    }
+    if (vt == NULL || len < 0 || (lua_Unsigned)len > SIZE_MAX / size) {
+        return NULL;
+    }
+    return new_array(ls, vt, size, len, len)->data;
+}
+
 static int array_size(lua_State* ls) {
     Array const* arr = check_array(ls, 1);
     return lua_pushinteger(ls, arr->size), 1;
@@ -493,6 +538,99 @@ static int array_fill(lua_State* ls) {
     return lua_settop(ls, 1), 1;
 }
 
+static Array* check_int64_array(lua_State* ls, int arg) {
+    Array* arr = check_array(ls, arg);
+    luaL_argexpected(ls, arr->vt == &vt_uint64, arg, "64-bit integer Array");
+    return arr;
+}
+
+// Check the optional offset and length arguments at arg and arg + 1, and return
+// a pointer to the first element of the range.
+static uint64_t* check_int64_range(lua_State* ls, int arg, Array const* arr,
+                                   lua_Integer* len) {
+    lua_Integer off = opt_offset(ls, arg, arr, 0);
+    luaL_argcheck(ls, 0 <= off && off <= arr->len, arg, "out of bounds");
+    lua_Integer l = luaL_optinteger(ls, arg + 1, arr->len - off);
+    if (l <= 0) l = 0;
+    luaL_argcheck(ls, off + l <= arr->len, arg + 1, "out of bounds");
+    *len = l;
+    return (uint64_t*)arr->data + off;
+}
+
+#define INT64_ARITH_OP(n, op) \
+static int array_ ## n(lua_State* ls) { \
+    Array const* arr = check_int64_array(ls, 1); \
+    lua_Integer len; \
+    uint64_t* p = check_int64_range(ls, 3, arr, &len); \
+    Array const* src = luaL_testudata(ls, 2, array_name); \
+    if (src != NULL) { \
+        luaL_argexpected(ls, src->vt == &vt_uint64, 2, \
+                         "integer, Int64 or 64-bit integer Array"); \
+        luaL_argcheck(ls, len <= src->len, 2, "too few elements"); \
+        uint64_t const* s = src->data; \
+        for (lua_Integer i = 0; i < len; ++i) p[i] op s[i]; \
+    } else { \
+        uint64_t v = mlua_check_int64(ls, 2); \
+        for (lua_Integer i = 0; i < len; ++i) p[i] op v; \
+    } \
+    return lua_settop(ls, 1), 1; \
+}
+
+INT64_ARITH_OP(add, +=)
+INT64_ARITH_OP(sub, -=)
+INT64_ARITH_OP(mul, *=)
+
+static int array_sum(lua_State* ls) {
+    Array const* arr = check_int64_array(ls, 1);
+    lua_Integer len;
+    uint64_t const* p = check_int64_range(ls, 2, arr, &len);
+    uint64_t sum = 0;
+    for (lua_Integer i = 0; i < len; ++i) sum += p[i];
+    return mlua_push_int64(ls, sum), 1;
+}
+
+static int array_tointeger(lua_State* ls) {
+    Array const* arr = check_int64_array(ls, 1);
+    lua_Integer off = check_offset(ls, 2, arr);
+    lua_Integer len = luaL_optinteger(ls, 3, 1);
+    if (len <= 0) return 0;
+    lua_settop(ls, 1);
+    if (luai_unlikely(!lua_checkstack(ls, len))) {
+        return luaL_error(ls, "too many results");
+    }
+    int64_t const* p = (int64_t const*)arr->data;
+    for (lua_Integer end = off + len; off < end; ++off) {
+        lua_Integer v;
+        if (luai_likely(0 <= off && off < arr->len
+                        && (int64_t)(v = (lua_Integer)p[off]) == p[off])) {
+            lua_pushinteger(ls, v);
+        } else {
+            luaL_pushfail(ls);
+        }
+    }
+    return len;
+}
+
+static int array_tonumber(lua_State* ls) {
+    Array const* arr = check_int64_array(ls, 1);
+    lua_Integer off = check_offset(ls, 2, arr);
+    lua_Integer len = luaL_optinteger(ls, 3, 1);
+    if (len <= 0) return 0;
+    lua_settop(ls, 1);
+    if (luai_unlikely(!lua_checkstack(ls, len))) {
+        return luaL_error(ls, "too many results");
+    }
+    int64_t const* p = (int64_t const*)arr->data;
+    for (lua_Integer end = off + len; off < end; ++off) {
+        if (luai_likely(0 <= off && off < arr->len)) {
+            lua_pushnumber(ls, (lua_Number)p[off]);
+        } else {
+            lua_pushnil(ls);
+        }
+    }
+    return len;
+}
+
 MLUA_SYMBOLS(array_syms) = {
     MLUA_SYM_F(size, array_),
     MLUA_SYM_F(len, array_),
@@ -502,6 +640,12 @@ MLUA_SYMBOLS(array_syms) = {
     MLUA_SYM_F(set, array_),
     MLUA_SYM_F(append, array_),
     MLUA_SYM_F(fill, array_),
+    MLUA_SYM_F(add, array_),
+    MLUA_SYM_F(sub, array_),
+    MLUA_SYM_F(mul, array_),
+    MLUA_SYM_F(sum, array_),
+    MLUA_SYM_F(tointeger, array_),
+    MLUA_SYM_F(tonumber, array_),
     // TODO: MLUA_SYM_F(move, array_),
 };
 
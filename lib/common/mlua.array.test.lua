@@ -348,3 +348,107 @@ function test_fill(t)
         else exp:raises("out of bounds") end
     end
 end
+
+local function arr64(...)
+    return array('i8', select('#', ...)):set(1, ...)
+end
+
+function test_int64_arith(t)
+    for _, test in ipairs{
+        {'add', {arr64(1, 2, 3), 5}, arr64(6, 7, 8)},
+        {'add', {arr64(1, 2, 3), 5, 2}, arr64(1, 7, 8)},
+        {'add', {arr64(1, 2, 3), 5, 2, 1}, arr64(1, 7, 3)},
+        {'add', {arr64(1, 2, 3), 5, -1}, arr64(1, 2, 8)},
+        {'add', {arr64(1, 2, 3), 5, 4}, arr64(1, 2, 3)},
+        {'add', {arr64(1, 2, 3), 5, 1, 0}, arr64(1, 2, 3)},
+        {'add', {arr64(1, 2, 3), arr64(10, 20, 30)}, arr64(11, 22, 33)},
+        {'add', {arr64(1, 2, 3), arr64(10, 20), 2}, arr64(1, 12, 23)},
+        {'add', {arr64(1, int64.max), 1}, arr64(2, int64.min)},
+        {'sub', {arr64(1, 2, 3), one64 << 40},
+         arr64(1 - (one64 << 40), 2 - (one64 << 40), 3 - (one64 << 40))},
+        {'sub', {arr64(10, 20, 30), arr64(1, 2, 3)}, arr64(9, 18, 27)},
+        {'mul', {arr64(1, -2, 3), int64(1000000007)},
+         arr64(int64(1000000007), int64(-2000000014), int64(3000000021))},
+        {'mul', {arr64(1, 2, 3), arr64(4, 5, 6), 1, 2}, arr64(4, 10, 3)},
+        {'add', {arr64(1, 2, 3), 5, 0}, "out of bounds"},
+        {'add', {arr64(1, 2, 3), 5, 5}, "out of bounds"},
+        {'add', {arr64(1, 2, 3), 5, 2, 3}, "out of bounds"},
+        {'add', {arr64(1, 2, 3), arr64(1, 2)}, "too few elements"},
+        {'add', {arr64(1, 2, 3), array('i4', 3)}, "integer Array expected"},
+        {'add', {array('i4', 3), 1}, "integer Array expected"},
+        {'add', {arr64(1, 2, 3), 1.5}, "integer"},
+    } do
+        local name, args, want = table.unpack(test)
+        local e = t.expr(args[1])
+        local exp = t:expect(e[name](e, table.unpack(args, 2)))
+        if type(want) == 'string' then exp:raises(want) else exp:eq(want) end
+    end
+    local a = arr64(1, 2, 3)
+    t:expect(t.expr(a):add(a)):eq(arr64(2, 4, 6))
+end
+
+function test_int64_sum(t)
+    local a = arr64(1, -2, one64 << 40, int64.max, 5)
+    for _, test in ipairs{
+        {{}, int64.min + (one64 << 40) + 3},
+        {{2}, int64.min + (one64 << 40) + 2},
+        {{1, 3}, (one64 << 40) - 1},
+        {{-2, 1}, int64.max},
+        {{1, 0}, int64(0)},
+        {{6}, int64(0)},
+        {{0}, "out of bounds"},
+        {{1, 6}, "out of bounds"},
+    } do
+        local args, want = table.unpack(test)
+        local exp = t:expect(t.expr(a):sum(table.unpack(args)))
+        if type(want) == 'string' then exp:raises(want)
+        else exp:eq(want, equal) end
+    end
+    t:expect(t.expr(array('i8', 0)):sum()):eq(int64(0), equal)
+    t:expect(t.expr(array('I8', 0)):sum()):eq(int64(0), equal)
+end
+
+function test_int64_convert(t)
+    local big = one64 << 40
+    local a = arr64(1, -2, big, int64.min)
+    local big_int = math.tointeger(int64.tointeger(big))
+    t:expect(t.mexpr(a):tointeger(1)):eq{1}
+    t:expect(t.mexpr(a):tointeger(1, 2)):eq{1, -2}
+    t:expect(t.mexpr(a):tointeger(0, 6)):eq(list.pack(
+        nil, 1, -2, big_int, int64.tointeger(int64.min), nil))
+    t:expect(t.mexpr(a):tointeger(1, 0)):eq{n = 0}
+    t:expect(t.mexpr(a):tonumber(1, 4)):eq{
+        1.0, -2.0, int64.tonumber(big), int64.tonumber(int64.min)}
+    t:expect(t.mexpr(a):tonumber(-1, 2)):eq(
+        list.pack(int64.tonumber(int64.min), nil))
+    t:expect(math.type(a:tonumber(1))):label("type"):eq('float')
+    t:expect(t.expr(array('i4', 1)):tonumber(1))
+        :raises("integer Array expected")
+end
+
+local bench_len = 1000
+
+function bench_int64_add_lua(b)
+    local a, one = array('i8', bench_len), int64(1)
+    for i = 1, b.n do
+        for j = 1, bench_len do a[j] = a[j] + one end
+    end
+end
+
+function bench_int64_add_C(b)
+    local a, one = array('i8', bench_len), int64(1)
+    for i = 1, b.n do a:add(one) end
+end
+
+function bench_int64_sum_lua(b)
+    local a = array('i8', bench_len)
+    for i = 1, b.n do
+        local sum = int64(0)
+        for j = 1, bench_len do sum = sum + a[j] end
+    end
+end
+
+function bench_int64_sum_C(b)
+    local a = array('i8', bench_len)
+    for i = 1, b.n do a:sum() end
+end
@@ -6,6 +6,7 @@
 #include "mlua/errors.h"
 #include "mlua/int64.h"
 #include "mlua/module.h"
+#include "mlua/thread.h"
 #include "mlua/util.h"
 
 static char const Dev_name[] = "mlua.block.Dev";
@@ -23,10 +24,67 @@ MLuaBlockDev* mlua_block_check(lua_State* ls, int arg) {
     return *((MLuaBlockDev**)ptr);
 }
 
+#if LIB_MLUA_MOD_MLUA_THREAD
+
+static int async_loop(lua_State* ls, bool timeout) {
+    MLuaBlockDev* dev = mlua_block_check(ls, 1);
+    int err;
+    void const* data;
+    if (!dev->async->poll(dev, &err, &data)) return -1;
+    if (err < 0) return mlua_err_push(ls, err);
+    if (lua_tointeger(ls, 2) == MLUA_BLOCK_READ) {
+        return lua_pushlstring(ls, data, lua_tointeger(ls, 3)), 1;
+    }
+    return lua_pushboolean(ls, true), 1;
+}
+
+// Start an operation with the arguments at indexes 2 and 3, and wait for it to
+// complete. If another thread has an operation pending on the device, yield
+// and retry until the device becomes available.
+static int async_start(lua_State* ls, int status, lua_KContext ctx) {
+    MLuaBlockDev* dev = mlua_block_check(ls, 1);
+    MLuaBlockOp op = (MLuaBlockOp)ctx;
+    uint64_t off = 0;
+    void const* src = NULL;
+    size_t size = 0;
+    if (op != MLUA_BLOCK_SYNC) off = mlua_check_int64(ls, 2);
+    if (op == MLUA_BLOCK_WRITE) {
+        src = lua_tolstring(ls, 3, &size);
+    } else if (op != MLUA_BLOCK_SYNC) {
+        size = lua_tointeger(ls, 3);
+    }
+    int err = dev->async->start(dev, op, off, src, size);
+    if (err == MLUA_EBUSY) return mlua_thread_yield(ls, 0, &async_start, ctx);
+    if (err < 0) return mlua_err_push(ls, err);
+    lua_settop(ls, 1);
+    lua_pushinteger(ls, op);
+    lua_pushinteger(ls, size);
+    return mlua_event_wait(ls, dev->async->event(dev), 0, &async_loop, 0);
+}
+
+#endif  // LIB_MLUA_MOD_MLUA_THREAD
+
+// Perform an operation asynchronously if the device supports it and
+// non-blocking event handling is selected, suspending the calling thread until
+// the operation completes. Returns -1 if the operation must be performed
+// synchronously.
+static int async_op(lua_State* ls, MLuaBlockDev* dev, MLuaBlockOp op) {
+#if LIB_MLUA_MOD_MLUA_THREAD
+    if (dev->async == NULL) return -1;
+    if (!mlua_event_can_wait(ls, dev->async->event(dev), 0)) return -1;
+    lua_settop(ls, 3);
+    return async_start(ls, LUA_OK, (lua_KContext)op);
+#else
+    return -1;
+#endif
+}
+
 static int Dev_read(lua_State* ls) {
     MLuaBlockDev* dev = mlua_block_check(ls, 1);
     uint64_t off = mlua_check_int64(ls, 2);
     size_t size = luaL_checkinteger(ls, 3);
+    int res = async_op(ls, dev, MLUA_BLOCK_READ);
+    if (res >= 0) return res;
     luaL_Buffer buf;
     void* dst = luaL_buffinitsize(ls, &buf, size);
     int err = dev->read(dev, off, dst, size);
@@ -39,6 +97,8 @@ static int Dev_write(lua_State* ls) {
     uint64_t off = mlua_check_int64(ls, 2);
     size_t len;
     void const* src = luaL_checklstring(ls, 3, &len);
+    int res = async_op(ls, dev, MLUA_BLOCK_WRITE);
+    if (res >= 0) return res;
     int err = dev->write(dev, off, src, len);
     if (err < 0) return mlua_err_push(ls, err);
     return lua_pushboolean(ls, true), 1;
@@ -48,6 +108,8 @@ static int Dev_erase(lua_State* ls) {
     MLuaBlockDev* dev = mlua_block_check(ls, 1);
     uint64_t off = mlua_check_int64(ls, 2);
     size_t size = luaL_checkinteger(ls, 3);
+    int res = async_op(ls, dev, MLUA_BLOCK_ERASE);
+    if (res >= 0) return res;
     int err = dev->erase(dev, off, size);
     if (err < 0) return mlua_err_push(ls, err);
     return lua_pushboolean(ls, true), 1;
@@ -55,6 +117,8 @@ static int Dev_erase(lua_State* ls) {
 
 static int Dev_sync(lua_State* ls) {
     MLuaBlockDev* dev = mlua_block_check(ls, 1);
+    int res = async_op(ls, dev, MLUA_BLOCK_SYNC);
+    if (res >= 0) return res;
     int err = dev->sync(dev);
     if (err < 0) return mlua_err_push(ls, err);
     return lua_pushboolean(ls, true), 1;
@@ -0,0 +1,320 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/block.h"
+#include "mlua/errors.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The default number of cache lines.
+#ifndef MLUA_BLOCK_CACHE_LINES
+#define MLUA_BLOCK_CACHE_LINES 16
+#endif
+
+// A cache line. The dirty range [dirty_lo, dirty_hi) is relative to the start
+// of the line, and is empty if dirty_lo == dirty_hi.
+typedef struct Line {
+    uint64_t off;
+    uint32_t used;
+    uint32_t dirty_lo;
+    uint32_t dirty_hi;
+    bool valid;
+} Line;
+
+// A write-back cache device. The userdata holds the line headers, followed by
+// the line data.
+typedef struct Cache {
+    MLuaBlockDev dev;
+    MLuaBlockDev* backend;
+    uint32_t line_size;
+    uint32_t count;
+    uint32_t tick;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;
+    uint8_t* data;
+    Line lines[];
+} Cache;
+
+static inline uint8_t* line_data(Cache* c, Line* l) {
+    return c->data + (size_t)(l - c->lines) * c->line_size;
+}
+
+// Write back the dirty range of a line.
+static int write_back(Cache* c, Line* l) {
+    if (l->dirty_lo == l->dirty_hi) return MLUA_EOK;
+    ++c->writebacks;
+    int err = c->backend->write(c->backend, l->off + l->dirty_lo,
+                                line_data(c, l) + l->dirty_lo,
+                                l->dirty_hi - l->dirty_lo);
+    if (err < 0) return err;
+    l->dirty_lo = l->dirty_hi = 0;
+    return MLUA_EOK;
+}
+
+// Return the line holding the given line-aligned offset, or NULL if it isn't
+// cached. Marks the line as most recently used.
+static Line* find_line(Cache* c, uint64_t off) {
+    for (uint32_t i = 0; i < c->count; ++i) {
+        Line* l = &c->lines[i];
+        if (l->valid && l->off == off) {
+            l->used = ++c->tick;
+            ++c->hits;
+            return l;
+        }
+    }
+    ++c->misses;
+    return NULL;
+}
+
+// Allocate a line for the given line-aligned offset, evicting the least
+// recently used line if necessary. If "fill" is true, the line is read from
+// the backend.
+static int alloc_line(Cache* c, uint64_t off, bool fill, Line** res) {
+    Line* l = &c->lines[0];
+    for (uint32_t i = 0; i < c->count; ++i) {
+        Line* li = &c->lines[i];
+        if (!li->valid) {
+            l = li;
+            break;
+        }
+        if (li->used < l->used) l = li;
+    }
+    if (l->valid) {
+        int err = write_back(c, l);
+        if (err < 0) return err;
+        l->valid = false;
+    }
+    if (fill) {
+        int err = c->backend->read(c->backend, off, line_data(c, l),
+                                   c->line_size);
+        if (err < 0) return err;
+    }
+    l->off = off;
+    l->used = ++c->tick;
+    l->dirty_lo = l->dirty_hi = 0;
+    l->valid = true;
+    *res = l;
+    return MLUA_EOK;
+}
+
+static int cache_dev_read(MLuaBlockDev* dev, uint64_t off, void* dst,
+                          size_t size) {
+    Cache* c = (Cache*)dev;
+    if (off + size > c->dev.size) return MLUA_EINVAL;
+    uint8_t* d = dst;
+    while (size > 0) {
+        uint64_t loff = off - off % c->line_size;
+        uint32_t pos = off - loff;
+        size_t len = c->line_size - pos;
+        if (len > size) len = size;
+        Line* l = find_line(c, loff);
+        if (l == NULL) {
+            int err = alloc_line(c, loff, true, &l);
+            if (err < 0) return err;
+        }
+        memcpy(d, line_data(c, l) + pos, len);
+        d += len;
+        off += len;
+        size -= len;
+    }
+    return MLUA_EOK;
+}
+
+static int cache_dev_write(MLuaBlockDev* dev, uint64_t off, void const* src,
+                           size_t size) {
+    Cache* c = (Cache*)dev;
+    if (off + size > c->dev.size) return MLUA_EINVAL;
+    uint8_t const* s = src;
+    while (size > 0) {
+        uint64_t loff = off - off % c->line_size;
+        uint32_t pos = off - loff;
+        size_t len = c->line_size - pos;
+        if (len > size) len = size;
+        Line* l = find_line(c, loff);
+        if (l == NULL) {
+            int err = alloc_line(c, loff, len < c->line_size, &l);
+            if (err < 0) return err;
+        }
+        memcpy(line_data(c, l) + pos, s, len);
+
+        // Extend the dirty range to cover the write. The gap between the
+        // previous range and the write holds the backend content, so writing
+        // it back again is harmless.
+        if (l->dirty_lo == l->dirty_hi) {
+            l->dirty_lo = pos;
+            l->dirty_hi = pos + len;
+        } else {
+            if (pos < l->dirty_lo) l->dirty_lo = pos;
+            if (pos + len > l->dirty_hi) l->dirty_hi = pos + len;
+        }
+        s += len;
+        off += len;
+        size -= len;
+    }
+    return MLUA_EOK;
+}
+
+static int cache_dev_erase(MLuaBlockDev* dev, uint64_t off, size_t size) {
+    Cache* c = (Cache*)dev;
+    if (off + size > c->dev.size) return MLUA_EINVAL;
+
+    // Drop the cached lines in the erased range, including dirty ones.
+    for (uint32_t i = 0; i < c->count; ++i) {
+        Line* l = &c->lines[i];
+        if (l->valid && l->off >= off && l->off < off + size) {
+            l->valid = false;
+        }
+    }
+    return c->backend->erase(c->backend, off, size);
+}
+
+// Return the dirty line holding the given line-aligned offset, or NULL if
+// there is none.
+static Line* find_dirty(Cache* c, uint64_t off) {
+    for (uint32_t i = 0; i < c->count; ++i) {
+        Line* l = &c->lines[i];
+        if (l->valid && l->off == off && l->dirty_lo != l->dirty_hi) return l;
+    }
+    return NULL;
+}
+
+// Write back the run of dirty lines from "first" to "last", whose dirty ranges
+// are adjacent on the backend, with a single write. The data is gathered in a
+// temporary buffer. Falls back to writing back the first line alone if the
+// buffer cannot be allocated.
+static int write_run(Cache* c, Line* first, Line* last) {
+    if (first == last) return write_back(c, first);
+    uint64_t start = first->off + first->dirty_lo;
+    size_t size = last->off + last->dirty_hi - start;
+    uint8_t* buf = malloc(size);
+    if (buf == NULL) return write_back(c, first);
+    for (uint64_t off = first->off; off <= last->off; off += c->line_size) {
+        Line* l = find_dirty(c, off);
+        memcpy(buf + (off + l->dirty_lo - start), line_data(c, l) + l->dirty_lo,
+               l->dirty_hi - l->dirty_lo);
+    }
+    ++c->writebacks;
+    int err = c->backend->write(c->backend, start, buf, size);
+    free(buf);
+    if (err < 0) return err;
+    for (uint64_t off = first->off; off <= last->off; off += c->line_size) {
+        Line* l = find_dirty(c, off);
+        l->dirty_lo = l->dirty_hi = 0;
+    }
+    return MLUA_EOK;
+}
+
+static int cache_dev_sync(MLuaBlockDev* dev) {
+    Cache* c = (Cache*)dev;
+
+    // Write back dirty lines in address order, coalescing runs of lines whose
+    // dirty ranges are adjacent into a single write.
+    for (;;) {
+        Line* first = NULL;
+        for (uint32_t i = 0; i < c->count; ++i) {
+            Line* l = &c->lines[i];
+            if (l->valid && l->dirty_lo != l->dirty_hi
+                    && (first == NULL || l->off < first->off)) {
+                first = l;
+            }
+        }
+        if (first == NULL) break;
+        Line* last = first;
+        while (last->dirty_hi == c->line_size) {
+            Line* l = find_dirty(c, last->off + c->line_size);
+            if (l == NULL || l->dirty_lo != 0) break;
+            last = l;
+        }
+        int err = write_run(c, first, last);
+        if (err < 0) return err;
+    }
+    return c->backend->sync(c->backend);
+}
+
+static Cache* check_Cache(lua_State* ls, int arg) {
+    MLuaBlockDev* dev = mlua_block_check(ls, arg);
+    luaL_argexpected(ls, dev->read == &cache_dev_read, arg, "cache device");
+    return (Cache*)dev;
+}
+
+static int mod_new(lua_State* ls) {
+    MLuaBlockDev* backend = mlua_block_check(ls, 1);
+    lua_Integer count = luaL_optinteger(ls, 2, MLUA_BLOCK_CACHE_LINES);
+    lua_Integer line_size = luaL_optinteger(ls, 3, backend->write_size);
+    luaL_argcheck(ls, line_size > 0 && (lua_Unsigned)line_size <= UINT32_MAX
+                      && line_size % backend->read_size == 0
+                      && line_size % backend->write_size == 0
+                      && backend->erase_size % line_size == 0,
+                  3, "invalid line size");
+    luaL_argcheck(ls, count > 0 && (lua_Unsigned)count <= UINT32_MAX
+                      && (lua_Unsigned)count <= (SIZE_MAX - sizeof(Cache))
+                         / (sizeof(Line) + (size_t)line_size),
+                  2, "invalid line count");
+
+    Cache* c = mlua_block_push(
+        ls, sizeof(Cache) + count * (sizeof(Line) + line_size), 1);
+    lua_pushvalue(ls, 1);
+    lua_setiuservalue(ls, -2, 1);  // Keep backend alive
+    memset(c, 0, sizeof(Cache) + count * sizeof(Line));
+    c->dev.read = &cache_dev_read;
+    c->dev.write = &cache_dev_write;
+    c->dev.erase = &cache_dev_erase;
+    c->dev.sync = &cache_dev_sync;
+    c->dev.size = backend->size;
+    c->dev.read_size = backend->read_size;
+    c->dev.write_size = backend->write_size;
+    c->dev.erase_size = backend->erase_size;
+    c->dev.async = NULL;
+    c->backend = backend;
+    c->line_size = line_size;
+    c->count = count;
+    c->data = (uint8_t*)&c->lines[count];
+    return 1;
+}
+
+static int mod_stats(lua_State* ls) {
+    Cache* c = check_Cache(ls, 1);
+    bool reset = mlua_opt_cbool(ls, 2, false);
+    lua_createtable(ls, 0, 3);
+    mlua_push_minint(ls, c->hits);
+    lua_setfield(ls, -2, "hits");
+    mlua_push_minint(ls, c->misses);
+    lua_setfield(ls, -2, "misses");
+    mlua_push_minint(ls, c->writebacks);
+    lua_setfield(ls, -2, "writebacks");
+    if (reset) c->hits = c->misses = c->writebacks = 0;
+    return 1;
+}
+
+static int mod_dirty(lua_State* ls) {
+    Cache* c = check_Cache(ls, 1);
+    lua_Integer cnt = 0;
+    for (uint32_t i = 0; i < c->count; ++i) {
+        Line* l = &c->lines[i];
+        if (l->valid && l->dirty_lo != l->dirty_hi) ++cnt;
+    }
+    return lua_pushinteger(ls, cnt), 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new, mod_),
+    MLUA_SYM_F(stats, mod_),
+    MLUA_SYM_F(dirty, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.block.cache) {
+    mlua_require(ls, "mlua.block", false);
+    mlua_require(ls, "mlua.int64", false);
+
+    mlua_new_module(ls, 0, module_syms);
+    return 1;
+}
@@ -0,0 +1,143 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local cache = require 'mlua.block.cache'
+local block_mem = require 'mlua.block.mem'
+local block_stats = require 'mlua.block.stats'
+local fs = require 'mlua.fs'
+local lfs = require 'mlua.fs.lfs'
+local math = require 'math'
+local mem = require 'mlua.mem'
+local string = require 'string'
+
+-- Create an erased memory device, wrapped to count backend operations.
+local function mem_dev(size)
+    local dev = block_stats.new(block_mem.new(mem.alloc(size), 256, 1024))
+    assert(dev:erase(0, size))
+    block_stats.stats(dev, true)
+    return dev
+end
+
+function test_new(t)
+    local dev = mem_dev(4096)
+    local c = cache.new(dev)
+    t:expect(t.mexpr(c):size()):eq{4096, 1, 256, 1024}
+    t:expect(t.expr(cache).new(dev, 0)):raises("invalid line count")
+    if string.packsize('j') >= 8 then
+        t:expect(t.expr(cache).new(dev, math.maxinteger))
+            :raises("invalid line count")
+    end
+    t:expect(t.expr(cache).new(dev, 4, 128)):raises("invalid line size")
+    t:expect(t.expr(cache).new(dev, 4, 768)):raises("invalid line size")
+    t:expect(t.expr(cache).stats(dev)):raises("cache device expected")
+end
+
+function test_write_back(t)
+    local dev = mem_dev(8192)
+    local c = cache.new(dev, 4, 512)
+    t:expect(t.expr(c):write(0, ('a'):rep(256))):eq(true)
+    t:expect(t.expr(c):write(256, ('b'):rep(256))):eq(true)
+    t:expect(t.expr(c):write(1024, ('c'):rep(256))):eq(true)
+    t:expect(t.expr(cache).dirty(c)):eq(2)
+    t:expect(t.expr(c):read(250, 12)):eq('aaaaaabbbbbb')
+    t:expect(t.expr(dev):read(0, 4)):eq('\xff\xff\xff\xff')
+    t:expect(block_stats.stats(dev).write.count):label("writes"):eq(0)
+
+    t:expect(t.expr(c):sync()):eq(true)
+    t:expect(t.expr(cache).dirty(c)):eq(0)
+    t:expect(t.expr(dev):read(250, 12)):eq('aaaaaabbbbbb')
+    t:expect(t.expr(dev):read(1024, 4)):eq('cccc')
+    local st = block_stats.stats(dev)
+    t:expect(st.write.count):label("writes"):eq(2)  -- Coalesced within lines
+    t:expect(st.sync.count):label("syncs"):eq(1)
+    t:expect(t.expr(cache).stats(c)):eq{hits = 2, misses = 2, writebacks = 2}
+end
+
+function test_coalesce(t)
+    local dev = mem_dev(8192)
+    local c = cache.new(dev, 8, 256)
+    c:write(256, ('a'):rep(768))
+    c:write(1024, ('b'):rep(256))
+    c:write(1792, ('c'):rep(256))
+    c:write(2048, ('d'):rep(256))
+    t:expect(t.expr(cache).dirty(c)):eq(6)
+    t:expect(t.expr(c):sync()):eq(true)
+    t:expect(t.expr(dev):read(1020, 8)):eq('aaaabbbb')
+    t:expect(t.expr(dev):read(1276, 8)):eq('bbbb\xff\xff\xff\xff')
+    t:expect(t.expr(dev):read(2044, 8)):eq('ccccdddd')
+    local st = block_stats.stats(dev)
+    t:expect(st.write.count):label("writes"):eq(2)  -- One per contiguous run
+    t:expect(st.write.bytes):label("bytes"):eq(1536)
+end
+
+function test_eviction(t)
+    local dev = mem_dev(8192)
+    local c = cache.new(dev, 2, 256)
+    c:write(0, ('a'):rep(256))
+    c:write(256, ('b'):rep(256))
+    c:read(0, 1)  -- Make line 0 most recently used
+    c:write(512, ('c'):rep(256))  -- Evicts line 1
+    t:expect(t.expr(dev):read(256, 4)):eq('bbbb')
+    t:expect(t.expr(dev):read(0, 4)):eq('\xff\xff\xff\xff')
+    t:expect(t.expr(cache).stats(c).writebacks):eq(1)
+    t:expect(t.expr(c):read(256, 4)):eq('bbbb')  -- Evicts line 0
+    t:expect(t.expr(dev):read(0, 4)):eq('aaaa')
+end
+
+function test_erase(t)
+    local dev = mem_dev(8192)
+    local c = cache.new(dev, 4, 256)
+    c:write(1024, ('a'):rep(256))
+    c:write(2048, ('b'):rep(256))
+    t:expect(t.expr(c):erase(1024, 1024)):eq(true)
+    t:expect(t.expr(cache).dirty(c)):eq(1)
+    t:expect(t.expr(c):read(1024, 4)):eq('\xff\xff\xff\xff')
+    c:sync()
+    t:expect(t.expr(dev):read(1024, 4)):eq('\xff\xff\xff\xff')
+    t:expect(t.expr(dev):read(2048, 4)):eq('bbbb')
+end
+
+-- Run a metadata-heavy littlefs workload on a device.
+local function lfs_workload(dev)
+    local f = lfs.new(dev)
+    assert(f:format())
+    assert(f:mount())
+    for i = 1, 20 do
+        local path = ('/file%d'):format(i)
+        local fh<close> = assert(f:open(path, fs.O_WRONLY | fs.O_CREAT))
+        assert(fh:write(('data %d'):format(i)))
+        assert(fh:close())
+        assert(f:setattr(path, 1, 'attr'))
+        assert(f:rename(path, path .. '.txt'))
+    end
+    for i = 1, 20, 2 do assert(f:remove(('/file%d.txt'):format(i))) end
+    assert(f:unmount())
+end
+
+function test_lfs_workload(t)
+    local dev = mem_dev(64 << 10)
+    lfs_workload(dev)
+    local direct = block_stats.stats(dev)
+
+    dev = mem_dev(64 << 10)
+    local c = cache.new(dev, 8, 1024)
+    lfs_workload(c)
+    t:assert(c:sync())
+    local cached = block_stats.stats(dev)
+    local st = cache.stats(c)
+    t:printf("direct: reads: %d, writes: %d\n", direct.read.count,
+             direct.write.count)
+    t:printf("cached: reads: %d, writes: %d, hits: %d, misses: %d\n",
+             cached.read.count, cached.write.count, st.hits, st.misses)
+    t:expect(cached.read.count):label("cached reads"):lt(direct.read.count)
+    t:expect(cached.write.count):label("cached writes")
+        :lte(direct.write.count)
+    t:expect(cached.erase.count):label("cached erases")
+        :eq(direct.erase.count)
+
+    -- Check that the filesystem is consistent on the backend.
+    local f<close> = lfs.new(dev)
+    t:assert(f:mount())
+    t:expect(t.mexpr(f):stat('/file2.txt')):eq{'file2.txt', fs.TYPE_REG, 6}
+    t:expect(t.expr(f):stat('/file3.txt')):eq(nil)
+end
@@ -0,0 +1,231 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/block.h"
+#include "mlua/errors.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/platform.h"
+#include "mlua/util.h"
+
+// The number of buckets in latency histograms. Bucket 0 counts operations that
+// took less than 1 us, bucket i > 0 those that took [2^(i-1), 2^i) us, and the
+// last bucket also counts all slower operations.
+#ifndef MLUA_BLOCK_STATS_BUCKETS
+#define MLUA_BLOCK_STATS_BUCKETS 24
+#endif
+
+// The per-operation statistics.
+typedef struct OpStats {
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t time;
+    uint32_t errors;
+    uint32_t max;
+    uint32_t hist[MLUA_BLOCK_STATS_BUCKETS];
+} OpStats;
+
+// An instrumenting device. The userdata holds the operation statistics,
+// followed by the per-block read, write and erase counts.
+typedef struct Stats {
+    MLuaBlockDev dev;
+    MLuaBlockDev* backend;
+    uint32_t nblocks;
+    OpStats ops[MLUA_BLOCK_SYNC + 1];
+    uint32_t blocks[];
+} Stats;
+
+static char const* const op_names[] = {"read", "write", "erase", "sync", NULL};
+
+static inline uint32_t* block_counts(Stats* s, MLuaBlockOp op) {
+    return s->blocks + (size_t)op * s->nblocks;
+}
+
+// Record the completion of an operation that started at "start".
+static int record(Stats* s, MLuaBlockOp op, uint64_t start, uint64_t off,
+                  size_t size, int res) {
+    uint64_t dt = mlua_ticks64() - start;
+    OpStats* st = &s->ops[op];
+    ++st->count;
+    st->bytes += size;
+    st->time += dt;
+    if (res < 0) ++st->errors;
+    if (dt > st->max) st->max = dt > UINT32_MAX ? UINT32_MAX : dt;
+    uint32_t b = 0;
+    while (dt != 0 && b < MLUA_BLOCK_STATS_BUCKETS - 1) {
+        dt >>= 1;
+        ++b;
+    }
+    ++st->hist[b];
+    if (op == MLUA_BLOCK_SYNC || size == 0) return res;
+
+    // Count the operation once for each erase block it touches.
+    uint32_t* counts = block_counts(s, op);
+    uint32_t esize = s->dev.erase_size;
+    uint64_t end = (off + size - 1) / esize;
+    if (end >= s->nblocks) end = s->nblocks - 1;
+    for (uint64_t i = off / esize; i <= end; ++i) ++counts[i];
+    return res;
+}
+
+static int stats_dev_read(MLuaBlockDev* dev, uint64_t off, void* dst,
+                          size_t size) {
+    Stats* s = (Stats*)dev;
+    uint64_t start = mlua_ticks64();
+    int res = s->backend->read(s->backend, off, dst, size);
+    return record(s, MLUA_BLOCK_READ, start, off, size, res);
+}
+
+static int stats_dev_write(MLuaBlockDev* dev, uint64_t off, void const* src,
+                           size_t size) {
+    Stats* s = (Stats*)dev;
+    uint64_t start = mlua_ticks64();
+    int res = s->backend->write(s->backend, off, src, size);
+    return record(s, MLUA_BLOCK_WRITE, start, off, size, res);
+}
+
+static int stats_dev_erase(MLuaBlockDev* dev, uint64_t off, size_t size) {
+    Stats* s = (Stats*)dev;
+    uint64_t start = mlua_ticks64();
+    int res = s->backend->erase(s->backend, off, size);
+    return record(s, MLUA_BLOCK_ERASE, start, off, size, res);
+}
+
+static int stats_dev_sync(MLuaBlockDev* dev) {
+    Stats* s = (Stats*)dev;
+    uint64_t start = mlua_ticks64();
+    int res = s->backend->sync(s->backend);
+    return record(s, MLUA_BLOCK_SYNC, start, 0, 0, res);
+}
+
+static Stats* check_Stats(lua_State* ls, int arg) {
+    MLuaBlockDev* dev = mlua_block_check(ls, arg);
+    luaL_argexpected(ls, dev->read == &stats_dev_read, arg, "stats device");
+    return (Stats*)dev;
+}
+
+static void reset(Stats* s) {
+    memset(s->ops, 0, sizeof(s->ops));
+    memset(s->blocks, 0,
+           (size_t)(MLUA_BLOCK_ERASE + 1) * s->nblocks * sizeof(uint32_t));
+}
+
+static int mod_new(lua_State* ls) {
+    MLuaBlockDev* backend = mlua_block_check(ls, 1);
+    uint64_t nblocks = backend->size / backend->erase_size;
+    luaL_argcheck(ls, nblocks > 0 && nblocks <= UINT32_MAX, 1,
+                  "unsupported device size");
+
+    Stats* s = mlua_block_push(
+        ls, sizeof(Stats)
+            + (MLUA_BLOCK_ERASE + 1) * nblocks * sizeof(uint32_t), 1);
+    lua_pushvalue(ls, 1);
+    lua_setiuservalue(ls, -2, 1);  // Keep backend alive
+    s->dev.read = &stats_dev_read;
+    s->dev.write = &stats_dev_write;
+    s->dev.erase = &stats_dev_erase;
+    s->dev.sync = &stats_dev_sync;
+    s->dev.size = backend->size;
+    s->dev.read_size = backend->read_size;
+    s->dev.write_size = backend->write_size;
+    s->dev.erase_size = backend->erase_size;
+    s->dev.async = NULL;
+    s->backend = backend;
+    s->nblocks = nblocks;
+    reset(s);
+    return 1;
+}
+
+static int mod_stats(lua_State* ls) {
+    Stats* s = check_Stats(ls, 1);
+    bool rst = mlua_opt_cbool(ls, 2, false);
+    lua_createtable(ls, 0, MLUA_BLOCK_SYNC + 1);
+    for (int i = 0; i <= MLUA_BLOCK_SYNC; ++i) {
+        OpStats* st = &s->ops[i];
+        lua_createtable(ls, 0, 5);
+        mlua_push_minint(ls, st->count);
+        lua_setfield(ls, -2, "count");
+        mlua_push_minint(ls, st->bytes);
+        lua_setfield(ls, -2, "bytes");
+        lua_pushinteger(ls, st->errors);
+        lua_setfield(ls, -2, "errors");
+        mlua_push_minint(ls, st->time);
+        lua_setfield(ls, -2, "time");
+        lua_pushinteger(ls, st->max);
+        lua_setfield(ls, -2, "max");
+        lua_setfield(ls, -2, op_names[i]);
+    }
+    if (rst) reset(s);
+    return 1;
+}
+
+static int mod_latency(lua_State* ls) {
+    Stats* s = check_Stats(ls, 1);
+    OpStats* st = &s->ops[luaL_checkoption(ls, 2, NULL, op_names)];
+    lua_createtable(ls, MLUA_BLOCK_STATS_BUCKETS, 0);
+    for (int i = 0; i < MLUA_BLOCK_STATS_BUCKETS; ++i) {
+        lua_pushinteger(ls, st->hist[i]);
+        lua_rawseti(ls, -2, i + 1);
+    }
+    return 1;
+}
+
+static int mod_blocks(lua_State* ls) {
+    Stats* s = check_Stats(ls, 1);
+    int op = luaL_checkoption(ls, 2, NULL, op_names);
+    luaL_argcheck(ls, op != MLUA_BLOCK_SYNC, 2, "no per-block sync counts");
+    uint32_t* counts = block_counts(s, op);
+    lua_createtable(ls, s->nblocks, 0);
+    for (uint32_t i = 0; i < s->nblocks; ++i) {
+        lua_pushinteger(ls, counts[i]);
+        lua_rawseti(ls, -2, i + 1);
+    }
+    return 1;
+}
+
+static int mod_changed(lua_State* ls) {
+    Stats* s = check_Stats(ls, 1);
+    uint32_t* writes = block_counts(s, MLUA_BLOCK_WRITE);
+    uint32_t* erases = block_counts(s, MLUA_BLOCK_ERASE);
+    uint32_t esize = s->dev.erase_size;
+    lua_newtable(ls);
+    lua_Integer cnt = 0;
+    for (uint32_t i = 0; i < s->nblocks;) {
+        if (writes[i] == 0 && erases[i] == 0) {
+            ++i;
+            continue;
+        }
+        uint32_t start = i;
+        while (i < s->nblocks && (writes[i] != 0 || erases[i] != 0)) ++i;
+        lua_createtable(ls, 2, 0);
+        lua_pushinteger(ls, (lua_Integer)start * esize);
+        lua_rawseti(ls, -2, 1);
+        lua_pushinteger(ls, (lua_Integer)(i - start) * esize);
+        lua_rawseti(ls, -2, 2);
+        lua_rawseti(ls, -2, ++cnt);
+    }
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_V(buckets, integer, MLUA_BLOCK_STATS_BUCKETS),
+    MLUA_SYM_F(new, mod_),
+    MLUA_SYM_F(stats, mod_),
+    MLUA_SYM_F(latency, mod_),
+    MLUA_SYM_F(blocks, mod_),
+    MLUA_SYM_F(changed, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.block.stats) {
+    mlua_require(ls, "mlua.block", false);
+    mlua_require(ls, "mlua.int64", false);
+
+    mlua_new_module(ls, 0, module_syms);
+    return 1;
+}
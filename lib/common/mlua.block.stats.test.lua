@@ -0,0 +1,85 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local block_mem = require 'mlua.block.mem'
+local stats = require 'mlua.block.stats'
+local fs = require 'mlua.fs'
+local lfs = require 'mlua.fs.lfs'
+local mem = require 'mlua.mem'
+local math = require 'math'
+local table = require 'table'
+
+-- Return the sum of the values in a list.
+local function sum(list)
+    local res = 0
+    for _, v in ipairs(list) do res = res + v end
+    return res
+end
+
+function test_new(t)
+    local dev = block_mem.new(mem.alloc(8192), 256, 1024)
+    local s = stats.new(dev)
+    t:expect(t.mexpr(s):size()):eq{8192, 1, 256, 1024}
+    t:expect(t.expr(stats).stats(dev)):raises("stats device expected")
+    t:expect(t.expr(stats).blocks(s, 'sync')):raises("no per%-block sync")
+    t:expect(t.expr(stats).latency(s, 'foo')):raises("invalid option")
+end
+
+function test_counts(t)
+    local dev = block_mem.new(mem.alloc(8192), 256, 1024)
+    local s = stats.new(dev)
+    t:assert(s:erase(0, 2048))
+    t:assert(s:write(768, ('a'):rep(512)))
+    t:assert(s:read(0, 256))
+    t:assert(s:sync())
+    t:expect(s:write(8192, ('a'):rep(256))):label("write"):eq(nil)
+
+    local st = stats.stats(s)
+    t:expect(st.read):label("read")
+        :eq({count = 1, bytes = 256, errors = 0, time = st.read.time,
+             max = st.read.max})
+    t:expect(st.write.count):label("write.count"):eq(2)
+    t:expect(st.write.bytes):label("write.bytes"):eq(768)
+    t:expect(st.write.errors):label("write.errors"):eq(1)
+    t:expect(st.erase.bytes):label("erase.bytes"):eq(2048)
+    t:expect(st.sync.count):label("sync.count"):eq(1)
+    t:expect(t.expr(stats).blocks(s, 'erase')):eq{1, 1, 0, 0, 0, 0, 0, 0}
+    t:expect(t.expr(stats).blocks(s, 'write')):eq{1, 1, 0, 0, 0, 0, 0, 0}
+    t:expect(t.expr(stats).blocks(s, 'read')):eq{1, 0, 0, 0, 0, 0, 0, 0}
+    local hist = stats.latency(s, 'write')
+    t:expect(#hist):label("#hist"):eq(stats.buckets)
+    t:expect(sum(hist)):label("sum(hist)"):eq(2)
+
+    stats.stats(s, true)
+    t:expect(t.expr(stats).stats(s).write.count):eq(0)
+    t:expect(t.expr(sum)(stats.blocks(s, 'erase'))):eq(0)
+    t:expect(t.expr(sum)(stats.latency(s, 'write'))):eq(0)
+end
+
+function test_lfs_workload(t)
+    local dev = block_mem.new(mem.alloc(64 << 10), 256, 1024)
+    local s = stats.new(dev)
+    local f = lfs.new(s)
+    t:assert(f:format())
+    t:assert(f:mount())
+    t:cleanup(function() f:unmount() end)
+    stats.stats(s, true)
+    for i = 1, 20 do
+        local fh<close> = assert(f:open('/data', fs.O_WRONLY | fs.O_CREAT
+                                                 | fs.O_APPEND))
+        assert(fh:write(('x'):rep(100)))
+    end
+
+    -- The per-block counts are consistent with the totals.
+    local st = stats.stats(s)
+    t:expect(st.write.count):label("write.count"):gt(0)
+    t:expect(st.write.bytes):label("write.bytes"):gte(st.write.count)
+    local erases = stats.blocks(s, 'erase')
+    t:expect(#erases):label("#erases"):eq(64)
+    t:expect(sum(erases)):label("sum(erases)"):eq(st.erase.count)
+    t:expect(sum(stats.latency(s, 'read'))):label("sum(read latency)")
+        :eq(st.read.count)
+    t:printf("writes: %d (%d bytes), erases: %d, max erases/block: %d\n",
+             st.write.count, st.write.bytes, st.erase.count,
+             math.max(table.unpack(erases)))
+end
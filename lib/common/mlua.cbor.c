@@ -0,0 +1,1023 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/array.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The maximum nesting depth of arrays, maps and tags, both when encoding and
+// when decoding.
+#ifndef MLUA_CBOR_MAX_DEPTH
+#define MLUA_CBOR_MAX_DEPTH 64
+#endif
+
+static char const list_name[] = "mlua.List";
+
+// Major types.
+enum {
+    MT_UINT = 0,
+    MT_NINT = 1,
+    MT_BYTES = 2,
+    MT_TEXT = 3,
+    MT_ARRAY = 4,
+    MT_MAP = 5,
+    MT_TAG = 6,
+    MT_SIMPLE = 7,
+};
+
+// Additional information values.
+enum {
+    AI_FALSE = 20,
+    AI_TRUE = 21,
+    AI_NULL = 22,
+    AI_UNDEFINED = 23,
+    AI_FLOAT16 = 25,
+    AI_FLOAT32 = 26,
+    AI_FLOAT64 = 27,
+    AI_INDEFINITE = 31,
+};
+
+#define BREAK 0xff
+
+// The range of typed array tags (RFC 8746). The tag bits are 0b010fsell,
+// where f is set for floats, s for signed integers, e for little-endian, and
+// ll encodes the element size.
+#define TAG_TYPED_FIRST 64
+#define TAG_TYPED_LAST 87
+#define TAG_FLOAT (1u << 4)
+#define TAG_SIGNED (1u << 3)
+#define TAG_LITTLE (1u << 2)
+
+static inline bool is_little_endian(void) {
+    union { int dummy; char little; } const endian = {1};
+    return endian.little;
+}
+
+// An encoder. The output is stored in a userdata at a fixed stack index, which
+// is replaced when the output grows.
+typedef struct Encoder {
+    lua_State* ls;
+    int idx;
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+    int depth;
+} Encoder;
+
+static uint8_t* enc_reserve(Encoder* enc, size_t size) {
+    if (size > enc->cap - enc->len) {
+        size_t cap = enc->cap;
+        while (cap - enc->len < size) {
+            if (cap > SIZE_MAX / 2) luaL_error(enc->ls, "output too large");
+            cap *= 2;
+        }
+        uint8_t* data = lua_newuserdatauv(enc->ls, cap, 0);
+        memcpy(data, enc->data, enc->len);
+        lua_replace(enc->ls, enc->idx);
+        enc->data = data;
+        enc->cap = cap;
+    }
+    return enc->data + enc->len;
+}
+
+static inline void enc_add(Encoder* enc, void const* s, size_t len) {
+    memcpy(enc_reserve(enc, len), s, len);
+    enc->len += len;
+}
+
+static inline void enc_byte(Encoder* enc, uint8_t b) {
+    *enc_reserve(enc, 1) = b;
+    ++enc->len;
+}
+
+static inline void put_be(uint8_t* p, uint64_t v, int size) {
+    for (int i = size - 1; i >= 0; --i, v >>= 8) p[i] = (uint8_t)v;
+}
+
+// Encode an initial byte and its argument, using the shortest encoding.
+static void enc_head(Encoder* enc, int major, uint64_t arg) {
+    uint8_t* p = enc_reserve(enc, 9);
+    int size;
+    if (arg < 24) {
+        p[0] = (major << 5) | arg;
+        ++enc->len;
+        return;
+    } else if (arg <= UINT8_MAX) {
+        p[0] = (major << 5) | 24;
+        size = 1;
+    } else if (arg <= UINT16_MAX) {
+        p[0] = (major << 5) | 25;
+        size = 2;
+    } else if (arg <= UINT32_MAX) {
+        p[0] = (major << 5) | 26;
+        size = 4;
+    } else {
+        p[0] = (major << 5) | 27;
+        size = 8;
+    }
+    put_be(p + 1, arg, size);
+    enc->len += 1 + size;
+}
+
+static void enc_int(Encoder* enc, int64_t v) {
+    if (v >= 0) {
+        enc_head(enc, MT_UINT, v);
+    } else {
+        enc_head(enc, MT_NINT, ~(uint64_t)v);
+    }
+}
+
+// Encode a float with single precision if this doesn't lose information, and
+// with double precision otherwise.
+// Return true iff the given number can be represented exactly as a float.
+// Non-finite values are always representable, and finite values outside of the
+// float range must be excluded before narrowing.
+static bool is_float32(lua_Number n) {
+    if (!isfinite(n)) return true;
+    if (!(-(lua_Number)FLT_MAX <= n && n <= (lua_Number)FLT_MAX)) return false;
+    return (lua_Number)(float)n == n;
+}
+
+static void enc_float(Encoder* enc, lua_Number n) {
+    uint8_t* p = enc_reserve(enc, 9);
+    if (is_float32(n)) {
+        float f = (float)n;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        p[0] = (MT_SIMPLE << 5) | AI_FLOAT32;
+        put_be(p + 1, bits, 4);
+        enc->len += 5;
+        return;
+    }
+    double d = (double)n;
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    p[0] = (MT_SIMPLE << 5) | AI_FLOAT64;
+    put_be(p + 1, bits, 8);
+    enc->len += 9;
+}
+
+// Return true iff the given string is valid UTF-8.
+static bool is_utf8(uint8_t const* s, size_t len) {
+    uint8_t const* end = s + len;
+    while (s < end) {
+        uint8_t c = *s;
+        if (c < 0x80) {
+            ++s;
+            continue;
+        }
+        int n;
+        uint32_t cp, min;
+        if ((c & 0xe0) == 0xc0) {
+            n = 1, cp = c & 0x1f, min = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            n = 2, cp = c & 0x0f, min = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            n = 3, cp = c & 0x07, min = 0x10000;
+        } else {
+            return false;
+        }
+        if (end - s <= n) return false;
+        for (int i = 1; i <= n; ++i) {
+            if ((s[i] & 0xc0) != 0x80) return false;
+            cp = (cp << 6) | (s[i] & 0x3f);
+        }
+        if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp < 0xe000)) {
+            return false;
+        }
+        s += n + 1;
+    }
+    return true;
+}
+
+// Encode a string as a text string if it is valid UTF-8, and as a byte string
+// otherwise.
+static void enc_string(Encoder* enc, char const* s, size_t len) {
+    enc_head(enc, is_utf8((uint8_t const*)s, len) ? MT_TEXT : MT_BYTES, len);
+    enc_add(enc, s, len);
+}
+
+static bool has_metatable(lua_State* ls, int idx, char const* name) {
+    if (!lua_getmetatable(ls, idx)) return false;
+    luaL_getmetatable(ls, name);
+    bool res = lua_rawequal(ls, -1, -2);
+    lua_pop(ls, 2);
+    return res;
+}
+
+// Determine if the table at the given index is encoded as an array, and if so,
+// return its length. Also return the number of entries of the table.
+static bool is_array(lua_State* ls, int idx, lua_Integer* len,
+                     lua_Integer* count) {
+    if (has_metatable(ls, idx, list_name)) {
+        if (lua_getfield(ls, idx, "n") == LUA_TNIL) {
+            *len = lua_rawlen(ls, idx);
+        } else {
+            int isnum;
+            *len = lua_tointegerx(ls, -1, &isnum);
+            if (!isnum || *len < 0) luaL_error(ls, "invalid list length");
+        }
+        lua_pop(ls, 1);
+        return true;
+    }
+
+    // Plain tables are arrays if they are non-empty and their keys are
+    // exactly 1..n.
+    bool res = true;
+    lua_Integer cnt = 0;
+    lua_pushnil(ls);
+    while (lua_next(ls, idx) != 0) {
+        lua_pop(ls, 1);
+        if (!lua_isinteger(ls, -1) || lua_tointeger(ls, -1) <= 0) {
+            res = false;
+        }
+        ++cnt;
+    }
+    *count = cnt;
+    if (!res || cnt == 0 || (lua_Integer)lua_rawlen(ls, idx) != cnt) {
+        return false;
+    }
+    *len = cnt;
+    return true;
+}
+
+static void enc_value(Encoder* enc, int idx);
+
+static void enter(Encoder* enc) {
+    if (enc->depth >= MLUA_CBOR_MAX_DEPTH) {
+        luaL_error(enc->ls, "nesting too deep");
+    }
+    luaL_checkstack(enc->ls, 8, "nesting too deep");
+    ++enc->depth;
+}
+
+static void enc_table(Encoder* enc, int idx) {
+    lua_State* ls = enc->ls;
+    enter(enc);
+    lua_Integer len, count;
+    if (is_array(ls, idx, &len, &count)) {
+        enc_head(enc, MT_ARRAY, len);
+        for (lua_Integer i = 1; i <= len; ++i) {
+            lua_geti(ls, idx, i);
+            enc_value(enc, lua_gettop(ls));
+            lua_pop(ls, 1);
+        }
+    } else {
+        enc_head(enc, MT_MAP, count);
+        lua_pushnil(ls);
+        while (lua_next(ls, idx) != 0) {
+            int top = lua_gettop(ls);
+            enc_value(enc, top - 1);
+            enc_value(enc, top);
+            lua_pop(ls, 1);
+        }
+    }
+    --enc->depth;
+}
+
+// Return the typed array tag for the given element layout, or 0 if the layout
+// cannot be represented as a typed array.
+static unsigned typed_array_tag(MLuaArrayInfo const* info) {
+    unsigned ll;
+    switch (info->kind) {
+    case MLUA_ARRAY_INT:
+    case MLUA_ARRAY_UINT:
+        switch (info->size) {
+        case 1: ll = 0; break;
+        case 2: ll = 1; break;
+        case 4: ll = 2; break;
+        case 8: ll = 3; break;
+        default: return 0;
+        }
+        unsigned tag = TAG_TYPED_FIRST | ll;
+        if (info->kind == MLUA_ARRAY_INT) tag |= TAG_SIGNED;
+        if (info->size > 1 && is_little_endian()) tag |= TAG_LITTLE;
+        return tag;
+    case MLUA_ARRAY_FLOAT:
+        if (info->size == sizeof(float)) {
+            ll = 1;
+        } else if (info->size == sizeof(double)) {
+            ll = 2;
+        } else {
+            return 0;
+        }
+        return TAG_TYPED_FIRST | TAG_FLOAT | ll
+               | (is_little_endian() ? TAG_LITTLE : 0);
+    default:
+        return 0;
+    }
+}
+
+// Encode an Array as a typed array if possible, or as an array of its elements
+// otherwise.
+static void enc_typed_array(Encoder* enc, int idx, MLuaArrayInfo const* info) {
+    unsigned tag = typed_array_tag(info);
+    if (tag != 0) {
+        size_t size = info->len * info->size;
+        enc_head(enc, MT_TAG, tag);
+        enc_head(enc, MT_BYTES, size);
+        enc_add(enc, info->data, size);
+        return;
+    }
+    lua_State* ls = enc->ls;
+    enter(enc);
+    enc_head(enc, MT_ARRAY, info->len);
+    for (lua_Integer i = 1; i <= info->len; ++i) {
+        lua_geti(ls, idx, i);
+        enc_value(enc, lua_gettop(ls));
+        lua_pop(ls, 1);
+    }
+    --enc->depth;
+}
+
+static void enc_value(Encoder* enc, int idx) {
+    lua_State* ls = enc->ls;
+    switch (lua_type(ls, idx)) {
+    case LUA_TNIL:
+        enc_byte(enc, (MT_SIMPLE << 5) | AI_NULL);
+        return;
+    case LUA_TBOOLEAN:
+        enc_byte(enc, (MT_SIMPLE << 5)
+                      | (lua_toboolean(ls, idx) ? AI_TRUE : AI_FALSE));
+        return;
+    case LUA_TNUMBER:
+        if (lua_isinteger(ls, idx)) {
+            enc_int(enc, lua_tointeger(ls, idx));
+        } else {
+            enc_float(enc, lua_tonumber(ls, idx));
+        }
+        return;
+    case LUA_TSTRING: {
+        size_t len;
+        char const* s = lua_tolstring(ls, idx, &len);
+        enc_string(enc, s, len);
+        return;
+    }
+    case LUA_TTABLE:
+        enc_table(enc, idx);
+        return;
+    case LUA_TUSERDATA: {
+#if !MLUA_IS64INT
+        int64_t v;
+        if (mlua_test_int64(ls, idx, &v)) {
+            enc_int(enc, v);
+            return;
+        }
+#endif
+        MLuaArrayInfo info;
+        if (mlua_array_info(ls, idx, &info)) {
+            enc_typed_array(enc, idx, &info);
+            return;
+        }
+        break;
+    }
+    }
+    luaL_error(ls, "cannot encode %s", luaL_typename(ls, idx));
+}
+
+// Encode the value at index 1 into the output buffer at index "idx".
+static void encode(lua_State* ls, Encoder* enc, int idx) {
+    *enc = (Encoder){.ls = ls, .idx = idx, .cap = 64};
+    enc->data = lua_newuserdatauv(ls, enc->cap, 0);
+    lua_replace(ls, idx);
+    enc_value(enc, 1);
+}
+
+static int mod_encode(lua_State* ls) {
+    lua_settop(ls, 2);
+    Encoder enc;
+    encode(ls, &enc, 2);
+    lua_pushlstring(ls, (char const*)enc.data, enc.len);
+    return 1;
+}
+
+static int mod_pack(lua_State* ls) {
+    MLuaBuffer dest;
+    luaL_argexpected(ls, mlua_get_buffer(ls, 1, &dest), 1, "buffer");
+    lua_Integer off = luaL_optinteger(ls, 3, 0);
+    luaL_argcheck(ls, 0 <= off && (lua_Unsigned)off <= dest.size, 3,
+                  "out of bounds");
+    lua_settop(ls, 3);
+    lua_rotate(ls, 1, -1);  // Move the value to index 1
+    lua_pushnil(ls);
+    Encoder enc;
+    encode(ls, &enc, 4);
+    if (enc.len > dest.size - off) return luaL_error(ls, "buffer too small");
+    mlua_buffer_write(&dest, off, enc.len, enc.data);
+    return mlua_push_size(ls, off + enc.len), 1;
+}
+
+// A decoder for a complete or partial input.
+typedef struct Parser {
+    lua_State* ls;
+    uint8_t const* start;
+    uint8_t const* p;
+    uint8_t const* end;
+    int depth;
+    char const* err;
+} Parser;
+
+static inline bool fail(Parser* ps, char const* err) {
+    ps->err = err;
+    return false;
+}
+
+static inline uint64_t get_be(uint8_t const* p, int size) {
+    uint64_t v = 0;
+    for (int i = 0; i < size; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+// Read an initial byte and its argument.
+static bool parse_head(Parser* ps, int* major, int* ai, uint64_t* arg) {
+    if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+    uint8_t ib = *ps->p;
+    *major = ib >> 5;
+    *ai = ib & 0x1f;
+    int size;
+    if (*ai < 24) {
+        *arg = *ai;
+        ++ps->p;
+        return true;
+    }
+    switch (*ai) {
+    case 24: size = 1; break;
+    case 25: size = 2; break;
+    case 26: size = 4; break;
+    case 27: size = 8; break;
+    case AI_INDEFINITE:
+        *arg = 0;
+        ++ps->p;
+        return true;
+    default: return fail(ps, "invalid additional information");
+    }
+    if (ps->end - ps->p - 1 < size) return fail(ps, "unexpected end of input");
+    *arg = get_be(ps->p + 1, size);
+    ps->p += 1 + size;
+    return true;
+}
+
+static bool parse_value(Parser* ps);
+
+static bool enter_parse(Parser* ps) {
+    if (ps->depth >= MLUA_CBOR_MAX_DEPTH) return fail(ps, "nesting too deep");
+    if (!lua_checkstack(ps->ls, 4)) return fail(ps, "nesting too deep");
+    ++ps->depth;
+    return true;
+}
+
+static bool parse_string(Parser* ps, int major, int ai, uint64_t len) {
+    if (ai != AI_INDEFINITE) {
+        if (len > (uint64_t)(ps->end - ps->p)) {
+            return fail(ps, "unexpected end of input");
+        }
+        lua_pushlstring(ps->ls, (char const*)ps->p, len);
+        ps->p += len;
+        return true;
+    }
+    luaL_Buffer buf;
+    luaL_buffinit(ps->ls, &buf);
+    for (;;) {
+        if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+        if (*ps->p == BREAK) {
+            ++ps->p;
+            break;
+        }
+        uint8_t const* cp = ps->p;
+        int cmajor, cai;
+        if (!parse_head(ps, &cmajor, &cai, &len)) return false;
+        if (cmajor != major || cai == AI_INDEFINITE) {
+            ps->p = cp;
+            return fail(ps, "invalid string chunk");
+        }
+        if (len > (uint64_t)(ps->end - ps->p)) {
+            return fail(ps, "unexpected end of input");
+        }
+        luaL_addlstring(&buf, (char const*)ps->p, len);
+        ps->p += len;
+    }
+    luaL_pushresult(&buf);
+    return true;
+}
+
+// Check if the next item is a break, and consume it.
+static bool parse_break(Parser* ps, bool* brk) {
+    if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+    *brk = *ps->p == BREAK;
+    if (*brk) ++ps->p;
+    return true;
+}
+
+// Return the number of slots to preallocate for "len" elements, bounded by
+// the number of elements that the remaining input can hold.
+static inline int prealloc(uint64_t len, size_t avail) {
+    if (len > avail) len = avail;
+    return len < INT_MAX ? (int)len : INT_MAX;
+}
+
+static bool parse_array(Parser* ps, int ai, uint64_t len) {
+    lua_State* ls = ps->ls;
+    bool indef = ai == AI_INDEFINITE;
+    lua_createtable(ls, prealloc(indef ? 0 : len, ps->end - ps->p), 1);
+    luaL_getmetatable(ls, list_name);
+    lua_setmetatable(ls, -2);
+    lua_Integer i = 0;
+    for (;; ++i) {
+        if (indef) {
+            bool brk;
+            if (!parse_break(ps, &brk)) return false;
+            if (brk) break;
+        } else if ((uint64_t)i >= len) {
+            break;
+        }
+        if (!parse_value(ps)) return false;
+        lua_rawseti(ls, -2, i + 1);
+    }
+    lua_pushinteger(ls, i);
+    lua_setfield(ls, -2, "n");
+    return true;
+}
+
+static bool parse_map(Parser* ps, int ai, uint64_t len) {
+    lua_State* ls = ps->ls;
+    bool indef = ai == AI_INDEFINITE;
+    lua_createtable(ls, 0, prealloc(indef ? 0 : len, (ps->end - ps->p) / 2));
+    for (uint64_t i = 0;; ++i) {
+        if (indef) {
+            bool brk;
+            if (!parse_break(ps, &brk)) return false;
+            if (brk) break;
+        } else if (i >= len) {
+            break;
+        }
+        uint8_t const* kp = ps->p;
+        if (!parse_value(ps)) return false;
+        if (lua_isnil(ls, -1)
+                || (lua_type(ls, -1) == LUA_TNUMBER
+                    && lua_tonumber(ls, -1) != lua_tonumber(ls, -1))) {
+            ps->p = kp;
+            return fail(ps, "invalid map key");
+        }
+        if (!parse_value(ps)) return false;
+        lua_rawset(ls, -3);
+    }
+    return true;
+}
+
+static lua_Number half_to_number(uint16_t h) {
+    int exp = (h >> 10) & 0x1f;
+    int mant = h & 0x3ff;
+    lua_Number v;
+    if (exp == 0) {
+        v = ldexp(mant, -24);
+    } else if (exp != 31) {
+        v = ldexp(mant + 1024, exp - 25);
+    } else {
+        v = mant == 0 ? (lua_Number)HUGE_VAL : (lua_Number)NAN;
+    }
+    return (h & 0x8000) != 0 ? -v : v;
+}
+
+static inline void swap_bytes(uint8_t* p, size_t size) {
+    for (size_t i = 0, j = size - 1; i < j; ++i, --j) {
+        uint8_t t = p[i];
+        p[i] = p[j];
+        p[j] = t;
+    }
+}
+
+// Parse a typed array, and push it as an Array.
+static bool parse_typed_array(Parser* ps, unsigned tag) {
+    uint8_t const* tp = ps->p;
+    int major, ai;
+    uint64_t len;
+    if (!parse_head(ps, &major, &ai, &len)) return false;
+    if (major != MT_BYTES || ai == AI_INDEFINITE) {
+        ps->p = tp;
+        return fail(ps, "invalid typed array");
+    }
+    if (len > (uint64_t)(ps->end - ps->p)) {
+        return fail(ps, "unexpected end of input");
+    }
+    unsigned ll = tag & 3;
+    size_t size = (size_t)1 << ll;
+    MLuaArrayKind kind;
+    size_t esize = size;
+    if ((tag & TAG_FLOAT) != 0) {
+        if ((tag & TAG_SIGNED) != 0 || ll == 3) {
+            return fail(ps, "unsupported typed array");
+        }
+        kind = MLUA_ARRAY_FLOAT;
+        size = esize = (size_t)2 << ll;
+        if (ll == 0) esize = sizeof(float);  // Widen half floats
+    } else {
+        if (tag == (TAG_TYPED_FIRST | TAG_SIGNED | TAG_LITTLE)) {
+            return fail(ps, "unsupported typed array");
+        }
+        kind = (tag & TAG_SIGNED) != 0 ? MLUA_ARRAY_INT : MLUA_ARRAY_UINT;
+    }
+    if (len % size != 0) return fail(ps, "invalid typed array");
+    lua_Integer cnt = len / size;
+    uint8_t* data = mlua_push_array(ps->ls, kind, esize, cnt);
+    if (data == NULL) return fail(ps, "unsupported typed array");
+    bool swap = size > 1 && ((tag & TAG_LITTLE) != 0) != is_little_endian();
+    if (size == 2 && kind == MLUA_ARRAY_FLOAT) {
+        float* fdata = (float*)data;
+        bool little = (tag & TAG_LITTLE) != 0;
+        for (lua_Integer i = 0; i < cnt; ++i) {
+            uint8_t const* p = ps->p + 2 * i;
+            uint16_t h = little ? p[0] | (p[1] << 8) : (p[0] << 8) | p[1];
+            fdata[i] = half_to_number(h);
+        }
+    } else {
+        memcpy(data, ps->p, len);
+        if (swap) {
+            for (size_t i = 0; i < len; i += size) swap_bytes(data + i, size);
+        }
+    }
+    ps->p += len;
+    return true;
+}
+
+static bool parse_simple(Parser* ps, int ai, uint64_t arg) {
+    lua_State* ls = ps->ls;
+    switch (ai) {
+    case AI_FALSE: lua_pushboolean(ls, false); return true;
+    case AI_TRUE: lua_pushboolean(ls, true); return true;
+    case AI_NULL: case AI_UNDEFINED: lua_pushnil(ls); return true;
+    case AI_FLOAT16: lua_pushnumber(ls, half_to_number(arg)); return true;
+    case AI_FLOAT32: {
+        uint32_t bits = arg;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        lua_pushnumber(ls, f);
+        return true;
+    }
+    case AI_FLOAT64: {
+        double d;
+        memcpy(&d, &arg, sizeof(d));
+        lua_pushnumber(ls, d);
+        return true;
+    }
+    case AI_INDEFINITE:
+        return fail(ps, "unexpected break");
+    default:
+        return fail(ps, "unsupported simple value");
+    }
+}
+
+// Parse the content of an item whose head has already been read, and push it
+// onto the stack.
+static bool parse_item(Parser* ps, int major, int ai, uint64_t arg) {
+    switch (major) {
+    case MT_UINT:
+        if (arg <= INT64_MAX) {
+            mlua_push_minint(ps->ls, (int64_t)arg);
+        } else {
+            lua_pushnumber(ps->ls, (lua_Number)arg);
+        }
+        return true;
+    case MT_NINT:
+        if (arg <= INT64_MAX) {
+            mlua_push_minint(ps->ls, -1 - (int64_t)arg);
+        } else {
+            lua_pushnumber(ps->ls, -1 - (lua_Number)arg);
+        }
+        return true;
+    case MT_BYTES:
+    case MT_TEXT:
+        return parse_string(ps, major, ai, arg);
+    case MT_ARRAY:
+        return parse_array(ps, ai, arg);
+    case MT_MAP:
+        return parse_map(ps, ai, arg);
+    case MT_TAG:
+        if (TAG_TYPED_FIRST <= arg && arg <= TAG_TYPED_LAST) {
+            return parse_typed_array(ps, arg);
+        }
+        // Other tags are ignored, and their content is decoded as-is.
+        return parse_value(ps);
+    default:
+        return parse_simple(ps, ai, arg);
+    }
+}
+
+// Parse a value, and push it onto the stack.
+static bool parse_value(Parser* ps) {
+    uint8_t const* start = ps->p;
+    int major, ai;
+    uint64_t arg;
+    if (!parse_head(ps, &major, &ai, &arg)) return false;
+    if (ai == AI_INDEFINITE
+            && (major == MT_UINT || major == MT_NINT || major == MT_TAG)) {
+        ps->p = start;
+        return fail(ps, "invalid additional information");
+    }
+    bool nested = major == MT_ARRAY || major == MT_MAP || major == MT_TAG;
+    if (nested && !enter_parse(ps)) {
+        ps->p = start;
+        return false;
+    }
+    if (!parse_item(ps, major, ai, arg)) {
+        if (major == MT_SIMPLE) ps->p = start;
+        return false;
+    }
+    if (nested) --ps->depth;
+    return true;
+}
+
+// Parse a value in [start, end), and push it. Returns the end of the value, or
+// NULL and pushes an error message on failure.
+static uint8_t const* parse(lua_State* ls, uint8_t const* start,
+                            uint8_t const* p, uint8_t const* end) {
+    int top = lua_gettop(ls);
+    Parser ps = {.ls = ls, .start = start, .p = p, .end = end};
+    if (parse_value(&ps)) return ps.p;
+    lua_settop(ls, top);
+    lua_pushfstring(ls, "%s at offset %I", ps.err,
+                    (lua_Integer)(ps.p - ps.start));
+    return NULL;
+}
+
+static int mod_decode(lua_State* ls) {
+    MLuaBuffer buf;
+    luaL_argexpected(ls, mlua_get_ro_buffer(ls, 1, &buf), 1,
+                     "string or buffer");
+    luaL_argexpected(ls, buf.vt == NULL, 1, "raw buffer");
+    lua_Integer off = luaL_optinteger(ls, 2, 0);
+    luaL_argcheck(ls, 0 <= off && (lua_Unsigned)off <= buf.size, 2,
+                  "out of bounds");
+    uint8_t const* start = buf.ptr;
+    uint8_t const* end = parse(ls, start, start + off, start + buf.size);
+    if (end == NULL) {
+        luaL_pushfail(ls);
+        lua_insert(ls, -2);
+        return 2;
+    }
+    return mlua_push_size(ls, end - start), 2;
+}
+
+// The result of scanning the input for a complete value.
+typedef enum ScanResult {
+    SCAN_OK,
+    SCAN_MORE,
+    SCAN_ERROR,
+} ScanResult;
+
+// A scanner that determines the extent of the next value without decoding it.
+// When the input is incomplete, "need" is set to the input length required to
+// make progress.
+typedef struct Scanner {
+    uint8_t const* start;
+    uint8_t const* p;
+    uint8_t const* end;
+    size_t need;
+} Scanner;
+
+static ScanResult more(Scanner* sc, uint8_t const* p, uint64_t size) {
+    uint64_t need = (uint64_t)(p - sc->start) + size;
+    sc->need = need < SIZE_MAX ? need : SIZE_MAX;
+    return SCAN_MORE;
+}
+
+static ScanResult scan_head(Scanner* sc, int* major, int* ai, uint64_t* arg) {
+    if (sc->p >= sc->end) return more(sc, sc->p, 1);
+    uint8_t ib = *sc->p;
+    *major = ib >> 5;
+    *ai = ib & 0x1f;
+    int size;
+    if (*ai < 24) {
+        size = 0;
+    } else if (*ai <= 27) {
+        size = 1 << (*ai - 24);
+    } else if (*ai == AI_INDEFINITE) {
+        size = 0;
+    } else {
+        return SCAN_ERROR;
+    }
+    if (sc->end - sc->p - 1 < size) return more(sc, sc->p, 1 + size);
+    *arg = size > 0 ? get_be(sc->p + 1, size) : (uint64_t)*ai;
+    sc->p += 1 + size;
+    return SCAN_OK;
+}
+
+static ScanResult scan_bytes(Scanner* sc, uint64_t len) {
+    if (len > (uint64_t)(sc->end - sc->p)) return more(sc, sc->p, len);
+    sc->p += len;
+    return SCAN_OK;
+}
+
+static ScanResult scan_value(Scanner* sc, int depth) {
+    if (depth > MLUA_CBOR_MAX_DEPTH) return SCAN_ERROR;
+    int major, ai;
+    uint64_t arg;
+    ScanResult res = scan_head(sc, &major, &ai, &arg);
+    if (res != SCAN_OK) return res;
+    bool indef = ai == AI_INDEFINITE;
+    switch (major) {
+    case MT_UINT:
+    case MT_NINT:
+        return indef ? SCAN_ERROR : SCAN_OK;
+    case MT_BYTES:
+    case MT_TEXT:
+        if (!indef) return scan_bytes(sc, arg);
+        for (;;) {
+            if (sc->p >= sc->end) return more(sc, sc->p, 1);
+            if (*sc->p == BREAK) {
+                ++sc->p;
+                return SCAN_OK;
+            }
+            int cmajor, cai;
+            res = scan_head(sc, &cmajor, &cai, &arg);
+            if (res != SCAN_OK) return res;
+            if (cmajor != major || cai == AI_INDEFINITE) return SCAN_ERROR;
+            res = scan_bytes(sc, arg);
+            if (res != SCAN_OK) return res;
+        }
+    case MT_ARRAY:
+    case MT_MAP: {
+        int per = major == MT_MAP ? 2 : 1;
+        for (uint64_t i = 0; indef || i < arg; ++i) {
+            if (indef) {
+                if (sc->p >= sc->end) return more(sc, sc->p, 1);
+                if (*sc->p == BREAK) {
+                    ++sc->p;
+                    return SCAN_OK;
+                }
+            }
+            for (int j = 0; j < per; ++j) {
+                res = scan_value(sc, depth + 1);
+                if (res != SCAN_OK) return res;
+            }
+        }
+        return SCAN_OK;
+    }
+    case MT_TAG:
+        if (indef) return SCAN_ERROR;
+        return scan_value(sc, depth + 1);
+    default:
+        return indef ? SCAN_ERROR : SCAN_OK;
+    }
+}
+
+static char const Decoder_name[] = "mlua.cbor.Decoder";
+
+// An incremental decoder. The buffered input is stored at [head, tail) in a
+// storage userdata, kept as user value 1. "need" is the buffered length below
+// which the next value is known to be incomplete.
+typedef struct Decoder {
+    uint8_t* data;
+    size_t cap;
+    size_t head;
+    size_t tail;
+    size_t need;
+} Decoder;
+
+static inline Decoder* check_Decoder(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Decoder_name);
+}
+
+static void dec_set_storage(lua_State* ls, int arg, Decoder* dec,
+                            size_t cap) {
+    uint8_t* data = lua_newuserdatauv(ls, cap, 0);
+    size_t len = dec->tail - dec->head;
+    if (len > 0) memcpy(data, dec->data + dec->head, len);
+    lua_setiuservalue(ls, arg, 1);
+    dec->data = data;
+    dec->cap = cap;
+    dec->head = 0;
+    dec->tail = len;
+}
+
+static uint8_t* dec_reserve(lua_State* ls, int arg, Decoder* dec,
+                            size_t size) {
+    if (size <= dec->cap - dec->tail) return dec->data + dec->tail;
+    size_t len = dec->tail - dec->head;
+    if (size > SIZE_MAX / 2 - len) luaL_error(ls, "input too large");
+    if (len + size <= dec->cap && dec->head >= len) {
+        memmove(dec->data, dec->data + dec->head, len);
+        dec->head = 0;
+        dec->tail = len;
+    } else {
+        size_t cap = dec->cap;
+        while (cap < len + size) cap *= 2;
+        dec_set_storage(ls, arg, dec, cap);
+    }
+    return dec->data + dec->tail;
+}
+
+static inline void dec_consume(Decoder* dec, size_t len) {
+    dec->head += len;
+    if (dec->head == dec->tail) dec->head = dec->tail = 0;
+}
+
+static int Decoder_feed(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    MLuaBuffer src;
+    luaL_argexpected(ls, mlua_get_ro_buffer(ls, 2, &src), 2,
+                     "string or buffer");
+    luaL_argcheck(ls, src.size != (size_t)-1, 2, "unsized buffer");
+    if (src.size > 0) {
+        uint8_t* dest = dec_reserve(ls, 1, dec, src.size);
+        mlua_buffer_read(&src, 0, src.size, dest);
+        dec->tail += src.size;
+    }
+    return lua_settop(ls, 1), 1;
+}
+
+static int Decoder_next(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    size_t len = dec->tail - dec->head;
+    if (len == 0 || len < dec->need) return lua_pushboolean(ls, false), 1;
+    uint8_t const* start = dec->data + dec->head;
+    Scanner sc = {.start = start, .p = start, .end = start + len};
+    switch (scan_value(&sc, 0)) {
+    case SCAN_OK: {
+        dec->need = 0;
+        lua_pushboolean(ls, true);
+        uint8_t const* end = parse(ls, start, start, sc.p);
+        dec_consume(dec, sc.p - start);
+        if (end != NULL) return 2;
+        luaL_pushfail(ls);
+        lua_replace(ls, -3);
+        return 2;
+    }
+    case SCAN_MORE:
+        dec->need = sc.need;
+        return lua_pushboolean(ls, false), 1;
+    default:
+        // The input cannot be resynchronized, so discard all of it.
+        dec->need = 0;
+        if (parse(ls, start, start, sc.end) != NULL) {
+            lua_pop(ls, 1);
+            lua_pushfstring(ls, "invalid input at offset %I",
+                            (lua_Integer)(sc.p - start));
+        }
+        dec_consume(dec, len);
+        luaL_pushfail(ls);
+        lua_insert(ls, -2);
+        return 2;
+    }
+}
+
+static int Decoder_reset(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    dec->head = dec->tail = dec->need = 0;
+    return lua_settop(ls, 1), 1;
+}
+
+static int Decoder___len(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    return mlua_push_size(ls, dec->tail - dec->head), 1;
+}
+
+MLUA_SYMBOLS(Decoder_syms) = {
+    MLUA_SYM_F(feed, Decoder_),
+    MLUA_SYM_F(next, Decoder_),
+    MLUA_SYM_F(reset, Decoder_),
+};
+
+MLUA_SYMBOLS_NOHASH(Decoder_syms_nh) = {
+    MLUA_SYM_F_NH(__len, Decoder_),
+};
+
+static int mod_decoder(lua_State* ls) {
+    Decoder* dec = lua_newuserdatauv(ls, sizeof(Decoder), 1);
+    memset(dec, 0, sizeof(*dec));
+    luaL_getmetatable(ls, Decoder_name);
+    lua_setmetatable(ls, -2);
+    dec_set_storage(ls, lua_gettop(ls), dec, 64);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(encode, mod_),
+    MLUA_SYM_F(pack, mod_),
+    MLUA_SYM_F(decode, mod_),
+    MLUA_SYM_F(decoder, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.cbor) {
+    mlua_require(ls, "mlua.array", false);
+    mlua_require(ls, "mlua.list", false);
+#if !MLUA_IS64INT
+    mlua_require(ls, "mlua.int64", false);
+#endif
+
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Decoder class.
+    mlua_new_class(ls, Decoder_name, Decoder_syms, Decoder_syms_nh);
+    lua_pop(ls, 1);
+    return 1;
+}
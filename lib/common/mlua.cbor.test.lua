@@ -0,0 +1,310 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local cbor = require 'mlua.cbor'
+local array = require 'mlua.array'
+local json = require 'mlua.json'
+local list = require 'mlua.list'
+local mem = require 'mlua.mem'
+local math = require 'math'
+local string = require 'string'
+local table = require 'table'
+
+local float32 = string.packsize('n') == 4
+
+-- Compare decoded values recursively.
+local function deep_eq(a, b)
+    if type(a) ~= 'table' or type(b) ~= 'table' then return equal(a, b) end
+    if getmetatable(a) ~= getmetatable(b) then return false end
+    for k, v in pairs(a) do
+        if not deep_eq(v, rawget(b, k)) then return false end
+    end
+    for k in pairs(b) do
+        if rawget(a, k) == nil then return false end
+    end
+    return true
+end
+
+local function hex(s)
+    return (s:gsub('%s', ''):gsub('%x%x', function(h)
+        return string.char(tonumber(h, 16))
+    end))
+end
+
+function test_encode(t)
+    for _, test in ipairs{
+        {nil, 'f6'},
+        {false, 'f4'},
+        {true, 'f5'},
+        {0, '00'},
+        {23, '17'},
+        {24, '18 18'},
+        {1000, '19 03e8'},
+        {1000000, '1a 000f4240'},
+        {-1, '20'},
+        {-1000, '39 03e7'},
+        {1.5, 'fa 3fc00000'},
+        {1.1, float32 and 'fa 3f8ccccd' or 'fb 3ff199999999999a'},
+        {1 / 0, 'fa 7f800000'},
+        {-1 / 0, 'fa ff800000'},
+        {float32 and 3.0 or 1e300,  -- Outside of the float range
+         float32 and 'fa 40400000' or 'fb 7e37e43c8800759c'},
+        {'', '60'},
+        {'IETF', '64 49455446'},
+        {'\xc3\xbc', '62 c3bc'},
+        {'\xff\x00', '42 ff00'},
+        {'\xed\xa0\x80', '43 eda080'},  -- Surrogate
+        {{}, 'a0'},
+        {{1, 2, 3}, '83 010203'},
+        {{a = 1}, 'a1 6161 01'},
+        {{[1] = 1, [3] = 3}, nil},
+        {list(), '80'},
+        {list{1, nil, 3, n = 3}, '83 01f603'},
+        {{list{}}, '81 80'},
+    } do
+        local v, want = table.unpack(test, 1, 2)
+        local got = cbor.encode(v)
+        if want then
+            t:expect(got):label("encode(%s)", v):eq(hex(want))
+        else
+            t:expect(got:byte(1)):label("encode(%s)[1]", v):eq(0xa2)
+        end
+    end
+end
+
+function test_encode_errors(t)
+    local rec = {}
+    rec.a = rec
+    t:expect(t.expr(cbor).encode(rec)):raises("nesting too deep")
+    t:expect(t.expr(cbor).encode(print)):raises("cannot encode function")
+    t:expect(t.expr(cbor).encode({[print] = 1}))
+        :raises("cannot encode function")
+end
+
+function test_decode(t)
+    for _, test in ipairs{
+        {'f6', nil},
+        {'f7', nil},
+        {'f4', false},
+        {'f5', true},
+        {'00', 0},
+        {'18 64', 100},
+        {'1b 000000e8d4a51000', 1000000000000},
+        {'38 63', -100},
+        {'f9 3c00', 1.0},
+        {'f9 c400', -4.0},
+        {'f9 0001', 5.960464477539063e-8},
+        {'f9 7c00', 1 / 0},
+        {'fa 47c35000', 100000.0},
+        {'fb 3ff199999999999a', 1.1},
+        {'1b ffffffffffffffff', 18446744073709551615.0},
+        {'3b ffffffffffffffff', -18446744073709551616.0},
+        {'64 49455446', 'IETF'},
+        {'42 ff00', '\xff\x00'},
+        {'7f 6161 6162 ff', 'ab'},
+        {'5f 41ff 40 ff', '\xff'},
+        {'80', list()},
+        {'83 01 82 0203 f6', list{1, list{2, 3}, nil, n = 3}},
+        {'9f 01 9f ff ff', list{1, list()}},
+        {'a2 6161 01 01 6162', {a = 1, [1] = 'b'}},
+        {'bf 6161 f5 ff', {a = true}},
+        {'c1 1a 514b67b0', 1363896240},
+    } do
+        local data, want = table.unpack(test, 1, 2)
+        data = hex(data)
+        t:expect(t.mexpr(cbor).decode(data))
+            :eq(list{want, #data, n = 2}, function(a, b)
+                return deep_eq(a[1], b[1]) and a[2] == b[2]
+            end)
+    end
+end
+
+function test_decode_offset(t)
+    local data = cbor.encode('abc') .. cbor.encode(list{1, 2})
+                 .. cbor.encode(nil)
+    local values, off = {}, 0
+    while off < #data do
+        local v
+        v, off = cbor.decode(data, off)
+        t:assert(off, "decode failed: %s", off)
+        table.insert(values, v or 'nil')
+    end
+    t:expect(values):label("values")
+        :eq({'abc', list{1, 2}, 'nil'}, deep_eq)
+
+    local buf = mem.alloc(32)
+    local v = {name = 'test', values = list{1.5, -2, true}}
+    t:expect(t.expr(cbor).pack(buf, v, 4)):eq(4 + #cbor.encode(v))
+    t:expect(t.mexpr(cbor).decode(buf, 4)):eq(list{v, 4 + #cbor.encode(v)},
+        function(a, b) return deep_eq(a[1], b[1]) and a[2] == b[2] end)
+    t:expect(t.expr(cbor).pack(buf, v, 20)):raises("buffer too small")
+end
+
+function test_roundtrip(t)
+    for _, v in ipairs{
+        math.maxinteger, math.mininteger, 0.1, -0.0, 1e300,
+        ('x'):rep(1000), list{('y'):rep(300), list(), {}},
+        {[true] = 'yes', [2.5] = list{false}, nested = {deep = list{1, 2}}},
+        list{[2] = 'two', n = 3},
+    } do
+        local got = cbor.decode(cbor.encode(v))
+        t:expect(got):label("decode(encode(%s))", v):eq(v, deep_eq)
+    end
+    local nan = cbor.decode(cbor.encode(0 / 0))
+    t:expect(nan ~= nan):label("NaN"):eq(true)
+end
+
+function test_typed_arrays(t)
+    for _, test in ipairs{
+        {'B', {0, 1, 255}, 64},
+        {'b', {0, -1, 127}, 72},
+        {'H', {0, 1, 65535}, 65},
+        {'h', {0, -1, 32767}, 73},
+        {'I4', {0, 1, 1 << 31}, 66},
+        {'i4', {0, -1, -(1 << 31)}, 74},
+        {'i8', {0, -1, math.maxinteger}, 75},
+        {'f', {0.0, 1.5, -2.0}, 81},
+        {'d', {0.0, 1.1, -2.0}, 82},
+    } do
+        local fmt, values, tag = table.unpack(test)
+        local a = array(fmt, #values):set(1, table.unpack(values))
+        local data = cbor.encode(a)
+        local got = data:byte(2) & ~4  -- Ignore endianness
+        t:expect(got):label("%s: tag", fmt):eq(tag)
+        t:expect(#data):label("%s: #data", fmt)
+            :eq(2 + (#values * a:size() < 24 and 1 or 2) + #values * a:size())
+        local b = cbor.decode(data)
+        t:expect(b:size()):label("%s: size", fmt):eq(a:size())
+        t:expect(b):label("%s: decode(encode(a))", fmt):eq(a)
+    end
+
+    -- Big-endian and half-float typed arrays.
+    local a = cbor.decode(hex('d8 41 44 0001 0002'))
+    t:expect(list{a:get(1, #a)}):label("uint16be"):eq(list{1, 2})
+    a = cbor.decode(hex('d8 54 44 003c 00c0'))
+    t:expect(list{a:get(1, #a)}):label("float16le"):eq(list{1.0, -2.0})
+
+    -- Arrays that have no typed array representation.
+    for _, fmt in ipairs{'i3', 'c2'} do
+        local a = array(fmt, 2):set(1, fmt == 'c2' and 'ab' or 1,
+                                    fmt == 'c2' and 'cd' or 2)
+        t:expect(cbor.decode(cbor.encode(a)))
+            :label("%s: decode(encode(a))", fmt):eq(list{a:get(1, 2)})
+    end
+end
+
+function test_decode_errors(t)
+    for _, test in ipairs{
+        {'', "unexpected end of input at offset 0"},
+        {'1c', "invalid additional information at offset 0"},
+        {'1f', "invalid additional information at offset 0"},
+        {'19 01', "unexpected end of input at offset 0"},
+        {'82 01', "unexpected end of input at offset 2"},
+        {'63 6161', "unexpected end of input at offset 1"},
+        {'ff', "unexpected break at offset 0"},
+        {'f8 20', "unsupported simple value at offset 0"},
+        {'7f 41 61 ff', "invalid string chunk at offset 1"},
+        {'a1 f6 01', "invalid map key at offset 1"},
+        {'d8 41 43 000100', "invalid typed array at offset 3"},
+        {'d8 41 01', "invalid typed array at offset 2"},
+        {('81'):rep(100) .. '00', "nesting too deep at offset 64"},
+    } do
+        local data, want = table.unpack(test, 1, 2)
+        t:expect(t.mexpr(cbor).decode(hex(data)))
+            :label("decode(%q)", data):eq{nil, want, n = 2}
+    end
+end
+
+function test_Decoder(t)
+    local values = {'abc', list{1, list{('x'):rep(300)}}, {a = 1.5}, nil,
+                    false, 42}
+    local parts = {}
+    for i = 1, 6 do parts[i] = cbor.encode(values[i]) end
+    local data = table.concat(parts)
+    for _, size in ipairs{1, 2, 5, 100, #data} do
+        local dec, got = cbor.decoder(), list()
+        for i = 1, #data, size do
+            dec:feed(data:sub(i, i + size - 1))
+            while true do
+                local ok, v = dec:next()
+                if not ok then
+                    t:assert(v == nil, "unexpected error: %s", v)
+                    break
+                end
+                got:append(v)
+            end
+        end
+        t:expect(got):label("values(size=%s)", size)
+            :eq(list{'abc', list{1, list{('x'):rep(300)}}, {a = 1.5}, nil,
+                     false, 42, n = 6}, deep_eq)
+        t:expect(#dec):label("#dec"):eq(0)
+    end
+
+    local dec = cbor.decoder()
+    dec:feed(hex('5a 00000100'))
+    t:expect(t.mexpr(dec):next()):eq{false}
+    t:expect(#dec):label("#dec"):eq(5)
+    dec:feed(('z'):rep(256))
+    t:expect(t.mexpr(dec):next()):eq{true, ('z'):rep(256)}
+    dec:feed(hex('82 01 1c 00'))
+    t:expect(t.mexpr(dec):next())
+        :eq{nil, "invalid additional information at offset 2", n = 2}
+    t:expect(#dec):label("#dec"):eq(0)
+    dec:feed(hex('82 01'))
+    t:expect(t.expr(dec):reset()):eq(dec)
+    t:expect(#dec):label("#dec"):eq(0)
+end
+
+local function bench_data()
+    local data = {}
+    for i = 1, 20 do
+        table.insert(data, {id = i, name = ('item %d'):format(i),
+                            tags = {'a', 'b\n'}, price = i * 1.25,
+                            active = i % 2 == 0})
+    end
+    return data
+end
+
+function bench_encode_json(b)
+    local data = bench_data()
+    b:bytes(#json.encode(data))
+    b:reset_timer()
+    for i = 1, b.n do json.encode(data) end
+end
+
+function bench_encode_cbor(b)
+    local data = bench_data()
+    b:bytes(#cbor.encode(data))
+    b:reset_timer()
+    for i = 1, b.n do cbor.encode(data) end
+end
+
+function bench_decode_json(b)
+    local data = json.encode(bench_data())
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do json.decode(data) end
+end
+
+function bench_decode_cbor(b)
+    local data = cbor.encode(bench_data())
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do cbor.decode(data) end
+end
+
+function bench_encode_array(b)
+    local a = array('d', 1000)
+    for i = 1, #a do a[i] = i / 3 end
+    b:bytes(#cbor.encode(a))
+    b:reset_timer()
+    for i = 1, b.n do cbor.encode(a) end
+end
+
+function bench_encode_list(b)
+    local l = list()
+    for i = 1, 1000 do l:append(i / 3) end
+    b:bytes(#cbor.encode(l))
+    b:reset_timer()
+    for i = 1, b.n do cbor.encode(l) end
+end
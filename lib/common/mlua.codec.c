@@ -0,0 +1,457 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The number of lookup tables used to compute CRCs: 1 (byte-wise, 1 KiB per
+// CRC), 4 or 8 (slicing-by-4 or slicing-by-8, 4 or 8 KiB per CRC).
+#ifndef MLUA_CODEC_CRC_SLICES
+#define MLUA_CODEC_CRC_SLICES 8
+#endif
+
+#if MLUA_CODEC_CRC_SLICES != 1 && MLUA_CODEC_CRC_SLICES != 4 \
+    && MLUA_CODEC_CRC_SLICES != 8
+#error MLUA_CODEC_CRC_SLICES must be 1, 4 or 8
+#endif
+
+static inline bool is_little_endian(void) {
+    union { int dummy; char little; } const endian = {1};
+    return endian.little;
+}
+
+static inline uint32_t load_le32(uint8_t const* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    if (is_little_endian()) return v;
+    return __builtin_bswap32(v);
+}
+
+static inline uint32_t load_be32(uint8_t const* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    if (!is_little_endian()) return v;
+    return __builtin_bswap32(v);
+}
+
+static char const Crc_name[] = "mlua.codec.Crc";
+
+// A CRC algorithm, described by its Rocksoft model parameters. For reflected
+// CRCs, the register holds the reflected CRC in its low bits. Otherwise, it
+// holds the CRC in its high bits.
+typedef struct Crc {
+    uint32_t table[MLUA_CODEC_CRC_SLICES][256];
+    uint32_t poly;
+    uint32_t init;
+    uint32_t xorout;
+    uint8_t width;
+    bool refin;
+    bool refout;
+} Crc;
+
+static inline Crc* check_Crc(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Crc_name);
+}
+
+static uint32_t reflect(uint32_t v, int width) {
+    uint32_t res = 0;
+    for (int i = 0; i < width; ++i, v >>= 1) res = (res << 1) | (v & 1);
+    return res;
+}
+
+static void crc_init_tables(Crc* crc) {
+    uint32_t (*t)[256] = crc->table;
+    if (crc->refin) {
+        uint32_t poly = reflect(crc->poly, crc->width);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; ++j) c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+            t[0][i] = c;
+        }
+        for (int k = 1; k < MLUA_CODEC_CRC_SLICES; ++k) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = t[k - 1][i];
+                t[k][i] = (c >> 8) ^ t[0][c & 0xff];
+            }
+        }
+    } else {
+        uint32_t poly = crc->poly << (32 - crc->width);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i << 24;
+            for (int j = 0; j < 8; ++j) {
+                c = (c & 0x80000000u) ? (c << 1) ^ poly : c << 1;
+            }
+            t[0][i] = c;
+        }
+        for (int k = 1; k < MLUA_CODEC_CRC_SLICES; ++k) {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = t[k - 1][i];
+                t[k][i] = (c << 8) ^ t[0][c >> 24];
+            }
+        }
+    }
+}
+
+static uint32_t crc_update_reflected(Crc const* crc, uint32_t reg,
+                                     uint8_t const* p, size_t len) {
+    uint32_t const (*t)[256] = crc->table;
+#if MLUA_CODEC_CRC_SLICES == 8
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t a = load_le32(p) ^ reg;
+        uint32_t b = load_le32(p + 4);
+        reg = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff]
+              ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24]
+              ^ t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff]
+              ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+    }
+#elif MLUA_CODEC_CRC_SLICES == 4
+    for (; len >= 4; p += 4, len -= 4) {
+        uint32_t a = load_le32(p) ^ reg;
+        reg = t[3][a & 0xff] ^ t[2][(a >> 8) & 0xff]
+              ^ t[1][(a >> 16) & 0xff] ^ t[0][a >> 24];
+    }
+#endif
+    for (; len > 0; ++p, --len) reg = t[0][(reg ^ *p) & 0xff] ^ (reg >> 8);
+    return reg;
+}
+
+static uint32_t crc_update_normal(Crc const* crc, uint32_t reg,
+                                  uint8_t const* p, size_t len) {
+    uint32_t const (*t)[256] = crc->table;
+#if MLUA_CODEC_CRC_SLICES == 8
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t a = load_be32(p) ^ reg;
+        uint32_t b = load_be32(p + 4);
+        reg = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff]
+              ^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff]
+              ^ t[3][b >> 24] ^ t[2][(b >> 16) & 0xff]
+              ^ t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+    }
+#elif MLUA_CODEC_CRC_SLICES == 4
+    for (; len >= 4; p += 4, len -= 4) {
+        uint32_t a = load_be32(p) ^ reg;
+        reg = t[3][a >> 24] ^ t[2][(a >> 16) & 0xff]
+              ^ t[1][(a >> 8) & 0xff] ^ t[0][a & 0xff];
+    }
+#endif
+    for (; len > 0; ++p, --len) reg = t[0][(reg >> 24) ^ *p] ^ (reg << 8);
+    return reg;
+}
+
+// Convert a CRC value to the register representation.
+static uint32_t crc_to_reg(Crc const* crc, uint32_t value) {
+    value ^= crc->xorout;
+    if (crc->refin != crc->refout) value = reflect(value, crc->width);
+    return crc->refin ? value : value << (32 - crc->width);
+}
+
+// Convert the register representation to a CRC value.
+static uint32_t crc_from_reg(Crc const* crc, uint32_t reg) {
+    uint32_t value = crc->refin ? reg : reg >> (32 - crc->width);
+    if (crc->refin != crc->refout) value = reflect(value, crc->width);
+    return value ^ crc->xorout;
+}
+
+static int Crc_checksum(lua_State* ls) {
+    Crc const* crc = check_Crc(ls, 1);
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 2, &len, NULL);
+    uint32_t reg;
+    if (lua_isnoneornil(ls, 5)) {
+        reg = crc->refin ? reflect(crc->init, crc->width)
+                         : crc->init << (32 - crc->width);
+    } else {
+        reg = crc_to_reg(crc, luaL_checkinteger(ls, 5));
+    }
+    reg = crc->refin ? crc_update_reflected(crc, reg, p, len)
+                     : crc_update_normal(crc, reg, p, len);
+    return lua_pushinteger(ls, (lua_Unsigned)crc_from_reg(crc, reg)), 1;
+}
+
+static int Crc___call(lua_State* ls) { return Crc_checksum(ls); }
+
+static int Crc_width(lua_State* ls) {
+    Crc const* crc = check_Crc(ls, 1);
+    return lua_pushinteger(ls, crc->width), 1;
+}
+
+MLUA_SYMBOLS(Crc_syms) = {
+    MLUA_SYM_F(checksum, Crc_),
+    MLUA_SYM_F(width, Crc_),
+};
+
+MLUA_SYMBOLS_NOHASH(Crc_syms_nh) = {
+    MLUA_SYM_F_NH(__call, Crc_),
+};
+
+// A predefined CRC algorithm.
+typedef struct CrcPreset {
+    char const* name;
+    uint32_t poly;
+    uint32_t init;
+    uint32_t xorout;
+    uint8_t width;
+    bool reflect;
+} CrcPreset;
+
+static CrcPreset const crc_presets[] = {
+    {"crc32", 0x04c11db7, 0xffffffff, 0xffffffff, 32, true},
+    {"crc32c", 0x1edc6f41, 0xffffffff, 0xffffffff, 32, true},
+    {"crc32-mpeg2", 0x04c11db7, 0xffffffff, 0, 32, false},
+    {"crc16-arc", 0x8005, 0, 0, 16, true},
+    {"crc16-ccitt", 0x1021, 0xffff, 0, 16, false},
+    {"crc16-kermit", 0x1021, 0, 0, 16, true},
+    {"crc16-modbus", 0x8005, 0xffff, 0, 16, true},
+    {"crc16-xmodem", 0x1021, 0, 0, 16, false},
+    {"crc8", 0x07, 0, 0, 8, false},
+    {"crc8-maxim", 0x31, 0, 0, 8, true},
+};
+
+static uint32_t check_crc_param(lua_State* ls, char const* name, int width,
+                                uint32_t def) {
+    lua_Integer v = def;
+    if (lua_getfield(ls, 1, name) != LUA_TNIL) {
+        int isnum;
+        v = lua_tointegerx(ls, -1, &isnum);
+        if (!isnum) return luaL_error(ls, "invalid CRC %s", name);
+    }
+    lua_pop(ls, 1);
+    uint32_t mask = width < 32 ? ((uint32_t)1 << width) - 1 : 0xffffffffu;
+    if (((lua_Unsigned)v & ~(lua_Unsigned)mask) != 0) {
+        return luaL_error(ls, "invalid CRC %s", name);
+    }
+    return v;
+}
+
+static bool opt_crc_flag(lua_State* ls, char const* name, bool def) {
+    bool res = def;
+    if (lua_getfield(ls, 1, name) != LUA_TNIL) res = lua_toboolean(ls, -1);
+    lua_pop(ls, 1);
+    return res;
+}
+
+static int mod_crc(lua_State* ls) {
+    Crc* crc = lua_newuserdatauv(ls, sizeof(Crc), 0);
+    if (lua_type(ls, 1) == LUA_TSTRING) {
+        char const* name = lua_tostring(ls, 1);
+        CrcPreset const* p = NULL;
+        for (size_t i = 0; i < MLUA_SIZE(crc_presets); ++i) {
+            if (strcmp(name, crc_presets[i].name) == 0) {
+                p = &crc_presets[i];
+                break;
+            }
+        }
+        if (p == NULL) return luaL_argerror(ls, 1, "unknown CRC");
+        crc->width = p->width;
+        crc->poly = p->poly;
+        crc->init = p->init;
+        crc->xorout = p->xorout;
+        crc->refin = crc->refout = p->reflect;
+    } else {
+        luaL_checktype(ls, 1, LUA_TTABLE);
+        lua_getfield(ls, 1, "width");
+        lua_Integer width = luaL_optinteger(ls, -1, 32);
+        lua_pop(ls, 1);
+        luaL_argcheck(ls, 1 <= width && width <= 32, 1, "invalid CRC width");
+        crc->width = width;
+        lua_getfield(ls, 1, "poly");
+        if (lua_isnil(ls, -1)) return luaL_error(ls, "missing CRC poly");
+        lua_pop(ls, 1);
+        crc->poly = check_crc_param(ls, "poly", width, 0);
+        crc->init = check_crc_param(ls, "init", width, 0);
+        crc->xorout = check_crc_param(ls, "xorout", width, 0);
+        crc->refin = opt_crc_flag(ls, "refin", false);
+        crc->refout = opt_crc_flag(ls, "refout", crc->refin);
+    }
+    crc_init_tables(crc);
+    luaL_getmetatable(ls, Crc_name);
+    lua_setmetatable(ls, -2);
+    return 1;
+}
+
+// The largest number of bytes for which the Adler-32 sums don't overflow.
+#define ADLER_NMAX 5552
+#define ADLER_MOD 65521
+
+static int mod_adler32(lua_State* ls) {
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 1, &len, NULL);
+    uint32_t value = luaL_optinteger(ls, 4, 1);
+    uint32_t a = value & 0xffff, b = value >> 16;
+    while (len > 0) {
+        size_t n = len < ADLER_NMAX ? len : ADLER_NMAX;
+        len -= n;
+        for (; n > 0; --n) {
+            a += *p++;
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+    }
+    return lua_pushinteger(ls, (lua_Unsigned)((b << 16) | a)), 1;
+}
+
+static char const hex_lower[] = "0123456789abcdef";
+static char const hex_upper[] = "0123456789ABCDEF";
+
+static int mod_hex_encode(lua_State* ls) {
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 1, &len, NULL);
+    char const* digits = lua_toboolean(ls, 4) ? hex_upper : hex_lower;
+    if (len > (SIZE_MAX - 1) / 2) return luaL_error(ls, "data too large");
+    luaL_Buffer buf;
+    char* out = luaL_buffinitsize(ls, &buf, 2 * len);
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t c = p[i];
+        out[2 * i] = digits[c >> 4];
+        out[2 * i + 1] = digits[c & 0xf];
+    }
+    return luaL_pushresultsize(&buf, 2 * len), 1;
+}
+
+static inline int hex_value(uint8_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static int mod_hex_decode(lua_State* ls) {
+    size_t len;
+    lua_Unsigned off;
+    uint8_t const* p = mlua_check_ro_range(ls, 1, &len, &off);
+    if (len % 2 != 0) {
+        luaL_pushfail(ls);
+        lua_pushliteral(ls, "odd number of hex digits");
+        return 2;
+    }
+    luaL_Buffer buf;
+    char* out = luaL_buffinitsize(ls, &buf, len / 2);
+    for (size_t i = 0; i < len; i += 2) {
+        int hi = hex_value(p[i]), lo = hex_value(p[i + 1]);
+        if (hi < 0 || lo < 0) {
+            luaL_pushfail(ls);
+            lua_pushfstring(ls, "invalid hex digit at offset %I",
+                            (lua_Integer)(off + i + (hi < 0 ? 0 : 1)));
+            return 2;
+        }
+        out[i / 2] = (hi << 4) | lo;
+    }
+    return luaL_pushresultsize(&buf, len / 2), 1;
+}
+
+static char const b64_std[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static char const b64_url[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+static int mod_base64_encode(lua_State* ls) {
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 1, &len, NULL);
+    bool url = lua_toboolean(ls, 4);
+    char const* alpha = url ? b64_url : b64_std;
+    if (len > (SIZE_MAX / 4 - 1) * 3) return luaL_error(ls, "data too large");
+    size_t rem = len % 3;
+    size_t size = len / 3 * 4 + (rem == 0 ? 0 : url ? rem + 1 : 4);
+    luaL_Buffer buf;
+    char* out = luaL_buffinitsize(ls, &buf, size);
+    uint8_t const* end = p + (len - rem);
+    for (; p < end; p += 3, out += 4) {
+        uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+        out[0] = alpha[v >> 18];
+        out[1] = alpha[(v >> 12) & 0x3f];
+        out[2] = alpha[(v >> 6) & 0x3f];
+        out[3] = alpha[v & 0x3f];
+    }
+    if (rem > 0) {
+        uint32_t v = (uint32_t)p[0] << 16;
+        if (rem > 1) v |= (uint32_t)p[1] << 8;
+        out[0] = alpha[v >> 18];
+        out[1] = alpha[(v >> 12) & 0x3f];
+        if (rem > 1) {
+            out[2] = alpha[(v >> 6) & 0x3f];
+        } else if (!url) {
+            out[2] = '=';
+        }
+        if (!url) out[3] = '=';
+    }
+    return luaL_pushresultsize(&buf, size), 1;
+}
+
+static inline int b64_value(uint8_t c, bool url) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == (url ? '-' : '+')) return 62;
+    if (c == (url ? '_' : '/')) return 63;
+    return -1;
+}
+
+static int mod_base64_decode(lua_State* ls) {
+    size_t len;
+    lua_Unsigned off;
+    uint8_t const* p = mlua_check_ro_range(ls, 1, &len, &off);
+    bool url = lua_toboolean(ls, 4);
+    size_t n = len;
+    if (n > 0 && p[n - 1] == '=') --n;
+    if (n > 0 && p[n - 1] == '=') --n;
+    if (n % 4 == 1 || (n < len && len % 4 != 0)) {
+        luaL_pushfail(ls);
+        lua_pushliteral(ls, "invalid base64 length");
+        return 2;
+    }
+    size_t size = n / 4 * 3 + (n % 4 == 0 ? 0 : n % 4 - 1);
+    luaL_Buffer buf;
+    uint8_t* out = (uint8_t*)luaL_buffinitsize(ls, &buf, size);
+    uint32_t v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int d = b64_value(p[i], url);
+        if (d < 0) {
+            luaL_pushfail(ls);
+            lua_pushfstring(ls, "invalid base64 character at offset %I",
+                            (lua_Integer)(off + i));
+            return 2;
+        }
+        v = (v << 6) | d;
+        if (i % 4 == 3) {
+            out[0] = v >> 16;
+            out[1] = v >> 8;
+            out[2] = v;
+            out += 3;
+        }
+    }
+    switch (n % 4) {
+    case 2:
+        out[0] = v >> 4;
+        break;
+    case 3:
+        out[0] = v >> 10;
+        out[1] = v >> 2;
+        break;
+    }
+    return luaL_pushresultsize(&buf, size), 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(crc, mod_),
+    MLUA_SYM_F(adler32, mod_),
+    MLUA_SYM_F(hex_encode, mod_),
+    MLUA_SYM_F(hex_decode, mod_),
+    MLUA_SYM_F(base64_encode, mod_),
+    MLUA_SYM_F(base64_decode, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.codec) {
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Crc class.
+    mlua_new_class(ls, Crc_name, Crc_syms, Crc_syms_nh);
+    lua_pop(ls, 1);
+    return 1;
+}
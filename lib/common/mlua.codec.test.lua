@@ -0,0 +1,230 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local codec = require 'mlua.codec'
+local mem = require 'mlua.mem'
+local string = require 'string'
+local table = require 'table'
+
+local check = '123456789'
+
+function test_crc_presets(t)
+    for _, test in ipairs{
+        {'crc32', 32, 0xcbf43926},
+        {'crc32c', 32, 0xe3069283},
+        {'crc32-mpeg2', 32, 0x0376e6e7},
+        {'crc16-arc', 16, 0xbb3d},
+        {'crc16-ccitt', 16, 0x29b1},
+        {'crc16-kermit', 16, 0x2189},
+        {'crc16-modbus', 16, 0x4b37},
+        {'crc16-xmodem', 16, 0x31c3},
+        {'crc8', 8, 0xf4},
+        {'crc8-maxim', 8, 0xa1},
+    } do
+        local name, width, want = table.unpack(test)
+        local crc = codec.crc(name)
+        t:expect(t.expr(crc):width()):eq(width)
+        t:expect(t.expr(crc):checksum(check)):eq(want)
+        t:expect(crc(check)):label("%s(check)", name):eq(want)
+    end
+    t:expect(t.expr(codec).crc('crc99')):raises("unknown CRC")
+end
+
+function test_crc_params(t)
+    for _, test in ipairs{
+        {{width = 32, poly = 0x04c11db7, init = 0xffffffff, refin = true,
+          xorout = 0xffffffff}, 0xcbf43926},
+        {{width = 32, poly = 0x04c11db7, init = 0xffffffff,
+          xorout = 0xffffffff}, 0xfc891918},  -- CRC-32/BZIP2
+        {{width = 16, poly = 0x8005, refin = true, refout = false}, 0xbcdd},
+        {{width = 16, poly = 0x1021, init = 0x1d0f}, 0xe5cc},  -- AUG-CCITT
+        {{width = 5, poly = 0x05, init = 0x1f, refin = true, xorout = 0x1f},
+         0x19},  -- CRC-5/USB
+        {{width = 7, poly = 0x09}, 0x75},  -- CRC-7/MMC
+        {{width = 3, poly = 0x3, init = 0x7, refin = true},
+         0x6},  -- CRC-3/ROHC
+    } do
+        local params, want = table.unpack(test)
+        t:expect(t.expr(codec.crc(params)):checksum(check)):eq(want)
+    end
+    t:expect(t.expr(codec).crc{width = 33, poly = 1})
+        :raises("invalid CRC width")
+    t:expect(t.expr(codec).crc{width = 8}):raises("missing CRC poly")
+    t:expect(t.expr(codec).crc{width = 8, poly = 0x107})
+        :raises("invalid CRC poly")
+end
+
+function test_crc_incremental(t)
+    local data = ('The quick brown fox jumps over the lazy dog'):rep(7)
+    for _, name in ipairs{'crc32', 'crc32-mpeg2', 'crc16-arc', 'crc16-ccitt',
+                          'crc8', 'crc8-maxim'} do
+        local crc = codec.crc(name)
+        local want = crc:checksum(data)
+        for _, size in ipairs{1, 3, 8, 13, 100} do
+            local value
+            for i = 1, #data, size do
+                value = crc:checksum(data:sub(i, i + size - 1), 0, nil, value)
+            end
+            t:expect(value):label("%s(size=%s)", name, size):eq(want)
+        end
+        -- Offsets and lengths that exercise the unaligned head and tail.
+        for off = 0, 9 do
+            for _, len in ipairs{0, 1, 7, 8, 9, 31} do
+                t:expect(t.expr(crc):checksum(data, off, len))
+                    :eq(crc:checksum(data:sub(off + 1, off + len)))
+            end
+        end
+        t:expect(t.expr(crc):checksum('')):eq(crc:checksum('', 0, 0))
+    end
+end
+
+function test_buffers(t)
+    local data = 'abcdefghijklmnopqrstuvwxyz'
+    local buf = mem.alloc(#data)
+    mem.write(buf, data)
+    local crc = codec.crc('crc32')
+    t:expect(t.expr(crc):checksum(buf)):eq(crc:checksum(data))
+    t:expect(t.expr(crc):checksum(buf, 3, 10))
+        :eq(crc:checksum(data:sub(4, 13)))
+    t:expect(t.expr(codec).adler32(buf, 5)):eq(codec.adler32(data:sub(6)))
+    t:expect(t.expr(codec).hex_encode(buf, 24)):eq('797a')
+    t:expect(t.expr(codec).base64_encode(buf, 0, 3)):eq('YWJj')
+    t:expect(t.expr(crc):checksum(data, 20, 7)):raises("out of bounds")
+    t:expect(t.expr(crc):checksum(data, 27)):raises("out of bounds")
+end
+
+function test_adler32(t)
+    t:expect(t.expr(codec).adler32('')):eq(1)
+    t:expect(t.expr(codec).adler32('Wikipedia')):eq(0x11e60398)
+    local data = ('\xff'):rep(20000)
+    local want = codec.adler32(data)
+    t:expect(want):label("adler32(ff * 20000)"):eq(0x9f51d664)
+    local value
+    for i = 1, #data, 999 do
+        value = codec.adler32(data:sub(i, i + 998), 0, nil, value)
+    end
+    t:expect(value):label("incremental"):eq(want)
+end
+
+function test_hex(t)
+    for _, test in ipairs{
+        {'', ''},
+        {'\x00', '00'},
+        {'\x01\x23\x45\x67\x89\xab\xcd\xef', '0123456789abcdef'},
+    } do
+        local data, want = table.unpack(test)
+        t:expect(t.expr(codec).hex_encode(data)):eq(want)
+        t:expect(t.expr(codec).hex_decode(want)):eq(data)
+        t:expect(t.expr(codec).hex_decode(want:upper())):eq(data)
+    end
+    t:expect(t.expr(codec).hex_encode('\xab\xcd', 0, nil, true)):eq('ABCD')
+    t:expect(t.mexpr(codec).hex_decode('abc'))
+        :eq{nil, "odd number of hex digits", n = 2}
+    t:expect(t.mexpr(codec).hex_decode('a0xb'))
+        :eq{nil, "invalid hex digit at offset 2", n = 2}
+    t:expect(t.mexpr(codec).hex_decode('00a0bg', 2))
+        :eq{nil, "invalid hex digit at offset 5", n = 2}
+end
+
+function test_base64(t)
+    for _, test in ipairs{
+        {'', '', ''},
+        {'f', 'Zg==', 'Zg'},
+        {'fo', 'Zm8=', 'Zm8'},
+        {'foo', 'Zm9v', 'Zm9v'},
+        {'foob', 'Zm9vYg==', 'Zm9vYg'},
+        {'fooba', 'Zm9vYmE=', 'Zm9vYmE'},
+        {'foobar', 'Zm9vYmFy', 'Zm9vYmFy'},
+        {'\xfb\xff\xbf', '+/+/', '-_-_'},
+    } do
+        local data, want, want_url = table.unpack(test)
+        t:expect(t.expr(codec).base64_encode(data)):eq(want)
+        t:expect(t.expr(codec).base64_encode(data, 0, nil, true)):eq(want_url)
+        t:expect(t.expr(codec).base64_decode(want)):eq(data)
+        t:expect(t.expr(codec).base64_decode(want_url, 0, nil, true)):eq(data)
+    end
+    t:expect(t.expr(codec).base64_decode('Zm8')):eq('fo')
+    t:expect(t.mexpr(codec).base64_decode('Zm9vY'))
+        :eq{nil, "invalid base64 length", n = 2}
+    t:expect(t.mexpr(codec).base64_decode('Zm8=='))
+        :eq{nil, "invalid base64 length", n = 2}
+    t:expect(t.mexpr(codec).base64_decode('Zm9v-_'))
+        :eq{nil, "invalid base64 character at offset 4", n = 2}
+    t:expect(t.mexpr(codec).base64_decode('Zm9v+/', 0, nil, true))
+        :eq{nil, "invalid base64 character at offset 4", n = 2}
+end
+
+-- A pure-Lua CRC-32, for benchmarking.
+local crc32_table = {}
+for i = 0, 255 do
+    local c = i
+    for _ = 1, 8 do
+        c = c & 1 ~= 0 and (c >> 1) ~ 0xedb88320 or c >> 1
+    end
+    crc32_table[i] = c
+end
+
+local function lua_crc32(data)
+    local c = 0xffffffff
+    for i = 1, #data do
+        c = crc32_table[(c ~ data:byte(i)) & 0xff] ~ (c >> 8)
+    end
+    return c ~ 0xffffffff
+end
+
+local function bench_block()
+    local parts = {}
+    for i = 0, 1023 do parts[i + 1] = string.char(i * 7 & 0xff) end
+    return table.concat(parts)
+end
+
+function bench_crc32_lua(b)
+    local data = bench_block()
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do lua_crc32(data) end
+end
+
+function bench_crc32_C(b)
+    local data, crc = bench_block(), codec.crc('crc32')
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do crc:checksum(data) end
+end
+
+function bench_adler32(b)
+    local data = bench_block()
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do codec.adler32(data) end
+end
+
+function bench_hex_encode_lua(b)
+    local data = bench_block()
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do
+        data:gsub('.', function(c) return ('%02x'):format(c:byte()) end)
+    end
+end
+
+function bench_hex_encode_C(b)
+    local data = bench_block()
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do codec.hex_encode(data) end
+end
+
+function bench_base64_encode(b)
+    local data = bench_block()
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do codec.base64_encode(data) end
+end
+
+function bench_base64_decode(b)
+    local data = codec.base64_encode(bench_block())
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do codec.base64_decode(data) end
+end
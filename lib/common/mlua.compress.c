@@ -0,0 +1,443 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The default base-2 logarithm of the window size.
+#ifndef MLUA_COMPRESS_WINDOW
+#define MLUA_COMPRESS_WINDOW 10
+#endif
+
+// The default base-2 logarithm of the maximum match length.
+#ifndef MLUA_COMPRESS_LOOKAHEAD
+#define MLUA_COMPRESS_LOOKAHEAD 5
+#endif
+
+// The base-2 logarithm of the number of hash chains used by the compressor.
+#ifndef MLUA_COMPRESS_HASH_BITS
+#define MLUA_COMPRESS_HASH_BITS 10
+#endif
+
+// The maximum number of candidates to examine when looking for a match.
+#ifndef MLUA_COMPRESS_MAX_CHAIN
+#define MLUA_COMPRESS_MAX_CHAIN 16
+#endif
+
+#define MIN_WINDOW 4
+#define MAX_WINDOW 14
+#define MIN_LOOKAHEAD 3
+
+// Parse compression parameters at the given argument index.
+static void check_params(lua_State* ls, int arg, uint8_t* wbits,
+                         uint8_t* lbits) {
+    lua_Integer w = MLUA_COMPRESS_WINDOW, l = MLUA_COMPRESS_LOOKAHEAD;
+    if (!lua_isnoneornil(ls, arg)) {
+        luaL_checktype(ls, arg, LUA_TTABLE);
+        lua_getfield(ls, arg, "window");
+        w = luaL_optinteger(ls, -1, w);
+        lua_getfield(ls, arg, "lookahead");
+        l = luaL_optinteger(ls, -1, l);
+        lua_pop(ls, 2);
+    }
+    luaL_argcheck(ls, MIN_WINDOW <= w && w <= MAX_WINDOW, arg,
+                  "invalid window");
+    luaL_argcheck(ls, MIN_LOOKAHEAD <= l && l < w, arg, "invalid lookahead");
+    *wbits = w;
+    *lbits = l;
+}
+
+static char const Compressor_name[] = "mlua.compress.Compressor";
+
+// A streaming compressor. The input buffer holds up to two windows of data:
+// the history before pos, and the input still to be encoded in [pos, len).
+// Positions in the buffer are linked into hash chains keyed on their first two
+// bytes, through head (the most recent position per hash) and prev (the
+// previous position with the same hash). Positions before hpos are linked.
+// Linking is deferred until the next match search, so that it doesn't depend
+// on whether the byte following a position has been received yet.
+typedef struct Compressor {
+    int16_t* head;
+    int16_t* prev;
+    uint8_t* buf;
+    uint64_t bits;
+    uint16_t pos;
+    uint16_t hpos;
+    uint16_t len;
+    uint8_t nbits;
+    uint8_t wbits;
+    uint8_t lbits;
+} Compressor;
+
+static inline Compressor* check_Compressor(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Compressor_name);
+}
+
+static void Compressor_clear(Compressor* c) {
+    for (size_t i = 0; i < (1u << MLUA_COMPRESS_HASH_BITS); ++i) {
+        c->head[i] = -1;
+    }
+    c->bits = 0;
+    c->nbits = 0;
+    c->pos = c->hpos = c->len = 0;
+}
+
+static Compressor* new_Compressor(lua_State* ls, uint8_t wbits,
+                                  uint8_t lbits) {
+    size_t bsize = (size_t)2 << wbits;
+    Compressor* c = lua_newuserdatauv(
+        ls, sizeof(Compressor)
+            + sizeof(int16_t) * ((1u << MLUA_COMPRESS_HASH_BITS) + bsize)
+            + bsize, 0);
+    c->head = (int16_t*)(c + 1);
+    c->prev = c->head + (1u << MLUA_COMPRESS_HASH_BITS);
+    c->buf = (uint8_t*)(c->prev + bsize);
+    c->wbits = wbits;
+    c->lbits = lbits;
+    Compressor_clear(c);
+    luaL_getmetatable(ls, Compressor_name);
+    lua_setmetatable(ls, -2);
+    return c;
+}
+
+static inline uint32_t hash2(uint8_t const* p) {
+    return ((((uint32_t)p[0] << 8) | p[1]) * 0x9e3779b1u)
+           >> (32 - MLUA_COMPRESS_HASH_BITS);
+}
+
+static inline void put_bits(Compressor* c, luaL_Buffer* out, uint32_t value,
+                            int n) {
+    c->bits = (c->bits << n) | value;
+    c->nbits += n;
+    while (c->nbits >= 8) {
+        c->nbits -= 8;
+        luaL_addchar(out, (char)(c->bits >> c->nbits));
+    }
+}
+
+// Link the positions from hpos up to end into the hash chains.
+static void link_to(Compressor* c, size_t end) {
+    for (; c->hpos < end; ++c->hpos) {
+        uint32_t h = hash2(c->buf + c->hpos);
+        c->prev[c->hpos] = c->head[h];
+        c->head[h] = c->hpos;
+    }
+}
+
+// Find the longest match for the input at pos, and return its length. The
+// distance to the match is stored in *dist.
+static size_t find_match(Compressor const* c, size_t pos, size_t max,
+                         size_t* dist) {
+    uint8_t const* buf = c->buf;
+    uint8_t const* cur = buf + pos;
+    size_t const wsize = (size_t)1 << c->wbits;
+    size_t best = 0;
+    int chain = MLUA_COMPRESS_MAX_CHAIN;
+    for (int32_t cand = c->head[hash2(cur)];
+            cand >= 0 && pos - cand <= wsize && chain-- > 0;
+            cand = c->prev[cand]) {
+        uint8_t const* m = buf + cand;
+        if (m[best] != cur[best]) continue;
+        size_t n = 0;
+        while (n < max && m[n] == cur[n]) ++n;
+        if (n > best) {
+            best = n;
+            *dist = pos - cand;
+            if (n == max) break;
+        }
+    }
+    return best;
+}
+
+// Encode the buffered input. Unless finishing, a full lookahead of input is
+// kept unencoded, so that matches can reach their maximum length.
+static void encode(Compressor* c, luaL_Buffer* out, bool finish) {
+    uint8_t const* buf = c->buf;
+    size_t const lsize = (size_t)1 << c->lbits;
+    unsigned const ref_bits = 1 + c->wbits + c->lbits;
+    size_t pos = c->pos, len = c->len;
+    while (pos < len && (finish || len - pos >= lsize)) {
+        link_to(c, pos);
+        size_t max = len - pos < lsize ? len - pos : lsize;
+        size_t dist = 0, n = max >= 2 ? find_match(c, pos, max, &dist) : 0;
+        if (n * 9 > ref_bits) {
+            put_bits(c, out, ((dist - 1) << c->lbits) | (n - 1), ref_bits);
+        } else {
+            put_bits(c, out, 0x100 | buf[pos], 9);
+            n = 1;
+        }
+        pos += n;
+    }
+    c->pos = pos;
+}
+
+// Discard the input that is more than a window before pos, to make room for
+// more input.
+static void slide(Compressor* c) {
+    size_t const wsize = (size_t)1 << c->wbits;
+    if (c->pos <= wsize) return;
+    int s = c->pos - wsize;
+    memmove(c->buf, c->buf + s, c->len - s);
+    c->len -= s;
+    c->pos -= s;
+    c->hpos -= s;
+    for (size_t i = 0; i < (1u << MLUA_COMPRESS_HASH_BITS); ++i) {
+        int v = c->head[i];
+        c->head[i] = v >= s ? v - s : -1;
+    }
+    for (size_t i = 0; i < c->hpos; ++i) {
+        int v = c->prev[i + s];
+        c->prev[i] = v >= s ? v - s : -1;
+    }
+}
+
+static void compress(Compressor* c, luaL_Buffer* out, uint8_t const* p,
+                     size_t len) {
+    size_t const bsize = (size_t)2 << c->wbits;
+    while (len > 0) {
+        if (c->len == bsize) slide(c);
+        size_t n = bsize - c->len;
+        if (n > len) n = len;
+        memcpy(c->buf + c->len, p, n);
+        c->len += n;
+        p += n;
+        len -= n;
+        encode(c, out, false);
+    }
+}
+
+static void finish(Compressor* c, luaL_Buffer* out) {
+    encode(c, out, true);
+    if (c->nbits > 0) luaL_addchar(out, (char)(c->bits << (8 - c->nbits)));
+    Compressor_clear(c);
+}
+
+static int Compressor_update(lua_State* ls) {
+    Compressor* c = check_Compressor(ls, 1);
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 2, &len, NULL);
+    luaL_Buffer out;
+    luaL_buffinit(ls, &out);
+    compress(c, &out, p, len);
+    return luaL_pushresult(&out), 1;
+}
+
+static int Compressor_finish(lua_State* ls) {
+    Compressor* c = check_Compressor(ls, 1);
+    luaL_Buffer out;
+    luaL_buffinit(ls, &out);
+    finish(c, &out);
+    return luaL_pushresult(&out), 1;
+}
+
+MLUA_SYMBOLS(Compressor_syms) = {
+    MLUA_SYM_F(update, Compressor_),
+    MLUA_SYM_F(finish, Compressor_),
+};
+
+static char const Decompressor_name[] = "mlua.compress.Decompressor";
+
+// A streaming decompressor. The window holds the most recent output, with the
+// next byte written at head. fill is the number of valid bytes in the window.
+typedef struct Decompressor {
+    uint64_t bits;
+    lua_Unsigned offset;
+    size_t head;
+    size_t fill;
+    uint8_t nbits;
+    uint8_t wbits;
+    uint8_t lbits;
+    uint8_t window[];
+} Decompressor;
+
+static inline Decompressor* check_Decompressor(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Decompressor_name);
+}
+
+static void Decompressor_clear(Decompressor* d) {
+    d->bits = 0;
+    d->nbits = 0;
+    d->offset = 0;
+    d->head = d->fill = 0;
+}
+
+static Decompressor* new_Decompressor(lua_State* ls, uint8_t wbits,
+                                      uint8_t lbits) {
+    Decompressor* d = lua_newuserdatauv(
+        ls, sizeof(Decompressor) + ((size_t)1 << wbits), 0);
+    d->wbits = wbits;
+    d->lbits = lbits;
+    Decompressor_clear(d);
+    luaL_getmetatable(ls, Decompressor_name);
+    lua_setmetatable(ls, -2);
+    return d;
+}
+
+// Decode compressed data. Returns false if the data contains an invalid
+// back-reference.
+static bool decompress(Decompressor* d, luaL_Buffer* out, uint8_t const* p,
+                       size_t len) {
+    size_t const wmask = ((size_t)1 << d->wbits) - 1;
+    unsigned const ref_bits = 1 + d->wbits + d->lbits;
+    uint32_t const lmask = ((uint32_t)1 << d->lbits) - 1;
+    uint64_t bits = d->bits;
+    unsigned nbits = d->nbits;
+    size_t head = d->head, fill = d->fill;
+    bool ok = true;
+    for (; len > 0; ++p, --len, ++d->offset) {
+        bits = (bits << 8) | *p;
+        nbits += 8;
+        for (;;) {
+            if (nbits == 0) break;
+            if ((bits >> (nbits - 1)) & 1) {
+                if (nbits < 9) break;
+                nbits -= 9;
+                uint8_t v = bits >> nbits;
+                d->window[head] = v;
+                head = (head + 1) & wmask;
+                if (fill <= wmask) ++fill;
+                luaL_addchar(out, (char)v);
+                continue;
+            }
+            if (nbits < ref_bits) break;
+            nbits -= ref_bits;
+            uint32_t ref = (uint32_t)(bits >> nbits);
+            size_t dist = ((ref >> d->lbits) & wmask) + 1;
+            size_t count = (ref & lmask) + 1;
+            if (dist > fill) {
+                ok = false;
+                goto done;
+            }
+            for (; count > 0; --count) {
+                uint8_t v = d->window[(head - dist) & wmask];
+                d->window[head] = v;
+                head = (head + 1) & wmask;
+                if (fill <= wmask) ++fill;
+                luaL_addchar(out, (char)v);
+            }
+        }
+    }
+done:
+    d->bits = bits;
+    d->nbits = nbits;
+    d->head = head;
+    d->fill = fill;
+    return ok;
+}
+
+static int push_error(lua_State* ls, Decompressor* d) {
+    lua_Unsigned offset = d->offset;
+    Decompressor_clear(d);
+    luaL_pushfail(ls);
+    lua_pushfstring(ls, "invalid back-reference at offset %I",
+                    (lua_Integer)offset);
+    return 2;
+}
+
+// Check that the remaining input bits are only padding.
+static bool check_end(Decompressor* d) {
+    bool ok = d->nbits < 8
+              && (d->bits & (((uint64_t)1 << d->nbits) - 1)) == 0;
+    Decompressor_clear(d);
+    return ok;
+}
+
+static int Decompressor_update(lua_State* ls) {
+    Decompressor* d = check_Decompressor(ls, 1);
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 2, &len, NULL);
+    luaL_Buffer out;
+    luaL_buffinit(ls, &out);
+    if (!decompress(d, &out, p, len)) return push_error(ls, d);
+    return luaL_pushresult(&out), 1;
+}
+
+static int Decompressor_finish(lua_State* ls) {
+    Decompressor* d = check_Decompressor(ls, 1);
+    if (!check_end(d)) {
+        luaL_pushfail(ls);
+        lua_pushliteral(ls, "truncated data");
+        return 2;
+    }
+    return lua_pushboolean(ls, true), 1;
+}
+
+static int Decompressor_reset(lua_State* ls) {
+    Decompressor* d = check_Decompressor(ls, 1);
+    Decompressor_clear(d);
+    return lua_settop(ls, 1), 1;
+}
+
+MLUA_SYMBOLS(Decompressor_syms) = {
+    MLUA_SYM_F(update, Decompressor_),
+    MLUA_SYM_F(finish, Decompressor_),
+    MLUA_SYM_F(reset, Decompressor_),
+};
+
+static int mod_compress(lua_State* ls) {
+    uint8_t wbits, lbits;
+    check_params(ls, 4, &wbits, &lbits);
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 1, &len, NULL);
+    Compressor* c = new_Compressor(ls, wbits, lbits);
+    luaL_Buffer out;
+    luaL_buffinit(ls, &out);
+    compress(c, &out, p, len);
+    finish(c, &out);
+    return luaL_pushresult(&out), 1;
+}
+
+static int mod_decompress(lua_State* ls) {
+    uint8_t wbits, lbits;
+    check_params(ls, 4, &wbits, &lbits);
+    size_t len;
+    uint8_t const* p = mlua_check_ro_range(ls, 1, &len, NULL);
+    Decompressor* d = new_Decompressor(ls, wbits, lbits);
+    luaL_Buffer out;
+    luaL_buffinit(ls, &out);
+    if (!decompress(d, &out, p, len)) return push_error(ls, d);
+    if (!check_end(d)) {
+        luaL_pushfail(ls);
+        lua_pushliteral(ls, "truncated data");
+        return 2;
+    }
+    return luaL_pushresult(&out), 1;
+}
+
+static int mod_compressor(lua_State* ls) {
+    uint8_t wbits, lbits;
+    check_params(ls, 1, &wbits, &lbits);
+    new_Compressor(ls, wbits, lbits);
+    return 1;
+}
+
+static int mod_decompressor(lua_State* ls) {
+    uint8_t wbits, lbits;
+    check_params(ls, 1, &wbits, &lbits);
+    new_Decompressor(ls, wbits, lbits);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(compress, mod_),
+    MLUA_SYM_F(decompress, mod_),
+    MLUA_SYM_F(compressor, mod_),
+    MLUA_SYM_F(decompressor, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.compress) {
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Compressor and Decompressor classes.
+    mlua_new_class(ls, Compressor_name, Compressor_syms, mlua_nosyms);
+    lua_pop(ls, 1);
+    mlua_new_class(ls, Decompressor_name, Decompressor_syms, mlua_nosyms);
+    lua_pop(ls, 1);
+    return 1;
+}
@@ -0,0 +1,125 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local compress = require 'mlua.compress'
+local errors = require 'mlua.errors'
+local fs = require 'mlua.fs'
+local oo = require 'mlua.oo'
+local table = require 'table'
+
+-- A stream that compresses the data written to it, and writes the compressed
+-- data to a wrapped stream.
+Writer = oo.class('Writer')
+
+function Writer:__init(stream, params)
+    self._stream, self._comp = stream, compress.compressor(params)
+end
+
+function Writer:stream() return self._stream end
+
+local function write_out(self, data)
+    if #data == 0 then return true end
+    local n, msg, err = self._stream:write(data)
+    if not n then return n, msg, err end
+    return true
+end
+
+function Writer:write(data)
+    local comp = self._comp
+    if not comp then return nil, "writer closed", errors.EBADF end
+    local ok, msg, err = write_out(self, comp:update(data))
+    if not ok then return ok, msg, err end
+    return #data
+end
+
+function Writer:close()
+    local comp = self._comp
+    if not comp then return true end
+    self._comp = nil
+    local ok, msg, err = write_out(self, comp:finish())
+    local stream = self._stream
+    if stream.close then
+        local cok, cmsg, cerr = stream:close()
+        if ok then ok, msg, err = cok, cmsg, cerr end
+    end
+    return ok, msg, err
+end
+
+Writer.__close = Writer.close
+
+-- A stream that reads compressed data from a wrapped stream, and returns the
+-- decompressed data.
+Reader = oo.class('Reader')
+
+function Reader:__init(stream, params, size)
+    self._stream, self._dec = stream, compress.decompressor(params)
+    self._size = size or 256
+    self._buf, self._pos = '', 1
+end
+
+function Reader:stream() return self._stream end
+
+-- Fill the buffer with decompressed data. Returns false at the end of the
+-- stream.
+local function fill(self, ...)
+    while self._pos > #self._buf do
+        local dec = self._dec
+        if not dec then return false end
+        local data, msg, err = self._stream:read(self._size, ...)
+        if not data then return data, msg, err end
+        if #data == 0 then
+            self._dec = nil
+            local ok; ok, msg = dec:finish()
+            if not ok then return ok, msg, errors.ECORRUPT end
+            return false
+        end
+        data, msg = dec:update(data)
+        if not data then
+            self._dec = nil
+            return data, msg, errors.ECORRUPT
+        end
+        self._buf, self._pos = data, 1
+    end
+    return true
+end
+
+function Reader:read(count, ...)
+    if count == nil then
+        local parts = {}
+        while true do
+            local ok, msg, err = fill(self, ...)
+            if ok == nil then return ok, msg, err end
+            if not ok then return table.concat(parts) end
+            table.insert(parts, self._buf:sub(self._pos))
+            self._pos = #self._buf + 1
+        end
+    end
+    local ok, msg, err = fill(self, ...)
+    if ok == nil then return ok, msg, err end
+    if not ok then return '' end
+    local pos = self._pos
+    self._pos = pos + count
+    return self._buf:sub(pos, pos + count - 1)
+end
+
+function Reader:close()
+    self._dec = nil
+    local stream = self._stream
+    if stream.close then return stream:close() end
+    return true
+end
+
+Reader.__close = Reader.close
+
+-- Open a compressed file on a filesystem. Returns a Reader if the file is
+-- opened for reading, and a Writer if it is opened for writing.
+function open(filesystem, path, flags, params, readahead)
+    local mode = flags & (fs.O_RDONLY | fs.O_WRONLY)
+    if mode ~= fs.O_RDONLY and mode ~= fs.O_WRONLY then
+        return nil, "unsupported open mode", errors.EINVAL
+    end
+    local f, msg, err = filesystem:open(path, flags, readahead)
+    if not f then return f, msg, err end
+    if mode == fs.O_RDONLY then return Reader(f, params) end
+    return Writer(f, params)
+end
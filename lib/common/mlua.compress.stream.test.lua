@@ -0,0 +1,124 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local block_mem = require 'mlua.block.mem'
+local compress = require 'mlua.compress'
+local errors = require 'mlua.errors'
+local stream = require 'mlua.compress.stream'
+local fs = require 'mlua.fs'
+local lfs = require 'mlua.fs.lfs'
+local mem = require 'mlua.mem'
+local oo = require 'mlua.oo'
+local math = require 'math'
+local string = require 'string'
+local table = require 'table'
+
+-- A stream that records writes, and returns reads of at most "size" bytes from
+-- the given data.
+local Stream = oo.class('Stream')
+
+function Stream:__init(data, size)
+    self.data, self.size, self.pos, self.writes = data or '', size, 1, {}
+end
+
+function Stream:read(count)
+    count = math.min(count, self.size or count)
+    local res = self.data:sub(self.pos, self.pos + count - 1)
+    self.pos = self.pos + #res
+    return res
+end
+
+function Stream:write(data)
+    table.insert(self.writes, data)
+    return #data
+end
+
+function Stream:close()
+    self.closed = true
+    return true
+end
+
+local function log_text(lines)
+    local parts = {}
+    for i = 1, lines do
+        table.insert(parts, ('%05d INFO event %d\n'):format(i, i % 13))
+    end
+    return table.concat(parts)
+end
+
+function test_Writer(t)
+    local data = log_text(100)
+    local s = Stream()
+    local w = stream.Writer(s)
+    t:expect(t.expr(w):stream()):eq(s)
+    for i = 1, #data, 50 do
+        t:expect(t.expr(w):write(data:sub(i, i + 49)))
+            :eq(math.min(50, #data - i + 1))
+    end
+    t:expect(t.expr(w):close()):eq(true)
+    t:expect(s.closed):label("closed"):eq(true)
+    t:expect(table.concat(s.writes)):label("output")
+        :eq(compress.compress(data))
+    t:expect(t.expr(w):close()):eq(true)
+    t:expect(t.mexpr(w):write('abc'))
+        :eq{nil, "writer closed", errors.EBADF, n = 3}
+
+    local full = Stream()
+    function full:write() return nil, "disk full", 28 end
+    w = stream.Writer(full, {window = 8, lookahead = 4})
+    t:expect(t.mexpr(w):write(('x'):rep(1000))):eq{nil, "disk full", 28, n = 3}
+end
+
+function test_Reader(t)
+    local data = log_text(100)
+    local params = {window = 8, lookahead = 4}
+    local z = compress.compress(data, 0, nil, params)
+    for _, size in ipairs{1, 5, 256} do
+        local s = Stream(z, size)
+        local r = stream.Reader(s, params, 16)
+        t:expect(t.expr(r):stream()):eq(s)
+        local parts = {}
+        while true do
+            local d = r:read(size)
+            t:assert(d, "read failed")
+            if #d == 0 then break end
+            t:assert(#d <= size, "read too much: %s", #d)
+            table.insert(parts, d)
+        end
+        t:expect(table.concat(parts)):label("read(%s)", size):eq(data)
+        t:expect(t.expr(r):read(1)):eq('')
+        t:expect(t.expr(r):close()):eq(true)
+        t:expect(s.closed):label("closed"):eq(true)
+    end
+    local r = stream.Reader(Stream(z), params)
+    t:expect(t.expr(r):read(10)):eq(data:sub(1, 10))
+    t:expect(t.expr(r):read()):eq(data:sub(11))
+
+    r = stream.Reader(Stream('\x80'), params)
+    t:expect(t.mexpr(r):read())
+        :eq{nil, "truncated data", errors.ECORRUPT, n = 3}
+    r = stream.Reader(Stream('\x00\x00'), params)
+    t:expect(t.mexpr(r):read(10))
+        :eq{nil, "invalid back-reference at offset 1", errors.ECORRUPT, n = 3}
+end
+
+function test_open(t)
+    local dev = block_mem.new(mem.alloc(64 << 10), 256, 256)
+    local f = lfs.new(dev)
+    assert(f:format())
+    assert(f:mount())
+    t:cleanup(function() f:unmount() end)
+
+    local data = log_text(500)
+    local w = assert(stream.open(f, '/log.z',
+                                 fs.O_WRONLY | fs.O_CREAT | fs.O_TRUNC))
+    t:expect(t.expr(w):write(data)):eq(#data)
+    t:expect(t.expr(w):close()):eq(true)
+    local _, _, size = assert(f:stat('/log.z'))
+    t:expect(size):label("size"):lt(#data // 2)
+
+    local r<close> = assert(stream.open(f, '/log.z', fs.O_RDONLY))
+    t:expect(t.expr(r):read()):eq(data)
+    t:expect(t.mexpr(stream).open(f, '/log.z', fs.O_RDWR))
+        :eq{nil, "unsupported open mode", errors.EINVAL, n = 3}
+end
@@ -0,0 +1,176 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local compress = require 'mlua.compress'
+local math = require 'math'
+local mem = require 'mlua.mem'
+local string = require 'string'
+local table = require 'table'
+
+-- Return log-like text, which compresses well.
+local function log_text(lines)
+    local parts = {}
+    for i = 1, lines do
+        table.insert(parts, ('%05d INFO sensor %d: temperature=%d.%02d\n')
+                            :format(i, i % 7, 20 + i % 5, i * 37 % 100))
+    end
+    return table.concat(parts)
+end
+
+-- Return pseudo-random data, which doesn't compress.
+local function random_data(len)
+    local parts, v = {}, 1
+    for i = 1, len do
+        v = (v * 1103515245 + 12345) & 0x7fffffff
+        parts[i] = string.char(v >> 16 & 0xff)
+    end
+    return table.concat(parts)
+end
+
+local params = {
+    {window = 4, lookahead = 3},
+    {window = 8, lookahead = 4},
+    {},
+    {window = 14, lookahead = 13},
+}
+
+function test_roundtrip(t)
+    local text, rnd = log_text(200), random_data(5000)
+    for _, data in ipairs{'', 'a', 'ab', ('x'):rep(1000), text, rnd,
+                          text .. rnd .. text} do
+        for _, p in ipairs(params) do
+            local z = compress.compress(data, 0, nil, p)
+            t:expect(t.expr(compress).decompress(z, 0, nil, p))
+                :label("decompress(compress(#%s, %s))", #data, p.window)
+                :eq(data)
+        end
+    end
+    local z = compress.compress(text)
+    t:expect(#z):label("#compress(text)"):lt(#text // 2)
+    t:expect(#compress.compress(rnd)):label("#compress(rnd)")
+        :lt(#rnd * 9 // 8 + 1)
+end
+
+function test_buffers(t)
+    local text = log_text(20)
+    local buf = mem.alloc(#text + 10)
+    mem.write(buf, text, 10)
+    local z = compress.compress(buf, 10)
+    t:expect(z):label("compress(buf)"):eq(compress.compress(text))
+    local zbuf = mem.alloc(#z)
+    mem.write(zbuf, z)
+    t:expect(t.expr(compress).decompress(zbuf)):eq(text)
+    t:expect(t.expr(compress).compress(buf, 11, #text))
+        :raises("out of bounds")
+end
+
+function test_params(t)
+    t:expect(t.expr(compress).compressor{window = 3})
+        :raises("invalid window")
+    t:expect(t.expr(compress).compressor{window = 15})
+        :raises("invalid window")
+    t:expect(t.expr(compress).compressor{window = 8, lookahead = 8})
+        :raises("invalid lookahead")
+    t:expect(t.expr(compress).decompressor{lookahead = 2})
+        :raises("invalid lookahead")
+end
+
+function test_streaming(t)
+    local data = log_text(300) .. random_data(3000) .. log_text(100)
+    for _, p in ipairs(params) do
+        local want = compress.compress(data, 0, nil, p)
+        for _, size in ipairs{1, 7, 100, 4096} do
+            local comp, parts = compress.compressor(p), {}
+            for i = 1, #data, size do
+                table.insert(parts, comp:update(data, i - 1,
+                                                math.min(size, #data - i + 1)))
+            end
+            table.insert(parts, comp:finish())
+            t:expect(table.concat(parts))
+                :label("compressor(%s, size=%s)", p.window, size):eq(want)
+
+            local dec = compress.decompressor(p)
+            parts = {}
+            for i = 1, #want, size do
+                table.insert(parts, dec:update(want:sub(i, i + size - 1)))
+            end
+            t:expect(t.expr(dec):finish()):eq(true)
+            t:expect(table.concat(parts))
+                :label("decompressor(%s, size=%s)", p.window, size):eq(data)
+        end
+    end
+
+    -- Compressors and decompressors are reset after finishing.
+    local comp, dec = compress.compressor(), compress.decompressor()
+    local z = comp:update('abcabcabc') .. comp:finish()
+    t:expect(comp:update('abcabcabc') .. comp:finish()):label("again"):eq(z)
+    t:expect(dec:update(z)):label("update"):eq('abcabcabc')
+    t:expect(t.expr(dec):finish()):eq(true)
+    t:expect(dec:update(z)):label("update again"):eq('abcabcabc')
+end
+
+function test_chunking(t)
+    -- The output doesn't depend on how the input is split across updates.
+    -- Random data over a two-letter alphabet has many short matches, which
+    -- end at arbitrary positions relative to the updates.
+    local data = random_data(600):gsub('.', function(c)
+        return c:byte() & 1 == 0 and 'a' or 'b'
+    end) .. log_text(20)
+    for _, p in ipairs{{window = 6, lookahead = 3}, {}} do
+        local want = compress.compress(data, 0, nil, p)
+        for size = 1, 64 do
+            local comp, parts = compress.compressor(p), {}
+            for i = 1, #data, size do
+                table.insert(parts, comp:update(data, i - 1,
+                                                math.min(size, #data - i + 1)))
+            end
+            table.insert(parts, comp:finish())
+            t:expect(table.concat(parts))
+                :label("compressor(%s, size=%s)", p.window, size):eq(want)
+        end
+    end
+end
+
+function test_errors(t)
+    local p = {window = 8, lookahead = 4}
+    t:expect(t.mexpr(compress).decompress('\x00\x00', 0, nil, p))
+        :eq{nil, "invalid back-reference at offset 1", n = 2}
+    local z = compress.compress(log_text(10))
+    t:expect(t.mexpr(compress).decompress(z:sub(1, -3)))
+        :eq{nil, "truncated data", n = 2}
+    local dec = compress.decompressor(p)
+    t:expect(t.expr(dec):update('\x80')):eq('')
+    t:expect(t.mexpr(dec):finish()):eq{nil, "truncated data", n = 2}
+    t:expect(t.expr(dec):update(compress.compress('abc', 0, nil, p)))
+        :eq('abc')
+    t:expect(t.expr(dec):finish()):eq(true)
+    t:expect(t.expr(dec):update('\x80')):eq('')
+    t:expect(t.expr(dec):reset()):eq(dec)
+    t:expect(t.expr(dec):finish()):eq(true)
+end
+
+local function bench_compress(b, data, p)
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do compress.compress(data, 0, nil, p) end
+end
+
+local function bench_decompress(b, data, p)
+    local z = compress.compress(data, 0, nil, p)
+    b:bytes(#data)
+    b:log("ratio: %.1f%%", 100 * #z / #data)
+    b:reset_timer()
+    for i = 1, b.n do compress.decompress(z, 0, nil, p) end
+end
+
+function bench_compress_w8(b) bench_compress(b, log_text(200), params[2]) end
+function bench_compress_w10(b) bench_compress(b, log_text(200), params[3]) end
+function bench_compress_random(b) bench_compress(b, random_data(8192)) end
+
+function bench_decompress_w8(b)
+    bench_decompress(b, log_text(200), params[2])
+end
+
+function bench_decompress_w10(b)
+    bench_decompress(b, log_text(200), params[3])
+end
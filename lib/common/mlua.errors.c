@@ -57,6 +57,7 @@ MLUA_SYMBOLS(module_syms) = {
     MLUA_SYM_V(ENOTDIR, integer, MLUA_ENOTDIR),
     MLUA_SYM_V(ENOTEMPTY, integer, MLUA_ENOTEMPTY),
     MLUA_SYM_V(EROFS, integer, MLUA_EROFS),
+    MLUA_SYM_V(ETIMEDOUT, integer, MLUA_ETIMEDOUT),
 
     MLUA_SYM_F(message, mod_),
 };
@@ -24,9 +24,27 @@
 static char const Filesystem_name[] = "mlua.fs.lfs.Filesystem";
 static char const File_name[] = "mlua.fs.lfs.File";
 static char const Dir_name[] = "mlua.fs.lfs.Dir";
+static char const Walk_name[] = "mlua.fs.lfs.Walk";
 
-#define LOOKAHEAD_SIZE 16
+// The default number of erase cycles before moving data to another block.
+#ifndef MLUA_FS_LFS_BLOCK_CYCLES
+#define MLUA_FS_LFS_BLOCK_CYCLES 500
+#endif
+
+// The maximum default size of the lookahead buffer. The default lookahead size
+// covers the whole device, up to this size.
+#ifndef MLUA_FS_LFS_LOOKAHEAD_MAX
+#define MLUA_FS_LFS_LOOKAHEAD_MAX 64
+#endif
+
+// The size of the buffer used to copy file content.
+#ifndef MLUA_FS_LFS_COPY_BUFFER_SIZE
+#define MLUA_FS_LFS_COPY_BUFFER_SIZE 512
+#endif
 
+// The buffers hold the lookahead buffer, followed by the read and program
+// caches. Their sizes are fixed when the filesystem is created, and the
+// configuration can use smaller sizes.
 typedef struct Filesystem {
     struct lfs_config config;
     lfs_t lfs;
@@ -34,20 +52,35 @@ typedef struct Filesystem {
     mutex_t mu;
 #endif
     bool mounted;
-    uint32_t lookahead_buffer[LOOKAHEAD_SIZE / sizeof(uint32_t)];
-    uint8_t buffers[0];
+    lfs_size_t cache_cap;
+    lfs_size_t lookahead_cap;
+    uint32_t buffers[];
 } Filesystem;
 
+// An open file. The buffer holds the file cache, followed by the optional
+// read-ahead buffer. The read-ahead data is in readahead[ra_pos:ra_len], and
+// the position of the littlefs file is at the end of that data.
 typedef struct File {
     lfs_file_t file;
     struct lfs_file_config config;
-    uint8_t buffer[0];
+    uint8_t* readahead;
+    lfs_size_t ra_size;
+    lfs_size_t ra_pos;
+    lfs_size_t ra_len;
+    uint8_t buffer[];
 } File;
 
 typedef struct Dir {
     lfs_dir_t dir;
 } Dir;
 
+// A recursive directory walk. The first user value is the filesystem, and the
+// second user value is a table holding the open directories and their paths
+// at odd and even indexes, respectively.
+typedef struct Walk {
+    int depth;
+} Walk;
+
 static inline MLuaBlockDev* fs_dev(Filesystem* fs) {
     return fs->config.context;
 }
@@ -161,7 +194,82 @@ static int fs_unlock(struct lfs_config const* c) {
 
 #endif  // LFS_THREADSAFE
 
-static void init_filesystem(Filesystem* fs, MLuaBlockDev* dev) {
+// Compute the default configuration for a block device.
+static void default_config(MLuaBlockDev* dev, struct lfs_config* c) {
+    c->read_size = dev->read_size;
+    c->prog_size = dev->write_size;
+    c->block_size = dev->erase_size;
+    c->block_cycles = MLUA_FS_LFS_BLOCK_CYCLES;
+    lfs_size_t cache = c->prog_size;
+    while (cache % c->read_size != 0) cache += c->prog_size;
+    c->cache_size = cache;
+    uint64_t blocks = dev->size / dev->erase_size;
+    uint64_t lookahead = ((blocks + 63) / 64) * 8;
+    if (lookahead > MLUA_FS_LFS_LOOKAHEAD_MAX) {
+        lookahead = MLUA_FS_LFS_LOOKAHEAD_MAX;
+    }
+    c->lookahead_size = lookahead;
+}
+
+static bool get_config_field(lua_State* ls, int arg, char const* name,
+                             lua_Integer* value) {
+    int isnum = 0;
+    if (lua_getfield(ls, arg, name) != LUA_TNIL) {
+        *value = lua_tointegerx(ls, -1, &isnum);
+        if (!isnum) luaL_error(ls, "invalid %s", name);
+    }
+    lua_pop(ls, 1);
+    return isnum;
+}
+
+// Update a configuration from the fields of the table at the given index, if
+// it isn't nil, and validate it. If "fs" isn't NULL, the cache and lookahead
+// sizes must fit into its buffers.
+static void check_config(lua_State* ls, int arg, MLuaBlockDev* dev,
+                         Filesystem* fs, struct lfs_config* c) {
+    if (lua_isnoneornil(ls, arg)) return;
+    luaL_checktype(ls, arg, LUA_TTABLE);
+    lua_Integer v;
+    if (get_config_field(ls, arg, "read_size", &v)) {
+        if (v <= 0 || v % dev->read_size != 0) {
+            luaL_error(ls, "invalid read_size");
+        }
+        c->read_size = v;
+    }
+    if (get_config_field(ls, arg, "prog_size", &v)) {
+        if (v <= 0 || v % dev->write_size != 0) {
+            luaL_error(ls, "invalid prog_size");
+        }
+        c->prog_size = v;
+    }
+    if (get_config_field(ls, arg, "cache_size", &v)) c->cache_size = v;
+    if (c->cache_size == 0 || c->cache_size % c->read_size != 0
+            || c->cache_size % c->prog_size != 0
+            || c->block_size % c->cache_size != 0) {
+        luaL_error(ls, "invalid cache_size");
+    }
+    if (fs != NULL && c->cache_size > fs->cache_cap) {
+        luaL_error(ls, "cache_size larger than allocated");
+    }
+    if (get_config_field(ls, arg, "lookahead_size", &v)) {
+        if (v <= 0 || v % 8 != 0) luaL_error(ls, "invalid lookahead_size");
+        if (fs != NULL && (lfs_size_t)v > fs->lookahead_cap) {
+            luaL_error(ls, "lookahead_size larger than allocated");
+        }
+        c->lookahead_size = v;
+    }
+    if (get_config_field(ls, arg, "block_cycles", &v)) {
+        if (v == 0 || v < -1) luaL_error(ls, "invalid block_cycles");
+        c->block_cycles = v;
+    }
+}
+
+static inline size_t buffers_size(struct lfs_config const* c) {
+    return c->lookahead_size + 2 * c->cache_size;
+}
+
+static void init_filesystem(Filesystem* fs, MLuaBlockDev* dev,
+                            struct lfs_config const* c) {
     memset(fs, 0, sizeof(*fs));
     fs->config.context = dev;
     fs->config.read = &fs_read;
@@ -173,15 +281,25 @@ static void init_filesystem(Filesystem* fs, MLuaBlockDev* dev) {
     fs->config.lock = &fs_lock;
     fs->config.unlock = &fs_unlock;
 #endif
-    fs->config.read_size = dev->read_size;
-    fs->config.prog_size = dev->write_size;
-    fs->config.block_size = dev->erase_size;
-    fs->config.block_cycles = 500;
-    fs->config.cache_size = fs->config.prog_size;
-    fs->config.lookahead_size = LOOKAHEAD_SIZE;
-    fs->config.read_buffer = fs->buffers;
-    fs->config.prog_buffer = &fs->buffers[fs->config.cache_size];
-    fs->config.lookahead_buffer = fs->lookahead_buffer;
+    fs->config.read_size = c->read_size;
+    fs->config.prog_size = c->prog_size;
+    fs->config.block_size = c->block_size;
+    fs->config.block_cycles = c->block_cycles;
+    fs->config.cache_size = c->cache_size;
+    fs->config.lookahead_size = c->lookahead_size;
+    fs->cache_cap = c->cache_size;
+    fs->lookahead_cap = c->lookahead_size;
+    uint8_t* buffers = (uint8_t*)fs->buffers;
+    fs->config.lookahead_buffer = buffers;
+    fs->config.read_buffer = buffers + fs->lookahead_cap;
+    fs->config.prog_buffer = buffers + fs->lookahead_cap + fs->cache_cap;
+}
+
+// Apply the configuration at the given index to a filesystem.
+static void apply_config(lua_State* ls, int arg, Filesystem* fs) {
+    struct lfs_config c = fs->config;
+    check_config(ls, arg, fs_dev(fs), fs, &c);
+    fs->config = c;
 }
 
 static inline Filesystem* check_Filesystem(lua_State* ls, int arg) {
@@ -219,6 +337,7 @@ static int Filesystem_format(lua_State* ls) {
     Filesystem* fs = check_Filesystem(ls, 1);
     if (fs->mounted) return mlua_err_push(ls, MLUA_EBUSY);
     lfs_size_t blocks = check_blocks(ls, fs, 2);
+    apply_config(ls, 3, fs);
     fs->config.block_count = blocks;
     return push_lfs_result_bool(ls, lfs_format(&fs->lfs, &fs->config));
 #endif
@@ -227,6 +346,7 @@ static int Filesystem_format(lua_State* ls) {
 static int Filesystem_mount(lua_State* ls) {
     Filesystem* fs = check_Filesystem(ls, 1);
     if (fs->mounted) return mlua_err_push(ls, MLUA_EBUSY);
+    apply_config(ls, 2, fs);
     // TODO: Mounting can cause hard exceptions. Attempt to identify that a
     // filesystem is actually present before mounting, e.g. look for "littlefs".
     int res = lfs_mount(&fs->lfs, &fs->config);
@@ -264,6 +384,26 @@ static int Filesystem_grow(lua_State* ls) {
 #endif
 }
 
+static int Filesystem_config(lua_State* ls) {
+    Filesystem* fs = check_Filesystem(ls, 1);
+    lua_createtable(ls, 0, 7);
+    lua_pushinteger(ls, fs->config.read_size);
+    lua_setfield(ls, -2, "read_size");
+    lua_pushinteger(ls, fs->config.prog_size);
+    lua_setfield(ls, -2, "prog_size");
+    lua_pushinteger(ls, fs->config.block_size);
+    lua_setfield(ls, -2, "block_size");
+    lua_pushinteger(ls, fs->config.block_count);
+    lua_setfield(ls, -2, "block_count");
+    lua_pushinteger(ls, fs->config.block_cycles);
+    lua_setfield(ls, -2, "block_cycles");
+    lua_pushinteger(ls, fs->config.cache_size);
+    lua_setfield(ls, -2, "cache_size");
+    lua_pushinteger(ls, fs->config.lookahead_size);
+    lua_setfield(ls, -2, "lookahead_size");
+    return 1;
+}
+
 static int Filesystem_statvfs(lua_State* ls) {
     Filesystem* fs = check_Filesystem(ls, 1);
     if (!fs->mounted) return mlua_err_push(ls, MLUA_ENOTCONN);
@@ -321,6 +461,10 @@ static int Filesystem_open(lua_State* ls) {
     if (!fs->mounted) return mlua_err_push(ls, MLUA_ENOTCONN);
     char const* path = luaL_checkstring(ls, 2);
     int flags = luaL_checkinteger(ls, 3);
+    lua_Integer ra_size = luaL_optinteger(ls, 4, 0);
+    luaL_argcheck(
+        ls, 0 <= ra_size && (lua_Unsigned)ra_size <= (lfs_size_t)-1, 4,
+        "invalid read-ahead size");
 
 #ifdef LFS_READONLY
     if (flags & (MLUA_FS_O_WRONLY | MLUA_FS_O_CREAT | MLUA_FS_O_EXCL
@@ -329,9 +473,12 @@ static int Filesystem_open(lua_State* ls) {
     }
 #endif
 
-    File* f = lua_newuserdatauv(ls, sizeof(File) + fs_dev(fs)->write_size, 1);
+    File* f = lua_newuserdatauv(
+        ls, sizeof(File) + fs->config.cache_size + ra_size, 1);
     memset(f, 0, sizeof(File));
     f->config.buffer = f->buffer;
+    f->readahead = f->buffer + fs->config.cache_size;
+    f->ra_size = ra_size;
     int res = lfs_file_opencfg(&fs->lfs, &f->file, path, from_open_flags(flags),
                                &f->config);
     if (res < 0) return push_error(ls, res);
@@ -342,6 +489,50 @@ static int Filesystem_open(lua_State* ls) {
     return 1;
 }
 
+// Open a directory of the filesystem at the given index, and push it. Returns
+// a negative error code on failure, in which case nothing is pushed.
+static int push_dir(lua_State* ls, int fs_arg, char const* path) {
+    Filesystem* fs = to_Filesystem(ls, fs_arg);
+    Dir* d = lua_newuserdatauv(ls, sizeof(Dir), 1);
+    memset(d, 0, sizeof(Dir));
+    int res = lfs_dir_open(&fs->lfs, &d->dir, path);
+    if (res < 0) return lua_pop(ls, 1), res;
+    luaL_getmetatable(ls, Dir_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, fs_arg);  // Keep fs alive
+    lua_setiuservalue(ls, -2, 1);
+    return LFS_ERR_OK;
+}
+
+// Close the directory at the given index, if it isn't closed already.
+static int close_dir(lua_State* ls, int arg) {
+    arg = lua_absindex(ls, arg);
+    Dir* d = lua_touserdata(ls, arg);
+    if (lua_getiuservalue(ls, arg, 1) == LUA_TNIL) {  // Already closed
+        return lua_pop(ls, 1), LFS_ERR_OK;
+    }
+    Filesystem* fs = to_Filesystem(ls, -1);
+    lua_pop(ls, 1);
+    lua_pushnil(ls);  // Mark as closed
+    lua_setiuservalue(ls, arg, 1);
+    return lfs_dir_close(&fs->lfs, &d->dir);
+}
+
+// Push the path of an entry in a directory.
+static void push_child_path(lua_State* ls, char const* dir, char const* name) {
+    size_t len = strlen(dir);
+    if (len > 0 && dir[len - 1] == '/') {
+        lua_pushfstring(ls, "%s%s", dir, name);
+    } else {
+        lua_pushfstring(ls, "%s/%s", dir, name);
+    }
+}
+
+static inline bool is_dot_entry(char const* name) {
+    return name[0] == '.'
+           && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
 static int Dir_next(lua_State* ls);
 
 static int Filesystem_list(lua_State* ls) {
@@ -350,19 +541,191 @@ static int Filesystem_list(lua_State* ls) {
     char const* path = luaL_checkstring(ls, 2);
 
     lua_pushcfunction(ls, &Dir_next);  // Iterator function
-    Dir* d = lua_newuserdatauv(ls, sizeof(Dir), 1);  // State
-    memset(d, 0, sizeof(Dir));
-    int res = lfs_dir_open(&fs->lfs, &d->dir, path);
+    int res = push_dir(ls, 1, path);  // State
     if (res < 0) return push_error(ls, res);
-    luaL_getmetatable(ls, Dir_name);
+    lua_pushnil(ls);  // Control variable
+    lua_pushvalue(ls, -2);  // Closing value
+    return 4;
+}
+
+static int Walk_next(lua_State* ls);
+
+static int Filesystem_walk(lua_State* ls) {
+    Filesystem* fs = check_Filesystem(ls, 1);
+    if (!fs->mounted) return mlua_err_push(ls, MLUA_ENOTCONN);
+    char const* path = luaL_optstring(ls, 2, "/");
+    lua_settop(ls, 2);
+
+    lua_pushcfunction(ls, &Walk_next);  // Iterator function
+    Walk* w = lua_newuserdatauv(ls, sizeof(Walk), 2);  // State
+    w->depth = 0;
+    luaL_getmetatable(ls, Walk_name);
     lua_setmetatable(ls, -2);
     lua_pushvalue(ls, 1);  // Keep fs alive
     lua_setiuservalue(ls, -2, 1);
+    lua_createtable(ls, 8, 0);
+    int res = push_dir(ls, 1, path);
+    if (res < 0) return push_error(ls, res);
+    lua_rawseti(ls, -2, 1);
+    lua_pushstring(ls, path);
+    lua_rawseti(ls, -2, 2);
+    lua_setiuservalue(ls, -2, 2);
+    w->depth = 1;
     lua_pushnil(ls);  // Control variable
     lua_pushvalue(ls, -2);  // Closing value
     return 4;
 }
 
+#ifndef LFS_READONLY
+
+// The state of a copy operation. The buffer holds the file caches of the
+// source and destination files, followed by the copy buffer.
+typedef struct Copy {
+    Filesystem* src_fs;
+    Filesystem* dst_fs;
+    lfs_file_t src;
+    lfs_file_t dst;
+    struct lfs_file_config src_config;
+    struct lfs_file_config dst_config;
+    uint8_t* data;
+    uint8_t buffer[];
+} Copy;
+
+static Copy* new_copy(lua_State* ls, Filesystem* src_fs, Filesystem* dst_fs) {
+    lfs_size_t src_cache = src_fs->config.cache_size;
+    lfs_size_t dst_cache = dst_fs->config.cache_size;
+    Copy* c = lua_newuserdatauv(
+        ls, sizeof(Copy) + src_cache + dst_cache + MLUA_FS_LFS_COPY_BUFFER_SIZE,
+        0);
+    memset(c, 0, sizeof(Copy));
+    c->src_fs = src_fs;
+    c->dst_fs = dst_fs;
+    c->src_config.buffer = c->buffer;
+    c->dst_config.buffer = c->buffer + src_cache;
+    c->data = c->buffer + src_cache + dst_cache;
+    return c;
+}
+
+// Copy the content of a file, streaming it through the copy buffer.
+static int copy_file(Copy* c, char const* src, char const* dst) {
+    if (c->src_fs == c->dst_fs && strcmp(src, dst) == 0) return LFS_ERR_INVAL;
+    int res = lfs_file_opencfg(&c->src_fs->lfs, &c->src, src, LFS_O_RDONLY,
+                               &c->src_config);
+    if (res < 0) return res;
+    res = lfs_file_opencfg(&c->dst_fs->lfs, &c->dst, dst,
+                           LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC,
+                           &c->dst_config);
+    if (res < 0) {
+        lfs_file_close(&c->src_fs->lfs, &c->src);
+        return res;
+    }
+    for (;;) {
+        lfs_ssize_t cnt = lfs_file_read(&c->src_fs->lfs, &c->src, c->data,
+                                        MLUA_FS_LFS_COPY_BUFFER_SIZE);
+        if (cnt <= 0) {
+            res = cnt;
+            break;
+        }
+        cnt = lfs_file_write(&c->dst_fs->lfs, &c->dst, c->data, cnt);
+        if (cnt < 0) {
+            res = cnt;
+            break;
+        }
+    }
+    int cres = lfs_file_close(&c->dst_fs->lfs, &c->dst);
+    if (res >= 0) res = cres;
+    lfs_file_close(&c->src_fs->lfs, &c->src);
+    return res;
+}
+
+// Copy a directory tree recursively. The filesystems are at the given indexes,
+// and the source and destination paths are at the top of the stack.
+static int copy_tree(lua_State* ls, Copy* c, int src_arg, int dst_arg) {
+    luaL_checkstack(ls, 4, NULL);
+    char const* src = lua_tostring(ls, -2);
+    char const* dst = lua_tostring(ls, -1);
+    int res = lfs_mkdir(&c->dst_fs->lfs, dst);
+    if (res < 0 && res != LFS_ERR_EXIST) return res;
+    res = push_dir(ls, src_arg, src);
+    if (res < 0) return res;
+    int dir = lua_gettop(ls);
+    Dir* d = lua_touserdata(ls, dir);
+    struct lfs_info info;
+    while ((res = lfs_dir_read(&c->src_fs->lfs, &d->dir, &info)) > 0) {
+        if (is_dot_entry(info.name)) continue;
+        push_child_path(ls, src, info.name);
+        push_child_path(ls, dst, info.name);
+        if (info.type == LFS_TYPE_DIR) {
+            res = copy_tree(ls, c, src_arg, dst_arg);
+        } else {
+            res = copy_file(c, lua_tostring(ls, -2), lua_tostring(ls, -1));
+        }
+        lua_pop(ls, 2);
+        if (res < 0) break;
+    }
+    int cres = close_dir(ls, dir);
+    lua_pop(ls, 1);
+    return res < 0 ? res : cres;
+}
+
+// Check that a path isn't inside a directory.
+static bool is_inside(char const* path, char const* dir) {
+    size_t len = strlen(dir);
+    while (len > 0 && dir[len - 1] == '/') --len;
+    return strncmp(path, dir, len) == 0
+           && (path[len] == '\0' || path[len] == '/');
+}
+
+#endif  // !LFS_READONLY
+
+// Check the destination filesystem argument of a copy operation.
+static Filesystem* check_dst_fs(lua_State* ls, int arg) {
+    if (lua_isnoneornil(ls, arg)) {
+        lua_settop(ls, arg - 1);
+        lua_pushvalue(ls, 1);
+    }
+    Filesystem* fs = check_Filesystem(ls, arg);
+    lua_settop(ls, arg);
+    return fs;
+}
+
+static int Filesystem_copy(lua_State* ls) {
+#ifdef LFS_READONLY
+    return mlua_err_push(ls, MLUA_EROFS);
+#else
+    Filesystem* fs = check_Filesystem(ls, 1);
+    char const* src = luaL_checkstring(ls, 2);
+    char const* dst = luaL_checkstring(ls, 3);
+    Filesystem* dst_fs = check_dst_fs(ls, 4);
+    if (!fs->mounted || !dst_fs->mounted) {
+        return mlua_err_push(ls, MLUA_ENOTCONN);
+    }
+    Copy* c = new_copy(ls, fs, dst_fs);
+    return push_lfs_result_bool(ls, copy_file(c, src, dst));
+#endif
+}
+
+static int Filesystem_copy_tree(lua_State* ls) {
+#ifdef LFS_READONLY
+    return mlua_err_push(ls, MLUA_EROFS);
+#else
+    Filesystem* fs = check_Filesystem(ls, 1);
+    char const* src = luaL_checkstring(ls, 2);
+    char const* dst = luaL_checkstring(ls, 3);
+    Filesystem* dst_fs = check_dst_fs(ls, 4);
+    if (!fs->mounted || !dst_fs->mounted) {
+        return mlua_err_push(ls, MLUA_ENOTCONN);
+    }
+    if (fs == dst_fs && is_inside(dst, src)) {
+        return mlua_err_push(ls, MLUA_EINVAL);
+    }
+    Copy* c = new_copy(ls, fs, dst_fs);
+    lua_pushvalue(ls, 2);
+    lua_pushvalue(ls, 3);
+    return push_lfs_result_bool(ls, copy_tree(ls, c, 1, 4));
+#endif
+}
+
 static int Filesystem_stat(lua_State* ls) {
     Filesystem* fs = check_Filesystem(ls, 1);
     if (!fs->mounted) return mlua_err_push(ls, MLUA_ENOTCONN);
@@ -470,6 +833,7 @@ MLUA_SYMBOLS(Filesystem_syms) = {
     MLUA_SYM_F(mount, Filesystem_),
     MLUA_SYM_F(unmount, Filesystem_),
     MLUA_SYM_F(is_mounted, Filesystem_),
+    MLUA_SYM_F(config, Filesystem_),
     MLUA_SYM_F(grow, Filesystem_),
     MLUA_SYM_F(statvfs, Filesystem_),
     MLUA_SYM_F(size, Filesystem_),
@@ -478,6 +842,7 @@ MLUA_SYMBOLS(Filesystem_syms) = {
     MLUA_SYM_F(mkconsistent, Filesystem_),
     MLUA_SYM_F(open, Filesystem_),
     MLUA_SYM_F(list, Filesystem_),
+    MLUA_SYM_F(walk, Filesystem_),
     MLUA_SYM_F(stat, Filesystem_),
     MLUA_SYM_F(getattr, Filesystem_),
     MLUA_SYM_F(setattr, Filesystem_),
@@ -485,6 +850,8 @@ MLUA_SYMBOLS(Filesystem_syms) = {
     MLUA_SYM_F(mkdir, Filesystem_),
     MLUA_SYM_F(remove, Filesystem_),
     MLUA_SYM_F(rename, Filesystem_),
+    MLUA_SYM_F(copy, Filesystem_),
+    MLUA_SYM_F(copy_tree, Filesystem_),
 #if !defined(LFS_READONLY) && defined(LFS_MIGRATE)
     MLUA_SYM_F(migrate, Filesystem_),
 #else
@@ -519,31 +886,89 @@ static int File_close(lua_State* ls) {
     return push_lfs_result_bool(ls, lfs_file_close(&fs->lfs, &f->file));
 }
 
+// Discard the read-ahead data, and move the file position back to the
+// position seen by the user.
+static int drop_readahead(Filesystem* fs, File* f) {
+    lfs_size_t avail = f->ra_len - f->ra_pos;
+    f->ra_pos = f->ra_len = 0;
+    if (avail == 0) return LFS_ERR_OK;
+    lfs_soff_t res = lfs_file_seek(&fs->lfs, &f->file, -(lfs_soff_t)avail,
+                                   LFS_SEEK_CUR);
+    return res < 0 ? res : LFS_ERR_OK;
+}
+
+// Check that the argument is an open file, and discard its read-ahead data.
+#define CHECK_FILE_DROP_READAHEAD(ls, arg, fs, f) \
+    Filesystem* fs = NULL; \
+    File* f = check_File(ls, arg, &fs); \
+    do { \
+        int res = drop_readahead(fs, f); \
+        if (res < 0) return push_error(ls, res); \
+    } while (0)
+
 static int File_sync(lua_State* ls) {
-    Filesystem* fs = NULL;
-    File* f = check_File(ls, 1, &fs);
+    CHECK_FILE_DROP_READAHEAD(ls, 1, fs, f);
     return push_lfs_result_bool(ls, lfs_file_sync(&fs->lfs, &f->file));
 }
 
 static int File_read(lua_State* ls) {
     Filesystem* fs = NULL;
     File* f = check_File(ls, 1, &fs);
-    // TODO: Make size optional
-    // TODO: Use file size as maximum buffer size
-    lfs_size_t size = luaL_checkinteger(ls, 2);
+
+    // Limit the read to the remaining data in the file.
+    lfs_soff_t fsize = lfs_file_size(&fs->lfs, &f->file);
+    if (fsize < 0) return push_error(ls, fsize);
+    lfs_soff_t pos = lfs_file_tell(&fs->lfs, &f->file);
+    if (pos < 0) return push_error(ls, pos);
+    pos -= f->ra_len - f->ra_pos;
+    lfs_size_t size = fsize > pos ? fsize - pos : 0;
+    if (!lua_isnoneornil(ls, 2)) {
+        lua_Integer len = luaL_checkinteger(ls, 2);
+        luaL_argcheck(ls, len >= 0, 2, "invalid size");
+        if ((lua_Unsigned)len < size) size = len;
+    }
     luaL_Buffer buf;
-    void* dst = luaL_buffinitsize(ls, &buf, size);
-    lfs_ssize_t res = lfs_file_read(&fs->lfs, &f->file, dst, size);
-    if (res < 0) return push_error(ls, res);
-    return luaL_pushresultsize(&buf, res), 1;
+    uint8_t* dst = (uint8_t*)luaL_buffinitsize(ls, &buf, size);
+    if (f->ra_size == 0) {
+        lfs_ssize_t res = lfs_file_read(&fs->lfs, &f->file, dst, size);
+        if (res < 0) return push_error(ls, res);
+        return luaL_pushresultsize(&buf, res), 1;
+    }
+
+    // Serve the read from the read-ahead buffer, refilling it as needed. Reads
+    // at least as large as the buffer bypass it.
+    lfs_size_t cnt = 0;
+    while (cnt < size) {
+        lfs_size_t avail = f->ra_len - f->ra_pos;
+        if (avail == 0) {
+            lfs_size_t rem = size - cnt;
+            if (rem >= f->ra_size) {
+                lfs_ssize_t res = lfs_file_read(&fs->lfs, &f->file, dst + cnt,
+                                                rem);
+                if (res < 0) return push_error(ls, res);
+                cnt += res;
+                break;
+            }
+            lfs_ssize_t res = lfs_file_read(&fs->lfs, &f->file, f->readahead,
+                                            f->ra_size);
+            if (res < 0) return push_error(ls, res);
+            if (res == 0) break;
+            f->ra_pos = 0;
+            f->ra_len = avail = res;
+        }
+        lfs_size_t n = size - cnt < avail ? size - cnt : avail;
+        memcpy(dst + cnt, f->readahead + f->ra_pos, n);
+        f->ra_pos += n;
+        cnt += n;
+    }
+    return luaL_pushresultsize(&buf, cnt), 1;
 }
 
 static int File_write(lua_State* ls) {
 #ifdef LFS_READONLY
     return mlua_err_push(ls, MLUA_EROFS);
 #else
-    Filesystem* fs = NULL;
-    File* f = check_File(ls, 1, &fs);
+    CHECK_FILE_DROP_READAHEAD(ls, 1, fs, f);
     size_t size;
     void const* src = luaL_checklstring(ls, 2, &size);
     lfs_ssize_t res = lfs_file_write(&fs->lfs, &f->file, src, size);
@@ -553,8 +978,7 @@ static int File_write(lua_State* ls) {
 }
 
 static int File_seek(lua_State* ls) {
-    Filesystem* fs = NULL;
-    File* f = check_File(ls, 1, &fs);
+    CHECK_FILE_DROP_READAHEAD(ls, 1, fs, f);
     lfs_soff_t off = luaL_checkinteger(ls, 2);
     int whence = luaL_optinteger(ls, 3, MLUA_FS_SEEK_SET);
     return push_lfs_result_int(ls,
@@ -564,12 +988,15 @@ static int File_seek(lua_State* ls) {
 static int File_tell(lua_State* ls) {
     Filesystem* fs = NULL;
     File* f = check_File(ls, 1, &fs);
-    return push_lfs_result_int(ls, lfs_file_tell(&fs->lfs, &f->file));
+    lfs_soff_t res = lfs_file_tell(&fs->lfs, &f->file);
+    if (res >= 0) res -= f->ra_len - f->ra_pos;
+    return push_lfs_result_int(ls, res);
 }
 
 static int File_rewind(lua_State* ls) {
     Filesystem* fs = NULL;
     File* f = check_File(ls, 1, &fs);
+    f->ra_pos = f->ra_len = 0;
     return push_lfs_result_int(ls, lfs_file_rewind(&fs->lfs, &f->file));
 }
 
@@ -583,8 +1010,7 @@ static int File_truncate(lua_State* ls) {
 #ifdef LFS_READONLY
     return mlua_err_push(ls, MLUA_EROFS);
 #else
-    Filesystem* fs = NULL;
-    File* f = check_File(ls, 1, &fs);
+    CHECK_FILE_DROP_READAHEAD(ls, 1, fs, f);
     lfs_off_t size = luaL_checkinteger(ls, 2);
     return push_lfs_result_bool(ls,
         lfs_file_truncate(&fs->lfs, &f->file, size));
@@ -622,14 +1048,8 @@ static inline Dir* check_Dir(lua_State* ls, int arg, Filesystem** fs) {
 }
 
 static int Dir___close(lua_State* ls) {
-    Dir* d = luaL_checkudata(ls, 1, Dir_name);
-    if (lua_getiuservalue(ls, 1, 1) == LUA_TNIL) {  // Already closed
-        return lua_pushboolean(ls, true), 1;
-    }
-    Filesystem* fs = to_Filesystem(ls, -1);
-    lua_pushnil(ls);  // Mark as closed
-    lua_setiuservalue(ls, 1, 1);
-    return push_lfs_result_bool(ls, lfs_dir_close(&fs->lfs, &d->dir));
+    luaL_checkudata(ls, 1, Dir_name);
+    return push_lfs_result_bool(ls, close_dir(ls, 1));
 }
 
 static int Dir_next(lua_State* ls) {
@@ -657,9 +1077,83 @@ MLUA_SYMBOLS_NOHASH(Dir_syms_nh) = {
     MLUA_SYM_F_NH(__gc, Dir_),
 };
 
+// Close the directories of a walk down to the given depth.
+static int close_walk(lua_State* ls, Walk* w, int depth) {
+    int res = LFS_ERR_OK;
+    if (w->depth <= depth) return res;
+    lua_getiuservalue(ls, 1, 2);
+    for (; w->depth > depth; --w->depth) {
+        lua_rawgeti(ls, -1, 2 * w->depth - 1);
+        int cres = close_dir(ls, -1);
+        if (res >= 0) res = cres;
+        lua_pop(ls, 1);
+        lua_pushnil(ls);
+        lua_rawseti(ls, -2, 2 * w->depth - 1);
+        lua_pushnil(ls);
+        lua_rawseti(ls, -2, 2 * w->depth);
+    }
+    lua_pop(ls, 1);
+    return res;
+}
+
+static int Walk_next(lua_State* ls) {
+    Walk* w = luaL_checkudata(ls, 1, Walk_name);
+    lua_settop(ls, 1);
+    lua_getiuservalue(ls, 1, 1);  // fs: 2
+    Filesystem* fs = to_Filesystem(ls, 2);
+    lua_getiuservalue(ls, 1, 2);  // stack: 3
+    struct lfs_info info;
+    while (w->depth > 0) {
+        lua_rawgeti(ls, 3, 2 * w->depth - 1);
+        Dir* d = lua_touserdata(ls, -1);
+        lua_pop(ls, 1);
+        int res = lfs_dir_read(&fs->lfs, &d->dir, &info);
+        if (res < 0) {
+            lua_pushstring(ls, mlua_err_msg(mlua_err(res)));
+            return lua_error(ls);
+        }
+        if (res == 0) {
+            close_walk(ls, w, w->depth - 1);
+            continue;
+        }
+        if (is_dot_entry(info.name)) continue;
+
+        // Push the path of the entry, and descend into directories.
+        lua_rawgeti(ls, 3, 2 * w->depth);
+        push_child_path(ls, lua_tostring(ls, -1), info.name);
+        lua_replace(ls, -2);
+        if (info.type == LFS_TYPE_DIR) {
+            res = push_dir(ls, 2, lua_tostring(ls, -1));
+            if (res < 0) {
+                lua_pushstring(ls, mlua_err_msg(mlua_err(res)));
+                return lua_error(ls);
+            }
+            ++w->depth;
+            lua_rawseti(ls, 3, 2 * w->depth - 1);
+            lua_pushvalue(ls, -1);
+            lua_rawseti(ls, 3, 2 * w->depth);
+        }
+        lua_pushinteger(ls, to_file_type(info.type));
+        if (info.type != LFS_TYPE_REG) return 2;
+        return lua_pushinteger(ls, info.size), 3;
+    }
+    return 0;
+}
+
+static int Walk___close(lua_State* ls) {
+    Walk* w = luaL_checkudata(ls, 1, Walk_name);
+    return push_lfs_result_bool(ls, close_walk(ls, w, 0));
+}
+
+MLUA_SYMBOLS_NOHASH(Walk_syms_nh) = {
+    MLUA_SYM_F_NH(__close, Walk_),
+};
+
 void* mlua_fs_lfs_alloc(MLuaBlockDev* dev) {
-    Filesystem* fs = malloc(sizeof(Filesystem) + 2 * dev->write_size);
-    init_filesystem(fs, dev);
+    struct lfs_config c;
+    default_config(dev, &c);
+    Filesystem* fs = malloc(sizeof(Filesystem) + buffers_size(&c));
+    init_filesystem(fs, dev, &c);
     return fs;
 }
 
@@ -679,13 +1173,16 @@ void mlua_fs_lfs_push(lua_State* ls, void* fs) {
 
 static int mod_new(lua_State* ls) {
     MLuaBlockDev* dev = mlua_block_check(ls, 1);
+    struct lfs_config c;
+    default_config(dev, &c);
+    check_config(ls, 2, dev, NULL, &c);
     Filesystem* fs = lua_newuserdatauv(
-        ls, sizeof(Filesystem) + 2 * dev->write_size, 1);
+        ls, sizeof(Filesystem) + buffers_size(&c), 1);
     luaL_getmetatable(ls, Filesystem_name);
     lua_setmetatable(ls, -2);
     lua_pushvalue(ls, 1);  // Keep dev alive
     lua_setiuservalue(ls, -2, 1);
-    init_filesystem(fs, dev);
+    init_filesystem(fs, dev, &c);
     return 1;
 }
 
@@ -715,6 +1212,10 @@ MLUA_OPEN_MODULE(mlua.fs.lfs) {
     mlua_new_class(ls, Dir_name, Dir_syms, Dir_syms_nh);
     lua_pop(ls, 1);
 
+    // Create the Walk class.
+    mlua_new_class(ls, Walk_name, mlua_nosyms, Walk_syms_nh);
+    lua_pop(ls, 1);
+
     // Create the module.
     mlua_new_module(ls, 0, module_syms);
     return 1;
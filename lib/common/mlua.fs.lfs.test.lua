@@ -24,7 +24,7 @@ function set_up(t)
              (dv >> 16) & 0xffff, dv & 0xffff)
 
     -- Create a filesystem in RAM.
-    dev = block_mem.new(mem.alloc(32 << 10, 256, 256))
+    dev = block_mem.new(mem.alloc(32 << 10), 256, 256)
     local size = dev:size()
     dfs = lfs.new(dev)
     t:expect(t.mexpr(dfs):mkdir('/dir'))
@@ -41,6 +41,48 @@ function set_up(t)
     write_file('/dir/sub/file', '123')
 end
 
+function test_config(t)
+    local d = block_mem.new(mem.alloc(64 << 10), 64, 1024)
+    local f = lfs.new(d)
+    t:expect(t.expr(f):config()):eq{
+        read_size = 1, prog_size = 64, block_size = 1024, block_count = 0,
+        block_cycles = 500, cache_size = 64, lookahead_size = 8,
+    }
+    f = lfs.new(d, {read_size = 16, prog_size = 128, cache_size = 256,
+                    lookahead_size = 16, block_cycles = -1})
+    t:expect(t.expr(f):config()):eq{
+        read_size = 16, prog_size = 128, block_size = 1024, block_count = 0,
+        block_cycles = -1, cache_size = 256, lookahead_size = 16,
+    }
+    t:expect(t.expr(f):format(nil, {cache_size = 128, block_cycles = 100}))
+        :eq(true)
+    t:expect(t.expr(f):mount({lookahead_size = 8})):eq(true)
+    t:cleanup(function() f:unmount() end)
+    local cfg = f:config()
+    t:expect(cfg.cache_size):label("cache_size"):eq(128)
+    t:expect(cfg.lookahead_size):label("lookahead_size"):eq(8)
+    t:expect(cfg.block_count):label("block_count"):eq(64)
+    t:expect(cfg.block_cycles):label("block_cycles"):eq(100)
+    f:unmount()
+
+    for _, test in ipairs{
+        {{read_size = 0}, "invalid read_size"},
+        {{prog_size = 48}, "invalid prog_size"},
+        {{cache_size = 96}, "invalid cache_size"},
+        {{cache_size = 2048}, "invalid cache_size"},
+        {{lookahead_size = 12}, "invalid lookahead_size"},
+        {{block_cycles = 0}, "invalid block_cycles"},
+        {{block_cycles = 'abc'}, "invalid block_cycles"},
+    } do
+        local cfg, err = table.unpack(test)
+        t:expect(t.expr(lfs).new(d, cfg)):raises(err)
+    end
+    t:expect(t.expr(f):mount({cache_size = 512}))
+        :raises("cache_size larger than allocated")
+    t:expect(t.expr(f):mount({lookahead_size = 32}))
+        :raises("lookahead_size larger than allocated")
+end
+
 function test_stat(t)
     t:expect(t.mexpr(dfs):stat('/')):eq{'/', fs.TYPE_DIR}
     t:expect(t.mexpr(dfs):stat('/dir')):eq{'dir', fs.TYPE_DIR}
@@ -143,11 +185,39 @@ function test_file(t)
         local f<close> = assert(dfs:open('/file', fs.O_RDONLY))
         t:expect(t.expr(f):read(100))
             :eq("The quick brown fox flies over the fence")
+        t:expect(t.expr(f):seek(10)):eq(10)
+        t:expect(t.expr(f):read()):eq("brown fox flies over the fence")
+        t:expect(t.expr(f):read()):eq("")
     end
     t:expect(t.mexpr(dfs):open('/not-found', fs.O_RDONLY))
         :eq{nil, "no such file or directory", errors.ENOENT, n = 3}
 end
 
+function test_file_readahead(t)
+    local data = {}
+    for i = 0, 299 do table.insert(data, ('%03d,'):format(i)) end
+    data = table.concat(data)
+    write_file('/readahead', data)
+    local f<close> = assert(dfs:open('/readahead', fs.O_RDWR, 64))
+    t:expect(t.expr(f):read(4)):eq(data:sub(1, 4))
+    t:expect(t.expr(f):tell()):eq(4)
+    t:expect(t.expr(f):read(100)):eq(data:sub(5, 104))
+    t:expect(t.expr(f):read(10)):eq(data:sub(105, 114))
+    t:expect(t.expr(f):seek(-4, fs.SEEK_CUR)):eq(110)
+    t:expect(t.expr(f):read(8)):eq(data:sub(111, 118))
+    t:expect(t.expr(f):write('xxxx')):eq(4)
+    t:expect(t.expr(f):tell()):eq(122)
+    t:expect(t.expr(f):rewind()):eq(0)
+    t:expect(t.expr(f):read(3)):eq(data:sub(1, 3))
+    t:expect(t.expr(f):seek(-2, fs.SEEK_END)):eq(#data - 2)
+    t:expect(t.expr(f):read(10)):eq(data:sub(-2))
+    t:expect(t.expr(f):read(10)):eq('')
+    t:expect(t.expr(f):seek(116)):eq(116)
+    t:expect(t.expr(f):read(8)):eq('02xxxx0,')
+    t:expect(t.expr(dfs):open('/readahead', fs.O_RDONLY, -1))
+        :raises("invalid read-ahead size")
+end
+
 local function read_dir(path)
     local entries = list()
     for name, type, size in assert(dfs:list(path)) do
@@ -172,3 +242,162 @@ function test_dir(t)
     }
     t:expect(t.expr.read_dir('/not-found')):raises("no such file")
 end
+
+local function walk(wfs, path)
+    local entries = list()
+    for p, type, size in assert(wfs:walk(path)) do
+        entries:append(list{p, type, size})
+    end
+    return entries:sort(util.table_comp{1})
+end
+
+function test_walk(t)
+    local _ = walk  -- Capture the upvalue
+    t:expect(t.expr.walk(dfs)):eq{
+        {'/dir', fs.TYPE_DIR},
+        {'/dir/file1', fs.TYPE_REG, 5},
+        {'/dir/file2', fs.TYPE_REG, 8},
+        {'/dir/sub', fs.TYPE_DIR},
+        {'/dir/sub/file', fs.TYPE_REG, 3},
+    }
+    t:expect(t.expr.walk(dfs, '/dir/sub/')):eq{
+        {'/dir/sub/file', fs.TYPE_REG, 3},
+    }
+    t:expect(t.mexpr(dfs):walk('/not-found'))
+        :eq{nil, "no such file or directory", errors.ENOENT, n = 3}
+    for p in dfs:walk('/') do break end  -- Close the walk early
+end
+
+local function read_file(rfs, path)
+    local f<close> = assert(rfs:open(path, fs.O_RDONLY))
+    return f:read()
+end
+
+function test_copy(t)
+    local data = ('0123456789'):rep(200)
+    write_file('/big', data)
+    t:expect(t.expr(dfs):copy('/big', '/big-copy')):eq(true)
+    t:expect(t.expr(read_file)(dfs, '/big-copy')):eq(data)
+    t:expect(t.expr(dfs):copy('/dir/file1', '/big-copy')):eq(true)
+    t:expect(t.expr(read_file)(dfs, '/big-copy')):eq('12345')
+    t:expect(t.mexpr(dfs):copy('/big', '/big'))
+        :eq{nil, "invalid argument", errors.EINVAL, n = 3}
+    t:expect(t.mexpr(dfs):copy('/not-found', '/x'))
+        :eq{nil, "no such file or directory", errors.ENOENT, n = 3}
+end
+
+function test_copy_tree(t)
+    local _ = walk  -- Capture the upvalue
+    t:expect(t.expr(dfs):copy_tree('/dir', '/copy')):eq(true)
+    t:expect(t.expr.walk(dfs, '/copy')):eq{
+        {'/copy/file1', fs.TYPE_REG, 5},
+        {'/copy/file2', fs.TYPE_REG, 8},
+        {'/copy/sub', fs.TYPE_DIR},
+        {'/copy/sub/file', fs.TYPE_REG, 3},
+    }
+    t:expect(t.expr(read_file)(dfs, '/copy/sub/file')):eq('123')
+    t:expect(t.mexpr(dfs):copy_tree('/dir', '/dir/sub/copy'))
+        :eq{nil, "invalid argument", errors.EINVAL, n = 3}
+
+    -- Copy to another filesystem.
+    local ofs<close> = lfs.new(block_mem.new(mem.alloc(16 << 10), 256, 256))
+    t:assert(ofs:format())
+    t:assert(ofs:mount())
+    t:expect(t.expr(dfs):copy_tree('/dir', '/', ofs)):eq(true)
+    t:expect(t.expr.walk(ofs, '/')):eq{
+        {'/file1', fs.TYPE_REG, 5},
+        {'/file2', fs.TYPE_REG, 8},
+        {'/sub', fs.TYPE_DIR},
+        {'/sub/file', fs.TYPE_REG, 3},
+    }
+    t:expect(t.expr(read_file)(ofs, '/file2')):eq('12345678')
+    t:expect(t.expr(ofs):copy('/sub/file', '/dir/file3', dfs)):eq(true)
+    t:expect(t.expr(read_file)(dfs, '/dir/file3')):eq('123')
+end
+
+-- Create a filesystem on a RAM block device with the given configuration, and
+-- write a file of the given size. The filesystem is mounted, and unmounts when
+-- closed.
+local function bench_fs(config, size)
+    local d = block_mem.new(mem.alloc(256 << 10), 256, 4096)
+    local bfs = lfs.new(d, config)
+    assert(bfs:format())
+    assert(bfs:mount())
+    if size then
+        local f<close> = assert(bfs:open('/data', fs.O_WRONLY | fs.O_CREAT))
+        local chunk = ('x'):rep(1024)
+        for i = 1, size // #chunk do assert(f:write(chunk)) end
+    end
+    return bfs
+end
+
+-- Read a file sequentially in small chunks, with the given filesystem
+-- configuration and read-ahead size.
+local function bench_read(b, config, readahead)
+    local size, chunk = 64 << 10, 32
+    local bfs<close> = bench_fs(config, size)
+    local f<close> = assert(bfs:open('/data', fs.O_RDONLY, readahead))
+    b:bytes(chunk)
+    b:reset_timer()
+    local pos = 0
+    for i = 1, b.n do
+        if pos >= size then
+            f:rewind()
+            pos = 0
+        end
+        f:read(chunk)
+        pos = pos + chunk
+    end
+end
+
+function bench_read_cache_256(b) bench_read(b, {cache_size = 256}) end
+function bench_read_cache_1024(b) bench_read(b, {cache_size = 1024}) end
+function bench_read_readahead_1024(b) bench_read(b, {cache_size = 256}, 1024) end
+
+-- Write a file sequentially in small chunks, with the given filesystem
+-- configuration.
+local function bench_write(b, config)
+    local size, data = 64 << 10, ('y'):rep(32)
+    local bfs<close> = bench_fs(config)
+    local f<close> = assert(bfs:open('/data', fs.O_WRONLY | fs.O_CREAT))
+    b:bytes(#data)
+    b:reset_timer()
+    local pos = 0
+    for i = 1, b.n do
+        if pos >= size then
+            f:rewind()
+            pos = 0
+        end
+        f:write(data)
+        pos = pos + #data
+    end
+end
+
+function bench_write_cache_256(b) bench_write(b, {cache_size = 256}) end
+function bench_write_cache_1024(b) bench_write(b, {cache_size = 1024}) end
+
+-- Open and close files in a directory, which scans the metadata.
+local function bench_open(b, config)
+    local bfs<close> = bench_fs(config)
+    for i = 1, 32 do
+        local f<close> = assert(bfs:open(('/f%d'):format(i),
+                                         fs.O_WRONLY | fs.O_CREAT))
+        f:write('data')
+    end
+    b:reset_timer()
+    for i = 1, b.n do
+        local f<close> = assert(bfs:open(('/f%d'):format(i % 32 + 1),
+                                         fs.O_RDONLY))
+    end
+end
+
+function bench_open_cache_256(b) bench_open(b, {cache_size = 256}) end
+function bench_open_cache_4096(b) bench_open(b, {cache_size = 4096}) end
+
+function bench_copy(b)
+    local size = 64 << 10
+    local bfs<close> = bench_fs({cache_size = 256}, size)
+    b:bytes(size)
+    b:reset_timer()
+    for i = 1, b.n do assert(bfs:copy('/data', '/copy')) end
+end
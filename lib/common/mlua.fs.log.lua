@@ -0,0 +1,463 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local errors = require 'mlua.errors'
+local fs = require 'mlua.fs'
+local int64 = require 'mlua.int64'
+local oo = require 'mlua.oo'
+local time = require 'mlua.time'
+local math = require 'math'
+local table = require 'table'
+
+-- A record is a header followed by the payload. The header contains a magic
+-- number, a check value over the other header fields, the payload length, the
+-- sequence number and the timestamp. Timestamps are 64-bit, and are packed as
+-- their low and high halves, so that they can be stored when lua_Integer is a
+-- 32-bit integer.
+local header = '<I2I2I4i8i4i4'
+local header_size = header:packsize()
+local magic = 0x474c
+
+-- An index entry contains the sequence number, the timestamp and the offset of
+-- a record in its segment.
+local entry = '<i8i4i4I4'
+local entry_size = entry:packsize()
+
+local mask32 = int64('0xffffffff')
+
+-- Split a timestamp into its low and high 32-bit halves.
+local function split_ts(ts)
+    ts = assert(int64(ts), "invalid timestamp")
+    return int64.tointeger(int64.ashr(ts << 32, 32)),
+           int64.tointeger(int64.ashr(ts, 32))
+end
+
+-- Join the low and high 32-bit halves of a timestamp. Returns an integer if
+-- the timestamp fits, or an Int64 otherwise.
+local function join_ts(lo, hi)
+    local ts = (int64(hi) << 32) | (int64(lo) & mask32)
+    return int64.tointeger(ts) or ts
+end
+
+-- Compute the check value of a record header.
+local function check(len, seq, lo, hi)
+    local v = len ~ seq ~ lo ~ hi
+    return (v ~ (v >> 16)) & 0xffff
+end
+
+-- Return the largest i in [1, n] for which pred(i) is true, or 0 if there is
+-- none. pred must be true up to some i, and false after it.
+local function last_true(n, pred)
+    local lo, hi = 0, n
+    while lo < hi do
+        local mid = (lo + hi + 1) // 2
+        if pred(mid) then lo = mid else hi = mid - 1 end
+    end
+    return lo
+end
+
+-- Read the record at the current position of a file, which must have the
+-- given sequence number. Returns the timestamp and the payload, nothing at the
+-- end of the valid records, or (fail, msg, err) on error.
+local function read_record(f, seq)
+    local hdr, msg, err = f:read(header_size)
+    if not hdr then return hdr, msg, err end
+    if #hdr < header_size then return end
+    local m, chk, len, s, lo, hi = header:unpack(hdr)
+    if m ~= magic or chk ~= check(len, s, lo, hi) or s ~= seq then return end
+    local data; data, msg, err = f:read(len)
+    if not data then return data, msg, err end
+    if #data < len then return end
+    return join_ts(lo, hi), data
+end
+
+-- Return the content of a file, or the empty string if it doesn't exist.
+local function read_file(lfs, path)
+    local f<close>, msg, err = lfs:open(path, fs.O_RDONLY)
+    if not f then
+        if err == errors.ENOENT then return '' end
+        return f, msg, err
+    end
+    return f:read()
+end
+
+-- Pack the index entries idx[i:] into a string.
+local function pack_entries(idx, i)
+    local parts = {}
+    for j = i or 1, #idx, 3 do
+        local lo, hi = split_ts(idx[j + 1])
+        table.insert(parts, entry:pack(idx[j], lo, hi, idx[j + 2]))
+    end
+    return table.concat(parts)
+end
+
+-- An append-only log of records, stored in segment files in a directory.
+Log = oo.class('Log')
+
+function Log:__init(lfs, dir, opts)
+    self._fs, self._dir = lfs, dir
+    self.segment_size = opts.segment_size or (64 << 10)
+    self.batch_size = opts.batch_size or 4096
+    self.index_interval = opts.index_interval or 1024
+    self.max_segments = opts.max_segments
+    self.readahead = opts.readahead or 512
+
+    -- Each segment is a table with the sequence number of its first record
+    -- (seq), and its index entries as a flat list of triples (idx).
+    self._segs = {}
+    self._size = 0  -- The committed size of the last segment
+    self._last_off = 0  -- The offset of the last index entry
+    self._next = 1  -- The sequence number of the next record
+    self._committed = 1  -- The sequence number of the first uncommitted record
+    self._buf, self._buf_len, self._pending = {}, 0, {}
+end
+
+function Log:_path(seq, ext)
+    return ('%s/%016x.%s'):format(self._dir, seq, ext)
+end
+
+-- Load the index of a segment. Ensures that the index has an entry for the
+-- first record, unless the segment is empty.
+function Log:_load_index(seg)
+    local data, msg, err = read_file(self._fs, self:_path(seg.seq, 'idx'))
+    if not data then return data, msg, err end
+    local idx = {}
+    for pos = 1, #data - entry_size + 1, entry_size do
+        local seq, lo, hi, off = entry:unpack(data, pos)
+        table.insert(idx, seq)
+        table.insert(idx, join_ts(lo, hi))
+        table.insert(idx, off)
+    end
+    seg.idx = idx
+    if idx[3] == 0 then return true end
+    local f<close>, fmsg, ferr = self._fs:open(self:_path(seg.seq, 'log'),
+                                               fs.O_RDONLY)
+    if not f then return f, fmsg, ferr end
+    local ts; ts, msg, err = read_record(f, seg.seq)
+    if ts then
+        table.move(idx, 1, #idx, 4)
+        idx[1], idx[2], idx[3] = seg.seq, ts, 0
+    elseif msg then
+        return ts, msg, err
+    end
+    return true
+end
+
+-- Recover the last segment after an unclean shutdown. Scans the records
+-- following the last index entry, truncates the segment after the last valid
+-- record, and rewrites the index if it doesn't match the segment.
+function Log:_recover(seg)
+    local lfs = self._fs
+    local f<close>, msg, err = lfs:open(self:_path(seg.seq, 'log'), fs.O_RDWR,
+                                        self.readahead)
+    if not f then return f, msg, err end
+    local size; size, msg, err = f:size()
+    if not size then return size, msg, err end
+
+    -- Drop the index entries past the end of the segment, and scan from the
+    -- last remaining one.
+    local idx = seg.idx
+    local n, dirty = #idx, false
+    while n > 0 and idx[n] >= size do
+        idx[n], idx[n - 1], idx[n - 2] = nil, nil, nil
+        n, dirty = n - 3, true
+    end
+    local off, seq = 0, seg.seq
+    if n > 0 then
+        off, seq = idx[n], idx[n - 2]
+        local ok; ok, msg, err = f:seek(off)
+        if not ok then return ok, msg, err end
+    end
+    local last_off = off
+    while true do
+        local ts, data; ts, data, err = read_record(f, seq)
+        if not ts then
+            if data then return ts, data, err end
+            break
+        end
+        if off == 0 or (off > last_off
+                        and off - last_off >= self.index_interval) then
+            table.insert(idx, seq)
+            table.insert(idx, ts)
+            table.insert(idx, off)
+            last_off, dirty = off, true
+        end
+        off, seq = off + header_size + #data, seq + 1
+    end
+    if off < size then
+        local ok; ok, msg, err = f:truncate(off)
+        if ok then ok, msg, err = f:sync() end
+        if not ok then return ok, msg, err end
+    end
+    if dirty then
+        local fi<close>, imsg, ierr = lfs:open(
+            self:_path(seg.seq, 'idx'), fs.O_WRONLY | fs.O_CREAT | fs.O_TRUNC)
+        if not fi then return fi, imsg, ierr end
+        local ok; ok, msg, err = fi:write(pack_entries(idx))
+        if ok then ok, msg, err = fi:close() end
+        if not ok then return ok, msg, err end
+    end
+    self._size, self._last_off = off, last_off
+    self._next, self._committed = seq, seq
+    return true
+end
+
+function Log:_load()
+    local lfs, dir = self._fs, self._dir
+    local ok, msg, err = lfs:mkdir(dir)
+    if not ok and err ~= errors.EEXIST then return ok, msg, err end
+    local it, state, ctl, dir_close = lfs:list(dir)
+    if not it then return it, state, ctl end
+    local seqs = {}
+    for name in it, state, ctl, dir_close do
+        local seq = name:match('^(%x+)%.log$')
+        if seq then table.insert(seqs, tonumber(seq, 16)) end
+    end
+    table.sort(seqs)
+    local segs = self._segs
+    for i, seq in ipairs(seqs) do
+        local seg = {seq = seq}
+        ok, msg, err = self:_load_index(seg)
+        if not ok then return ok, msg, err end
+        if i == #seqs then
+            ok, msg, err = self:_recover(seg)
+            if not ok then return ok, msg, err end
+        end
+        if #seg.idx > 0 or i == #seqs then table.insert(segs, seg) end
+    end
+    return true
+end
+
+-- Open a log stored in the given directory, which is created if necessary.
+function open(lfs, dir, opts)
+    local self = Log(lfs, dir, opts or {})
+    local ok, msg, err = self:_load()
+    if not ok then return ok, msg, err end
+    return self
+end
+
+function Log:_open_files()
+    if self._file then return true end
+    local lfs, seq = self._fs, self._segs[#self._segs].seq
+    local flags = fs.O_WRONLY | fs.O_CREAT | fs.O_APPEND
+    local f, msg, err = lfs:open(self:_path(seq, 'log'), flags)
+    if not f then return f, msg, err end
+    local fi; fi, msg, err = lfs:open(self:_path(seq, 'idx'), flags)
+    if not fi then
+        f:close()
+        return fi, msg, err
+    end
+    self._file, self._idx_file = f, fi
+    return true
+end
+
+function Log:_close_files()
+    local f, fi = self._file, self._idx_file
+    if not f then return true end
+    self._file, self._idx_file = nil, nil
+    local ok, msg, err = f:close()
+    local iok, imsg, ierr = fi:close()
+    if not ok then return ok, msg, err end
+    return iok, imsg, ierr
+end
+
+-- Commit the pending records, close the current segment, and start a new one.
+-- Removes the oldest segments if there are more than max_segments.
+function Log:_rotate()
+    local ok, msg, err = self:commit()
+    if ok then ok, msg, err = self:_close_files() end
+    if not ok then return ok, msg, err end
+    local segs = self._segs
+    table.insert(segs, {seq = self._next, idx = {}})
+    self._size, self._last_off = 0, 0
+    local max = self.max_segments
+    while max and #segs > max do
+        local seq = segs[1].seq
+        ok, msg, err = self._fs:remove(self:_path(seq, 'log'))
+        if not ok then return ok, msg, err end
+        self._fs:remove(self:_path(seq, 'idx'))
+        table.remove(segs, 1)
+    end
+    return true
+end
+
+-- Append a record to the log. The record is buffered, and committed once the
+-- buffered records reach batch_size bytes. Timestamps must be non-decreasing
+-- over the lifetime of the log.
+function Log:append(data, ts)
+    ts = ts or time.ticks64()
+    local size = header_size + #data
+    local off = self._size + self._buf_len
+    if #self._segs == 0 or (off > 0 and off + size > self.segment_size) then
+        local ok, msg, err = self:_rotate()
+        if not ok then return ok, msg, err end
+        off = 0
+    end
+    local seq = self._next
+    if off == 0 or off - self._last_off >= self.index_interval then
+        local pending = self._pending
+        table.insert(pending, seq)
+        table.insert(pending, ts)
+        table.insert(pending, off)
+        self._last_off = off
+    end
+    local buf = self._buf
+    local lo, hi = split_ts(ts)
+    table.insert(buf, header:pack(magic, check(#data, seq, lo, hi), #data, seq,
+                                  lo, hi))
+    table.insert(buf, data)
+    self._buf_len = self._buf_len + size
+    self._next = seq + 1
+    if self._buf_len >= self.batch_size then
+        local ok, msg, err = self:commit()
+        if not ok then return ok, msg, err end
+    end
+    return seq
+end
+
+-- Write the pending records to the current segment with a single write, and
+-- sync it.
+function Log:commit()
+    if self._buf_len == 0 then return true end
+    local ok, msg, err = self:_open_files()
+    if not ok then return ok, msg, err end
+    local f, data = self._file, table.concat(self._buf)
+    ok, msg, err = f:write(data)
+    if ok then ok, msg, err = f:sync() end
+    if not ok then
+        -- Drop the partial write. The batch is kept, so the commit can be
+        -- retried.
+        self._buf = {data}
+        f:truncate(self._size)
+        f:sync()
+        return ok, msg, err
+    end
+    self._size = self._size + #data
+    self._buf, self._buf_len = {}, 0
+    self._committed = self._next
+
+    -- Write the new index entries. A failure only makes the index sparser,
+    -- and is repaired when the log is opened again.
+    local pending = self._pending
+    if #pending == 0 then return true end
+    local idx = self._segs[#self._segs].idx
+    table.move(pending, 1, #pending, #idx + 1, idx)
+    self._pending = {}
+    local fi = self._idx_file
+    ok, msg, err = fi:write(pack_entries(pending))
+    if ok then ok, msg, err = fi:sync() end
+    if not ok then return ok, msg, err end
+    return true
+end
+
+-- Commit the pending records and close the log.
+function Log:close()
+    local ok, msg, err = self:commit()
+    local cok, cmsg, cerr = self:_close_files()
+    if not ok then return ok, msg, err end
+    return cok, cmsg, cerr
+end
+
+Log.__close = Log.close
+
+-- Return the sequence numbers of the first and the last committed records.
+function Log:bounds()
+    local seg = self._segs[1]
+    return seg and seg.seq or self._committed, self._committed - 1
+end
+
+-- An iterator over the committed records of a log.
+local Scan = oo.class('Scan')
+
+function Scan:__init(log, seq) self._log, self._seq = log, seq end
+
+-- Open the segment containing the next record, and position the file at the
+-- closest indexed record.
+function Scan:_open()
+    local log = self._log
+    local segs = log._segs
+    local i = last_true(#segs, function(i) return segs[i].seq <= self._seq end)
+    if i == 0 then
+        i = 1
+        self._seq = segs[1].seq
+    end
+    local seg = segs[i]
+    local f, msg, err = log._fs:open(log:_path(seg.seq, 'log'), fs.O_RDONLY,
+                                     log.readahead)
+    if not f then error(msg, 0) end
+    self._f, self._sseq, self._cur = f, seg.seq, seg.seq
+    local idx = seg.idx
+    local j = last_true(#idx // 3, function(j)
+        return idx[3 * j - 2] <= self._seq
+    end)
+    if j > 0 then
+        self._cur = idx[3 * j - 2]
+        local ok; ok, msg = f:seek(idx[3 * j])
+        if not ok then error(msg, 0) end
+    end
+end
+
+function Scan:__close()
+    local f = self._f
+    if f then
+        self._f = nil
+        f:close()
+    end
+end
+
+local function scan_next(self)
+    local log = self._log
+    while self._seq < log._committed do
+        if not self._f then self:_open() end
+        local cur = self._cur
+        local ts, data, err = read_record(self._f, cur)
+        if ts then
+            self._cur = cur + 1
+            if cur >= self._seq then
+                self._seq = cur + 1
+                return cur, ts, data
+            end
+        elseif data then
+            error(data, 0)
+        else
+            -- Continue with the next segment, if there is one.
+            self:__close()
+            local segs, sseq = log._segs, self._sseq
+            local i = last_true(#segs, function(i)
+                return segs[i].seq <= sseq
+            end)
+            local seg = segs[i + 1]
+            if not seg then break end
+            self._seq = math.max(self._seq, seg.seq)
+        end
+    end
+    self:__close()
+end
+
+-- Return an iterator over the committed records of the log, starting at the
+-- given sequence number. The iterator yields (seq, ts, data).
+function Log:scan(seq)
+    local scan = Scan(self, seq or self:bounds())
+    return scan_next, scan, nil, scan
+end
+
+-- Return the sequence number of the first committed record whose timestamp is
+-- at least ts, or nil if there is none. Timestamps must be non-decreasing.
+function Log:find(ts)
+    local segs = self._segs
+    local i = last_true(#segs, function(i)
+        local sts = segs[i].idx[2]
+        return sts ~= nil and sts < ts
+    end)
+    local start
+    if i > 0 then
+        local idx = segs[i].idx
+        local j = last_true(#idx // 3, function(j)
+            return idx[3 * j - 1] < ts
+        end)
+        start = idx[3 * j - 2]
+    end
+    for seq, rts in self:scan(start) do
+        if rts >= ts then return seq end
+    end
+end
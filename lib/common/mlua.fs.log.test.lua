@@ -0,0 +1,181 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local block_mem = require 'mlua.block.mem'
+local block_stats = require 'mlua.block.stats'
+local fs = require 'mlua.fs'
+local int64 = require 'mlua.int64'
+local lfs = require 'mlua.fs.lfs'
+local log = require 'mlua.fs.log'
+local mem = require 'mlua.mem'
+local table = require 'table'
+
+-- Create and mount a filesystem in RAM, on a device that counts operations.
+local function mem_fs(t, size)
+    local dev = block_stats.new(
+        block_mem.new(mem.alloc(size or (64 << 10)), 256, 256))
+    local f = lfs.new(dev)
+    assert(f:format())
+    assert(f:mount())
+    if t then t:cleanup(function() f:unmount() end) end
+    return f, dev
+end
+
+-- Return the names of the segments of a log, in order.
+local function segments(f, dir)
+    local names = {}
+    for name in assert(f:list(dir)) do
+        if name:match('%.log$') then table.insert(names, name) end
+    end
+    table.sort(names)
+    return names
+end
+
+-- Return the records of a log as a list of {seq, ts, data}.
+local function records(lg, seq)
+    local res = {}
+    for s, ts, data in lg:scan(seq) do table.insert(res, {s, ts, data}) end
+    return res
+end
+
+function test_append_scan(t)
+    local f = mem_fs(t)
+    local lg<close> = assert(log.open(f, '/log'))
+    t:expect(t.mexpr(lg):bounds()):eq{1, 0}
+    t:expect(t.expr(lg):append('one', 10)):eq(1)
+    t:expect(t.expr(lg):append('two', 20)):eq(2)
+    t:expect(t.expr(records)(lg)):eq{}
+    t:expect(t.expr(lg):commit()):eq(true)
+    t:expect(t.expr(lg):append('three', 30)):eq(3)
+    t:expect(t.expr(lg):commit()):eq(true)
+    t:expect(t.mexpr(lg):bounds()):eq{1, 3}
+    t:expect(t.expr(records)(lg))
+        :eq{{1, 10, 'one'}, {2, 20, 'two'}, {3, 30, 'three'}}
+    t:expect(t.expr(records)(lg, 2)):eq{{2, 20, 'two'}, {3, 30, 'three'}}
+    t:expect(t.expr(records)(lg, 4)):eq{}
+    t:expect(t.expr(lg):close()):eq(true)
+
+    local lg2<close> = assert(log.open(f, '/log'))
+    t:expect(t.mexpr(lg2):bounds()):eq{1, 3}
+    t:expect(t.expr(lg2):append('four', 40)):eq(4)
+    t:expect(t.expr(lg2):close()):eq(true)
+    t:expect(t.expr(records)(lg2, 3)):eq{{3, 30, 'three'}, {4, 40, 'four'}}
+end
+
+function test_batching(t)
+    local f, dev = mem_fs(t)
+    local lg<close> = assert(log.open(f, '/log', {batch_size = 1024}))
+    block_stats.stats(dev, true)
+    for i = 1, 20 do lg:append(('record %d'):format(i)) end
+    t:expect(block_stats.stats(dev).write.count):label("writes"):eq(0)
+    t:expect(t.mexpr(lg):bounds()):eq{1, 0}
+    for i = 21, 40 do lg:append(('record %d'):format(i)) end
+    t:expect(block_stats.stats(dev).write.count):label("writes"):gt(0)
+    t:expect(select(2, lg:bounds())):label("last"):gt(20)
+    t:expect(t.expr(lg):commit()):eq(true)
+    t:expect(t.mexpr(lg):bounds()):eq{1, 40}
+end
+
+function test_rotation(t)
+    local f = mem_fs(t)
+    local opts = {segment_size = 1024, batch_size = 0, max_segments = 3}
+    local lg<close> = assert(log.open(f, '/log', opts))
+    local data = ('x'):rep(100)
+    for i = 1, 100 do lg:append(data, i) end
+    local segs = segments(f, '/log')
+    t:expect(#segs):label("#segs"):eq(3)
+    local first = lg:bounds()
+    t:expect(segs[1]):label("segs[1]"):eq(('%016x.log'):format(first))
+    t:expect(t.mexpr(lg):bounds()):eq{first, 100}
+    local recs = records(lg, 1)
+    t:expect(#recs):label("#recs"):eq(100 - first + 1)
+    t:expect(recs[1][1]):label("recs[1].seq"):eq(first)
+    t:expect(recs[#recs][1]):label("recs[#recs].seq"):eq(100)
+end
+
+function test_find(t)
+    local f = mem_fs(t)
+    local opts = {segment_size = 2048, index_interval = 256}
+    local lg<close> = assert(log.open(f, '/log', opts))
+    for i = 1, 200 do lg:append(('rec%d'):format(i), i * 10) end
+    t:assert(lg:commit())
+    t:expect(#segments(f, '/log')):label("#segs"):gt(1)
+    t:expect(t.expr(lg):find(0)):eq(1)
+    t:expect(t.expr(lg):find(10)):eq(1)
+    t:expect(t.expr(lg):find(995)):eq(100)
+    t:expect(t.expr(lg):find(1000)):eq(100)
+    t:expect(t.expr(lg):find(2000)):eq(200)
+    t:expect(t.expr(lg):find(2001)):eq(nil)
+    t:expect(t.expr(records)(lg, 150)[1]):eq{150, 1500, 'rec150'}
+end
+
+function test_int64_timestamps(t)
+    local f = mem_fs(t)
+    local lg<close> = assert(log.open(f, '/log', {index_interval = 64}))
+    local base = int64(1) << 40
+    for i = 1, 50 do lg:append(('rec%d'):format(i), base + i * 10) end
+    t:assert(lg:close())
+    local lg2<close> = assert(log.open(f, '/log', {index_interval = 64}))
+    local recs = records(lg2, 20)
+    t:expect(recs[1][3]):label("recs[1].data"):eq('rec20')
+    t:expect(recs[1][2]):label("recs[1].ts"):eq(base + 200, equal)
+    t:expect(t.expr(lg2):find(base + 195)):eq(20)
+    t:expect(t.expr(lg2):find(base - 1)):eq(1)
+    t:expect(t.expr(lg2):find(base + 501)):eq(nil)
+    t:expect(t.expr(lg2):find(-base)):eq(1)
+
+    -- The default timestamp is time.ticks64().
+    local seq = lg2:append('now')
+    t:assert(lg2:commit())
+    t:expect(records(lg2, seq)[1][2]):label("ts"):gt(0)
+end
+
+function test_recovery(t)
+    local f = mem_fs(t)
+    do
+        local lg<close> = assert(log.open(f, '/log'))
+        for i = 1, 10 do lg:append(('rec%d'):format(i), i) end
+    end
+    local path = '/log/' .. segments(f, '/log')[1]
+    local _, _, size = f:stat(path)
+
+    -- Simulate an interrupted write at the end of the segment.
+    do
+        local fh<close> = assert(f:open(path, fs.O_WRONLY | fs.O_APPEND))
+        t:assert(fh:write('\x4c\x47garbage'))
+    end
+    local lg<close> = assert(log.open(f, '/log'))
+    t:expect(t.mexpr(lg):bounds()):eq{1, 10}
+    t:expect(t.mexpr(f):stat(path)):eq{path:match('[^/]+$'), fs.TYPE_REG, size}
+    t:expect(t.expr(lg):append('rec11', 11)):eq(11)
+    t:expect(t.expr(lg):commit()):eq(true)
+    t:expect(t.expr(records)(lg, 10)):eq{{10, 10, 'rec10'}, {11, 11, 'rec11'}}
+end
+
+function bench_append(b)
+    local f<close> = mem_fs(nil, 256 << 10)
+    local lg<close> = assert(log.open(f, '/log', {
+        segment_size = 16 << 10, max_segments = 4, index_interval = 1024}))
+    local data = ('x'):rep(64)
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do lg:append(data, i) end
+    assert(lg:commit())
+end
+
+function bench_scan(b)
+    local f<close> = mem_fs(nil, 256 << 10)
+    local lg<close> = assert(log.open(f, '/log', {segment_size = 16 << 10}))
+    local data, cnt = ('x'):rep(64), 1024
+    for i = 1, cnt do lg:append(data, i) end
+    assert(lg:commit())
+    b:bytes(#data)
+    b:reset_timer()
+    local n = 0
+    while n < b.n do
+        for _ in lg:scan(1) do
+            n = n + 1
+            if n >= b.n then break end
+        end
+    end
+end
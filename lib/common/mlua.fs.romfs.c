@@ -0,0 +1,353 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/errors.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// An image starts with a header, made of a magic number, the size of the
+// image, the number of slots in the index (a power of two), and the number of
+// entries. The header is followed by the index, an open-addressing hash table
+// keyed by the FNV-1a hash of the entry names. Each slot holds the hash, the
+// offset of the zero-terminated name, the offset of the data, and the size of
+// the data. Empty slots have a name offset of zero. The index is followed by
+// the names and the data, which is aligned on 4 bytes. All integers are 32-bit
+// little-endian.
+#define MAGIC "MLRF"
+#define HEADER_SIZE 16
+#define SLOT_SIZE 16
+#define DATA_ALIGN 4
+
+static char const Image_name[] = "mlua.fs.romfs.Image";
+
+static inline uint32_t get_u32(uint8_t const* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t hash(char const* s, size_t len) {
+    uint32_t h = 0x811c9dc5u;
+    for (size_t i = 0; i < len; ++i) h = (h ^ (uint8_t)s[i]) * 0x01000193u;
+    return h;
+}
+
+static inline size_t align(size_t v) {
+    return (v + DATA_ALIGN - 1) & ~(size_t)(DATA_ALIGN - 1);
+}
+
+// A view of an image in memory.
+typedef struct Img {
+    uint8_t const* start;
+    uint32_t size;
+    uint32_t nslots;
+    uint32_t count;
+} Img;
+
+static inline uint8_t const* slot_at(Img const* img, uint32_t i) {
+    return img->start + HEADER_SIZE + i * SLOT_SIZE;
+}
+
+// Get the image held in the string or raw buffer at the given index, or
+// located at the address given as an integer or a pointer, and check its
+// header. The size of an image given by address is taken from its header.
+static int get_img(lua_State* ls, int arg, Img* img) {
+    MLuaBuffer buf;
+    switch (lua_type(ls, arg)) {
+    case LUA_TNUMBER: {
+        int ok;
+        buf.ptr = (void*)(uintptr_t)lua_tointegerx(ls, arg, &ok);
+        if (!ok) return MLUA_EINVAL;
+        buf.size = SIZE_MAX;
+        break;
+    }
+    case LUA_TLIGHTUSERDATA:
+        buf.ptr = lua_touserdata(ls, arg);
+        buf.size = SIZE_MAX;
+        break;
+    default:
+        if (!mlua_get_ro_buffer(ls, arg, &buf) || buf.vt != NULL) {
+            return MLUA_EINVAL;
+        }
+        break;
+    }
+    if (buf.ptr == NULL) return MLUA_EINVAL;
+    if (buf.size < HEADER_SIZE) return MLUA_ECORRUPT;
+    uint8_t const* p = buf.ptr;
+    if (memcmp(p, MAGIC, 4) != 0) return MLUA_ECORRUPT;
+    img->start = p;
+    img->size = get_u32(p + 4);
+    img->nslots = get_u32(p + 8);
+    img->count = get_u32(p + 12);
+    if (img->size > buf.size || img->size < HEADER_SIZE || img->nslots == 0
+            || (img->nslots & (img->nslots - 1)) != 0
+            || img->nslots > (img->size - HEADER_SIZE) / SLOT_SIZE
+            || img->count > img->nslots) {
+        return MLUA_ECORRUPT;
+    }
+    return MLUA_EOK;
+}
+
+// Check that all the slots of an image point inside the image.
+static int check_slots(Img const* img) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < img->nslots; ++i) {
+        uint8_t const* s = slot_at(img, i);
+        uint32_t noff = get_u32(s + 4);
+        if (noff == 0) continue;
+        uint32_t doff = get_u32(s + 8), dsize = get_u32(s + 12);
+        if (noff >= img->size
+                || memchr(img->start + noff, '\0', img->size - noff) == NULL
+                || doff > img->size || dsize > img->size - doff) {
+            return MLUA_ECORRUPT;
+        }
+        ++count;
+    }
+    return count == img->count ? MLUA_EOK : MLUA_ECORRUPT;
+}
+
+// Find an entry by name, and return its slot, or NULL if it isn't found.
+static uint8_t const* find_entry(Img const* img, char const* name,
+                                 size_t len) {
+    uint32_t h = hash(name, len), mask = img->nslots - 1;
+    for (uint32_t i = h & mask, n = 0; n < img->nslots;
+            i = (i + 1) & mask, ++n) {
+        uint8_t const* s = slot_at(img, i);
+        uint32_t noff = get_u32(s + 4);
+        if (noff == 0) break;
+        if (get_u32(s) == h && len < img->size - noff
+                && memcmp(img->start + noff, name, len) == 0
+                && img->start[noff + len] == '\0') {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Get the image of the Image at the given index. Raises an error if the image
+// isn't valid anymore, e.g. because its buffer was unmapped.
+static void check_Image(lua_State* ls, int arg, Img* img) {
+    luaL_checkudata(ls, arg, Image_name);
+    lua_getiuservalue(ls, arg, 1);
+    int err = get_img(ls, lua_absindex(ls, -1), img);
+    lua_pop(ls, 1);
+    if (err != MLUA_EOK) luaL_error(ls, "invalid image: %s", mlua_err_msg(err));
+}
+
+static int Image_read(lua_State* ls) {
+    Img img;
+    check_Image(ls, 1, &img);
+    size_t len;
+    char const* name = luaL_checklstring(ls, 2, &len);
+    uint8_t const* s = find_entry(&img, name, len);
+    if (s == NULL) return lua_pushnil(ls), 1;
+    lua_pushlstring(ls, (char const*)img.start + get_u32(s + 8),
+                    get_u32(s + 12));
+    return 1;
+}
+
+static int Image_size(lua_State* ls) {
+    Img img;
+    check_Image(ls, 1, &img);
+    if (lua_isnoneornil(ls, 2)) return lua_pushinteger(ls, img.size), 1;
+    size_t len;
+    char const* name = luaL_checklstring(ls, 2, &len);
+    uint8_t const* s = find_entry(&img, name, len);
+    if (s == NULL) return lua_pushnil(ls), 1;
+    return lua_pushinteger(ls, get_u32(s + 12)), 1;
+}
+
+static int list_next(lua_State* ls) {
+    Img img;
+    check_Image(ls, lua_upvalueindex(1), &img);
+    lua_Integer i = lua_tointeger(ls, lua_upvalueindex(2));
+    for (; (lua_Unsigned)i < img.nslots; ++i) {
+        uint8_t const* s = slot_at(&img, i);
+        uint32_t noff = get_u32(s + 4);
+        if (noff == 0) continue;
+        lua_pushinteger(ls, i + 1);
+        lua_replace(ls, lua_upvalueindex(2));
+        lua_pushstring(ls, (char const*)img.start + noff);
+        lua_pushinteger(ls, get_u32(s + 12));
+        return 2;
+    }
+    lua_pushinteger(ls, i);
+    lua_replace(ls, lua_upvalueindex(2));
+    return 0;
+}
+
+static int Image_list(lua_State* ls) {
+    Img img;
+    check_Image(ls, 1, &img);
+    lua_settop(ls, 1);
+    lua_pushinteger(ls, 0);
+    lua_pushcclosure(ls, &list_next, 2);
+    return 1;
+}
+
+// Load the chunk held in an entry, without copying it out of the image.
+static int load_entry(lua_State* ls, Img const* img, uint8_t const* s,
+                      char const* name, char const* mode) {
+    lua_pushfstring(ls, "@%s", name);
+    int res = luaL_loadbufferx(ls, (char const*)img->start + get_u32(s + 8),
+                               get_u32(s + 12), lua_tostring(ls, -1), mode);
+    lua_remove(ls, -2);
+    return res;
+}
+
+static int Image_load(lua_State* ls) {
+    Img img;
+    check_Image(ls, 1, &img);
+    size_t len;
+    char const* name = luaL_checklstring(ls, 2, &len);
+    char const* mode = luaL_optstring(ls, 3, "bt");
+    uint8_t const* s = find_entry(&img, name, len);
+    if (s == NULL) return mlua_err_push(ls, MLUA_ENOENT);
+    if (load_entry(ls, &img, s, name, mode) != LUA_OK) {
+        return luaL_pushfail(ls), lua_insert(ls, -2), 2;
+    }
+    return 1;
+}
+
+static int load_module(lua_State* ls) {
+    lua_pushvalue(ls, lua_upvalueindex(1));
+    lua_rotate(ls, 1, 1);
+    mlua_new_lua_module(ls, lua_tostring(ls, lua_upvalueindex(2)));
+    if (!lua_setupvalue(ls, 1, 1)) lua_pop(ls, 1);  // Set _ENV
+    lua_call(ls, lua_gettop(ls) - 1, 1);
+    return 1;
+}
+
+static int search(lua_State* ls) {
+    Img img;
+    check_Image(ls, lua_upvalueindex(1), &img);
+    size_t len;
+    char const* name = luaL_checklstring(ls, 1, &len);
+    uint8_t const* s = find_entry(&img, name, len);
+    if (s == NULL) return lua_pushfstring(ls, "no romfs entry '%s'", name), 1;
+    if (load_entry(ls, &img, s, name, NULL) != LUA_OK) {
+        return luaL_error(ls, "error loading module '%s' from romfs:\n\t%s",
+                          name, lua_tostring(ls, -1));
+    }
+    lua_pushvalue(ls, 1);  // Module name
+    lua_pushcclosure(ls, &load_module, 2);
+    lua_pushfstring(ls, "romfs:%s", name);
+    return 2;
+}
+
+static int Image_searcher(lua_State* ls) {
+    Img img;
+    check_Image(ls, 1, &img);
+    lua_settop(ls, 1);
+    lua_pushcclosure(ls, &search, 1);
+    return 1;
+}
+
+MLUA_SYMBOLS(Image_syms) = {
+    MLUA_SYM_F(read, Image_),
+    MLUA_SYM_F(size, Image_),
+    MLUA_SYM_F(list, Image_),
+    MLUA_SYM_F(load, Image_),
+    MLUA_SYM_F(searcher, Image_),
+};
+
+static int mod_new(lua_State* ls) {
+    Img img;
+    int err = get_img(ls, 1, &img);
+    if (err == MLUA_EOK) err = check_slots(&img);
+    if (err != MLUA_EOK) return mlua_err_push(ls, err);
+    lua_newuserdatauv(ls, 0, 1);
+    luaL_getmetatable(ls, Image_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, 1);  // Keep the buffer alive
+    lua_setiuservalue(ls, -2, 1);
+    return 1;
+}
+
+static int mod_pack(lua_State* ls) {
+    luaL_checktype(ls, 1, LUA_TTABLE);
+
+    // Compute the size of the image.
+    size_t count = 0, size = 0;
+    lua_pushnil(ls);
+    while (lua_next(ls, 1)) {
+        if (lua_type(ls, -2) != LUA_TSTRING
+                || lua_type(ls, -1) != LUA_TSTRING) {
+            return luaL_error(ls, "invalid entry");
+        }
+        ++count;
+        size += lua_rawlen(ls, -2) + 1 + lua_rawlen(ls, -1)
+                + 2 * (DATA_ALIGN - 1);
+        lua_pop(ls, 1);
+    }
+    lua_Integer nslots = 1;
+    while ((size_t)nslots < 2 * count) nslots <<= 1;
+    nslots = luaL_optinteger(ls, 2, nslots);
+    luaL_argcheck(ls, nslots > 0 && (nslots & (nslots - 1)) == 0
+                      && (size_t)nslots >= count
+                      && (lua_Unsigned)nslots
+                         <= (UINT32_MAX - HEADER_SIZE) / SLOT_SIZE,
+                  2, "invalid slot count");
+    size_t index_size = HEADER_SIZE + (size_t)nslots * SLOT_SIZE;
+    luaL_argcheck(ls, size <= UINT32_MAX - index_size, 1, "image too large");
+    size += index_size;
+
+    // Build the image.
+    luaL_Buffer buf;
+    uint8_t* p = (uint8_t*)luaL_buffinitsize(ls, &buf, size);
+    memset(p, 0, size);
+    memcpy(p, MAGIC, 4);
+    put_u32(p + 8, nslots);
+    put_u32(p + 12, count);
+    size_t off = HEADER_SIZE + nslots * SLOT_SIZE;
+    uint32_t mask = nslots - 1;
+    lua_pushnil(ls);
+    while (lua_next(ls, 1)) {
+        size_t nlen, dlen;
+        char const* name = lua_tolstring(ls, -2, &nlen);
+        char const* data = lua_tolstring(ls, -1, &dlen);
+        uint32_t h = hash(name, nlen);
+        uint32_t i = h & mask;
+        while (get_u32(p + HEADER_SIZE + i * SLOT_SIZE + 4) != 0) {
+            i = (i + 1) & mask;
+        }
+        uint8_t* s = p + HEADER_SIZE + i * SLOT_SIZE;
+        put_u32(s, h);
+        put_u32(s + 4, off);
+        memcpy(p + off, name, nlen + 1);
+        off = align(off + nlen + 1);
+        put_u32(s + 8, off);
+        put_u32(s + 12, dlen);
+        memcpy(p + off, data, dlen);
+        off = align(off + dlen);
+        lua_pop(ls, 1);
+    }
+    put_u32(p + 4, off);
+    luaL_pushresultsize(&buf, off);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new, mod_),
+    MLUA_SYM_F(pack, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.fs.romfs) {
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Image class.
+    mlua_new_class(ls, Image_name, Image_syms, mlua_nosyms);
+    lua_pop(ls, 1);
+    return 1;
+}
@@ -0,0 +1,176 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local block_mem = require 'mlua.block.mem'
+local errors = require 'mlua.errors'
+local fs = require 'mlua.fs'
+local lfs = require 'mlua.fs.lfs'
+local romfs = require 'mlua.fs.romfs'
+local mem = require 'mlua.mem'
+local util = require 'mlua.util'
+local package = require 'package'
+local string = require 'string'
+local table = require 'table'
+
+local prefix = ...
+
+local files = {
+    empty = '',
+    one = 'the first entry',
+    two = ('x'):rep(1000),
+}
+
+function test_pack_read(t)
+    local img = romfs.pack(files)
+    t:expect(#img % 4):label("#img % 4"):eq(0)
+    local im = assert(romfs.new(img))
+    t:expect(t.expr(im):size()):eq(#img)
+    for name, data in pairs(files) do
+        t:expect(t.expr(im):read(name)):eq(data)
+        t:expect(t.expr(im):size(name)):eq(#data)
+    end
+    t:expect(t.expr(im):read('missing')):eq(nil)
+    t:expect(t.expr(im):read('on')):eq(nil)
+    t:expect(t.expr(im):size('missing')):eq(nil)
+
+    local entries = {}
+    for name, size in im:list() do entries[name] = size end
+    t:expect(entries):label("entries")
+        :eq({empty = 0, one = #files.one, two = #files.two}, util.table_eq)
+
+    -- Images in memory buffers are used in place.
+    local buf = mem.alloc(#img)
+    mem.write(buf, img)
+    local im = assert(romfs.new(buf))
+    t:expect(t.expr(im):read('one')):eq(files.one)
+
+    -- Images given by address take their size from the header.
+    local im = assert(romfs.new(buf:ptr()))
+    t:expect(t.expr(im):size()):eq(#img)
+    t:expect(t.expr(im):read('two')):eq(files.two)
+    t:expect(t.expr(romfs).pack({a = 'b'}, 0)):raises("invalid slot count")
+    t:expect(t.expr(romfs).pack({a = 'b'}, 3)):raises("invalid slot count")
+    t:expect(t.expr(romfs).pack({a = 'b'}, 1 << 28))
+        :raises("invalid slot count")
+end
+
+function test_many_entries(t)
+    local entries = {}
+    for i = 1, 200 do entries[('mod%d'):format(i)] = ('data%d'):format(i) end
+    local im = assert(romfs.new(romfs.pack(entries, 256)))
+    for name, data in pairs(entries) do
+        t:expect(t.expr(im):read(name)):eq(data)
+    end
+    local cnt = 0
+    for _ in im:list() do cnt = cnt + 1 end
+    t:expect(cnt):label("count"):eq(200)
+end
+
+function test_load(t)
+    local src = 'return ...'
+    local im = assert(romfs.new(romfs.pack{
+        src = src,
+        bin = string.dump(load(src), true),
+        bad = 'return +',
+    }))
+    local f = assert(im:load('src'))
+    t:expect(t.mexpr(f)(1, 2)):eq{1, 2, n = 2}
+    local f = assert(im:load('bin'))
+    t:expect(t.mexpr(f)(3, 4)):eq{3, 4, n = 2}
+    t:expect(t.expr(im):load('src', 'b')):eq(nil)
+    t:expect(t.expr(im):load('bin', 't')):eq(nil)
+    t:expect(select(2, im:load('bad'))):label("msg"):matches('^bad:1:')
+    t:expect(t.mexpr(im):load('missing'))
+        :eq{nil, errors.message(errors.ENOENT), errors.ENOENT, n = 3}
+end
+
+function test_searcher(t)
+    local mod_a, mod_b = prefix .. '.a', prefix .. '.b'
+    t:cleanup(function()
+        package.loaded[mod_a] = nil
+        package.loaded[mod_b] = nil
+    end)
+    local im = assert(romfs.new(romfs.pack{
+        [mod_a] = 'args = {...}\nvalue = "a"',
+        [mod_b] = string.dump(load('return {value = "b"}')),
+    }))
+    t:patch(package, 'searchers', {im:searcher()})
+
+    local m, p = require(mod_a)
+    t:expect(t.expr(m).args):eq({mod_a, 'romfs:' .. mod_a}, util.table_eq)
+    t:expect(t.expr(m).value):eq('a')
+    t:expect(p):label("a.path"):eq('romfs:' .. mod_a)
+    local m = require(mod_b)
+    t:expect(t.expr(m).value):eq('b')
+    t:expect(t.expr(require)(prefix .. '.c')):raises("no romfs entry")
+end
+
+function test_corrupt(t)
+    local img = romfs.pack(files)
+    local ecorrupt = {nil, errors.message(errors.ECORRUPT), errors.ECORRUPT,
+                      n = 3}
+    t:expect(t.mexpr(romfs).new('')):eq(ecorrupt)
+    t:expect(t.mexpr(romfs).new('XXXX' .. img:sub(5))):eq(ecorrupt)
+    t:expect(t.mexpr(romfs).new(img:sub(1, -2))):eq(ecorrupt)
+    t:expect(t.mexpr(romfs).new(img:sub(1, 16) .. ('\xff'):rep(#img - 16)))
+        :eq(ecorrupt)
+    -- A size smaller than the header, with a large slot count.
+    t:expect(t.mexpr(romfs).new(img:sub(1, 4) .. ('<I4I4'):pack(0, 1 << 28)
+                                .. img:sub(13)))
+        :eq(ecorrupt)
+    local einval = {nil, errors.message(errors.EINVAL), errors.EINVAL, n = 3}
+    t:expect(t.mexpr(romfs).new(0)):eq(einval)
+    t:expect(t.mexpr(romfs).new(1.5)):eq(einval)
+    t:expect(t.mexpr(romfs).new({})):eq(einval)
+end
+
+local bench_mods = 20
+
+-- Return the source of the benchmark modules.
+local function bench_sources()
+    local srcs = {}
+    for i = 1, bench_mods do
+        local lines = {}
+        for j = 1, 20 do
+            table.insert(lines, ('function f%d(a, b) return a + b * %d end')
+                                :format(j, j))
+        end
+        srcs[('mod%d'):format(i)] = table.concat(lines, '\n')
+    end
+    return srcs
+end
+
+function bench_load_romfs(b)
+    local im = assert(romfs.new(romfs.pack(bench_sources())))
+    b:reset_timer()
+    for i = 1, b.n do assert(im:load(('mod%d'):format(i % bench_mods + 1))) end
+end
+
+function bench_load_romfs_bytecode(b)
+    local srcs = {}
+    for name, src in pairs(bench_sources()) do
+        srcs[name] = string.dump(load(src), true)
+    end
+    local im = assert(romfs.new(romfs.pack(srcs)))
+    b:reset_timer()
+    for i = 1, b.n do assert(im:load(('mod%d'):format(i % bench_mods + 1))) end
+end
+
+function bench_load_lfs(b)
+    local dev = block_mem.new(mem.alloc(64 << 10), 256, 256)
+    local f = lfs.new(dev)
+    assert(f:format())
+    assert(f:mount())
+    for name, src in pairs(bench_sources()) do
+        local fh<close> = assert(f:open('/' .. name,
+                                        fs.O_WRONLY | fs.O_CREAT))
+        assert(fh:write(src))
+    end
+    b:reset_timer()
+    for i = 1, b.n do
+        local fh<close> = assert(
+            f:open(('/mod%d'):format(i % bench_mods + 1), fs.O_RDONLY))
+        assert(load(fh:read()))
+    end
+    f:unmount()
+end
@@ -81,7 +81,7 @@ bool mlua_string_to_int64(char const* s, int base, int64_t* value) {
         int digit = isdigit((unsigned char)c) ? c - '0'
                     : toupper((unsigned char)c) - 'A' + 10;
         if (digit >= base) return false;
-        // TODO: Check for overflow? See l_str2int() in lobject.c
+        if (v > (UINT64_MAX - digit) / base) return false;  // Overflow
         v = v * base + digit;
         c = *s++;
     } while (isalnum((unsigned char)c));
@@ -213,6 +213,32 @@ static int64_t shift_left(int64_t lhs, int64_t rhs, bool arith) {
     return INT64_OP(lhs, >>, rhs);
 }
 
+// Store a value into the Int64 at index 1 if it is a full userdata, or push a
+// new Int64 otherwise.
+static int store_to(lua_State* ls, int64_t value) {
+#if !MLUA_IS64INT
+    int64_t* v = luaL_testudata(ls, 1, mlua_int64_name);
+    if (v != NULL) {
+        *v = value;
+        lua_settop(ls, 1);
+        return 1;
+    }
+#endif
+    mlua_push_int64(ls, value);
+    return 1;
+}
+
+#define ARITH_TO_OP(n, op) \
+static int int64_ ## n(lua_State* ls) { \
+    int64_t lhs = mlua_check_int64(ls, 2), rhs = mlua_check_int64(ls, 3); \
+    if (!lua_isnil(ls, 1)) mlua_check_int64(ls, 1); \
+    return store_to(ls, INT64_OP(lhs, op, rhs)); \
+}
+
+ARITH_TO_OP(add_to, +)
+ARITH_TO_OP(sub_to, -)
+ARITH_TO_OP(mul_to, *)
+
 static int int64_ashr(lua_State* ls) {
     mlua_push_int64(ls, shift_left(mlua_check_int64(ls, 1),
                                    -mlua_check_int64(ls, 2), true));
@@ -443,6 +469,9 @@ static int int64___concat(lua_State* ls) {
 #endif  // !MLUA_IS64INT
 
 MLUA_SYMBOLS(int64_syms) = {
+    MLUA_SYM_F(add_to, int64_),
+    MLUA_SYM_F(sub_to, int64_),
+    MLUA_SYM_F(mul_to, int64_),
     MLUA_SYM_F(ashr, int64_),
     MLUA_SYM_F(hex, int64_),
     MLUA_SYM_F(tointeger, int64_),
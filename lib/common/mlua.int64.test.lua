@@ -124,6 +124,12 @@ function test_cast_to_int64(t)
         {{'0xabcdef0123456789'},                    -- Negative
             integer_bits < 64 and int64(0x23456789, 0xabcdef01)
             or int64(0xabcdef0123456789)},
+        {{'18446744073709551615'}, int64(-1)},      -- Overflow
+        {{'18446744073709551616'}, nil},
+        {{'-18446744073709551616'}, nil},
+        {{'0x10000000000000000'}, nil},
+        {{'0x0000000000000000ffffffffffffffff'}, int64(-1)},
+        {{'100000000000000000000000000', 2}, int64(1) << 26},
     } do
         if test == skip then goto continue end
         local args, want = table.unpack(test)
@@ -359,6 +365,44 @@ function test_relational_ops(t)
     end
 end
 
+function test_arith_to(t)
+    local ops = {
+        {'add_to', function(a, b) return a + b end},
+        {'sub_to', function(a, b) return a - b end},
+        {'mul_to', function(a, b) return a * b end},
+    }
+    local values = {
+        0, 1, -7, 12345678, int64('12345678901234'), int64.max, int64.min,
+    }
+    for _, op in ipairs(ops) do
+        local name, f = table.unpack(op)
+        for _, a in ipairs(values) do
+            for _, b in ipairs(values) do
+                local dst = int64(42)
+                local want = f(int64(a), b)
+                t:expect(t.expr(int64)[name](dst, a, b)):eq(want, equal)
+                if integer_bits < 64 then
+                    t:expect(dst):label("dst"):eq(want, equal)
+                end
+                t:expect(t.expr(int64)[name](nil, a, b)):eq(want, equal)
+            end
+        end
+    end
+
+    -- The destination is updated in place when it is a full userdata.
+    local acc = int64(0)
+    for i = 1, 10 do
+        local res = int64.add_to(acc, acc, i)
+        if integer_bits < 64 then
+            t:assert(rawequal(res, acc), "add_to() returned a new value")
+        end
+        acc = res
+    end
+    t:expect(acc):label("acc"):eq(int64(55), equal)
+    t:expect(t.expr(int64).add_to(1.5, 1, 2)):raises("integer")
+    t:expect(t.expr(int64).add_to(nil, 1.5, 2)):raises("integer")
+end
+
 function test_tostring(t)
     for _, test in ipairs{
         {int64(0), '0'},
@@ -383,3 +427,13 @@ function test_concat(t)
     }
     run_binary_ops_tests(t, ops, values, values)
 end
+
+function bench_add_op(b)
+    local v, one = int64(0), int64(1)
+    for i = 1, b.n do v = v + one end
+end
+
+function bench_add_to(b)
+    local v, one = int64(0), int64(1)
+    for i = 1, b.n do v = int64.add_to(v, v, one) end
+end
@@ -1,6 +1,7 @@
 -- Copyright 2023 Remy Blank <remy@c-space.org>
 -- SPDX-License-Identifier: MIT
 
+local mem = require 'mlua.mem'
 local oo = require 'mlua.oo'
 local string = require 'string'
 local table = require 'table'
@@ -78,7 +79,8 @@ end
 
 -- Read one newline-terminated line from a reader. May return an unterminated
 -- line if the reader reaches EOF. This function is inefficient, because it
--- reads one character at a time.
+-- reads one character at a time. Prefer mlua.io.reader for line-oriented
+-- input.
 function read_line(reader, ...)
     local parts = {}
     while true do
@@ -95,28 +97,34 @@ end
 Recorder = oo.class('Recorder')
 
 -- Return true iff the buffer is empty.
-function Recorder:is_empty() return (self.n or 0) == 0 end
+function Recorder:is_empty()
+    local sb = self._sb
+    return not sb or #sb == 0
+end
 
 -- Write data to the writer.
 function Recorder:write(...)
-    local len = self.n or 0
-    for i = 1, select('#', ...) do
-        local data = select(i, ...)
-        if #data > 0 then
-            len = len + 1
-            self[len] = data
-        end
+    local sb = self._sb
+    if not sb then
+        sb = mem.builder()
+        self._sb = sb
     end
-    if len > 0 then self.n = len end
+    sb:add(...)
 end
 
+-- Flush the writer. This is a no-op.
+function Recorder:flush() end
+
 -- Replay the written data to the given writer.
 function Recorder:replay(w)
-    for _, data in ipairs(self) do w:write(data) end
+    if not self:is_empty() then w:write(self._sb:tostring()) end
 end
 
 -- Return the content of the buffer as a string.
-function Recorder:__tostring() return table.concat(self) end
+function Recorder:__tostring()
+    local sb = self._sb
+    return sb and sb:tostring() or ''
+end
 
 -- A writer that indents written lines, except empty ones.
 Indenter = oo.class('Indenter')
@@ -0,0 +1,276 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The default size of the read buffer.
+#ifndef MLUA_IO_READER_BUFFER_SIZE
+#define MLUA_IO_READER_BUFFER_SIZE 256
+#endif
+
+static char const Reader_name[] = "mlua.io.reader.Reader";
+
+// A buffered reader. The wrapped stream is stored as the first user value, and
+// the buffer as the second user value. The buffered data is in
+// buf[pos:len], and the first "scan" bytes of it are known not to contain the
+// delimiter.
+typedef struct Reader {
+    char* buf;
+    size_t size;
+    size_t pos;
+    size_t len;
+    size_t scan;
+    bool eof;
+} Reader;
+
+static inline Reader* check_Reader(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Reader_name);
+}
+
+// Read modes, as stored in the continuation context.
+typedef enum ReadMode {
+    MODE_SOME,
+    MODE_EXACT,
+    MODE_DELIM,
+} ReadMode;
+
+// The continuation context holds the read mode, the delimiter, a flag
+// indicating if errors should be raised, and the index of the last fixed
+// argument. The stack is [self, count, args...], where "args" are passed to
+// the read method of the stream.
+#define CTX(mode, delim, raise, frame) ((lua_KContext)( \
+    (mode) | ((raise) ? 4 : 0) | ((delim) << 8) | ((frame) << 16)))
+#define CTX_MODE(ctx) ((ReadMode)((ctx) & 3))
+#define CTX_RAISE(ctx) (((ctx) & 4) != 0)
+#define CTX_DELIM(ctx) ((char)(((ctx) >> 8) & 0xff))
+#define CTX_FRAME(ctx) ((int)((ctx) >> 16))
+
+// Replace the buffer with one of the given size, preserving buffered data.
+static void resize_buffer(lua_State* ls, Reader* r, size_t size) {
+    char* buf = lua_newuserdatauv(ls, size, 0);
+    size_t avail = r->len - r->pos;
+    memcpy(buf, r->buf + r->pos, avail);
+    lua_setiuservalue(ls, 1, 2);
+    r->buf = buf;
+    r->size = size;
+    r->pos = 0;
+    r->len = avail;
+}
+
+// Push "len" bytes from the buffer, and consume them.
+static int push_data(lua_State* ls, Reader* r, size_t len) {
+    lua_pushlstring(ls, r->buf + r->pos, len);
+    r->pos += len;
+    r->scan = 0;
+    if (r->pos == r->len) r->pos = r->len = 0;
+    return 1;
+}
+
+// Try to complete a read from the buffered data. Returns the number of results,
+// or -1 if more data is needed.
+static int complete(lua_State* ls, Reader* r, lua_KContext ctx) {
+    size_t avail = r->len - r->pos;
+    switch (CTX_MODE(ctx)) {
+    case MODE_SOME: {
+        if (avail == 0 && !r->eof) return -1;
+        size_t count = lua_tointeger(ls, 2);
+        r->eof = false;
+        return push_data(ls, r, count < avail ? count : avail);
+    }
+    case MODE_EXACT: {
+        size_t count = lua_tointeger(ls, 2);
+        if (avail < count && !r->eof) return -1;
+        r->eof = false;
+        return push_data(ls, r, count < avail ? count : avail);
+    }
+    case MODE_DELIM: {
+        char const* start = r->buf + r->pos;
+        char const* p = memchr(start + r->scan, CTX_DELIM(ctx),
+                               avail - r->scan);
+        if (p != NULL) return push_data(ls, r, p - start + 1);
+        r->scan = avail;
+        if (!r->eof) return -1;
+        r->eof = false;
+        if (avail == 0) return lua_pushnil(ls), 1;
+        return push_data(ls, r, avail);
+    }}
+    return -1;
+}
+
+// Handle the results of a stream read. Returns the number of results to return
+// on error, or -1 if the read was successful.
+static int handle_read(lua_State* ls, Reader* r, lua_KContext ctx) {
+    int frame = CTX_FRAME(ctx);
+    if (lua_isnoneornil(ls, frame + 1)) {
+        if (CTX_RAISE(ctx)) {
+            lua_settop(ls, frame + 2);
+            if (lua_isnil(ls, -1)) lua_pushliteral(ls, "read failed");
+            return lua_error(ls);
+        }
+        if (lua_gettop(ls) == frame) lua_pushnil(ls);
+        return lua_gettop(ls) - frame;
+    }
+    size_t len;
+    char const* data = lua_tolstring(ls, frame + 1, &len);
+    if (data == NULL) return luaL_error(ls, "read returned a non-string");
+    if (len > r->size - r->len) {
+        return luaL_error(ls, "read returned too much data");
+    }
+    memcpy(r->buf + r->len, data, len);
+    r->len += len;
+    if (len == 0) r->eof = true;
+    lua_settop(ls, frame);
+    return -1;
+}
+
+static int read_cont(lua_State* ls, int status, lua_KContext ctx);
+
+static int read_loop(lua_State* ls, Reader* r, lua_KContext ctx) {
+    int frame = CTX_FRAME(ctx);
+    for (;;) {
+        int res = complete(ls, r, ctx);
+        if (res >= 0) return res;
+
+        // Make room in the buffer.
+        size_t need = r->len - r->pos + 1;
+        if (CTX_MODE(ctx) == MODE_EXACT) {
+            size_t count = lua_tointeger(ls, 2);
+            if (count > need) need = count;
+        }
+        if (need > r->size) {
+            size_t size = 2 * r->size;
+            resize_buffer(ls, r, size > need ? size : need);
+        } else if (r->pos > 0) {
+            memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+            r->len -= r->pos;
+            r->pos = 0;
+        }
+
+        // Call stream:read(free, args...).
+        lua_getiuservalue(ls, 1, 1);
+        lua_getfield(ls, -1, "read");
+        lua_insert(ls, -2);
+        lua_pushinteger(ls, r->size - r->len);
+        for (int i = 3; i <= frame; ++i) lua_pushvalue(ls, i);
+        lua_callk(ls, frame, LUA_MULTRET, ctx, &read_cont);
+        res = handle_read(ls, r, ctx);
+        if (res >= 0) return res;
+    }
+}
+
+static int read_cont(lua_State* ls, int status, lua_KContext ctx) {
+    Reader* r = lua_touserdata(ls, 1);
+    int res = handle_read(ls, r, ctx);
+    if (res >= 0) return res;
+    return read_loop(ls, r, ctx);
+}
+
+// Start a read. The stack must be [self, count, args...].
+static int start_read(lua_State* ls, ReadMode mode, char delim, bool raise) {
+    Reader* r = lua_touserdata(ls, 1);
+    return read_loop(ls, r, CTX(mode, (uint8_t)delim, raise, lua_gettop(ls)));
+}
+
+static int Reader_read(lua_State* ls) {
+    check_Reader(ls, 1);
+    luaL_argcheck(ls, luaL_checkinteger(ls, 2) >= 0, 2, "invalid length");
+    return start_read(ls, MODE_SOME, 0, false);
+}
+
+static int Reader_read_exact(lua_State* ls) {
+    check_Reader(ls, 1);
+    luaL_argcheck(ls, luaL_checkinteger(ls, 2) >= 0, 2, "invalid length");
+    return start_read(ls, MODE_EXACT, 0, false);
+}
+
+static int Reader_read_until(lua_State* ls) {
+    check_Reader(ls, 1);
+    size_t len;
+    char const* delim = luaL_checklstring(ls, 2, &len);
+    luaL_argcheck(ls, len == 1, 2, "invalid delimiter");
+    char d = delim[0];
+    lua_pushnil(ls);
+    lua_replace(ls, 2);
+    return start_read(ls, MODE_DELIM, d, false);
+}
+
+static int Reader_read_line(lua_State* ls) {
+    check_Reader(ls, 1);
+    lua_pushnil(ls);
+    lua_insert(ls, 2);
+    return start_read(ls, MODE_DELIM, '\n', false);
+}
+
+static int lines_iter(lua_State* ls) {
+    lua_settop(ls, 0);
+    lua_pushvalue(ls, lua_upvalueindex(1));
+    lua_pushnil(ls);
+    int nup = lua_tointeger(ls, lua_upvalueindex(2));
+    for (int i = 1; i <= nup; ++i) lua_pushvalue(ls, lua_upvalueindex(2 + i));
+    return start_read(ls, MODE_DELIM, '\n', true);
+}
+
+static int Reader_lines(lua_State* ls) {
+    check_Reader(ls, 1);
+    int nargs = lua_gettop(ls) - 1;
+    luaL_argcheck(ls, nargs <= 250, 2, "too many arguments");
+    lua_pushinteger(ls, nargs);
+    lua_insert(ls, 2);
+    lua_pushcclosure(ls, &lines_iter, 2 + nargs);
+    return 1;
+}
+
+static int Reader_buffered(lua_State* ls) {
+    Reader* r = check_Reader(ls, 1);
+    lua_pushinteger(ls, r->len - r->pos);
+    return 1;
+}
+
+static int Reader_stream(lua_State* ls) {
+    check_Reader(ls, 1);
+    lua_getiuservalue(ls, 1, 1);
+    return 1;
+}
+
+MLUA_SYMBOLS(Reader_syms) = {
+    MLUA_SYM_F(read, Reader_),
+    MLUA_SYM_F(read_exact, Reader_),
+    MLUA_SYM_F(read_until, Reader_),
+    MLUA_SYM_F(read_line, Reader_),
+    MLUA_SYM_F(lines, Reader_),
+    MLUA_SYM_F(buffered, Reader_),
+    MLUA_SYM_F(stream, Reader_),
+};
+
+static int mod_new(lua_State* ls) {
+    luaL_checkany(ls, 1);
+    lua_Integer size = luaL_optinteger(ls, 2, MLUA_IO_READER_BUFFER_SIZE);
+    luaL_argcheck(ls, size > 0, 2, "invalid size");
+    Reader* r = lua_newuserdatauv(ls, sizeof(Reader), 2);
+    *r = (Reader){.size = size};
+    luaL_getmetatable(ls, Reader_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, 1);
+    lua_setiuservalue(ls, -2, 1);
+    r->buf = lua_newuserdatauv(ls, size, 0);
+    lua_setiuservalue(ls, -2, 2);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.io.reader) {
+    mlua_new_module(ls, 0, module_syms);
+    mlua_new_class(ls, Reader_name, Reader_syms, mlua_nosyms);
+    lua_pop(ls, 1);
+    return 1;
+}
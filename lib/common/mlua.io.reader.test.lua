@@ -0,0 +1,135 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local errors = require 'mlua.errors'
+local io = require 'mlua.io'
+local reader = require 'mlua.io.reader'
+local oo = require 'mlua.oo'
+local thread = require 'mlua.thread'
+local table = require 'table'
+
+-- A stream that returns pre-defined chunks, optionally yielding before each
+-- read. Strings are returned, truncated to the requested length, and tables
+-- are unpacked with table.unpack(chunk, 1, chunk.n).
+local Stream = oo.class('Stream')
+
+function Stream:__init(chunks, yield)
+    self.chunks, self.yield = chunks, yield
+end
+
+function Stream:read(len)
+    if self.yield then thread.yield() end
+    local chunk = table.remove(self.chunks, 1)
+    if chunk == nil then return '' end
+    if type(chunk) == 'table' then return table.unpack(chunk, 1, chunk.n) end
+    if #chunk > len then
+        table.insert(self.chunks, 1, chunk:sub(len + 1))
+        chunk = chunk:sub(1, len)
+    end
+    return chunk
+end
+
+function test_new(t)
+    local s = Stream({})
+    local r = reader.new(s)
+    t:expect(t.expr(r):stream()):eq(s)
+    t:expect(t.expr(r):buffered()):eq(0)
+    t:expect(t.expr(reader).new(s, 0)):raises("invalid size")
+end
+
+function test_read_BNB(t)
+    local r = reader.new(Stream({'abcdef', 'gh'}, true), 4)
+    t:expect(t.expr(r):read(2)):eq('ab')
+    t:expect(t.expr(r):buffered()):eq(2)
+    t:expect(t.expr(r):read(10)):eq('cd')
+    t:expect(t.expr(r):read(10)):eq('ef')
+    t:expect(t.expr(r):read(10)):eq('gh')
+    t:expect(t.expr(r):read(10)):eq('')
+    t:expect(t.expr(r):read(-1)):raises("invalid length")
+end
+
+function test_read_exact_BNB(t)
+    local r = reader.new(Stream({'ab', 'cdef', 'ghijklmnop', 'q'}, true), 4)
+    t:expect(t.expr(r):read_exact(3)):eq('abc')
+    t:expect(t.expr(r):read_exact(0)):eq('')
+    t:expect(t.expr(r):read_exact(10)):eq('defghijklm')
+    t:expect(t.expr(r):read_exact(10)):eq('nopq')
+    t:expect(t.expr(r):read_exact(10)):eq('')
+end
+
+function test_read_line_BNB(t)
+    local r = reader.new(Stream({'ab\ncd', 'ef\n\ngh', 'ijklmnop\nqr'}, true),
+                         4)
+    for _, want in ipairs{'ab\n', 'cdef\n', '\n', 'ghijklmnop\n', 'qr'} do
+        t:expect(t.expr(r):read_line()):eq(want)
+    end
+    t:expect(t.expr(r):read_line()):eq(nil)
+end
+
+function test_read_until(t)
+    local r = reader.new(Stream({'a,b,', ',cd'}))
+    for _, want in ipairs{'a,', 'b,', ',', 'cd'} do
+        t:expect(t.expr(r):read_until(',')):eq(want)
+    end
+    t:expect(t.expr(r):read_until(',')):eq(nil)
+    t:expect(t.expr(r):read_until(',,')):raises("invalid delimiter")
+end
+
+function test_lines_BNB(t)
+    local r = reader.new(Stream({'one\ntw', 'o\nthree'}, true), 4)
+    local got = {}
+    for line in r:lines() do table.insert(got, line) end
+    t:expect(got):label("lines"):eq{'one\n', 'two\n', 'three'}
+end
+
+function test_errors(t)
+    local r = reader.new(Stream({'ab', {nil, "boom", 42, n = 3}, 'cd\n'}))
+    t:expect(t.mexpr(r):read_line()):eq{nil, "boom", 42, n = 3}
+    t:expect(t.expr(r):buffered()):eq(2)
+    t:expect(t.expr(r):read_line()):eq('abcd\n')
+    r = reader.new(Stream({{nil, "boom", n = 2}}))
+    t:expect(t.expr(function() for _ in r:lines() do end end)()):raises("boom")
+    r = reader.new(Stream({'abcdef'}), 4)
+    r:stream().read = function() return 'abcdef' end
+    t:expect(t.expr(r):read(1)):raises("too much data")
+end
+
+function test_timeout(t)
+    local r = reader.new(Stream{
+        'ab', {nil, "timed out", errors.ETIMEDOUT, n = 3}})
+    t:expect(t.mexpr(r):read_exact(3))
+        :eq{nil, "timed out", errors.ETIMEDOUT, n = 3}
+end
+
+-- Return a stream producing "cnt" lines of "len" characters, in chunks.
+local function line_stream(cnt, len)
+    local line = ('x'):rep(len - 1) .. '\n'
+    local data = line:rep(cnt)
+    local pos = 1
+    return {read = function(self, n)
+        local chunk = data:sub(pos, pos + n - 1)
+        pos = pos + #chunk
+        return chunk
+    end}
+end
+
+function bench_read_line(b)
+    local r = reader.new(line_stream(b.n, 64))
+    b:bytes(64)
+    b:reset_timer()
+    for i = 1, b.n do r:read_line() end
+end
+
+function bench_lines(b)
+    local r = reader.new(line_stream(b.n, 64))
+    b:bytes(64)
+    b:reset_timer()
+    for line in r:lines() do end
+end
+
+function bench_io_read_line(b)
+    local s = line_stream(b.n, 64)
+    b:bytes(64)
+    b:reset_timer()
+    for i = 1, b.n do io.read_line(s) end
+end
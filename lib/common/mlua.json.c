@@ -0,0 +1,867 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The maximum nesting depth of arrays and objects, both when encoding and when
+// decoding.
+#ifndef MLUA_JSON_MAX_DEPTH
+#define MLUA_JSON_MAX_DEPTH 64
+#endif
+
+// The amount of buffered output above which the encoder writes to the writer.
+#ifndef MLUA_JSON_WRITE_SIZE
+#define MLUA_JSON_WRITE_SIZE 256
+#endif
+
+static char const array_name[] = "mlua.json.array";
+static char const object_name[] = "mlua.json.object";
+static char const list_name[] = "mlua.List";
+
+// An encoder. The output is stored in a userdata at a fixed stack index, which
+// is replaced when the output grows.
+typedef struct Encoder {
+    lua_State* ls;
+    int idx;
+    int writer;
+    char* data;
+    size_t len;
+    size_t cap;
+    int depth;
+} Encoder;
+
+static char* enc_reserve(Encoder* enc, size_t size) {
+    if (size > enc->cap - enc->len) {
+        size_t cap = enc->cap;
+        while (cap - enc->len < size) cap *= 2;
+        char* data = lua_newuserdatauv(enc->ls, cap, 0);
+        memcpy(data, enc->data, enc->len);
+        lua_replace(enc->ls, enc->idx);
+        enc->data = data;
+        enc->cap = cap;
+    }
+    return enc->data + enc->len;
+}
+
+static inline void enc_add(Encoder* enc, char const* s, size_t len) {
+    memcpy(enc_reserve(enc, len), s, len);
+    enc->len += len;
+}
+
+#define enc_literal(enc, s) enc_add((enc), "" s, sizeof(s) - 1)
+
+static inline void enc_char(Encoder* enc, char c) {
+    *enc_reserve(enc, 1) = c;
+    ++enc->len;
+}
+
+// Write the buffered output to the writer.
+static void enc_flush(Encoder* enc) {
+    lua_State* ls = enc->ls;
+    if (enc->len == 0) return;
+    lua_getfield(ls, enc->writer, "write");
+    lua_pushvalue(ls, enc->writer);
+    lua_pushlstring(ls, enc->data, enc->len);
+    lua_call(ls, 2, 2);
+    if (!lua_toboolean(ls, -2)) {
+        if (lua_isnil(ls, -1)) lua_pushliteral(ls, "write failed");
+        lua_error(ls);
+    }
+    lua_pop(ls, 2);
+    enc->len = 0;
+}
+
+static inline void enc_maybe_flush(Encoder* enc) {
+    if (enc->writer != 0 && enc->len >= MLUA_JSON_WRITE_SIZE) enc_flush(enc);
+}
+
+static void enc_string(Encoder* enc, char const* s, size_t len) {
+    static char const hex[] = "0123456789abcdef";
+    enc_char(enc, '"');
+    size_t start = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        enc_add(enc, s + start, i - start);
+        start = i + 1;
+        char* p = enc_reserve(enc, 6);
+        p[0] = '\\';
+        switch (c) {
+        case '"': p[1] = '"'; break;
+        case '\\': p[1] = '\\'; break;
+        case '\b': p[1] = 'b'; break;
+        case '\f': p[1] = 'f'; break;
+        case '\n': p[1] = 'n'; break;
+        case '\r': p[1] = 'r'; break;
+        case '\t': p[1] = 't'; break;
+        default:
+            memcpy(p + 1, "u00", 3);
+            p[4] = hex[c >> 4];
+            p[5] = hex[c & 0xf];
+            enc->len += 6;
+            continue;
+        }
+        enc->len += 2;
+    }
+    enc_add(enc, s + start, len - start);
+    enc_char(enc, '"');
+}
+
+static void enc_number(Encoder* enc, int idx) {
+    char buf[MLUA_MAX_NUMBER_STR_SIZE];
+    int len;
+    if (lua_isinteger(enc->ls, idx)) {
+        len = snprintf(buf, sizeof(buf), LUA_INTEGER_FMT,
+                       (LUAI_UACINT)lua_tointeger(enc->ls, idx));
+    } else {
+        lua_Number n = lua_tonumber(enc->ls, idx);
+        if (!isfinite(n)) luaL_error(enc->ls, "cannot encode inf or nan");
+        len = mlua_number_to_string(n, buf, sizeof(buf));
+    }
+    enc_add(enc, buf, len);
+}
+
+// Return true iff the metatable of the value at the given index is the
+// metatable with the given registry name.
+static bool has_metatable(lua_State* ls, int idx, char const* name) {
+    if (!lua_getmetatable(ls, idx)) return false;
+    luaL_getmetatable(ls, name);
+    bool res = lua_rawequal(ls, -1, -2);
+    lua_pop(ls, 2);
+    return res;
+}
+
+// Determine if the table at the given index is encoded as an array, and if so,
+// return its length.
+static bool is_array(lua_State* ls, int idx, lua_Integer* len) {
+    if (has_metatable(ls, idx, array_name)
+            || has_metatable(ls, idx, list_name)) {
+        if (lua_getfield(ls, idx, "n") == LUA_TNIL) {
+            *len = lua_rawlen(ls, idx);
+        } else {
+            int isnum;
+            *len = lua_tointegerx(ls, -1, &isnum);
+            if (!isnum || *len < 0) luaL_error(ls, "invalid array length");
+        }
+        lua_pop(ls, 1);
+        return true;
+    }
+    if (has_metatable(ls, idx, object_name)) return false;
+
+    // Plain tables are arrays if they are non-empty and their keys are
+    // exactly 1..n.
+    lua_Integer cnt = 0;
+    lua_pushnil(ls);
+    while (lua_next(ls, idx) != 0) {
+        lua_pop(ls, 1);
+        if (!lua_isinteger(ls, -1) || lua_tointeger(ls, -1) <= 0) {
+            lua_pop(ls, 1);
+            return false;
+        }
+        ++cnt;
+    }
+    if (cnt == 0 || (lua_Integer)lua_rawlen(ls, idx) != cnt) return false;
+    *len = cnt;
+    return true;
+}
+
+static void enc_value(Encoder* enc, int idx);
+
+static void enc_table(Encoder* enc, int idx) {
+    lua_State* ls = enc->ls;
+    if (enc->depth >= MLUA_JSON_MAX_DEPTH) {
+        luaL_error(ls, "nesting too deep");
+    }
+    luaL_checkstack(ls, 8, "nesting too deep");
+    ++enc->depth;
+    lua_Integer len;
+    if (is_array(ls, idx, &len)) {
+        enc_char(enc, '[');
+        for (lua_Integer i = 1; i <= len; ++i) {
+            if (i > 1) enc_char(enc, ',');
+            lua_geti(ls, idx, i);
+            enc_value(enc, lua_gettop(ls));
+            lua_pop(ls, 1);
+        }
+        enc_char(enc, ']');
+    } else {
+        enc_char(enc, '{');
+        bool first = true;
+        lua_pushnil(ls);
+        while (lua_next(ls, idx) != 0) {
+            if (!first) enc_char(enc, ',');
+            first = false;
+            int top = lua_gettop(ls);
+            switch (lua_type(ls, top - 1)) {
+            case LUA_TSTRING: {
+                size_t klen;
+                char const* k = lua_tolstring(ls, top - 1, &klen);
+                enc_string(enc, k, klen);
+                break;
+            }
+            case LUA_TNUMBER:
+                enc_char(enc, '"');
+                enc_number(enc, top - 1);
+                enc_char(enc, '"');
+                break;
+            default:
+                luaL_error(ls, "cannot encode %s key",
+                           luaL_typename(ls, top - 1));
+            }
+            enc_char(enc, ':');
+            enc_value(enc, top);
+            lua_pop(ls, 1);
+        }
+        enc_char(enc, '}');
+    }
+    --enc->depth;
+}
+
+static void enc_value(Encoder* enc, int idx) {
+    lua_State* ls = enc->ls;
+    switch (lua_type(ls, idx)) {
+    case LUA_TNIL:
+        enc_literal(enc, "null");
+        break;
+    case LUA_TBOOLEAN:
+        if (lua_toboolean(ls, idx)) {
+            enc_literal(enc, "true");
+        } else {
+            enc_literal(enc, "false");
+        }
+        break;
+    case LUA_TNUMBER:
+        enc_number(enc, idx);
+        break;
+    case LUA_TSTRING: {
+        size_t len;
+        char const* s = lua_tolstring(ls, idx, &len);
+        enc_string(enc, s, len);
+        break;
+    }
+    case LUA_TTABLE:
+        enc_table(enc, idx);
+        break;
+    case LUA_TLIGHTUSERDATA:
+        if (lua_touserdata(ls, idx) == NULL) {
+            enc_literal(enc, "null");
+            break;
+        }
+        // fall through
+    default: {
+#if !MLUA_IS64INT
+        int64_t v;
+        if (mlua_test_int64(ls, idx, &v)) {
+            char buf[MLUA_MAX_INT64_STR_SIZE];
+            enc_add(enc, buf, mlua_int64_to_string(v, buf, sizeof(buf)));
+            break;
+        }
+#endif
+        luaL_error(ls, "cannot encode %s", luaL_typename(ls, idx));
+    }
+    }
+    enc_maybe_flush(enc);
+}
+
+static int mod_encode(lua_State* ls) {
+    luaL_checkany(ls, 1);
+    lua_settop(ls, 2);
+    Encoder enc = {.ls = ls, .idx = 3, .cap = 64};
+    if (!lua_isnil(ls, 2)) enc.writer = 2;
+    enc.data = lua_newuserdatauv(ls, enc.cap, 0);
+    enc_value(&enc, 1);
+    if (enc.writer == 0) {
+        lua_pushlstring(ls, enc.data, enc.len);
+        return 1;
+    }
+    enc_flush(&enc);
+    return 0;
+}
+
+// A parser. The metatable for arrays is at index "array_mt".
+typedef struct Parser {
+    lua_State* ls;
+    char const* start;
+    char const* p;
+    char const* end;
+    int array_mt;
+    int depth;
+    char const* err;
+} Parser;
+
+static bool parse_value(Parser* ps);
+
+static inline bool fail(Parser* ps, char const* err) {
+    if (ps->err == NULL) ps->err = err;
+    return false;
+}
+
+static inline void skip_ws(Parser* ps) {
+    char const* p = ps->p;
+    char const* end = ps->end;
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+        ++p;
+    }
+    ps->p = p;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex4(Parser* ps, uint32_t* value) {
+    if (ps->end - ps->p < 4) return fail(ps, "invalid escape");
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) {
+        int d = hex_digit(*ps->p++);
+        if (d < 0) return fail(ps, "invalid escape");
+        v = (v << 4) | d;
+    }
+    *value = v;
+    return true;
+}
+
+static int encode_utf8(uint32_t cp, char* buf) {
+    if (cp < 0x80) {
+        buf[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        buf[0] = 0xc0 | (cp >> 6);
+        buf[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    } else if (cp < 0x10000) {
+        buf[0] = 0xe0 | (cp >> 12);
+        buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+        buf[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    buf[0] = 0xf0 | (cp >> 18);
+    buf[1] = 0x80 | ((cp >> 12) & 0x3f);
+    buf[2] = 0x80 | ((cp >> 6) & 0x3f);
+    buf[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+static bool parse_escape(Parser* ps, luaL_Buffer* buf) {
+    if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+    char c = *ps->p++;
+    switch (c) {
+    case '"': case '\\': case '/': luaL_addchar(buf, c); return true;
+    case 'b': luaL_addchar(buf, '\b'); return true;
+    case 'f': luaL_addchar(buf, '\f'); return true;
+    case 'n': luaL_addchar(buf, '\n'); return true;
+    case 'r': luaL_addchar(buf, '\r'); return true;
+    case 't': luaL_addchar(buf, '\t'); return true;
+    case 'u': break;
+    default: return fail(ps, "invalid escape");
+    }
+    uint32_t cp;
+    if (!parse_hex4(ps, &cp)) return false;
+    if (cp >= 0xd800 && cp < 0xdc00 && ps->end - ps->p >= 6
+            && ps->p[0] == '\\' && ps->p[1] == 'u') {
+        char const* p = ps->p;
+        ps->p += 2;
+        uint32_t lo;
+        if (!parse_hex4(ps, &lo)) return false;
+        if (lo >= 0xdc00 && lo < 0xe000) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+        } else {
+            ps->p = p;  // Not a low surrogate; decode it separately
+        }
+    }
+    char u[4];
+    luaL_addlstring(buf, u, encode_utf8(cp, u));
+    return true;
+}
+
+// Parse a string, and push it onto the stack.
+static bool parse_string(Parser* ps) {
+    char const* p = ++ps->p;
+    char const* end = ps->end;
+    while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) {
+        ++p;
+    }
+    if (p < end && *p == '"') {
+        lua_pushlstring(ps->ls, ps->p, p - ps->p);
+        ps->p = p + 1;
+        return true;
+    }
+    luaL_Buffer buf;
+    luaL_buffinit(ps->ls, &buf);
+    for (;;) {
+        luaL_addlstring(&buf, ps->p, p - ps->p);
+        ps->p = p;
+        if (p >= end) return fail(ps, "unexpected end of input");
+        char c = *p;
+        if (c == '"') break;
+        if (c != '\\') return fail(ps, "invalid character in string");
+        ++ps->p;
+        if (!parse_escape(ps, &buf)) return false;
+        p = ps->p;
+        while (p < end && *p != '"' && *p != '\\'
+               && (unsigned char)*p >= 0x20) {
+            ++p;
+        }
+    }
+    ++ps->p;
+    luaL_pushresult(&buf);
+    return true;
+}
+
+static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Parse a number, and push it onto the stack.
+static bool parse_number(Parser* ps) {
+    char const* p = ps->p;
+    char const* end = ps->end;
+    bool neg = p < end && *p == '-';
+    if (neg) ++p;
+    if (p >= end || !is_digit(*p)) return fail(ps, "invalid number");
+    uint64_t v = 0;
+    bool overflow = false;
+    if (*p == '0') {
+        ++p;
+    } else {
+        while (p < end && is_digit(*p)) {
+            unsigned d = *p++ - '0';
+            if (v > (UINT64_MAX - d) / 10) overflow = true;
+            v = v * 10 + d;
+        }
+    }
+    bool is_int = true;
+    if (p < end && *p == '.') {
+        is_int = false;
+        ++p;
+        if (p >= end || !is_digit(*p)) return fail(ps, "invalid number");
+        while (p < end && is_digit(*p)) ++p;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        is_int = false;
+        ++p;
+        if (p < end && (*p == '+' || *p == '-')) ++p;
+        if (p >= end || !is_digit(*p)) return fail(ps, "invalid number");
+        while (p < end && is_digit(*p)) ++p;
+    }
+    if (is_int && !overflow
+            && v <= (neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX)) {
+        int64_t i = neg ? (int64_t)(0 - v) : (int64_t)v;
+        mlua_push_minint(ps->ls, i);
+        ps->p = p;
+        return true;
+    }
+
+    // Convert with strtod(), which requires a zero-terminated string.
+    size_t len = p - ps->p;
+    char buf[64];
+    char const* s = buf;
+    if (len < sizeof(buf)) {
+        memcpy(buf, ps->p, len);
+        buf[len] = '\0';
+    } else {
+        s = lua_pushlstring(ps->ls, ps->p, len);
+    }
+    lua_Number n = strtod(s, NULL);
+    if (s != buf) lua_pop(ps->ls, 1);
+    lua_pushnumber(ps->ls, n);
+    ps->p = p;
+    return true;
+}
+
+static bool parse_literal(Parser* ps, char const* lit, size_t len) {
+    if ((size_t)(ps->end - ps->p) < len) {
+        if (memcmp(ps->p, lit, ps->end - ps->p) == 0) {
+            return fail(ps, "unexpected end of input");
+        }
+        return fail(ps, "invalid literal");
+    }
+    if (memcmp(ps->p, lit, len) != 0) return fail(ps, "invalid literal");
+    ps->p += len;
+    return true;
+}
+
+static bool enter(Parser* ps) {
+    if (ps->depth >= MLUA_JSON_MAX_DEPTH) return fail(ps, "nesting too deep");
+    if (!lua_checkstack(ps->ls, 4)) return fail(ps, "nesting too deep");
+    ++ps->depth;
+    return true;
+}
+
+static bool parse_array(Parser* ps) {
+    if (!enter(ps)) return false;
+    ++ps->p;
+    lua_newtable(ps->ls);
+    lua_pushvalue(ps->ls, ps->array_mt);
+    lua_setmetatable(ps->ls, -2);
+    skip_ws(ps);
+    if (ps->p < ps->end && *ps->p == ']') {
+        ++ps->p;
+        --ps->depth;
+        return true;
+    }
+    for (lua_Integer i = 1;; ++i) {
+        if (!parse_value(ps)) return false;
+        lua_rawseti(ps->ls, -2, i);
+        skip_ws(ps);
+        if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+        char c = *ps->p++;
+        if (c == ']') break;
+        if (c != ',') return fail(ps, "expected ',' or ']'");
+    }
+    --ps->depth;
+    return true;
+}
+
+static bool parse_object(Parser* ps) {
+    if (!enter(ps)) return false;
+    ++ps->p;
+    lua_newtable(ps->ls);
+    skip_ws(ps);
+    if (ps->p < ps->end && *ps->p == '}') {
+        ++ps->p;
+        --ps->depth;
+        return true;
+    }
+    for (;;) {
+        skip_ws(ps);
+        if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+        if (*ps->p != '"') return fail(ps, "expected string key");
+        if (!parse_string(ps)) return false;
+        skip_ws(ps);
+        if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+        if (*ps->p++ != ':') return fail(ps, "expected ':'");
+        if (!parse_value(ps)) return false;
+        lua_rawset(ps->ls, -3);
+        skip_ws(ps);
+        if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+        char c = *ps->p++;
+        if (c == '}') break;
+        if (c != ',') return fail(ps, "expected ',' or '}'");
+    }
+    --ps->depth;
+    return true;
+}
+
+// Parse a value, and push it onto the stack.
+static bool parse_value(Parser* ps) {
+    skip_ws(ps);
+    if (ps->p >= ps->end) return fail(ps, "unexpected end of input");
+    switch (*ps->p) {
+    case '{': return parse_object(ps);
+    case '[': return parse_array(ps);
+    case '"': return parse_string(ps);
+    case 't':
+        if (!parse_literal(ps, "true", 4)) return false;
+        lua_pushboolean(ps->ls, true);
+        return true;
+    case 'f':
+        if (!parse_literal(ps, "false", 5)) return false;
+        lua_pushboolean(ps->ls, false);
+        return true;
+    case 'n':
+        if (!parse_literal(ps, "null", 4)) return false;
+        lua_pushlightuserdata(ps->ls, NULL);
+        return true;
+    default:
+        if (*ps->p == '-' || is_digit(*ps->p)) return parse_number(ps);
+        return fail(ps, "unexpected character");
+    }
+}
+
+// Parse a complete document in [start, end), and push the resulting value.
+// Returns false and pushes an error message on failure.
+static bool parse(lua_State* ls, char const* start, char const* end) {
+    int top = lua_gettop(ls);
+    luaL_getmetatable(ls, array_name);
+    Parser ps = {.ls = ls, .start = start, .p = start, .end = end,
+                 .array_mt = top + 1};
+    if (parse_value(&ps)) {
+        skip_ws(&ps);
+        if (ps.p == ps.end) {
+            lua_replace(ls, top + 1);
+            return true;
+        }
+        fail(&ps, "trailing data");
+    }
+    lua_settop(ls, top);
+    lua_pushfstring(ls, "%s at offset %I", ps.err,
+                    (lua_Integer)(ps.p - ps.start));
+    return false;
+}
+
+static int mod_decode(lua_State* ls) {
+    MLuaBuffer buf;
+    luaL_argexpected(ls, mlua_get_ro_buffer(ls, 1, &buf), 1,
+                     "string or buffer");
+    luaL_argexpected(ls, buf.vt == NULL, 1, "raw buffer");
+    if (!parse(ls, buf.ptr, (char const*)buf.ptr + buf.size)) {
+        luaL_pushfail(ls);
+        lua_insert(ls, -2);
+        return 2;
+    }
+    return 1;
+}
+
+static int mod_array(lua_State* ls) {
+    if (lua_isnoneornil(ls, 1)) {
+        lua_settop(ls, 0);
+        lua_newtable(ls);
+    }
+    luaL_checktype(ls, 1, LUA_TTABLE);
+    lua_settop(ls, 1);
+    luaL_setmetatable(ls, array_name);
+    return 1;
+}
+
+static int mod_object(lua_State* ls) {
+    if (lua_isnoneornil(ls, 1)) {
+        lua_settop(ls, 0);
+        lua_newtable(ls);
+    }
+    luaL_checktype(ls, 1, LUA_TTABLE);
+    lua_settop(ls, 1);
+    luaL_setmetatable(ls, object_name);
+    return 1;
+}
+
+static int mod_is_array(lua_State* ls) {
+    luaL_checktype(ls, 1, LUA_TTABLE);
+    return lua_pushboolean(ls, has_metatable(ls, 1, array_name)), 1;
+}
+
+static char const Decoder_name[] = "mlua.json.Decoder";
+
+// The states of the incremental decoder scanner.
+typedef enum ScanState {
+    SCAN_IDLE,
+    SCAN_CONTAINER,
+    SCAN_STRING,
+    SCAN_ESCAPE,
+    SCAN_SCALAR,
+} ScanState;
+
+// An incremental decoder. The buffered input is stored at [head, tail) in a
+// storage userdata, kept as user value 1. A scanner tracks the nesting of
+// the input as it arrives, so that values are only parsed once they are
+// complete. "scan" is the offset up to which the input was scanned, relative
+// to head.
+typedef struct Decoder {
+    char* data;
+    size_t cap;
+    size_t head;
+    size_t tail;
+    size_t scan;
+    uint32_t depth;
+    ScanState state;
+} Decoder;
+
+static inline Decoder* check_Decoder(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Decoder_name);
+}
+
+static void dec_set_storage(lua_State* ls, int arg, Decoder* dec,
+                            size_t cap) {
+    char* data = lua_newuserdatauv(ls, cap, 0);
+    size_t len = dec->tail - dec->head;
+    if (len > 0) memcpy(data, dec->data + dec->head, len);
+    lua_setiuservalue(ls, arg, 1);
+    dec->data = data;
+    dec->cap = cap;
+    dec->head = 0;
+    dec->tail = len;
+}
+
+static char* dec_reserve(lua_State* ls, int arg, Decoder* dec, size_t size) {
+    if (size <= dec->cap - dec->tail) return dec->data + dec->tail;
+    size_t len = dec->tail - dec->head;
+    if (size > SIZE_MAX / 2 - len) luaL_error(ls, "input too large");
+    if (len + size <= dec->cap && dec->head >= len) {
+        memmove(dec->data, dec->data + dec->head, len);
+        dec->head = 0;
+        dec->tail = len;
+    } else {
+        size_t cap = dec->cap;
+        while (cap < len + size) cap *= 2;
+        dec_set_storage(ls, arg, dec, cap);
+    }
+    return dec->data + dec->tail;
+}
+
+static inline void dec_consume(Decoder* dec, size_t len) {
+    dec->head += len;
+    dec->scan -= len;
+    if (dec->head == dec->tail) dec->head = dec->tail = 0;
+}
+
+static inline bool is_ws(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool is_delim(char c) {
+    return is_ws(c) || c == ',' || c == ':' || c == '[' || c == ']'
+           || c == '{' || c == '}' || c == '"';
+}
+
+// Scan the buffered input for the end of the next value. Returns the length
+// of the value, or 0 if the value isn't complete yet.
+static size_t dec_scan(Decoder* dec) {
+    char const* data = dec->data + dec->head;
+    size_t len = dec->tail - dec->head;
+    size_t i = dec->scan;
+    for (; i < len; ++i) {
+        char c = data[i];
+        switch (dec->state) {
+        case SCAN_IDLE:
+            if (c == '{' || c == '[') {
+                dec->state = SCAN_CONTAINER;
+                dec->depth = 1;
+            } else if (c == '"') {
+                dec->state = SCAN_STRING;
+                dec->depth = 0;
+            } else {
+                dec->state = SCAN_SCALAR;
+            }
+            break;
+        case SCAN_CONTAINER:
+            if (c == '"') {
+                dec->state = SCAN_STRING;
+            } else if (c == '{' || c == '[') {
+                ++dec->depth;
+            } else if ((c == '}' || c == ']') && --dec->depth == 0) {
+                dec->scan = i + 1;
+                return i + 1;
+            }
+            break;
+        case SCAN_STRING:
+            if (c == '\\') {
+                dec->state = SCAN_ESCAPE;
+            } else if (c == '"') {
+                if (dec->depth == 0) {
+                    dec->scan = i + 1;
+                    return i + 1;
+                }
+                dec->state = SCAN_CONTAINER;
+            }
+            break;
+        case SCAN_ESCAPE:
+            dec->state = SCAN_STRING;
+            break;
+        case SCAN_SCALAR:
+            if (is_delim(c)) {
+                dec->scan = i;
+                return i;
+            }
+            break;
+        }
+    }
+    dec->scan = i;
+    return 0;
+}
+
+static int Decoder_feed(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    MLuaBuffer src;
+    luaL_argexpected(ls, mlua_get_ro_buffer(ls, 2, &src), 2,
+                     "string or buffer");
+    luaL_argcheck(ls, src.size != (size_t)-1, 2, "unsized buffer");
+    if (src.size > 0) {
+        char* dest = dec_reserve(ls, 1, dec, src.size);
+        mlua_buffer_read(&src, 0, src.size, dest);
+        dec->tail += src.size;
+    }
+    return lua_settop(ls, 1), 1;
+}
+
+static int Decoder_next(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    if (dec->state == SCAN_IDLE) {
+        // Drop the whitespace before the next value.
+        size_t i = 0, len = dec->tail - dec->head;
+        char const* data = dec->data + dec->head;
+        while (i < len && is_ws(data[i])) ++i;
+        dec->scan = i;
+        dec_consume(dec, i);
+    }
+    size_t len = dec_scan(dec);
+    if (len == 0) return 0;
+    dec->state = SCAN_IDLE;
+    char const* start = dec->data + dec->head;
+    bool ok = parse(ls, start, start + len);
+    dec_consume(dec, len);
+    if (ok) return 1;
+    luaL_pushfail(ls);
+    lua_insert(ls, -2);
+    return 2;
+}
+
+static int Decoder_reset(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    dec->head = dec->tail = dec->scan = 0;
+    dec->depth = 0;
+    dec->state = SCAN_IDLE;
+    return lua_settop(ls, 1), 1;
+}
+
+static int Decoder___len(lua_State* ls) {
+    Decoder* dec = check_Decoder(ls, 1);
+    return mlua_push_size(ls, dec->tail - dec->head), 1;
+}
+
+MLUA_SYMBOLS(Decoder_syms) = {
+    MLUA_SYM_F(feed, Decoder_),
+    MLUA_SYM_F(next, Decoder_),
+    MLUA_SYM_F(reset, Decoder_),
+};
+
+MLUA_SYMBOLS_NOHASH(Decoder_syms_nh) = {
+    MLUA_SYM_F_NH(__len, Decoder_),
+};
+
+static int mod_decoder(lua_State* ls) {
+    Decoder* dec = lua_newuserdatauv(ls, sizeof(Decoder), 1);
+    memset(dec, 0, sizeof(*dec));
+    luaL_getmetatable(ls, Decoder_name);
+    lua_setmetatable(ls, -2);
+    dec_set_storage(ls, lua_gettop(ls), dec, 64);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_V(null, lightuserdata, NULL),
+    MLUA_SYM_F(encode, mod_),
+    MLUA_SYM_F(decode, mod_),
+    MLUA_SYM_F(decoder, mod_),
+    MLUA_SYM_F(array, mod_),
+    MLUA_SYM_F(object, mod_),
+    MLUA_SYM_F(is_array, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.json) {
+#if !MLUA_IS64INT
+    mlua_require(ls, "mlua.int64", false);
+#endif
+
+    mlua_new_module(ls, 0, module_syms);
+    luaL_newmetatable(ls, array_name);
+    lua_pop(ls, 1);
+    luaL_newmetatable(ls, object_name);
+    lua_pop(ls, 1);
+
+    // Create the Decoder class.
+    mlua_new_class(ls, Decoder_name, Decoder_syms, Decoder_syms_nh);
+    lua_pop(ls, 1);
+    return 1;
+}
@@ -0,0 +1,291 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local json = require 'mlua.json'
+local list = require 'mlua.list'
+local mem = require 'mlua.mem'
+local math = require 'math'
+local string = require 'string'
+local table = require 'table'
+
+local float32 = string.packsize('n') == 4
+
+-- Compare decoded values recursively.
+local function deep_eq(a, b)
+    if type(a) ~= 'table' or type(b) ~= 'table' then return equal(a, b) end
+    for k, v in pairs(a) do
+        if not deep_eq(v, rawget(b, k)) then return false end
+    end
+    for k in pairs(b) do
+        if rawget(a, k) == nil then return false end
+    end
+    return true
+end
+
+function test_encode(t)
+    for _, test in ipairs{
+        {nil, 'null'},
+        {json.null, 'null'},
+        {true, 'true'},
+        {false, 'false'},
+        {123, '123'},
+        {-4.5, '-4.5'},
+        {1.0, '1.0'},
+        {0.1 + 0.2, float32 and '0.3' or '0.30000000000000004'},
+        {1 / 3, float32 and '0.33333334' or '0.3333333333333333'},
+        {'abc', '"abc"'},
+        {'a"b\\c\b\f\n\r\t\1\x1f\x7f\xc3\xa9',
+         '"a\\"b\\\\c\\b\\f\\n\\r\\t\\u0001\\u001f\x7f\xc3\xa9"'},
+        {{}, '{}'},
+        {{1, 2, 'x'}, '[1,2,"x"]'},
+        {{[1] = 1, [3] = 3}, '{"1":1,"3":3}'},
+        {{a = {b = {}}}, '{"a":{"b":{}}}'},
+        {json.array(), '[]'},
+        {json.array{n = 3}, '[null,null,null]'},
+        {json.object{1, 2}, '{"1":1,"2":2}'},
+        {list(), '[]'},
+        {list{1, nil, 3, n = 3}, '[1,null,3]'},
+    } do
+        local v, want = table.unpack(test, 1, 2)
+        t:expect(t.expr(json).encode(v)):eq(want)
+    end
+end
+
+function test_encode_errors(t)
+    local rec = {}
+    rec.a = rec
+    t:expect(t.expr(json).encode(rec)):raises("nesting too deep")
+    t:expect(t.expr(json).encode(print)):raises("cannot encode function")
+    t:expect(t.expr(json).encode({[true] = 1}))
+        :raises("cannot encode boolean key")
+    t:expect(t.expr(json).encode(math.huge)):raises("cannot encode inf")
+end
+
+function test_encode_writer(t)
+    local parts = {}
+    local w = {write = function(self, data)
+        table.insert(parts, data)
+        return true
+    end}
+    local v = {}
+    for i = 1, 100 do v[i] = {i, 'text', {key = i}} end
+    t:expect(t.expr(json).encode(v, w)):eq(nil)
+    t:expect(#parts):label("#parts"):gt(1)
+    t:expect(table.concat(parts)):label("output"):eq(json.encode(v))
+    local fw = {write = function() return nil, "boom" end}
+    t:expect(t.expr(json).encode(v, fw)):raises("boom")
+end
+
+function test_decode(t)
+    for _, test in ipairs{
+        {' null ', json.null},
+        {'true', true},
+        {'false', false},
+        {'0', 0},
+        {'-12', -12},
+        {'-9223372036854775808', math.mininteger},
+        {'1.5', 1.5},
+        {'-3e2', -300.0},
+        {'2E-1', 0.2},
+        {'"abc"', 'abc'},
+        {'"a\\"\\\\\\/\\b\\f\\n\\r\\t"', 'a"\\/\b\f\n\r\t'},
+        {'"\\u00e9\\u20ac\\ud83d\\ude00"',
+         '\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80'},
+        {'[]', {}},
+        {'[1, "a", [true]]', {1, 'a', {true}}},
+        {'{"a": {"b": [1, 2]}, "c": null}',
+         {a = {b = {1, 2}}, c = json.null}},
+    } do
+        local data, want = table.unpack(test, 1, 2)
+        t:expect(t.expr(json).decode(data)):eq(want, deep_eq)
+    end
+    local v = json.decode('[[], {}]')
+    t:expect(t.expr(json).is_array(v)):eq(true)
+    t:expect(t.expr(json).is_array(v[1])):eq(true)
+    t:expect(t.expr(json).is_array(v[2])):eq(false)
+    t:expect(t.expr(json).encode(v)):eq('[[],{}]')
+    t:expect(math.type(json.decode('12345678901234567890')))
+        :label("type(big)"):eq('float')
+
+    local buf = mem.alloc(9)
+    mem.write(buf, '{"a": 1} ')
+    t:expect(t.expr(json).decode(buf)):eq({a = 1}, deep_eq)
+end
+
+function test_decode_errors(t)
+    for _, test in ipairs{
+        {'', "unexpected end of input at offset 0"},
+        {'[1,', "unexpected end of input at offset 3"},
+        {'[1,]', "unexpected character at offset 3"},
+        {'{"a" 1}', "expected ':' at offset 6"},
+        {'{"a": 1,}', "expected string key at offset 8"},
+        {'{1: 2}', "expected string key at offset 1"},
+        {'[1] x', "trailing data at offset 4"},
+        {'tru', "unexpected end of input at offset 0"},
+        {'nulx', "invalid literal at offset 0"},
+        {'01', "trailing data at offset 1"},
+        {'1.', "invalid number at offset 0"},
+        {'"\\x"', "invalid escape at offset 3"},
+        {'"a\1"', "invalid character in string at offset 2"},
+        {('['):rep(100) .. (']'):rep(100), "nesting too deep at offset 64"},
+    } do
+        local data, want = table.unpack(test, 1, 2)
+        t:expect(t.mexpr(json).decode(data)):eq{nil, want, n = 2}
+    end
+end
+
+function test_Decoder(t)
+    local doc = '{"a": [1, "x]\\"y"]} [2] "s" 42 true\n{"b": null}\n'
+    local want = {{a = {1, 'x]"y'}}, {2}, 's', 42, true, {b = json.null}}
+    for _, size in ipairs{1, 3, 7, #doc} do
+        local dec, got = json.decoder(), {}
+        for i = 1, #doc, size do
+            dec:feed(doc:sub(i, i + size - 1))
+            while true do
+                local v, err = dec:next()
+                if v == nil then
+                    t:assert(err == nil, "unexpected error: %s", err)
+                    break
+                end
+                table.insert(got, v)
+            end
+        end
+        t:expect(got):label("values(size=%s)", size):eq(want, deep_eq)
+        t:expect(#dec):label("#dec"):eq(0)
+    end
+
+    local dec = json.decoder()
+    dec:feed('[1, }  [2]')
+    t:expect(t.mexpr(dec):next())
+        :eq{nil, "unexpected character at offset 4", n = 2}
+    t:expect(t.expr(dec):next()):eq({2}, deep_eq)
+    t:expect(t.expr(dec):next()):eq(nil)
+    dec:feed('[3')
+    t:expect(t.expr(dec):reset()):eq(dec)
+    t:expect(#dec):label("#dec"):eq(0)
+end
+
+-- A pure-Lua JSON codec, for benchmarking.
+local lua_json = {}
+
+local escapes = {['"'] = '\\"', ['\\'] = '\\\\', ['\b'] = '\\b',
+                 ['\f'] = '\\f', ['\n'] = '\\n', ['\r'] = '\\r',
+                 ['\t'] = '\\t'}
+
+function lua_json.encode(v)
+    local typ = type(v)
+    if typ == 'table' then
+        local parts = {}
+        if #v > 0 then
+            for _, e in ipairs(v) do table.insert(parts, lua_json.encode(e)) end
+            return '[' .. table.concat(parts, ',') .. ']'
+        end
+        for k, e in pairs(v) do
+            table.insert(parts, lua_json.encode(tostring(k)) .. ':'
+                                .. lua_json.encode(e))
+        end
+        return '{' .. table.concat(parts, ',') .. '}'
+    elseif typ == 'string' then
+        return '"' .. v:gsub('[%c"\\]', function(c)
+            return escapes[c] or ('\\u%04x'):format(c:byte())
+        end) .. '"'
+    elseif v == nil then return 'null' end
+    return tostring(v)
+end
+
+function lua_json.decode(s)
+    local pos = 1
+    local value
+    local function ws() pos = s:find('[^ \t\r\n]', pos) or #s + 1 end
+    value = function()
+        ws()
+        local c = s:sub(pos, pos)
+        if c == '{' then
+            local res = {}
+            pos = pos + 1
+            ws()
+            if s:sub(pos, pos) == '}' then pos = pos + 1 return res end
+            while true do
+                ws()
+                local k = value()
+                ws()
+                pos = pos + 1  -- ':'
+                res[k] = value()
+                ws()
+                c = s:sub(pos, pos)
+                pos = pos + 1
+                if c == '}' then return res end
+            end
+        elseif c == '[' then
+            local res = {}
+            pos = pos + 1
+            ws()
+            if s:sub(pos, pos) == ']' then pos = pos + 1 return res end
+            while true do
+                table.insert(res, value())
+                ws()
+                c = s:sub(pos, pos)
+                pos = pos + 1
+                if c == ']' then return res end
+            end
+        elseif c == '"' then
+            local parts = {}
+            pos = pos + 1
+            while true do
+                c = s:sub(pos, pos)
+                pos = pos + 1
+                if c == '"' then return table.concat(parts) end
+                if c == '\\' then
+                    c = s:sub(pos, pos)
+                    pos = pos + 1
+                    if c == 'n' then c = '\n' elseif c == 't' then c = '\t' end
+                end
+                table.insert(parts, c)
+            end
+        elseif s:sub(pos, pos + 3) == 'true' then pos = pos + 4 return true
+        elseif s:sub(pos, pos + 4) == 'false' then pos = pos + 5 return false
+        elseif s:sub(pos, pos + 3) == 'null' then pos = pos + 4 return nil end
+        local num = s:match('^-?%d+%.?%d*[eE]?[-+]?%d*', pos)
+        pos = pos + #num
+        return math.tointeger(num) or tonumber(num)
+    end
+    return value()
+end
+
+local function bench_data()
+    local data = {}
+    for i = 1, 20 do
+        table.insert(data, {id = i, name = ('item %d'):format(i),
+                            tags = {'a', 'b\n'}, price = i * 1.25,
+                            active = i % 2 == 0})
+    end
+    return data
+end
+
+function bench_encode_lua(b)
+    local data = bench_data()
+    b:bytes(#json.encode(data))
+    b:reset_timer()
+    for i = 1, b.n do lua_json.encode(data) end
+end
+
+function bench_encode_C(b)
+    local data = bench_data()
+    b:bytes(#json.encode(data))
+    b:reset_timer()
+    for i = 1, b.n do json.encode(data) end
+end
+
+function bench_decode_lua(b)
+    local data = json.encode(bench_data())
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do lua_json.decode(data) end
+end
+
+function bench_decode_C(b)
+    local data = json.encode(bench_data())
+    b:bytes(#data)
+    b:reset_timer()
+    for i = 1, b.n do json.decode(data) end
+end
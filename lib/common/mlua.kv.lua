@@ -0,0 +1,418 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local errors = require 'mlua.errors'
+local fs = require 'mlua.fs'
+local mem = require 'mlua.mem'
+local oo = require 'mlua.oo'
+local math = require 'math'
+local string = require 'string'
+local table = require 'table'
+
+-- The store file starts with a header containing a magic number, the number
+-- of index slots, the number of live entries, the number of used slots (live
+-- and deleted), and the number of bytes held by dead entries.
+local header = '<c4I4I4I4I4'
+local header_size = header:packsize()
+local magic = 'MLKV'
+
+-- The header is followed by the index, an open-addressing hash table of slots
+-- holding the hash of a key and the offset of its entry.
+local slot = '<I4I4'
+local slot_size = slot:packsize()
+local EMPTY, DELETED = 0, 1
+
+-- The index is followed by the entries, each holding the key and value
+-- lengths, the key and the value.
+local entry = '<I2I4'
+local entry_size = entry:packsize()
+
+-- The number of slots read at a time when iterating over the index.
+local slot_chunk = 64
+
+-- Raise an error carrying (msg, err) if "ok" is a failure, and return it
+-- otherwise.
+local function check(ok, msg, err)
+    if not ok then return error({msg, err}, 0) end
+    return ok
+end
+
+-- Return the results of a pcall(), translating errors raised by check() into
+-- (fail, msg, err).
+local function guard(ok, ...)
+    if ok then return ... end
+    local e = ...
+    if type(e) == 'table' then return nil, e[1], e[2] end
+    return error(e, 0)
+end
+
+-- Raise an ECORRUPT error.
+local function corrupt()
+    return check(nil, errors.message(errors.ECORRUPT), errors.ECORRUPT)
+end
+
+-- Compute the FNV-1a hash of a key. The values EMPTY and DELETED are never
+-- returned. Hashes are unsigned 32-bit values, which are negative when
+-- lua_Integer is a 32-bit integer, so they must be compared with math.ult().
+local function hash(key)
+    local h = 0x811c9dc5
+    for i = 1, #key do h = ((h ~ key:byte(i)) * 0x01000193) & 0xffffffff end
+    if math.ult(h, DELETED + 1) then h = h + 2 end
+    return h
+end
+
+-- Return the smallest power of two that is at least n.
+local function pow2(n)
+    local p = 1
+    while p < n do p = p << 1 end
+    return p
+end
+
+-- Read data at the given offset of a file.
+local function read_at(f, off, len)
+    check(f:seek(off))
+    local data = check(f:read(len))
+    if #data < len then corrupt() end
+    return data
+end
+
+-- Read the entry at the given offset, and return its key and value length.
+-- The file is left positioned at the start of the value.
+local function read_key(f, off)
+    local klen, vlen = entry:unpack(read_at(f, off, entry_size))
+    return read_at(f, off + entry_size, klen), vlen
+end
+
+-- A persistent key-value store, held in a single littlefs file.
+Store = oo.class('Store')
+
+function Store:__init(lfs, path, opts)
+    self._fs, self._path = lfs, path
+    self.min_slots = pow2(opts.slots or 64)
+    self.cache_size = opts.cache or 16
+    self._pending, self._npending = {}, 0  -- Deleted keys map to false
+    self._cache, self._ncache, self._tick = {}, 0, 0
+    self._hits, self._misses = 0, 0
+end
+
+-- Open the store file and read its header.
+function Store:_load()
+    local f = check(self._fs:open(self._path, fs.O_RDWR))
+    local ok, m, nslots, count, used, dead = pcall(function()
+        return header:unpack(read_at(f, 0, header_size))
+    end)
+    if not ok or m ~= magic or nslots == 0 or nslots & (nslots - 1) ~= 0 then
+        f:close()
+        corrupt()
+    end
+    self._f = f
+    self._nslots, self._count, self._used, self._dead =
+        nslots, count, used, dead
+end
+
+-- Find a key in the index. If the key is present, returns its slot index, the
+-- offset of its entry and the length of its value, and leaves the file
+-- positioned at the start of the value. Otherwise, returns the index of the
+-- slot where the key can be inserted, and true if that slot was deleted.
+-- "overlay" optionally maps slot indexes to the hashes of slots that were
+-- changed but not written yet.
+function Store:_find(key, h, overlay)
+    local f, mask = self._f, self._nslots - 1
+    local i, free = h & mask, nil
+    while true do
+        local sh, off = overlay and overlay[i], nil
+        if not sh then
+            sh, off = slot:unpack(
+                read_at(f, header_size + i * slot_size, slot_size))
+        elseif sh ~= DELETED then
+            sh = nil  -- Taken by another key of the same batch
+        end
+        if sh == EMPTY then return free or i, nil, nil, free ~= nil end
+        if sh == DELETED then
+            free = free or i
+        elseif sh == h then
+            local k, vlen = read_key(f, off)
+            if k == key then return i, off, vlen end
+        end
+        i = (i + 1) & mask
+    end
+end
+
+-- Return an iterator over the committed entries, yielding the key and the
+-- value length, and leaving the file positioned at the start of the value.
+function Store:_entries()
+    local f, nslots = self._f, self._nslots
+    local i, chunk, pos = 0, nil, nil
+    return function()
+        while i < nslots do
+            if i % slot_chunk == 0 then
+                local cnt = math.min(slot_chunk, nslots - i)
+                chunk = read_at(f, header_size + i * slot_size,
+                                cnt * slot_size)
+                pos = 1
+            end
+            local sh, off; sh, off, pos = slot:unpack(chunk, pos)
+            i = i + 1
+            if math.ult(DELETED, sh) then return read_key(f, off) end
+        end
+    end
+end
+
+-- Write a new store file holding the live entries and the pending changes,
+-- with the given number of slots, and replace the current file with it.
+function Store:_rewrite(nslots)
+    local lfs, tmp = self._fs, self._path .. '.tmp'
+    local out<close> = check(lfs:open(
+        tmp, fs.O_WRONLY | fs.O_CREAT | fs.O_TRUNC))
+    check(out:write(header:pack('\0\0\0\0', 0, 0, 0, 0)))
+    check(out:write(('\0'):rep(nslots * slot_size)))
+    local mask, hashes, offs = nslots - 1, {}, {}
+    local off, count = header_size + nslots * slot_size, 0
+    local function add(key, value)
+        local h = hash(key)
+        local i = h & mask
+        while hashes[i] do i = (i + 1) & mask end
+        hashes[i], offs[i] = h, off
+        check(out:write(entry:pack(#key, #value) .. key .. value))
+        off, count = off + entry_size + #key + #value, count + 1
+    end
+
+    local f, pending = self._f, self._pending
+    if f then
+        for key, vlen in self:_entries() do
+            if pending[key] == nil then add(key, check(f:read(vlen))) end
+        end
+    end
+    for key, value in pairs(pending) do
+        if value then add(key, value) end
+    end
+
+    -- Write the index and the header last, so that an interrupted rewrite
+    -- leaves an invalid file.
+    local parts = {}
+    for i = 0, mask do
+        table.insert(parts, slot:pack(hashes[i] or EMPTY, offs[i] or 0))
+    end
+    check(out:seek(header_size))
+    check(out:write(table.concat(parts)))
+    check(out:seek(0))
+    check(out:write(header:pack(magic, nslots, count, count, 0)))
+    check(out:close())
+    if f then
+        self._f = nil
+        check(f:close())
+    end
+    check(lfs:rename(tmp, self._path))
+    self:_load()
+end
+
+local function open_store(self)
+    local lfs, path = self._fs, self._path
+    lfs:remove(path .. '.tmp')  -- Left over by an interrupted rewrite
+    local ok, msg, err = lfs:stat(path)
+    if ok then
+        self:_load()
+    elseif err == errors.ENOENT then
+        self:_rewrite(self.min_slots)
+    else
+        check(ok, msg, err)
+    end
+    return self
+end
+
+-- Open the store held in the file "path" of the filesystem "lfs", creating it
+-- if it doesn't exist.
+function open(lfs, path, opts)
+    return guard(pcall(open_store, Store(lfs, path, opts or {})))
+end
+
+-- Add a value to the cache, evicting the least recently used value if the
+-- cache is full.
+function Store:_cache_put(key, value)
+    if self.cache_size <= 0 then return end
+    local cache = self._cache
+    if self._ncache >= self.cache_size then
+        local lru, used
+        for k, c in pairs(cache) do
+            if not used or c[2] < used then lru, used = k, c[2] end
+        end
+        cache[lru] = nil
+        self._ncache = self._ncache - 1
+    end
+    self._tick = self._tick + 1
+    cache[key] = {value, self._tick}
+    self._ncache = self._ncache + 1
+end
+
+local function get(self, key)
+    local value = self._pending[key]
+    if value ~= nil then return value end
+    local c = self._cache[key]
+    if c then
+        self._hits = self._hits + 1
+        self._tick = self._tick + 1
+        c[2] = self._tick
+        return c[1]
+    end
+    self._misses = self._misses + 1
+    local _, off, vlen = self:_find(key, hash(key))
+    value = off and check(self._f:read(vlen)) or false
+    self:_cache_put(key, value)
+    return value
+end
+
+-- Return the value associated with a key, or nil if the key isn't present. If
+-- "buffer" is provided, the value is written to it at "offset", and its length
+-- is returned instead.
+function Store:get(key, buffer, offset)
+    local ok, value, msg, err = pcall(get, self, key)
+    if not ok then return guard(ok, value) end
+    if not value then return nil end
+    if buffer then
+        mem.write(buffer, value, offset)
+        return #value
+    end
+    return value
+end
+
+-- Set the value associated with a key. The value can be a string or an object
+-- implementing the buffer protocol. A nil value removes the key. The change
+-- is buffered until the next commit.
+function Store:set(key, value)
+    if #key > 0xffff then return error("key too long", 2) end
+    if value == nil then
+        value = false
+    elseif type(value) ~= 'string' then
+        value = mem.read(value)
+    end
+    local pending = self._pending
+    if pending[key] == nil then self._npending = self._npending + 1 end
+    pending[key] = value
+    local cache = self._cache
+    if cache[key] then
+        cache[key] = nil
+        self._ncache = self._ncache - 1
+    end
+end
+
+-- Apply the pending changes in place. The index lookups are done first, so
+-- that a read error doesn't leave partial changes. New entries are appended
+-- with a single write.
+function Store:_update()
+    local f = self._f
+    local size = check(f:size())
+    local overlay, slots, parts = {}, {}, {}
+    local pos, count, used, dead = size, self._count, self._used, self._dead
+    for key, value in pairs(self._pending) do
+        local h = hash(key)
+        local i, off, vlen, reuse = self:_find(key, h, overlay)
+        if off then dead = dead + entry_size + #key + vlen end
+        if value then
+            if not off then
+                count = count + 1
+                if not reuse then used = used + 1 end
+            end
+            local e = entry:pack(#key, #value) .. key .. value
+            table.insert(parts, e)
+            overlay[i], slots[i] = h, slot:pack(h, pos)
+            pos = pos + #e
+        elseif off then
+            overlay[i], slots[i] = DELETED, slot:pack(DELETED, 0)
+            count = count - 1
+        end
+    end
+
+    if #parts > 0 then
+        check(f:seek(size))
+        check(f:write(table.concat(parts)))
+    end
+    for i, data in pairs(slots) do
+        check(f:seek(header_size + i * slot_size))
+        check(f:write(data))
+    end
+    check(f:seek(0))
+    check(f:write(header:pack(magic, self._nslots, count, used, dead)))
+    check(f:sync())
+    self._count, self._used, self._dead = count, used, dead
+end
+
+local function commit(self)
+    local npending = self._npending
+    if npending == 0 then return true end
+
+    -- Grow the index if it would become more than 3/4 full, and compact the
+    -- file if dead entries take more than half of it. Otherwise, update the
+    -- file in place. littlefs only makes the changes visible on sync, so a
+    -- commit interrupted by a power loss leaves the file unchanged.
+    local nslots = self._nslots
+    if (self._used + npending) * 4 > nslots * 3 then
+        self:_rewrite(pow2(math.max(self.min_slots,
+                                    (self._count + npending) * 2)))
+    elseif self._dead * 2 > check(self._f:size()) then
+        self:_rewrite(nslots)
+    else
+        local ok, e = pcall(self._update, self)
+        if not ok then
+            -- A failed write leaves the file in an error state, where
+            -- littlefs discards the changes on close. Reload the file to
+            -- drop them, and keep the pending changes for a retry.
+            local f = self._f
+            self._f = nil
+            f:close()
+            self:_load()
+            return error(e, 0)
+        end
+    end
+    self._pending, self._npending = {}, 0
+    return true
+end
+
+-- Write the pending changes atomically to the store file.
+function Store:commit() return guard(pcall(commit, self)) end
+
+local function compact(self)
+    commit(self)
+    if self._dead == 0 and self._used == self._count then return true end
+    self:_rewrite(pow2(math.max(self.min_slots, self._count * 2)))
+    return true
+end
+
+-- Commit the pending changes, then rewrite the store file without dead
+-- entries and deleted slots.
+function Store:compact() return guard(pcall(compact, self)) end
+
+local function keys(self)
+    local res = {}
+    local pending = self._pending
+    for key in self:_entries() do
+        if pending[key] == nil then table.insert(res, key) end
+    end
+    for key, value in pairs(pending) do
+        if value then table.insert(res, key) end
+    end
+    return res
+end
+
+-- Return a list of the keys in the store, in arbitrary order.
+function Store:keys() return guard(pcall(keys, self)) end
+
+-- Return statistics about the store.
+function Store:stats()
+    local size = self._f and self._f:size()
+    return {count = self._count, slots = self._nslots, used = self._used,
+            dead = self._dead, size = size, pending = self._npending,
+            hits = self._hits, misses = self._misses}
+end
+
+-- Commit the pending changes and close the store file.
+function Store:close()
+    local f = self._f
+    if not f then return true end
+    local ok, msg, err = self:commit()
+    self._f = nil
+    local cok, cmsg, cerr = f:close()
+    if not ok then return ok, msg, err end
+    return cok, cmsg, cerr
+end
+
+Store.__close = Store.close
@@ -0,0 +1,254 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local block_mem = require 'mlua.block.mem'
+local errors = require 'mlua.errors'
+local fs = require 'mlua.fs'
+local kv = require 'mlua.kv'
+local lfs = require 'mlua.fs.lfs'
+local mem = require 'mlua.mem'
+local table = require 'table'
+
+-- Create and mount a filesystem in RAM.
+local function mem_fs(t)
+    local dev = block_mem.new(mem.alloc(128 << 10), 256, 256)
+    local f = lfs.new(dev)
+    assert(f:format())
+    assert(f:mount())
+    if t then t:cleanup(function() f:unmount() end) end
+    return f
+end
+
+function test_get_set(t)
+    local f = mem_fs(t)
+    local s<close> = assert(kv.open(f, '/kv'))
+    t:expect(t.expr(s):get('a')):eq(nil)
+    s:set('a', 'one')
+    s:set('b', '')
+    t:expect(t.expr(s):get('a')):eq('one')
+    t:expect(t.expr(s):get('b')):eq('')
+    t:expect(t.expr(s):stats().pending):eq(2)
+    t:expect(t.expr(s):commit()):eq(true)
+    t:expect(t.expr(s):stats().count):eq(2)
+    t:expect(t.expr(s):get('a')):eq('one')
+    s:set('a', 'two')
+    s:set('b', nil)
+    t:expect(t.expr(s):get('a')):eq('two')
+    t:expect(t.expr(s):get('b')):eq(nil)
+    t:expect(t.expr(s):commit()):eq(true)
+    t:expect(t.expr(s):get('b')):eq(nil)
+    t:expect(t.expr(s):keys()):eq{'a'}
+    t:expect(t.expr(s):set(('k'):rep(0x10000), 'v')):raises("key too long")
+    t:expect(t.expr(s):close()):eq(true)
+
+    local s2<close> = assert(kv.open(f, '/kv'))
+    t:expect(t.expr(s2):get('a')):eq('two')
+    t:expect(t.expr(s2):get('b')):eq(nil)
+end
+
+function test_buffer(t)
+    local f = mem_fs(t)
+    local s<close> = assert(kv.open(f, '/kv'))
+    local buf = mem.alloc(8)
+    mem.write(buf, 'abcdefgh')
+    s:set('buf', buf)
+    t:assert(s:commit())
+    t:expect(t.expr(s):get('buf')):eq('abcdefgh')
+    local dst = mem.alloc(16)
+    t:expect(t.expr(s):get('buf', dst, 4)):eq(8)
+    t:expect(t.expr(mem).read(dst, 4, 8)):eq('abcdefgh')
+    t:expect(t.expr(s):get('missing', dst)):eq(nil)
+end
+
+function test_atomic_commit(t)
+    local f = mem_fs(t)
+    local s<close> = assert(kv.open(f, '/kv'))
+    s:set('a', '1')
+    t:assert(s:commit())
+    s:set('a', '2')
+    s:set('b', '3')
+
+    -- Uncommitted changes aren't visible to another reader.
+    do
+        local s2<close> = assert(kv.open(f, '/kv'))
+        t:expect(t.expr(s2):get('a')):eq('1')
+        t:expect(t.expr(s2):get('b')):eq(nil)
+    end
+    t:assert(s:commit())
+    local s2<close> = assert(kv.open(f, '/kv'))
+    t:expect(t.expr(s2):get('a')):eq('2')
+    t:expect(t.expr(s2):get('b')):eq('3')
+end
+
+function test_grow(t)
+    local f = mem_fs(t)
+    local s<close> = assert(kv.open(f, '/kv', {slots = 16}))
+    t:expect(t.expr(s):stats().slots):eq(16)
+    for i = 1, 300 do
+        s:set(('key%d'):format(i), ('value%d'):format(i))
+        if i % 50 == 0 then t:assert(s:commit()) end
+    end
+    local st = s:stats()
+    t:expect(st.count):label("count"):eq(300)
+    t:expect(st.slots * 3):label("slots * 3"):gte(st.used * 4)
+    for i = 1, 300 do
+        local key = ('key%d'):format(i)
+        t:expect(t.expr(s):get(key)):eq(('value%d'):format(i))
+    end
+    t:expect(#s:keys()):label("#keys"):eq(300)
+end
+
+function test_compact(t)
+    local f = mem_fs(t)
+    local s<close> = assert(kv.open(f, '/kv'))
+    for i = 1, 20 do s:set(('key%d'):format(i), ('x'):rep(64)) end
+    t:assert(s:commit())
+    local size = s:stats().size
+    for i = 1, 20, 2 do s:set(('key%d'):format(i), nil) end
+    for i = 2, 20, 2 do s:set(('key%d'):format(i), ('y'):rep(64)) end
+    t:assert(s:commit())
+    t:expect(s:stats().dead):label("dead"):gt(0)
+    t:expect(t.expr(s):compact()):eq(true)
+    local st = s:stats()
+    t:expect(st.dead):label("dead"):eq(0)
+    t:expect(st.used):label("used"):eq(10)
+    t:expect(st.size):label("size"):lt(size)
+    t:expect(t.expr(s):get('key1')):eq(nil)
+    t:expect(t.expr(s):get('key2')):eq(('y'):rep(64))
+end
+
+function test_many_keys(t)
+    -- About half of the keys have a hash with the most significant bit set,
+    -- which is negative when lua_Integer is a 32-bit integer.
+    local f = mem_fs(t)
+    local s<close> = assert(kv.open(f, '/kv', {slots = 16}))
+    local want = {}
+    for i = 1, 400 do
+        local key = ('k%d'):format(i)
+        s:set(key, key:upper())
+        if i % 3 == 0 then
+            s:set(key, nil)
+        else
+            table.insert(want, key)
+        end
+        if i % 100 == 0 then t:assert(s:commit()) end
+    end
+    table.sort(want)
+    local function check(s, what)
+        local keys = assert(s:keys())
+        table.sort(keys)
+        t:expect(keys):label("%s: keys", what):eq(want)
+        for _, key in ipairs(want) do
+            t:expect(s:get(key)):label("%s: get(%q)", what, key)
+                :eq(key:upper())
+        end
+    end
+    check(s, "committed")
+    t:expect(t.expr(s):compact()):eq(true)
+    check(s, "compacted")
+    t:expect(t.expr(s):close()):eq(true)
+    local s2<close> = assert(kv.open(f, '/kv'))
+    check(s2, "reopened")
+end
+
+function test_cache(t)
+    local f = mem_fs(t)
+    local s<close> = assert(kv.open(f, '/kv', {cache = 2}))
+    for _, k in ipairs{'a', 'b', 'c'} do s:set(k, k) end
+    t:assert(s:commit())
+    s:get('a')
+    s:get('a')
+    s:get('b')
+    s:get('missing')  -- Evicts a
+    s:get('missing')
+    s:get('a')
+    local st = s:stats()
+    t:expect(st.hits):label("hits"):eq(2)
+    t:expect(st.misses):label("misses"):eq(4)
+end
+
+function test_corrupt(t)
+    local f = mem_fs(t)
+    do
+        local fh<close> = assert(f:open('/kv', fs.O_WRONLY | fs.O_CREAT))
+        assert(fh:write(('garbage'):rep(4)))
+    end
+    t:expect(t.mexpr(kv).open(f, '/kv'))
+        :eq{nil, errors.message(errors.ECORRUPT), errors.ECORRUPT, n = 3}
+end
+
+local bench_keys = 100
+
+-- Populate a filesystem with a store holding bench_keys keys.
+local function bench_store()
+    local f = mem_fs()
+    local s = assert(kv.open(f, '/kv'))
+    for i = 1, bench_keys do
+        s:set(('key%d'):format(i), ('value%d'):format(i))
+    end
+    assert(s:commit())
+    return f, s
+end
+
+-- Populate a filesystem with one file per key.
+local function bench_files()
+    local f = mem_fs()
+    assert(f:mkdir('/kv'))
+    for i = 1, bench_keys do
+        local fh<close> = assert(f:open(('/kv/key%d'):format(i),
+                                        fs.O_WRONLY | fs.O_CREAT))
+        assert(fh:write(('value%d'):format(i)))
+    end
+    return f
+end
+
+function bench_get(b)
+    local f, s = bench_store()
+    s.cache_size = 0
+    b:reset_timer()
+    for i = 1, b.n do s:get(('key%d'):format(i % bench_keys + 1)) end
+    s:close()
+    f:unmount()
+end
+
+function bench_get_cached(b)
+    local f, s = bench_store()
+    b:reset_timer()
+    for i = 1, b.n do s:get(('key%d'):format(i % 8 + 1)) end
+    s:close()
+    f:unmount()
+end
+
+function bench_get_files(b)
+    local f = bench_files()
+    b:reset_timer()
+    for i = 1, b.n do
+        local fh<close> = f:open(('/kv/key%d'):format(i % bench_keys + 1),
+                                 fs.O_RDONLY)
+        fh:read()
+    end
+    f:unmount()
+end
+
+function bench_set_commit(b)
+    local f, s = bench_store()
+    b:reset_timer()
+    for i = 1, b.n do
+        s:set(('key%d'):format(i % bench_keys + 1), ('v%d'):format(i))
+        if i % 10 == 0 then s:commit() end
+    end
+    s:commit()
+    s:close()
+    f:unmount()
+end
+
+function bench_set_files(b)
+    local f = bench_files()
+    b:reset_timer()
+    for i = 1, b.n do
+        local fh<close> = f:open(('/kv/key%d'):format(i % bench_keys + 1),
+                                 fs.O_WRONLY | fs.O_TRUNC)
+        fh:write(('v%d'):format(i))
+    end
+    f:unmount()
+end
@@ -1,6 +1,8 @@
 // Copyright 2023 Remy Blank <remy@c-space.org>
 // SPDX-License-Identifier: MIT
 
+#include <limits.h>
+
 #include "lua.h"
 #include "lauxlib.h"
 #include "mlua/module.h"
@@ -10,6 +12,10 @@ static char const list_name[] = "mlua.List";
 
 #define LEN_IDX "n"
 
+// The maximum number of values transferred per call when converting between
+// lists and arrays.
+#define ARRAY_CHUNK 64
+
 static void new_list(lua_State* ls, int cap) {
     lua_createtable(ls, cap, 1);
     luaL_getmetatable(ls, list_name);
@@ -138,6 +144,29 @@ static int list_append(lua_State* ls) {
     return 1;
 }
 
+static int list_extend(lua_State* ls) {
+    if (lua_gettop(ls) == 0) lua_settop(ls, 1);
+    int top = lua_gettop(ls);
+    lua_Integer len = 0;
+    if (lua_isnil(ls, 1)) {
+        new_list(ls, 0);
+        lua_replace(ls, 1);
+    } else {
+        len = length(ls, 1);
+    }
+    for (int arg = 2; arg <= top; ++arg) {
+        lua_Integer cnt = length(ls, arg);
+        for (lua_Integer i = 1; i <= cnt; ++i) {
+            lua_geti(ls, arg, i);
+            lua_seti(ls, 1, luaL_intop(+, len, i));
+        }
+        len = luaL_intop(+, len, cnt);
+    }
+    lua_pushinteger(ls, len);
+    lua_setfield(ls, 1, LEN_IDX);
+    return lua_settop(ls, 1), 1;
+}
+
 static int list_insert(lua_State* ls) {
     lua_Integer len = 0;
     if (lua_isnil(ls, 1)) {
@@ -190,6 +219,25 @@ static int list_remove(lua_State* ls) {
     return 1;
 }
 
+static int list_slice(lua_State* ls) {
+    lua_Integer len = length(ls, 1);
+    lua_Integer i = luaL_optinteger(ls, 2, 1);
+    lua_Integer j = luaL_optinteger(ls, 3, len);
+    if (i < 0) i = i < -len ? 1 : len + i + 1;
+    else if (i == 0) i = 1;
+    if (j < 0) j = len + j + 1;
+    else if (j > len) j = len;
+    lua_Integer cnt = i <= j ? j - i + 1 : 0;
+    new_list(ls, cnt <= INT_MAX ? (int)cnt : 0);
+    for (lua_Integer k = 0; k < cnt; ++k) {
+        lua_geti(ls, 1, i + k);
+        lua_rawseti(ls, -2, k + 1);
+    }
+    lua_pushinteger(ls, cnt);
+    lua_setfield(ls, -2, LEN_IDX);
+    return 1;
+}
+
 static int list_pack(lua_State* ls) {
     lua_Integer len = lua_gettop(ls);
     new_list(ls, len);
@@ -212,6 +260,42 @@ static int list_unpack(lua_State* ls) {
     return n;
 }
 
+static int list_move(lua_State* ls) {
+    lua_Integer f = luaL_checkinteger(ls, 2);
+    lua_Integer e = luaL_checkinteger(ls, 3);
+    lua_Integer t = luaL_checkinteger(ls, 4);
+    int dst = !lua_isnoneornil(ls, 5) ? 5 : 1;
+    luaL_checktype(ls, 1, LUA_TTABLE);
+    luaL_checktype(ls, dst, LUA_TTABLE);
+    if (e >= f) {
+        luaL_argcheck(ls, f > 0 || e < LUA_MAXINTEGER + f, 3,
+                      "too many elements to move");
+        lua_Integer n = e - f;
+        luaL_argcheck(ls, t <= LUA_MAXINTEGER - n, 4,
+                      "destination wrap around");
+        if (t > e || t <= f || (dst != 1 && !lua_rawequal(ls, 1, dst))) {
+            for (lua_Integer i = 0; i <= n; ++i) {
+                lua_geti(ls, 1, f + i);
+                lua_seti(ls, dst, t + i);
+            }
+        } else {
+            for (lua_Integer i = n; i >= 0; --i) {
+                lua_geti(ls, 1, f + i);
+                lua_seti(ls, dst, t + i);
+            }
+        }
+
+        // Extend the destination if it tracks its length explicitly.
+        if (lua_getfield(ls, dst, LEN_IDX) != LUA_TNIL
+                && luaL_checkinteger(ls, -1) < t + n) {
+            lua_pushinteger(ls, t + n);
+            lua_setfield(ls, dst, LEN_IDX);
+        }
+        lua_pop(ls, 1);
+    }
+    return lua_pushvalue(ls, dst), 1;
+}
+
 static int restore_mt(lua_State* ls) {
     lua_pushnil(ls);
     lua_setmetatable(ls, lua_upvalueindex(1));
@@ -288,6 +372,65 @@ static int list_find(lua_State* ls) {
     return 0;
 }
 
+static int list_from_array(lua_State* ls) {
+    lua_Integer len = luaL_len(ls, 1);
+    lua_Integer i = luaL_optinteger(ls, 2, 1);
+    lua_Integer j = luaL_optinteger(ls, 3, len);
+    lua_settop(ls, 1);
+    lua_Unsigned cnt = 0;
+    if (i <= j) {
+        luaL_argcheck(ls, i >= 1, 2, "out of range");
+        luaL_argcheck(ls, j <= len, 3, "out of range");
+        cnt = (lua_Unsigned)j - (lua_Unsigned)i + 1u;
+    }
+    new_list(ls, cnt <= INT_MAX ? (int)cnt : 0);
+    lua_getfield(ls, 1, "get");
+    luaL_checkstack(ls, ARRAY_CHUNK, NULL);
+    for (lua_Unsigned k = 0; k < cnt;) {
+        int n = cnt - k < ARRAY_CHUNK ? (int)(cnt - k) : ARRAY_CHUNK;
+        lua_pushvalue(ls, 3);
+        lua_pushvalue(ls, 1);
+        lua_pushinteger(ls, i + (lua_Integer)k);
+        lua_pushinteger(ls, n);
+        lua_call(ls, 3, n);
+        for (int m = n; m > 0; --m) lua_rawseti(ls, 2, k + m);
+        k += n;
+    }
+    lua_pushinteger(ls, cnt);
+    lua_setfield(ls, 2, LEN_IDX);
+    return lua_settop(ls, 2), 1;
+}
+
+static int list_to_array(lua_State* ls) {
+    lua_Integer len = length(ls, 1);
+    luaL_checkstring(ls, 2);
+    lua_Integer i = luaL_optinteger(ls, 3, 1);
+    lua_Integer j = luaL_optinteger(ls, 4, len);
+    lua_settop(ls, 2);
+    lua_Integer cnt = 0;
+    if (i <= j) {
+        luaL_argcheck(ls, i > 0 || j < LUA_MAXINTEGER + i, 4,
+                      "too many elements");
+        cnt = j - i + 1;
+    }
+    mlua_require(ls, "mlua.array", true);
+    lua_pushvalue(ls, 2);
+    lua_pushinteger(ls, cnt);
+    lua_call(ls, 2, 1);  // Array(format, cnt)
+    lua_getfield(ls, 3, "set");
+    luaL_checkstack(ls, ARRAY_CHUNK + 3, NULL);
+    for (lua_Integer k = 0; k < cnt;) {
+        int n = cnt - k < ARRAY_CHUNK ? (int)(cnt - k) : ARRAY_CHUNK;
+        lua_pushvalue(ls, 4);
+        lua_pushvalue(ls, 3);
+        lua_pushinteger(ls, k + 1);
+        for (int m = 0; m < n; ++m) lua_geti(ls, 1, i + k + m);
+        lua_call(ls, n + 2, 0);
+        k += n;
+    }
+    return lua_settop(ls, 3), 1;
+}
+
 static int repr_done(lua_State* ls) {
     lua_pushvalue(ls, lua_upvalueindex(1));
     lua_pushnil(ls);
@@ -330,14 +473,17 @@ MLUA_SYMBOLS(list_syms) = {
     MLUA_SYM_F(eq, list_),
     MLUA_SYM_F(ipairs, list_),
     MLUA_SYM_F(append, list_),
+    MLUA_SYM_F(extend, list_),
     MLUA_SYM_F(insert, list_),
     MLUA_SYM_F(remove, list_),
-    // TODO: MLUA_SYM_F(slice, list_),
+    MLUA_SYM_F(slice, list_),
     MLUA_SYM_F(pack, list_),
     MLUA_SYM_F(unpack, list_),
-    // TODO: MLUA_SYM_F(move, list_),
+    MLUA_SYM_F(move, list_),
     MLUA_SYM_F(concat, list_),
     MLUA_SYM_F(find, list_),
+    MLUA_SYM_F(from_array, list_),
+    MLUA_SYM_F(to_array, list_),
 };
 
 MLUA_SYMBOLS_NOHASH(list_syms_nh) = {
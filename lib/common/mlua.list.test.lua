@@ -1,9 +1,11 @@
 -- Copyright 2023 Remy Blank <remy@c-space.org>
 -- SPDX-License-Identifier: MIT
 
+local array = require 'mlua.array'
 local list = require 'mlua.list'
 local repr = require 'mlua.repr'
 local util = require 'mlua.util'
+local math = require 'math'
 local table = require 'table'
 
 function test_list(t)
@@ -95,6 +97,26 @@ function test_append(t)
     end
 end
 
+function test_extend(t)
+    for _, test in ipairs{
+        {{}, {n = 0}},
+        {{nil, n = 1}, {n = 0}},
+        {{nil, {1, 2}}, {1, 2, n = 2}},
+        {{{1}, {2, 3}, nil, {4}}, {1, 2, 3, 4, n = 4}},
+        {{{1, n = 2}, {nil, 3, n = 2}}, {1, nil, nil, 3, n = 4}},
+        {{{1, 2}, {}}, {1, 2, n = 2}},
+    } do
+        local args, want = table.unpack(test)
+        local argsc = copy_args(args)
+        t:expect(list.extend(table.unpack(args, 1, args.n)))
+            :func("extend", table.unpack(argsc, 1, argsc.n))
+            :eq(want, util.table_eq)
+    end
+    local l = list{1, 2}
+    t:expect(list.extend(l, l)):label("extend(l, l)")
+        :eq(list{1, 2, 1, 2}, list.eq)
+end
+
 function test_insert(t)
     for _, test in ipairs{
         {{nil, 1, n = 2}, {1, n = 1}},
@@ -127,6 +149,29 @@ function test_remove(t)
     end
 end
 
+function test_slice(t)
+    local l = list{1, 2, nil, 4, 5, n = 5}
+    for _, test in ipairs{
+        {{nil}, {n = 0}},
+        {{{}}, {n = 0}},
+        {{l}, {1, 2, nil, 4, 5, n = 5}},
+        {{l, 2}, {2, nil, 4, 5, n = 4}},
+        {{l, 2, 3}, {2, nil, n = 2}},
+        {{l, 0, 1}, {1, n = 1}},
+        {{l, -2}, {4, 5, n = 2}},
+        {{l, -10, -4}, {1, 2, n = 2}},
+        {{l, 4, 10}, {4, 5, n = 2}},
+        {{l, 4, 3}, {n = 0}},
+        {{l, 6}, {n = 0}},
+    } do
+        local args, want = table.unpack(test)
+        local got = list.slice(table.unpack(args, 1, 3))
+        t:expect(got):func("slice", table.unpack(args, 1, 3))
+            :eq(want, util.table_eq)
+        t:expect(getmetatable(got)):label("metatable"):eq(list)
+    end
+end
+
 function test_pack(t)
     for _, test in ipairs{
         {list.pack(), list{n = 0}},
@@ -158,6 +203,31 @@ function test_unpack(t)
     end
 end
 
+function test_move(t)
+    for _, test in ipairs{
+        {{{1, 2, 3}, 1, 3, 2}, {1, 1, 2, 3}},
+        {{{1, 2, 3, 4, 5}, 2, 5, 1}, {2, 3, 4, 5, 5}},
+        {{{1, 2, 3}, 3, 1, 1}, {1, 2, 3}},
+        {{list{1, 2, 3}, 1, 3, 3}, {1, 2, 1, 2, 3, n = 5}},
+        {{list{1, 2, 3}, 2, 3, 1}, {2, 3, 3, n = 3}},
+        {{list{1, nil, 3, n = 3}, 1, 3, 1, list()}, {1, nil, 3, n = 3}},
+        {{{1, 2, 3}, 2, 3, 2, list{7, 8, 9, 10}}, {7, 2, 3, 10, n = 4}},
+        {{{1, 2, 3}, 1, 3, 1, {}}, {1, 2, 3}},
+    } do
+        local args, want = table.unpack(test)
+        local argsc = copy_args(args)
+        local dst = args[5] or args[1]
+        t:expect(list.move(table.unpack(args, 1, 5)))
+            :func("move", table.unpack(argsc, 1, 5)):eq(dst)
+        t:expect(dst):func("move", table.unpack(argsc, 1, 5)):op("->")
+            :eq(want, util.table_eq)
+    end
+    t:expect(t.expr(list).move({}, math.mininteger, 1, 1))
+        :raises("too many elements to move")
+    t:expect(t.expr(list).move({}, 1, math.maxinteger, 2))
+        :raises("destination wrap around")
+end
+
 function test_sort(t)
     for _, test in ipairs{
         {{nil, n = 1}, nil},
@@ -216,6 +286,60 @@ function test_find(t)
     end
 end
 
+function test_from_array(t)
+    local a = array('i', 100)
+    for i = 1, #a do a[i] = i * i end
+    for _, test in ipairs{
+        {{array('d', 0)}, list()},
+        {{array('h', 3):set(1, 1, -2, 3)}, list{1, -2, 3}},
+        {{array('f', 2):set(1, 1.5, -2.0)}, list{1.5, -2.0}},
+        {{array('c3', 2):set(1, 'abc', 'de')}, list{'abc', 'de\0'}},
+        {{a, 99}, list{99 * 99, 100 * 100}},
+        {{a, 5, 4}, list()},
+    } do
+        local args, want = table.unpack(test)
+        local got = list.from_array(table.unpack(args, 1, 3))
+        t:expect(got):func("from_array", table.unpack(args, 1, 3))
+            :eq(want)
+        t:expect(getmetatable(got)):label("metatable"):eq(list)
+    end
+    local got = list.from_array(a)
+    t:expect(#got):label("#from_array(a)"):eq(100)
+    t:expect(got[100]):label("from_array(a)[100]"):eq(10000)
+    got = list.from_array(array('j', 1):set(1, math.mininteger))
+    t:expect(got):label("from_array(j)"):eq(list{math.mininteger})
+    t:expect(t.expr(list).from_array(a, 0)):raises("out of range")
+    t:expect(t.expr(list).from_array(a, 1, 101)):raises("out of range")
+    t:expect(t.expr(list).from_array(a, math.mininteger, math.maxinteger))
+        :raises("out of range")
+end
+
+function test_to_array(t)
+    local l = list()
+    for i = 1, 100 do l:append(i * 3) end
+    for _, test in ipairs{
+        {{list(), 'd'}, 'd', {}},
+        {{{1, -2, 3}, 'h'}, 'h', {1, -2, 3}},
+        {{{1.5, 2.25}, 'f'}, 'f', {1.5, 2.25}},
+        {{{'ab', 'cd'}, 'c2'}, 'c2', {'ab', 'cd'}},
+        {{l, 'H', 90}, 'H', {270, 273, 276, 279, 282, 285, 288, 291, 294,
+                             297, 300}},
+        {{l, 'i', 98, 99}, 'i', {294, 297}},
+    } do
+        local args, fmt, want = table.unpack(test)
+        local got = list.to_array(table.unpack(args, 1, 4))
+        t:expect(got):func("to_array", table.unpack(args, 1, 4))
+            :eq(array(fmt, #want):set(1, table.unpack(want)))
+    end
+    local a = list.to_array(l, 'j')
+    t:expect(#a):label("#to_array(l)"):eq(100)
+    t:expect(a[100]):label("to_array(l)[100]"):eq(300)
+    t:expect(t.expr(list).to_array({1, 'x'}, 'i'))
+        :raises("number expected")
+    t:expect(t.expr(list).to_array(l, 'i', math.mininteger, math.maxinteger))
+        :raises("too many elements")
+end
+
 function test_repr(t)
     local rec = list{1, list{2}, 3}
     rec[2]:append(rec)
@@ -230,3 +354,77 @@ function test_repr(t)
         t:expect(repr(arg)):label("repr()"):eq(want)
     end
 end
+
+local function bench_list(n)
+    local l = list()
+    for i = 1, n do l:append(i) end
+    return l
+end
+
+function bench_slice_lua(b)
+    local l = bench_list(1000)
+    for i = 1, b.n do
+        local r = list()
+        for j = 101, 900 do r:append(l[j]) end
+    end
+end
+
+function bench_slice_C(b)
+    local l = bench_list(1000)
+    for i = 1, b.n do l:slice(101, 900) end
+end
+
+function bench_move_lua(b)
+    local l, dst = bench_list(1000), list()
+    for i = 1, b.n do
+        for j = 1, 1000 do dst:insert(j, l[j]) end
+        dst:len(0)
+    end
+end
+
+function bench_move_C(b)
+    local l, dst = bench_list(1000), list()
+    for i = 1, b.n do
+        l:move(1, 1000, 1, dst)
+        dst:len(0)
+    end
+end
+
+function bench_extend_lua(b)
+    local l = bench_list(1000)
+    for i = 1, b.n do
+        local r = list()
+        for _, v in l:ipairs() do r:append(v) end
+    end
+end
+
+function bench_extend_C(b)
+    local l = bench_list(1000)
+    for i = 1, b.n do list.extend(list(), l) end
+end
+
+function bench_from_array_lua(b)
+    local a = array('d', 1000)
+    for i = 1, b.n do
+        local r = list()
+        for j = 1, #a do r:append(a[j]) end
+    end
+end
+
+function bench_from_array_C(b)
+    local a = array('d', 1000)
+    for i = 1, b.n do list.from_array(a) end
+end
+
+function bench_to_array_lua(b)
+    local l = bench_list(1000)
+    for i = 1, b.n do
+        local a = array('d', #l)
+        for j = 1, #l do a[j] = l[j] end
+    end
+end
+
+function bench_to_array_C(b)
+    local l = bench_list(1000)
+    for i = 1, b.n do l:to_array('d') end
+end
@@ -2,10 +2,14 @@
 // SPDX-License-Identifier: MIT
 
 #include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "mlua/int64.h"
 #include "mlua/module.h"
+#include "mlua/thread.h"
 #include "mlua/util.h"
 
 // TODO: Use Buffer for read operations (I2C, SPI, UART, stdio). Allow providing
@@ -13,31 +17,159 @@
 
 char const Buffer_name[] = "mlua.mem.Buffer";
 
-static inline void* check_Buffer(lua_State* ls, int arg) {
+// A block of memory allocated on the C heap. Blocks don't belong to any
+// interpreter, so they can be transferred between interpreters and cores.
+typedef struct SharedBlock {
+    size_t size;
+    struct Buffer* exporter;   // The buffer being exported, until committed
+    struct SharedBlock* next;  // The next detached block
+    void* owner;               // The sentinel of the detaching interpreter
+    uint8_t data[];
+} SharedBlock;
+
+// The shared blocks that were detached, but not attached yet. Protected by the
+// event lock. Handles are validated against this list before being used.
+static SharedBlock* detached_blocks;
+
+// A per-interpreter sentinel, which frees the blocks detached by the
+// interpreter that were never attached when it is collected.
+static char const Detached_name[] = "mlua.mem.Detached";
+
+// A memory buffer. Local buffers store their data after the header, in the
+// memory of the interpreter. Shared buffers reference a SharedBlock. A
+// detached buffer has a NULL data pointer.
+typedef struct Buffer {
+    uint8_t* ptr;
+    size_t size;
+    SharedBlock* block;
+} Buffer;
+
+static inline Buffer* to_Buffer(lua_State* ls, int arg) {
     return luaL_checkudata(ls, arg, Buffer_name);
 }
 
+static inline Buffer* check_Buffer(lua_State* ls, int arg) {
+    Buffer* buf = luaL_checkudata(ls, arg, Buffer_name);
+    luaL_argcheck(ls, buf->ptr != NULL, arg, "detached buffer");
+    return buf;
+}
+
+static Buffer* new_Buffer(lua_State* ls, size_t size, SharedBlock* block) {
+    Buffer* buf = lua_newuserdatauv(
+        ls, sizeof(Buffer) + (block == NULL ? size : 0), 0);
+    buf->ptr = block == NULL ? (uint8_t*)(buf + 1) : block->data;
+    buf->size = size;
+    buf->block = block;
+    luaL_getmetatable(ls, Buffer_name);
+    lua_setmetatable(ls, -2);
+    return buf;
+}
+
+// Detach the shared block of a buffer, and invalidate the buffer.
+static SharedBlock* detach_block(lua_State* ls, int arg) {
+    Buffer* buf = check_Buffer(ls, arg);
+    luaL_argcheck(ls, buf->block != NULL, arg, "buffer isn't shared");
+    SharedBlock* block = buf->block;
+    luaL_argcheck(ls, block->exporter == NULL, arg, "buffer is being exported");
+    buf->ptr = NULL;
+    buf->size = 0;
+    buf->block = NULL;
+    return block;
+}
+
+static void push_attached(lua_State* ls, void* handle) {
+    SharedBlock* block = handle;
+    mlua_require(ls, "mlua.mem", false);  // Ensure the class is defined
+    new_Buffer(ls, block->size, block);
+}
+
+static void release_block(void* handle) {
+    SharedBlock* block = handle;
+    // If the export wasn't committed, the block still belongs to the buffer.
+    if (block->exporter != NULL) {
+        block->exporter = NULL;
+        return;
+    }
+    free(block);
+}
+
+static void commit_block(void* handle) {
+    SharedBlock* block = handle;
+    Buffer* buf = block->exporter;
+    block->exporter = NULL;
+    buf->ptr = NULL;
+    buf->size = 0;
+    buf->block = NULL;
+}
+
+static MLuaExportVt const Buffer_export_vt = {
+    .import = &push_attached,
+    .release = &release_block,
+    .commit = &commit_block,
+};
+
 static int Buffer_ptr(lua_State* ls) {
-    return lua_pushlightuserdata(ls, check_Buffer(ls, 1)), 1;
+    return lua_pushlightuserdata(ls, check_Buffer(ls, 1)->ptr), 1;
+}
+
+static int Buffer_is_shared(lua_State* ls) {
+    return lua_pushboolean(ls, to_Buffer(ls, 1)->block != NULL), 1;
+}
+
+static int Buffer_detach(lua_State* ls) {
+    lua_rawgetp(ls, LUA_REGISTRYINDEX, Detached_name);
+    void* owner = lua_touserdata(ls, -1);
+    SharedBlock* block = detach_block(ls, 1);
+    block->owner = owner;
+    mlua_event_lock();
+    block->next = detached_blocks;
+    detached_blocks = block;
+    mlua_event_unlock();
+    return lua_pushlightuserdata(ls, block), 1;
 }
 
 static int Buffer___len(lua_State* ls) {
-    return lua_pushinteger(ls, lua_rawlen(ls, 1)), 1;
+    return lua_pushinteger(ls, to_Buffer(ls, 1)->size), 1;
 }
 
 static int Buffer___buffer(lua_State* ls) {
-    lua_pushlightuserdata(ls, check_Buffer(ls, 1));
-    lua_pushinteger(ls, lua_rawlen(ls, 1));
+    Buffer* buf = to_Buffer(ls, 1);
+    if (buf->ptr == NULL) return 0;
+    lua_pushlightuserdata(ls, buf->ptr);
+    lua_pushinteger(ls, buf->size);
     return 2;
 }
 
+static int Buffer___export(lua_State* ls) {
+    Buffer* buf = to_Buffer(ls, 1);
+    SharedBlock* block = buf->block;
+    if (block == NULL || block->exporter != NULL) return 0;
+    block->exporter = buf;
+    lua_pushlightuserdata(ls, block);
+    lua_pushlightuserdata(ls, (void*)&Buffer_export_vt);
+    return 2;
+}
+
+static int Buffer___gc(lua_State* ls) {
+    Buffer* buf = to_Buffer(ls, 1);
+    free(buf->block);
+    buf->ptr = NULL;
+    buf->size = 0;
+    buf->block = NULL;
+    return 0;
+}
+
 MLUA_SYMBOLS(Buffer_syms) = {
     MLUA_SYM_F(ptr, Buffer_),
+    MLUA_SYM_F(is_shared, Buffer_),
+    MLUA_SYM_F(detach, Buffer_),
 };
 
 MLUA_SYMBOLS_NOHASH(Buffer_syms_nh) = {
     MLUA_SYM_F_NH(__len, Buffer_),
     MLUA_SYM_F_NH(__buffer, Buffer_),
+    MLUA_SYM_F_NH(__export, Buffer_),
+    MLUA_SYM_F_NH(__gc, Buffer_),
 };
 
 static void check_ro_buffer(lua_State* ls, int arg, MLuaBuffer* buf) {
@@ -58,6 +190,193 @@ static inline void check_bounds(
     luaL_argcheck(ls, off + len <= buf->size, ilen, "out of bounds");
 }
 
+char const ByteQueue_name[] = "mlua.mem.ByteQueue";
+
+// The minimum capacity of a ByteQueue.
+#define QUEUE_MIN_CAP 64
+
+// A growable byte queue. The queued data is stored contiguously at
+// [head, tail) in a storage userdata, kept as user value 1. A StringBuilder
+// uses the same representation, with head always zero. When appending,
+// the data is moved to the start of the storage if the consumed part is at
+// least as large as the queued part, and the storage is grown otherwise. This
+// makes the cost of appending and consuming amortized O(1) per byte.
+typedef struct ByteQueue {
+    uint8_t* data;
+    size_t cap;
+    size_t head;
+    size_t tail;
+} ByteQueue;
+
+static inline ByteQueue* check_ByteQueue(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, ByteQueue_name);
+}
+
+static inline size_t queue_len(ByteQueue const* q) {
+    return q->tail - q->head;
+}
+
+// Replace the storage of the queue at the given index with a new storage of
+// the given capacity.
+static void queue_set_storage(lua_State* ls, int arg, ByteQueue* q,
+                              size_t cap) {
+    uint8_t* data = lua_newuserdatauv(ls, cap, 0);
+    size_t len = queue_len(q);
+    if (len > 0) memcpy(data, q->data + q->head, len);
+    lua_setiuservalue(ls, arg, 1);
+    q->data = data;
+    q->cap = cap;
+    q->head = 0;
+    q->tail = len;
+}
+
+// Ensure that "size" bytes can be appended to the queue, and return a pointer
+// to the end of the queued data.
+static uint8_t* queue_reserve(lua_State* ls, int arg, ByteQueue* q,
+                              size_t size) {
+    if (size <= q->cap - q->tail) return q->data + q->tail;
+    size_t len = queue_len(q);
+    if (size > SIZE_MAX / 2 - len) luaL_error(ls, "queue too large");
+    if (len + size <= q->cap && q->head >= len) {
+        memmove(q->data, q->data + q->head, len);
+        q->head = 0;
+        q->tail = len;
+    } else {
+        size_t cap = q->cap;
+        while (cap < len + size) cap *= 2;
+        queue_set_storage(ls, arg, q, cap);
+    }
+    return q->data + q->tail;
+}
+
+static inline void queue_consume(ByteQueue* q, size_t len) {
+    q->head += len;
+    if (q->head == q->tail) q->head = q->tail = 0;
+}
+
+static size_t queue_find(ByteQueue const* q, size_t off, void const* needle,
+                         size_t needle_len) {
+    size_t len = queue_len(q);
+    if (off > len) return SIZE_MAX;
+    uint8_t const* start = q->data + q->head;
+    uint8_t const* pos = memmem(start + off, len - off, needle, needle_len);
+    return pos != NULL ? (size_t)(pos - start) : SIZE_MAX;
+}
+
+static inline size_t opt_max(lua_State* ls, int arg, ByteQueue const* q) {
+    size_t len = queue_len(q);
+    if (lua_isnoneornil(ls, arg)) return len;
+    lua_Integer max = luaL_checkinteger(ls, arg);
+    luaL_argcheck(ls, max >= 0, arg, "invalid length");
+    return (lua_Unsigned)max < len ? (size_t)max : len;
+}
+
+static int ByteQueue_append(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    int top = lua_gettop(ls);
+    for (int i = 2; i <= top; ++i) {
+        MLuaBuffer src;
+        check_ro_buffer(ls, i, &src);
+        luaL_argcheck(ls, src.size != (size_t)-1, i, "unsized buffer");
+        if (src.size == 0) continue;
+        uint8_t* dest = queue_reserve(ls, 1, q, src.size);
+        if (lua_rawequal(ls, 1, i)) src.ptr = q->data + q->head;
+        mlua_buffer_read(&src, 0, src.size, dest);
+        q->tail += src.size;
+    }
+    return lua_settop(ls, 1), 1;
+}
+
+static int ByteQueue_peek(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    lua_Integer off = luaL_optinteger(ls, 3, 0);
+    luaL_argcheck(ls, off >= 0 && (lua_Unsigned)off <= queue_len(q), 3,
+                  "out of bounds");
+    size_t len = opt_max(ls, 2, q);
+    if (len > queue_len(q) - off) len = queue_len(q) - off;
+    lua_pushlstring(ls, (char const*)q->data + q->head + off, len);
+    return 1;
+}
+
+static int ByteQueue_read(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    size_t len = opt_max(ls, 2, q);
+    lua_pushlstring(ls, (char const*)q->data + q->head, len);
+    queue_consume(q, len);
+    return 1;
+}
+
+static int ByteQueue_read_until(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    size_t delim_len;
+    char const* delim = luaL_checklstring(ls, 2, &delim_len);
+    luaL_argcheck(ls, delim_len > 0, 2, "empty delimiter");
+    bool keep = mlua_opt_cbool(ls, 3, false);
+    lua_Integer off = luaL_optinteger(ls, 4, 0);
+    luaL_argcheck(ls, off >= 0, 4, "out of bounds");
+    size_t pos = queue_find(q, off, delim, delim_len);
+    if (pos == SIZE_MAX) return 0;
+    lua_pushlstring(ls, (char const*)q->data + q->head,
+                    keep ? pos + delim_len : pos);
+    queue_consume(q, pos + delim_len);
+    return 1;
+}
+
+static int ByteQueue_find(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    size_t needle_len;
+    char const* needle = luaL_checklstring(ls, 2, &needle_len);
+    lua_Integer off = luaL_optinteger(ls, 3, 0);
+    luaL_argcheck(ls, off >= 0, 3, "out of bounds");
+    size_t pos = queue_find(q, off, needle, needle_len);
+    if (pos == SIZE_MAX) return 0;
+    return lua_pushinteger(ls, pos), 1;
+}
+
+static int ByteQueue_consume(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    size_t len = opt_max(ls, 2, q);
+    queue_consume(q, len);
+    return lua_pushinteger(ls, len), 1;
+}
+
+static int ByteQueue_clear(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    q->head = q->tail = 0;
+    return 0;
+}
+
+static int ByteQueue_cap(lua_State* ls) {
+    return mlua_push_size(ls, check_ByteQueue(ls, 1)->cap), 1;
+}
+
+static int ByteQueue___len(lua_State* ls) {
+    return mlua_push_size(ls, queue_len(check_ByteQueue(ls, 1))), 1;
+}
+
+static int ByteQueue___buffer(lua_State* ls) {
+    ByteQueue* q = check_ByteQueue(ls, 1);
+    lua_pushlightuserdata(ls, q->data + q->head);
+    mlua_push_size(ls, queue_len(q));
+    return 2;
+}
+
+MLUA_SYMBOLS(ByteQueue_syms) = {
+    MLUA_SYM_F(append, ByteQueue_),
+    MLUA_SYM_F(peek, ByteQueue_),
+    MLUA_SYM_F(read, ByteQueue_),
+    MLUA_SYM_F(read_until, ByteQueue_),
+    MLUA_SYM_F(find, ByteQueue_),
+    MLUA_SYM_F(consume, ByteQueue_),
+    MLUA_SYM_F(clear, ByteQueue_),
+    MLUA_SYM_F(cap, ByteQueue_),
+};
+
+MLUA_SYMBOLS_NOHASH(ByteQueue_syms_nh) = {
+    MLUA_SYM_F_NH(__len, ByteQueue_),
+    MLUA_SYM_F_NH(__buffer, ByteQueue_),
+};
+
 static int mod_read(lua_State* ls) {
     MLuaBuffer src;
     check_ro_buffer(ls, 1, &src);
@@ -161,10 +480,170 @@ static int mod_set(lua_State* ls) {
     return 0;
 }
 
+char const StringBuilder_name[] = "mlua.mem.StringBuilder";
+
+static inline ByteQueue* check_StringBuilder(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, StringBuilder_name);
+}
+
+// Append data to the StringBuilder at index 1.
+static inline void builder_add(lua_State* ls, ByteQueue* sb, void const* src,
+                               size_t len) {
+    if (len == 0) return;
+    memcpy(queue_reserve(ls, 1, sb, len), src, len);
+    sb->tail += len;
+}
+
+static int StringBuilder_add(lua_State* ls) {
+    ByteQueue* sb = check_StringBuilder(ls, 1);
+    int top = lua_gettop(ls);
+    for (int i = 2; i <= top; ++i) {
+        size_t len;
+        char const* s = luaL_checklstring(ls, i, &len);
+        builder_add(ls, sb, s, len);
+    }
+    return lua_settop(ls, 1), 1;
+}
+
+static int StringBuilder_write(lua_State* ls) {
+    return StringBuilder_add(ls);
+}
+
+static int StringBuilder_addf(lua_State* ls) {
+    ByteQueue* sb = check_StringBuilder(ls, 1);
+    luaL_checkstring(ls, 2);
+    int top = lua_gettop(ls);
+    lua_getfield(ls, 2, "format");  // string.format, through the metatable
+    lua_rotate(ls, 2, 1);
+    lua_call(ls, top - 1, 1);
+    size_t len;
+    char const* s = lua_tolstring(ls, 2, &len);
+    builder_add(ls, sb, s, len);
+    return lua_settop(ls, 1), 1;
+}
+
+static int StringBuilder_add_buffer(lua_State* ls) {
+    ByteQueue* sb = check_StringBuilder(ls, 1);
+    MLuaBuffer src;
+    check_ro_buffer(ls, 2, &src);
+    lua_Unsigned off = luaL_optinteger(ls, 3, 0);
+    lua_Unsigned len = optlen(ls, &src, 4, src.size - off);
+    check_bounds(ls, &src, off, 3, len, 4);
+    if (len == 0) return lua_settop(ls, 1), 1;
+    uint8_t* dest = queue_reserve(ls, 1, sb, len);
+    if (lua_rawequal(ls, 1, 2)) src.ptr = sb->data;
+    mlua_buffer_read(&src, off, len, dest);
+    sb->tail += len;
+    return lua_settop(ls, 1), 1;
+}
+
+static int StringBuilder_len(lua_State* ls) {
+    return mlua_push_size(ls, check_StringBuilder(ls, 1)->tail), 1;
+}
+
+static int StringBuilder_reset(lua_State* ls) {
+    check_StringBuilder(ls, 1)->tail = 0;
+    return lua_settop(ls, 1), 1;
+}
+
+static int StringBuilder_tostring(lua_State* ls) {
+    ByteQueue* sb = check_StringBuilder(ls, 1);
+    lua_pushlstring(ls, (char const*)sb->data, sb->tail);
+    return 1;
+}
+
+static int StringBuilder___len(lua_State* ls) {
+    return StringBuilder_len(ls);
+}
+
+static int StringBuilder___tostring(lua_State* ls) {
+    return StringBuilder_tostring(ls);
+}
+
+static int StringBuilder___buffer(lua_State* ls) {
+    ByteQueue* sb = check_StringBuilder(ls, 1);
+    lua_pushlightuserdata(ls, sb->data);
+    mlua_push_size(ls, sb->tail);
+    return 2;
+}
+
+MLUA_SYMBOLS(StringBuilder_syms) = {
+    MLUA_SYM_F(add, StringBuilder_),
+    MLUA_SYM_F(addf, StringBuilder_),
+    MLUA_SYM_F(add_buffer, StringBuilder_),
+    MLUA_SYM_F(write, StringBuilder_),
+    MLUA_SYM_F(len, StringBuilder_),
+    MLUA_SYM_F(reset, StringBuilder_),
+    MLUA_SYM_F(tostring, StringBuilder_),
+};
+
+MLUA_SYMBOLS_NOHASH(StringBuilder_syms_nh) = {
+    MLUA_SYM_F_NH(__len, StringBuilder_),
+    MLUA_SYM_F_NH(__tostring, StringBuilder_),
+    MLUA_SYM_F_NH(__buffer, StringBuilder_),
+};
+
 static int mod_alloc(lua_State* ls) {
-    lua_newuserdatauv(ls, luaL_checkinteger(ls, 1), 0);
-    luaL_getmetatable(ls, Buffer_name);
+    lua_Integer size = luaL_checkinteger(ls, 1);
+    luaL_argcheck(ls, size >= 0, 1, "invalid size");
+    if (!mlua_opt_cbool(ls, 2, false)) {
+        new_Buffer(ls, size, NULL);
+        return 1;
+    }
+    Buffer* buf = new_Buffer(ls, 0, NULL);
+    SharedBlock* block = malloc(sizeof(SharedBlock) + size);
+    if (block == NULL) return luaL_error(ls, "out of memory");
+    block->size = size;
+    block->exporter = NULL;
+    buf->ptr = block->data;
+    buf->size = size;
+    buf->block = block;
+    return 1;
+}
+
+static int mod_attach(lua_State* ls) {
+    luaL_checktype(ls, 1, LUA_TLIGHTUSERDATA);
+    SharedBlock* block = lua_touserdata(ls, 1);
+    Buffer* buf = new_Buffer(ls, 0, NULL);
+    bool found = false;
+    mlua_event_lock();
+    for (SharedBlock** p = &detached_blocks; *p != NULL; p = &(*p)->next) {
+        if (*p == block) {
+            *p = block->next;
+            found = true;
+            break;
+        }
+    }
+    mlua_event_unlock();
+    luaL_argcheck(ls, found, 1, "invalid handle");
+    block->next = NULL;
+    block->owner = NULL;
+    buf->ptr = block->data;
+    buf->size = block->size;
+    buf->block = block;
+    return 1;
+}
+
+// Push a new ByteQueue or StringBuilder, with the capacity given as argument
+// 1.
+static void new_queue(lua_State* ls, char const* name) {
+    lua_Integer cap = luaL_optinteger(ls, 1, 0);
+    luaL_argcheck(ls, cap >= 0, 1, "invalid capacity");
+    ByteQueue* q = lua_newuserdatauv(ls, sizeof(ByteQueue), 1);
+    memset(q, 0, sizeof(*q));
+    luaL_getmetatable(ls, name);
     lua_setmetatable(ls, -2);
+    queue_set_storage(ls, lua_gettop(ls), q,
+                      cap < QUEUE_MIN_CAP ? QUEUE_MIN_CAP : cap);
+}
+
+static int mod_queue(lua_State* ls) {
+    new_queue(ls, ByteQueue_name);
+    return 1;
+}
+
+static int mod_builder(lua_State* ls) {
+    new_queue(ls, StringBuilder_name);
     return 1;
 }
 
@@ -179,6 +658,33 @@ static int mod_mallinfo(lua_State* ls) {
     return 2;
 }
 
+static int Detached___gc(lua_State* ls) {
+    void* owner = lua_touserdata(ls, 1);
+    SharedBlock* blocks = NULL;
+    mlua_event_lock();
+    for (SharedBlock** p = &detached_blocks; *p != NULL;) {
+        SharedBlock* block = *p;
+        if (block->owner != owner) {
+            p = &block->next;
+            continue;
+        }
+        *p = block->next;
+        block->next = blocks;
+        blocks = block;
+    }
+    mlua_event_unlock();
+    while (blocks != NULL) {
+        SharedBlock* block = blocks;
+        blocks = block->next;
+        free(block);
+    }
+    return 0;
+}
+
+MLUA_SYMBOLS_NOHASH(Detached_syms_nh) = {
+    MLUA_SYM_F_NH(__gc, Detached_),
+};
+
 MLUA_SYMBOLS(module_syms) = {
     MLUA_SYM_F(read, mod_),
     MLUA_SYM_F(read_cstr, mod_),
@@ -188,6 +694,9 @@ MLUA_SYMBOLS(module_syms) = {
     MLUA_SYM_F(get, mod_),
     MLUA_SYM_F(set, mod_),
     MLUA_SYM_F(alloc, mod_),
+    MLUA_SYM_F(attach, mod_),
+    MLUA_SYM_F(queue, mod_),
+    MLUA_SYM_F(builder, mod_),
     MLUA_SYM_F(mallinfo, mod_),
 };
 
@@ -202,5 +711,20 @@ MLUA_OPEN_MODULE(mlua.mem) {
     // Create the Buffer class.
     mlua_new_class(ls, Buffer_name, Buffer_syms, Buffer_syms_nh);
     lua_pop(ls, 1);
+
+    // Create the ByteQueue class.
+    mlua_new_class(ls, ByteQueue_name, ByteQueue_syms, ByteQueue_syms_nh);
+    lua_pop(ls, 1);
+
+    // Create the StringBuilder class.
+    mlua_new_class(ls, StringBuilder_name, StringBuilder_syms,
+                   StringBuilder_syms_nh);
+    lua_pop(ls, 1);
+
+    // Create the sentinel for detached blocks.
+    lua_newuserdatauv(ls, 1, 0);
+    mlua_new_class(ls, Detached_name, mlua_nosyms, Detached_syms_nh);
+    lua_setmetatable(ls, -2);
+    lua_rawsetp(ls, LUA_REGISTRYINDEX, Detached_name);
     return 1;
 }
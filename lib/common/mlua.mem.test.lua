@@ -17,6 +17,28 @@ function test_buffer(t)
         :matches('^mlua.mem.Buffer: 0?x?[0-9a-fA-F]+$')
 end
 
+function test_shared(t)
+    local buf = mem.alloc(10, true)
+    t:expect(t.expr(buf):is_shared()):eq(true)
+    t:expect(t.expr(mem.alloc(10)):is_shared()):eq(false)
+    mem.write(buf, 'abcdefghij')
+    local ptr = buf:ptr()
+    local handle = buf:detach()
+    t:expect(#buf):label("#buf"):eq(0)
+    t:expect(t.expr(buf):ptr()):raises("detached buffer")
+    t:expect(t.expr(buf):detach()):raises("detached buffer")
+    t:expect(t.expr(mem).read(buf)):raises("string or buffer expected")
+    t:expect(t.expr(_G).type(handle)):eq('userdata')
+    local buf2 = mem.attach(handle)
+    t:expect(#buf2):label("#buf2"):eq(10)
+    t:expect(t.expr(buf2):ptr()):eq(ptr)
+    t:expect(t.expr(mem).read(buf2)):eq('abcdefghij')
+    t:expect(t.expr(mem).attach(handle)):raises("invalid handle")
+    t:expect(t.expr(mem).attach(ptr)):raises("invalid handle")
+    t:expect(t.expr(mem).attach(1234)):raises("userdata expected")
+    t:expect(t.expr(mem.alloc(10)):detach()):raises("buffer isn't shared")
+end
+
 function test_read(t)
     local buf = mem.alloc(10)
     mem.write(buf, 'abcdefghij')
@@ -204,3 +226,145 @@ function _test_set(t)
         else exp:raises("out of bounds") end
     end
 end
+
+function test_ByteQueue(t)
+    local q = mem.queue()
+    t:expect(#q):label("#q"):eq(0)
+    t:expect(t.expr(q):cap()):eq(64)
+    t:expect(t.expr(_G).tostring(q))
+        :matches('^mlua.mem.ByteQueue: 0?x?[0-9a-fA-F]+$')
+    local buf = mem.alloc(3)
+    mem.write(buf, 'xyz')
+    t:expect(t.expr(q):append('abc\r\n', buf, '\r\nde', '')):eq(q)
+    t:expect(#q):label("#q"):eq(12)
+    t:expect(t.expr(mem).read(q)):eq('abc\r\nxyz\r\nde')
+    t:expect(t.expr(mem).find(q, 'xyz')):eq(5)
+    t:expect(t.expr(q):find('\r\n')):eq(3)
+    t:expect(t.expr(q):find('\r\n', 4)):eq(8)
+    t:expect(t.expr(q):find('\r\n', 9)):eq(nil)
+    t:expect(t.expr(q):peek()):eq('abc\r\nxyz\r\nde')
+    t:expect(t.expr(q):peek(2)):eq('ab')
+    t:expect(t.expr(q):peek(4, 10)):eq('de')
+    t:expect(t.expr(q):peek(nil, 13)):raises("out of bounds")
+    t:expect(t.expr(q):read_until('\r\n')):eq('abc')
+    t:expect(t.expr(q):read_until('\r\n', true)):eq('xyz\r\n')
+    t:expect(t.expr(q):read_until('\r\n')):eq(nil)
+    t:expect(t.expr(q):read_until('')):raises("empty delimiter")
+    t:expect(t.expr(q):append(q)):eq(q)
+    t:expect(t.expr(q):read(3)):eq('ded')
+    t:expect(t.expr(q):consume(5)):eq(1)
+    t:expect(#q):label("#q"):eq(0)
+    t:expect(t.expr(q):read()):eq('')
+    q:append('abc')
+    q:clear()
+    t:expect(#q):label("#q"):eq(0)
+    t:expect(t.expr(mem.queue(1000)):cap()):eq(1000)
+end
+
+function test_ByteQueue_growth(t)
+    local q, want, got = mem.queue(), {}, {}
+    for i = 1, 500 do
+        local chunk = ('%d,'):format(i)
+        table.insert(want, chunk)
+        q:append(chunk)
+        if i % 3 == 0 then
+            while true do
+                local v = q:read_until(',', true)
+                if not v then break end
+                table.insert(got, v)
+            end
+        end
+    end
+    table.insert(got, q:read())
+    t:expect(table.concat(got)):label("data"):eq(table.concat(want))
+    t:expect(q:cap()):label("cap"):lte(64)
+end
+
+function test_StringBuilder(t)
+    local sb = mem.builder()
+    t:expect(#sb):label("#sb"):eq(0)
+    t:expect(t.expr(sb):tostring()):eq('')
+    t:expect(t.expr(sb):add('ab', 12, '', 'cd')):eq(sb)
+    t:expect(t.expr(sb):addf('<%s|%03d>', 'x', 7)):eq(sb)
+    local buf = mem.alloc(4)
+    mem.write(buf, 'wxyz')
+    sb:add_buffer(buf, 1, 2):add_buffer('hello', 3):write('!')
+    t:expect(t.expr(sb):len()):eq(18)
+    t:expect(t.expr(_G).tostring(sb)):eq('ab12cd<x|007>xylo!')
+    t:expect(t.expr(mem).read(sb, 2, 4)):eq('12cd')
+    sb:add_buffer(sb, 0, 2)
+    t:expect(t.expr(sb):tostring()):eq('ab12cd<x|007>xylo!ab')
+    t:expect(t.expr(sb):add({})):raises("string expected")
+    t:expect(t.expr(sb):add_buffer('abc', 2, 2)):raises("out of bounds")
+    t:expect(t.expr(sb):reset()):eq(sb)
+    t:expect(#sb):label("#sb"):eq(0)
+    local want = {}
+    for i = 1, 300 do
+        sb:addf('%d,', i)
+        table.insert(want, ('%d,'):format(i))
+    end
+    t:expect(t.expr(sb):tostring()):eq(table.concat(want))
+end
+
+local function chunks(b)
+    local line = ('x'):rep(60) .. '\n'
+    local data = line:rep(b.n)
+    local res = {}
+    for i = 1, #data, 37 do table.insert(res, data:sub(i, i + 36)) end
+    b:bytes(#data)
+    b:reset_timer()
+    return res
+end
+
+function bench_lines_concat(b)
+    local buf = ''
+    for _, chunk in ipairs(chunks(b)) do
+        buf = buf .. chunk
+        while true do
+            local pos = buf:find('\n', 1, true)
+            if not pos then break end
+            local line = buf:sub(1, pos - 1)
+            buf = buf:sub(pos + 1)
+        end
+    end
+end
+
+function bench_lines_ByteQueue(b)
+    local q = mem.queue()
+    for _, chunk in ipairs(chunks(b)) do
+        q:append(chunk)
+        while true do
+            local line = q:read_until('\n')
+            if not line then break end
+        end
+    end
+end
+
+function bench_large_concat(b)
+    local buf = ''
+    for _, chunk in ipairs(chunks(b)) do buf = buf .. chunk end
+    while #buf > 0 do buf = buf:sub(62) end
+end
+
+function bench_large_ByteQueue(b)
+    local q = mem.queue()
+    for _, chunk in ipairs(chunks(b)) do q:append(chunk) end
+    while #q > 0 do q:consume(61) end
+end
+
+function bench_text_table_concat(b)
+    for i = 1, b.n do
+        local parts = {}
+        for j = 1, 20 do table.insert(parts, 'some text; ') end
+        table.concat(parts)
+    end
+end
+
+function bench_text_StringBuilder(b)
+    local sb = mem.builder()
+    for i = 1, b.n do
+        sb:reset()
+        for j = 1, 20 do sb:add('some text; ') end
+        sb:tostring()
+    end
+end
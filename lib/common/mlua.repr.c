@@ -0,0 +1,332 @@
+// Copyright 2024 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The maximum nesting depth of tables. Deeper tables are represented as "...".
+#ifndef MLUA_REPR_MAX_DEPTH
+#define MLUA_REPR_MAX_DEPTH 64
+#endif
+
+// An output buffer. The data is stored in a userdata at a fixed stack index,
+// which is replaced when the buffer grows. Unlike a luaL_Buffer, this allows
+// using the stack freely while formatting nested values.
+typedef struct Out {
+    lua_State* ls;
+    int idx;
+    char* data;
+    size_t len;
+    size_t cap;
+} Out;
+
+// The state of a repr() call. The "seen" table is at index 2.
+typedef struct State {
+    Out out;
+    int depth;
+} State;
+
+#define SEEN_IDX 2
+
+static char* out_reserve(Out* out, size_t size) {
+    if (size > out->cap - out->len) {
+        size_t cap = out->cap;
+        while (cap - out->len < size) cap *= 2;
+        char* data = lua_newuserdatauv(out->ls, cap, 0);
+        memcpy(data, out->data, out->len);
+        lua_replace(out->ls, out->idx);
+        out->data = data;
+        out->cap = cap;
+    }
+    return out->data + out->len;
+}
+
+static inline void out_add(Out* out, char const* s, size_t len) {
+    memcpy(out_reserve(out, len), s, len);
+    out->len += len;
+}
+
+#define out_literal(out, s) out_add((out), "" s, sizeof(s) - 1)
+
+static inline void out_char(Out* out, char c) {
+    *out_reserve(out, 1) = c;
+    ++out->len;
+}
+
+// Add the string on top of the stack, and pop it.
+static void out_pop(Out* out) {
+    size_t len;
+    char const* s = lua_tolstring(out->ls, -1, &len);
+    out_add(out, s, len);
+    lua_pop(out->ls, 1);
+}
+
+static void repr_value(State* st, int idx);
+
+static void repr_string(Out* out, int idx) {
+    size_t len;
+    char const* s = lua_tolstring(out->ls, idx, &len);
+    out_char(out, '"');
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = s[i];
+        char const* e = NULL;
+        switch (c) {
+        case '\a': e = "\\a"; break;
+        case '\b': e = "\\b"; break;
+        case '\t': e = "\\t"; break;
+        case '\n': e = "\\n"; break;
+        case '\v': e = "\\v"; break;
+        case '\f': e = "\\f"; break;
+        case '\r': e = "\\r"; break;
+        case '"': e = "\\\""; break;
+        case '\\': e = "\\\\"; break;
+        }
+        if (e != NULL) {
+            out_add(out, e, 2);
+        } else if (iscntrl(c)) {
+            char buf[5];
+            snprintf(buf, sizeof(buf), "\\x%02x", c);
+            out_add(out, buf, 4);
+        } else {
+            out_char(out, c);
+        }
+    }
+    out_char(out, '"');
+}
+
+static void repr_float(Out* out, lua_Number n) {
+    char buf[MLUA_MAX_NUMBER_STR_SIZE];
+    out_add(out, buf, mlua_number_to_string(n, buf, sizeof(buf)));
+}
+
+static bool is_identifier(char const* s, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)s[0]) || s[0] == '_')) {
+        return false;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if (!(isalnum((unsigned char)s[i]) || s[i] == '_')) return false;
+    }
+    return true;
+}
+
+// Check if the table at the given index should be formatted as a list, and
+// return its length. Also return the number of entries of the table.
+static bool is_list(lua_State* ls, int idx, lua_Integer* plen,
+                    size_t* pcount) {
+    lua_Integer len;
+    int isnum = 1;
+    if (lua_getfield(ls, idx, "n") == LUA_TNIL) {
+        len = lua_rawlen(ls, idx);
+    } else {
+        len = lua_tointegerx(ls, -1, &isnum);
+    }
+    lua_pop(ls, 1);
+    bool res = isnum && len >= 0;
+    lua_Integer cnt = 0;
+    size_t count = 0;
+    lua_pushnil(ls);
+    while (lua_next(ls, idx) != 0) {
+        lua_pop(ls, 1);
+        ++count;
+        if (!res) continue;
+        if (lua_type(ls, -1) == LUA_TSTRING
+                && strcmp(lua_tostring(ls, -1), "n") == 0) {
+            continue;
+        }
+        lua_Integer k = lua_tointegerx(ls, -1, &isnum);
+        if (!lua_isinteger(ls, -1) || k <= 0 || k > len) {
+            res = false;
+            continue;
+        }
+        ++cnt;
+    }
+    if (res && len > 10 && cnt < len / 2) res = false;
+    *plen = len;
+    *pcount = count;
+    return res;
+}
+
+static void repr_list(State* st, int idx, lua_Integer len) {
+    lua_State* ls = st->out.ls;
+    out_char(&st->out, '{');
+    for (lua_Integer i = 1; i <= len; ++i) {
+        if (i > 1) out_literal(&st->out, ", ");
+        lua_geti(ls, idx, i);
+        repr_value(st, lua_gettop(ls));
+        lua_pop(ls, 1);
+    }
+    if (lua_getfield(ls, idx, "n") != LUA_TNIL) {
+        if (len > 0) out_literal(&st->out, ", ");
+        out_literal(&st->out, "n = ");
+        repr_value(st, lua_gettop(ls));
+    }
+    lua_pop(ls, 1);
+    out_char(&st->out, '}');
+}
+
+// An entry of a table being formatted, as a range of the output buffer.
+typedef struct Entry {
+    char const* data;
+    size_t off;
+    size_t len;
+} Entry;
+
+static int compare_entries(void const* pa, void const* pb) {
+    Entry const* a = pa;
+    Entry const* b = pb;
+    size_t len = a->len < b->len ? a->len : b->len;
+    int res = memcmp(a->data + a->off, b->data + b->off, len);
+    if (res != 0) return res;
+    return a->len < b->len ? -1 : a->len > b->len ? 1 : 0;
+}
+
+// Format the entries of a table as "key = value", sort them, and output them
+// separated by commas.
+static void repr_entries(State* st, int idx, size_t count) {
+    lua_State* ls = st->out.ls;
+    Out* out = &st->out;
+    Entry* entries = lua_newuserdatauv(ls, count * sizeof(Entry), 0);
+    size_t start = out->len, n = 0;
+    lua_pushnil(ls);
+    while (n < count && lua_next(ls, idx) != 0) {
+        Entry* e = &entries[n++];
+        e->off = out->len;
+        int top = lua_gettop(ls);
+        size_t klen;
+        char const* k = lua_type(ls, top - 1) == LUA_TSTRING ?
+                        lua_tolstring(ls, top - 1, &klen) : NULL;
+        if (k != NULL && is_identifier(k, klen)) {
+            out_add(out, k, klen);
+        } else {
+            out_char(out, '[');
+            repr_value(st, top - 1);
+            out_char(out, ']');
+        }
+        out_literal(out, " = ");
+        repr_value(st, top);
+        e->len = out->len - e->off;
+        lua_pop(ls, 1);
+    }
+    if (n == count) lua_pop(ls, 1);  // Pop the last key
+
+    // Move the formatted entries to a temporary buffer, sort them, and write
+    // them back.
+    size_t size = out->len - start;
+    char* tmp = lua_newuserdatauv(ls, size, 0);
+    memcpy(tmp, out->data + start, size);
+    out->len = start;
+    for (size_t i = 0; i < n; ++i) {
+        entries[i].data = tmp;
+        entries[i].off -= start;
+    }
+    qsort(entries, n, sizeof(Entry), &compare_entries);
+    out_reserve(out, size + 2 * n);
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0) out_literal(out, ", ");
+        out_add(out, tmp + entries[i].off, entries[i].len);
+    }
+    lua_pop(ls, 2);
+}
+
+static void repr_table(State* st, int idx) {
+    lua_State* ls = st->out.ls;
+    lua_pushvalue(ls, idx);
+    if (lua_rawget(ls, SEEN_IDX) != LUA_TNIL
+            || st->depth >= MLUA_REPR_MAX_DEPTH) {
+        lua_pop(ls, 1);
+        out_literal(&st->out, "...");
+        return;
+    }
+    lua_pop(ls, 1);
+    luaL_checkstack(ls, 8, "too many nested tables");
+    lua_pushvalue(ls, idx);
+    lua_pushboolean(ls, true);
+    lua_rawset(ls, SEEN_IDX);
+    ++st->depth;
+
+    lua_Integer len;
+    size_t count;
+    if (is_list(ls, idx, &len, &count)) {
+        repr_list(st, idx, len);
+    } else {
+        out_char(&st->out, '{');
+        if (count > 0) repr_entries(st, idx, count);
+        out_char(&st->out, '}');
+    }
+
+    --st->depth;
+    lua_pushvalue(ls, idx);
+    lua_pushnil(ls);
+    lua_rawset(ls, SEEN_IDX);
+}
+
+static int mod_repr(lua_State* ls);
+
+static void repr_value(State* st, int idx) {
+    lua_State* ls = st->out.ls;
+    if (luaL_getmetafield(ls, idx, "__repr") != LUA_TNIL) {
+        lua_pushvalue(ls, idx);
+        if (lua_rawget(ls, SEEN_IDX) != LUA_TNIL) {
+            lua_pop(ls, 2);
+            out_literal(&st->out, "...");
+            return;
+        }
+        lua_pop(ls, 1);
+        lua_pushvalue(ls, idx);
+        lua_pushcfunction(ls, &mod_repr);
+        lua_pushvalue(ls, SEEN_IDX);
+        lua_call(ls, 3, 1);
+        luaL_tolstring(ls, -1, NULL);
+        out_pop(&st->out);
+        lua_pop(ls, 1);
+        return;
+    }
+    switch (lua_type(ls, idx)) {
+    case LUA_TSTRING:
+        repr_string(&st->out, idx);
+        break;
+    case LUA_TNUMBER:
+        if (lua_isinteger(ls, idx)) {
+            char buf[32];
+            int len = snprintf(buf, sizeof(buf), LUA_INTEGER_FMT,
+                               (LUAI_UACINT)lua_tointeger(ls, idx));
+            out_add(&st->out, buf, len);
+        } else {
+            repr_float(&st->out, lua_tonumber(ls, idx));
+        }
+        break;
+    case LUA_TTABLE:
+        repr_table(st, idx);
+        break;
+    default:
+        luaL_tolstring(ls, idx, NULL);
+        out_pop(&st->out);
+        break;
+    }
+}
+
+static int mod_repr(lua_State* ls) {
+    lua_settop(ls, 2);
+    if (lua_isnil(ls, SEEN_IDX)) {
+        lua_newtable(ls);
+        lua_replace(ls, SEEN_IDX);
+    }
+    State st = {.out = {.ls = ls, .idx = 3, .cap = 64}};
+    st.out.data = lua_newuserdatauv(ls, st.out.cap, 0);
+    repr_value(&st, 1);
+    lua_pushlstring(ls, st.out.data, st.out.len);
+    return 1;
+}
+
+MLUA_OPEN_MODULE(mlua.repr) {
+    lua_pushcfunction(ls, &mod_repr);
+    return 1;
+}
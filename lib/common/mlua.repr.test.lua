@@ -2,8 +2,11 @@
 -- SPDX-License-Identifier: MIT
 
 local repr = require 'mlua.repr'
+local string = require 'string'
 local table = require 'table'
 
+local float32 = string.packsize('n') == 4
+
 function test_repr(t)
     local repr = repr
     local rec = {a = {b = 2, d = 4}}
@@ -15,6 +18,12 @@ function test_repr(t)
         {true, tostring(true)},
         {123, tostring(123)},
         {4.5, tostring(4.5)},
+        {1.0, '1.0'},
+        {-0.0, '-0.0'},
+        {0.1, '0.1'},
+        {0.1 + 0.2, float32 and '0.3' or '0.30000000000000004'},
+        {1 / 3, float32 and '0.33333334' or '0.3333333333333333'},
+        {1 / 0, tostring(1 / 0)},
         {'abc', '"abc"'},
         {'\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f'
          .. '\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f'
@@ -30,6 +39,8 @@ function test_repr(t)
         {{[4] = 4, n = 3}, '{[4] = 4, n = 3}'},  -- Out-of-range key
         {{1, 2, n = 11}, '{[1] = 1, [2] = 2, n = 11}'},  -- Too many nils
         {{a = 1, b = 2, [3] = 4}, '{[3] = 4, a = 1, b = 2}'},
+        {{A = 1, _b = 2, ['c d'] = 3, [true] = 4},
+         '{A = 1, ["c d"] = 3, [true] = 4, _b = 2}'},
         {{a = {1, 2}, b = {c = 3, d = 4}}, '{a = {1, 2}, b = {c = 3, d = 4}}'},
         {rec, '{a = {b = 2, c = ..., d = 4}, e = ...}'},
     } do
@@ -37,3 +48,36 @@ function test_repr(t)
         t:expect(t.expr.repr(v)):eq(want)
     end
 end
+
+function test_repr_protocol(t)
+    local mt = {__repr = function(v, repr, seen)
+        return ('R(%s)'):format(repr(v.value, seen))
+    end}
+    local v = setmetatable({value = {1, 'a'}}, mt)
+    t:expect(t.expr.repr(v)):eq('R({1, "a"})')
+    t:expect(t.expr.repr({v, {k = v}})):eq('{R({1, "a"}), {k = R({1, "a"})}}')
+    t:expect(t.expr.repr(v, {[v] = true})):eq('...')
+end
+
+function test_repr_depth(t)
+    local deep = {}
+    local v = deep
+    for i = 1, 100 do
+        v[1] = {}
+        v = v[1]
+    end
+    t:expect(t.expr.repr(deep)):matches('^{{{.*{%.%.%.}.*}}}$')
+end
+
+local function bench_data()
+    local data = {}
+    for i = 1, 50 do
+        data[('key%d'):format(i)] = {i, i * 1.5, 'value', {a = i, b = true}}
+    end
+    return data
+end
+
+function bench_repr(b)
+    local data = bench_data()
+    for i = 1, b.n do repr(data) end
+end
@@ -0,0 +1,525 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include "mlua/ring.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mlua/errors.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/platform.h"
+#include "mlua/util.h"
+
+void mlua_ring_init(MLuaRing* r, unsigned int cap, unsigned int flags) {
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->reserve, 0);
+    atomic_init(&r->rwait, false);
+    atomic_init(&r->wwait, false);
+    r->mask = cap - 1;
+    r->flags = flags;
+    mlua_event_init(&r->read_event);
+    mlua_event_init(&r->write_event);
+}
+
+// Copy data into the ring at the given position, wrapping around as needed.
+static void put(MLuaRing* r, unsigned int pos, void const* src,
+                unsigned int len) {
+    unsigned int off = pos & r->mask;
+    unsigned int n = mlua_ring_cap(r) - off;
+    if (n >= len) {
+        memcpy(r->data + off, src, len);
+        return;
+    }
+    memcpy(r->data + off, src, n);
+    memcpy(r->data, (uint8_t const*)src + n, len - n);
+}
+
+// Copy data out of the ring at the given position, wrapping around as needed.
+static void get(MLuaRing* r, unsigned int pos, void* dest, unsigned int len) {
+    unsigned int off = pos & r->mask;
+    unsigned int n = mlua_ring_cap(r) - off;
+    if (n >= len) {
+        memcpy(dest, r->data + off, len);
+        return;
+    }
+    memcpy(dest, r->data + off, n);
+    memcpy((uint8_t*)dest + n, r->data, len - n);
+}
+
+// Clear a waiting flag, and return true iff it was set. The fence pairs with
+// the one in the wait functions, so that either the writer sees the flag, or
+// the waiter sees the updated positions.
+static inline bool take_flag(atomic_bool* flag) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(flag, memory_order_relaxed)) return false;
+    atomic_store_explicit(flag, false, memory_order_relaxed);
+    return true;
+}
+
+// Reserve between "min" and "max" bytes for writing. Returns the number of
+// bytes reserved, and sets "start" to the position of the reservation.
+static unsigned int reserve(MLuaRing* r, unsigned int min, unsigned int max,
+                            unsigned int* start) {
+    unsigned int cap = mlua_ring_cap(r);
+    unsigned int pos = atomic_load_explicit(&r->reserve, memory_order_relaxed);
+    for (;;) {
+        unsigned int avail = cap - (pos - atomic_load_explicit(
+                                        &r->head, memory_order_acquire));
+        if (avail < min) return 0;
+        unsigned int n = max < avail ? max : avail;
+#if MLUA_RING_MP_LOCK_FREE
+        if (r->flags & MLUA_RING_MULTI_PRODUCER) {
+            if (!atomic_compare_exchange_weak_explicit(
+                    &r->reserve, &pos, pos + n, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                continue;
+            }
+            *start = pos;
+            return n;
+        }
+#endif
+        atomic_store_explicit(&r->reserve, pos + n, memory_order_relaxed);
+        *start = pos;
+        return n;
+    }
+}
+
+// Commit a reservation, making the data visible to the consumer.
+// Reservations are committed in order, so a producer may have to wait for
+// earlier reservations of other producers to be committed.
+static void commit(MLuaRing* r, unsigned int start, unsigned int len) {
+#if MLUA_RING_MP_LOCK_FREE
+    if (r->flags & MLUA_RING_MULTI_PRODUCER) {
+        while (atomic_load_explicit(&r->tail, memory_order_acquire) != start) {}
+    }
+#endif
+    atomic_store_explicit(&r->tail, start + len, memory_order_release);
+}
+
+// Write an optional header followed by between "min" and "max" bytes of data.
+// Returns the total number of bytes written, including the header, or zero if
+// there wasn't enough space.
+static unsigned int write(MLuaRing* r, void const* hdr, unsigned int hlen,
+                          void const* src, unsigned int min,
+                          unsigned int max) {
+#if !MLUA_RING_MP_LOCK_FREE
+    // Serialize producers, so that a producer cannot be interrupted by another
+    // producer of the same ring while holding a reservation.
+    bool locked = (r->flags & MLUA_RING_MULTI_PRODUCER) != 0;
+    if (locked) mlua_event_lock();
+#endif
+    unsigned int start;
+    unsigned int n = reserve(r, hlen + min, hlen + max, &start);
+    if (n != 0) {
+        if (hlen != 0) put(r, start, hdr, hlen);
+        if (n > hlen) put(r, start + hlen, src, n - hlen);
+        commit(r, start, n);
+    }
+#if !MLUA_RING_MP_LOCK_FREE
+    if (locked) {
+        if (n != 0 && take_flag(&r->rwait)) {
+            mlua_event_set_nolock(&r->read_event);
+        }
+        mlua_event_unlock();
+        return n;
+    }
+#endif
+    if (n != 0 && take_flag(&r->rwait)) mlua_event_set(&r->read_event);
+    return n;
+}
+
+unsigned int mlua_ring_write(MLuaRing* r, void const* src, unsigned int len) {
+    if (len == 0) return 0;
+    return write(r, NULL, 0, src, 1, len);
+}
+
+bool mlua_ring_write_all(MLuaRing* r, void const* src, unsigned int len) {
+    if (len == 0) return true;
+    return write(r, NULL, 0, src, len, len) != 0;
+}
+
+unsigned int mlua_ring_read(MLuaRing* r, void* dest, unsigned int len) {
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int avail = atomic_load_explicit(&r->tail, memory_order_acquire)
+                         - head;
+    if (len > avail) len = avail;
+    if (len == 0) return 0;
+    get(r, head, dest, len);
+    atomic_store_explicit(&r->head, head + len, memory_order_release);
+    if (take_flag(&r->wwait)) mlua_event_set(&r->write_event);
+    return len;
+}
+
+bool mlua_ring_push_record(MLuaRing* r, void const* src, unsigned int len) {
+    if (len > MLUA_RING_RECORD_MAX) return false;
+    uint16_t hdr = len;
+    return write(r, &hdr, MLUA_RING_RECORD_HEADER, src, len, len) != 0;
+}
+
+int mlua_ring_peek_record(MLuaRing* r) {
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int avail = atomic_load_explicit(&r->tail, memory_order_acquire)
+                         - head;
+    if (avail < MLUA_RING_RECORD_HEADER) return -1;
+    uint16_t hdr;
+    get(r, head, &hdr, sizeof(hdr));
+    return hdr;
+}
+
+unsigned int mlua_ring_pop_record(MLuaRing* r, void* dest, unsigned int size) {
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint16_t hdr;
+    get(r, head, &hdr, sizeof(hdr));
+    unsigned int len = hdr;
+    get(r, head + MLUA_RING_RECORD_HEADER, dest, len < size ? len : size);
+    atomic_store_explicit(&r->head, head + MLUA_RING_RECORD_HEADER + len,
+                          memory_order_release);
+    if (take_flag(&r->wwait)) mlua_event_set(&r->write_event);
+    return len;
+}
+
+bool mlua_ring_wait_readable(MLuaRing* r, unsigned int len) {
+    atomic_store_explicit(&r->rwait, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    return mlua_ring_len(r) < len;
+}
+
+bool mlua_ring_wait_writable(MLuaRing* r, unsigned int len) {
+    atomic_store_explicit(&r->wwait, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    return mlua_ring_free(r) < len;
+}
+
+// A ring shared between interpreters. The ring is allocated on the C heap, and
+// each interpreter holds at most one userdata per ring, so that the owner of
+// an event can disable it when the userdata is collected.
+typedef struct Ring {
+    int refs;            // Protected by the event lock
+    MLuaGlobal* reader;  // The owner of the read event
+    MLuaGlobal* writer;  // The owner of the write event
+    MLuaRing ring;
+} Ring;
+
+static char const Ring_name[] = "mlua.ring.Ring";
+
+static void release_ring(void* handle) {
+    Ring* rg = handle;
+    mlua_event_lock();
+    bool last = --rg->refs == 0;
+    mlua_event_unlock();
+    if (last) free(rg);
+}
+
+static inline Ring* check_Ring(lua_State* ls, int arg) {
+    Ring* rg = *((Ring**)luaL_checkudata(ls, arg, Ring_name));
+    luaL_argcheck(ls, rg != NULL, arg, "invalid ring");
+    return rg;
+}
+
+static inline Ring* to_Ring(lua_State* ls, int arg) {
+    return *((Ring**)lua_touserdata(ls, arg));
+}
+
+// Push the userdata for a ring. The reference is transferred to the userdata.
+static void push_ring(lua_State* ls, void* handle) {
+    Ring* rg = handle;
+    lua_rawgetp(ls, LUA_REGISTRYINDEX, Ring_name);
+    if (lua_rawgetp(ls, -1, rg) != LUA_TNIL) {
+        lua_remove(ls, -2);
+        release_ring(rg);
+        return;
+    }
+    lua_pop(ls, 1);
+    Ring** ud = lua_newuserdatauv(ls, sizeof(Ring*), 0);
+    *ud = rg;
+    luaL_getmetatable(ls, Ring_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, -1);
+    lua_rawsetp(ls, -3, rg);
+    lua_remove(ls, -2);
+}
+
+static void import_ring(lua_State* ls, void* handle) {
+    mlua_require(ls, "mlua.ring", false);  // Ensure the class is defined
+    push_ring(ls, handle);
+}
+
+static MLuaExportVt const Ring_export_vt = {
+    .import = &import_ring,
+    .release = &release_ring,
+};
+
+// Make the interpreter the owner of an event, and enable the event. Returns
+// false iff the event is owned by another interpreter.
+static bool claim_event(lua_State* ls, MLuaGlobal** owner, MLuaEvent* ev) {
+    MLuaGlobal* g = mlua_global(ls);
+    mlua_event_lock();
+    MLuaGlobal* cur = *owner;
+    if (cur == NULL) *owner = g;
+    mlua_event_unlock();
+    if (cur != NULL) return cur == g;
+    mlua_event_enable(ls, ev);
+    return true;
+}
+
+static void check_data(lua_State* ls, Ring* rg, int arg, MLuaBuffer* buf) {
+    luaL_argexpected(ls, mlua_get_ro_buffer(ls, arg, buf) && buf->vt == NULL,
+                     arg, "string or raw buffer");
+    size_t max = mlua_ring_cap(&rg->ring);
+    if (rg->ring.flags & MLUA_RING_RECORDS) {
+        max = max - MLUA_RING_RECORD_HEADER;
+        if (max > MLUA_RING_RECORD_MAX) max = MLUA_RING_RECORD_MAX;
+    }
+    luaL_argcheck(ls, buf->size <= max, arg, "data too large");
+}
+
+static bool try_write(Ring* rg, MLuaBuffer const* buf) {
+    if (rg->ring.flags & MLUA_RING_RECORDS) {
+        return mlua_ring_push_record(&rg->ring, buf->ptr, buf->size);
+    }
+    return mlua_ring_write_all(&rg->ring, buf->ptr, buf->size);
+}
+
+static bool try_read(lua_State* ls, Ring* rg, int arg) {
+    MLuaRing* r = &rg->ring;
+    luaL_Buffer buf;
+    if (r->flags & MLUA_RING_RECORDS) {
+        int len = mlua_ring_peek_record(r);
+        if (len < 0) return false;
+        void* dest = luaL_buffinitsize(ls, &buf, len);
+        mlua_ring_pop_record(r, dest, len);
+        luaL_pushresultsize(&buf, len);
+        return true;
+    }
+    lua_Unsigned max = luaL_optinteger(ls, arg, UINT_MAX);
+    if (max == 0) return lua_pushliteral(ls, ""), true;
+    unsigned int len = mlua_ring_len(r);
+    if (len > max) len = max;
+    if (len == 0) return false;
+    void* dest = luaL_buffinitsize(ls, &buf, len);
+    mlua_ring_read(r, dest, len);
+    luaL_pushresultsize(&buf, len);
+    return true;
+}
+
+// Wait for a condition in blocking mode. The OS thread is blocked on the event
+// lock until an event is set. The condition, i.e. that at least "need" bytes
+// can be written if "write" is true, or read otherwise, is re-checked under
+// the lock, so that a wakeup between the loop function and the wait isn't
+// lost.
+static int block(lua_State* ls, MLuaEventLoopFn loop, bool write,
+                 unsigned int need, int index) {
+    Ring* rg = to_Ring(ls, 1);
+    uint64_t deadline = lua_isnoneornil(ls, index) ? MLUA_TICKS_MAX
+                        : (uint64_t)mlua_check_time(ls, index);
+    bool timeout = false;
+    for (;;) {
+        int res = loop(ls, timeout);
+        if (res >= 0) return res;
+        mlua_event_lock();
+        unsigned int avail = write ? mlua_ring_free(&rg->ring)
+                                   : mlua_ring_len(&rg->ring);
+        if (avail < need) timeout = mlua_event_wait_nolock(deadline);
+        mlua_event_unlock();
+    }
+}
+
+static int poll_cont(lua_State* ls, int status, lua_KContext ctx);
+
+// Wait for a condition by polling the loop function. This is used when the
+// event is owned by another interpreter, and therefore cannot be waited for.
+static int poll(lua_State* ls, MLuaEventLoopFn loop, int index) {
+    if (!lua_isnoneornil(ls, index)) {
+        luaL_argexpected(ls, mlua_is_time(ls, index), index,
+                         "integer or Int64");
+    }
+    return poll_cont(ls, LUA_OK, (lua_KContext)loop);
+}
+
+static int poll_cont(lua_State* ls, int status, lua_KContext ctx) {
+    MLuaEventLoopFn loop = (MLuaEventLoopFn)ctx;
+    int res = loop(ls, !lua_isnoneornil(ls, 3) && mlua_time_reached(ls, 3));
+    if (res >= 0) return res;
+    return mlua_thread_yield(ls, 0, &poll_cont, ctx);
+}
+
+static int write_loop(lua_State* ls, bool timeout) {
+    Ring* rg = to_Ring(ls, 1);
+    MLuaBuffer buf;
+    mlua_get_ro_buffer(ls, 2, &buf);
+    unsigned int need = buf.size;
+    if (rg->ring.flags & MLUA_RING_RECORDS) need += MLUA_RING_RECORD_HEADER;
+    for (;;) {
+        if (try_write(rg, &buf)) return lua_pushboolean(ls, true), 1;
+        if (timeout) return mlua_err_push(ls, MLUA_ETIMEDOUT);
+        if (mlua_ring_wait_writable(&rg->ring, need)) return -1;
+    }
+}
+
+static int Ring_write(lua_State* ls) {
+    Ring* rg = check_Ring(ls, 1);
+    MLuaBuffer buf;
+    check_data(ls, rg, 2, &buf);
+    lua_settop(ls, 3);  // Ensure deadline is set
+    bool owned = claim_event(ls, &rg->writer, &rg->ring.write_event);
+    if (mlua_thread_blocking(ls)) {
+        unsigned int need = buf.size;
+        if (rg->ring.flags & MLUA_RING_RECORDS) need += MLUA_RING_RECORD_HEADER;
+        return block(ls, &write_loop, true, need, 3);
+    }
+    if (owned && mlua_event_can_wait(ls, &rg->ring.write_event, 0)) {
+        return mlua_event_wait(ls, &rg->ring.write_event, 0, &write_loop, 3);
+    }
+    return poll(ls, &write_loop, 3);
+}
+
+static int Ring_try_write(lua_State* ls) {
+    Ring* rg = check_Ring(ls, 1);
+    MLuaBuffer buf;
+    check_data(ls, rg, 2, &buf);
+    return lua_pushboolean(ls, try_write(rg, &buf)), 1;
+}
+
+static int read_loop(lua_State* ls, bool timeout) {
+    Ring* rg = to_Ring(ls, 1);
+    for (;;) {
+        if (try_read(ls, rg, 2)) return 1;
+        if (timeout) return mlua_err_push(ls, MLUA_ETIMEDOUT);
+        if (mlua_ring_wait_readable(&rg->ring, 1)) return -1;
+    }
+}
+
+static int Ring_read(lua_State* ls) {
+    Ring* rg = check_Ring(ls, 1);
+    if (!claim_event(ls, &rg->reader, &rg->ring.read_event)) {
+        return luaL_error(ls, "ring has a reader in another interpreter");
+    }
+    lua_settop(ls, 3);  // Ensure deadline is set
+    if (mlua_thread_blocking(ls)) return block(ls, &read_loop, false, 1, 3);
+    if (mlua_event_can_wait(ls, &rg->ring.read_event, 0)) {
+        return mlua_event_wait(ls, &rg->ring.read_event, 0, &read_loop, 3);
+    }
+    return poll(ls, &read_loop, 3);
+}
+
+static int Ring_try_read(lua_State* ls) {
+    Ring* rg = check_Ring(ls, 1);
+    if (!try_read(ls, rg, 2)) luaL_pushfail(ls);
+    return 1;
+}
+
+static int Ring_len(lua_State* ls) {
+    return lua_pushinteger(ls, mlua_ring_len(&check_Ring(ls, 1)->ring)), 1;
+}
+
+static int Ring_free(lua_State* ls) {
+    return lua_pushinteger(ls, mlua_ring_free(&check_Ring(ls, 1)->ring)), 1;
+}
+
+static int Ring_cap(lua_State* ls) {
+    return lua_pushinteger(ls, mlua_ring_cap(&check_Ring(ls, 1)->ring)), 1;
+}
+
+static int Ring___export(lua_State* ls) {
+    Ring* rg = *((Ring**)luaL_checkudata(ls, 1, Ring_name));
+    if (rg == NULL) return 0;
+    mlua_event_lock();
+    ++rg->refs;
+    mlua_event_unlock();
+    lua_pushlightuserdata(ls, rg);
+    lua_pushlightuserdata(ls, (void*)&Ring_export_vt);
+    return 2;
+}
+
+// Release an event if the interpreter is its owner.
+static void release_event(lua_State* ls, MLuaGlobal** owner, MLuaEvent* ev) {
+    MLuaGlobal* g = mlua_global(ls);
+    mlua_event_lock();
+    bool owned = *owner == g;
+    mlua_event_unlock();
+    if (!owned) return;
+    mlua_event_disable(ls, ev);
+    mlua_event_lock();
+    *owner = NULL;
+    mlua_event_unlock();
+}
+
+static int Ring___gc(lua_State* ls) {
+    Ring** ud = luaL_checkudata(ls, 1, Ring_name);
+    Ring* rg = *ud;
+    if (rg == NULL) return 0;
+    *ud = NULL;
+    release_event(ls, &rg->reader, &rg->ring.read_event);
+    release_event(ls, &rg->writer, &rg->ring.write_event);
+    release_ring(rg);
+    return 0;
+}
+
+MLUA_SYMBOLS(Ring_syms) = {
+    MLUA_SYM_F(write, Ring_),
+    MLUA_SYM_F(try_write, Ring_),
+    MLUA_SYM_F(read, Ring_),
+    MLUA_SYM_F(try_read, Ring_),
+    MLUA_SYM_F(len, Ring_),
+    MLUA_SYM_F(free, Ring_),
+    MLUA_SYM_F(cap, Ring_),
+};
+
+MLUA_SYMBOLS_NOHASH(Ring_syms_nh) = {
+    MLUA_SYM_F_NH(__export, Ring_),
+    MLUA_SYM_F_NH(__gc, Ring_),
+};
+
+static int mod_new(lua_State* ls) {
+    lua_Integer size = luaL_checkinteger(ls, 1);
+    lua_Integer flags = luaL_optinteger(ls, 2, 0);
+    luaL_argcheck(ls, 0 < size && (lua_Unsigned)size <= UINT_MAX / 2 + 1, 1,
+                  "invalid size");
+    luaL_argcheck(
+        ls, (flags & ~(MLUA_RING_MULTI_PRODUCER | MLUA_RING_RECORDS)) == 0,
+        2, "invalid flags");
+    unsigned int cap = 1;
+    while (cap < (lua_Unsigned)size) cap <<= 1;
+    if ((flags & MLUA_RING_RECORDS) && cap <= MLUA_RING_RECORD_HEADER) {
+        cap = 2 * MLUA_RING_RECORD_HEADER;
+    }
+    Ring* rg = malloc(offsetof(Ring, ring) + mlua_ring_size(cap));
+    if (rg == NULL) return luaL_error(ls, "out of memory");
+    rg->refs = 1;
+    rg->reader = rg->writer = NULL;
+    mlua_ring_init(&rg->ring, cap, flags);
+    push_ring(ls, rg);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_V(MULTI_PRODUCER, integer, MLUA_RING_MULTI_PRODUCER),
+    MLUA_SYM_V(RECORDS, integer, MLUA_RING_RECORDS),
+    MLUA_SYM_F(new, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.ring) {
+    mlua_thread_require(ls);
+    mlua_require(ls, "mlua.int64", false);
+
+    // Create the module.
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Ring class.
+    mlua_new_class(ls, Ring_name, Ring_syms, Ring_syms_nh);
+    lua_pop(ls, 1);
+
+    // Create the ring userdata cache, with weak values.
+    lua_createtable(ls, 0, 0);
+    lua_createtable(ls, 0, 1);
+    lua_pushliteral(ls, "v");
+    lua_setfield(ls, -2, "__mode");
+    lua_setmetatable(ls, -2);
+    lua_rawsetp(ls, LUA_REGISTRYINDEX, Ring_name);
+    return 1;
+}
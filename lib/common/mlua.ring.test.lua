@@ -0,0 +1,121 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local errors = require 'mlua.errors'
+local mem = require 'mlua.mem'
+local ring = require 'mlua.ring'
+local thread = require 'mlua.thread'
+local time = require 'mlua.time'
+local string = require 'string'
+local table = require 'table'
+
+function test_new(t)
+    for _, test in ipairs{
+        {1, 0, 1}, {5, 0, 8}, {64, 0, 64}, {65, 0, 128}, {40000, 0, 65536},
+        {1, ring.RECORDS, 4}, {3, ring.RECORDS, 4}, {5, ring.RECORDS, 8},
+    } do
+        local size, flags, want = table.unpack(test)
+        local r = ring.new(size, flags)
+        t:expect(t.expr(r):cap()):eq(want)
+        t:expect(t.expr(r):len()):eq(0)
+        t:expect(t.expr(r):free()):eq(want)
+    end
+    t:expect(t.expr(ring).new(0)):raises("invalid size")
+    t:expect(t.expr(ring).new(-1)):raises("invalid size")
+    t:expect(t.expr(ring).new(16, 4)):raises("invalid flags")
+end
+
+function test_bytes(t)
+    local r = ring.new(8)
+    t:expect(t.expr(r):try_read()):eq(nil)
+    t:expect(t.expr(r):try_read(0)):eq('')
+    t:expect(t.expr(r):read(0)):eq('')
+    t:expect(t.expr(r):try_write('abcde')):eq(true)
+    t:expect(t.expr(r):try_read(0)):eq('')
+    t:expect(t.expr(r):len()):eq(5)
+    t:expect(t.expr(r):free()):eq(3)
+    t:expect(t.expr(r):try_write('fghi')):eq(false)
+    t:expect(t.expr(r):try_read(3)):eq('abc')
+    t:expect(t.expr(r):try_write('fghi')):eq(true)  -- Wraps around
+    t:expect(t.expr(r):read()):eq('defghi')
+    t:expect(t.expr(r):try_write('')):eq(true)
+    t:expect(t.expr(r):len()):eq(0)
+    t:expect(t.expr(r):write('123456789')):raises("data too large")
+    t:expect(t.expr(r):write({})):raises("string or raw buffer expected")
+end
+
+function test_buffer(t)
+    local r, buf = ring.new(16), mem.alloc(6)
+    mem.write(buf, 'abcdef')
+    t:expect(t.expr(r):write(buf)):eq(true)
+    t:expect(t.expr(r):read()):eq('abcdef')
+end
+
+function test_records(t)
+    local r = ring.new(16, ring.RECORDS)
+    t:expect(t.expr(r):try_read()):eq(nil)
+    t:expect(t.expr(r):write('abc')):eq(true)
+    t:expect(t.expr(r):write('')):eq(true)
+    t:expect(t.expr(r):write('defgh')):eq(true)
+    t:expect(t.expr(r):len()):eq(14)
+    t:expect(t.expr(r):try_write('ij')):eq(false)
+    t:expect(t.expr(r):read(1)):eq('abc')
+    t:expect(t.expr(r):try_write('ij')):eq(true)  -- Wraps around
+    t:expect(t.expr(r):read()):eq('')
+    t:expect(t.expr(r):read()):eq('defgh')
+    t:expect(t.expr(r):read()):eq('ij')
+    t:expect(t.expr(r):try_read()):eq(nil)
+    t:expect(t.expr(r):write(('x'):rep(15))):raises("data too large")
+end
+
+function test_read_timeout_BNB(t)
+    local r = ring.new(16)
+    t:expect(t.mexpr(r):read(nil, time.deadline(1000)))
+        :eq{nil, "timed out", errors.ETIMEDOUT, n = 3}
+end
+
+function test_write_timeout_BNB(t)
+    local r = ring.new(4)
+    r:write('abcd')
+    t:expect(t.mexpr(r):write('e', time.deadline(1000)))
+        :eq{nil, "timed out", errors.ETIMEDOUT, n = 3}
+end
+
+function test_read_waits(t)
+    local r = ring.new(16)
+    local th<close> = thread.start(function()
+        for i = 1, 3 do
+            thread.yield()
+            r:write(('%s'):format(i))
+        end
+    end)
+    for i = 1, 3 do t:expect(t.expr(r):read()):eq(('%s'):format(i)) end
+end
+
+function test_write_waits(t)
+    local r, got = ring.new(4, ring.RECORDS), {}
+    local th<close> = thread.start(function()
+        for i = 1, 10 do table.insert(got, r:read()) end
+    end)
+    for i = 1, 10 do r:write(string.char(0x40 + i)) end
+    th:join()
+    t:expect(table.concat(got)):label("got"):eq('ABCDEFGHIJ')
+end
+
+function bench_bytes(b)
+    local r, data = ring.new(1024), ('x'):rep(64)
+    b:bytes(#data)
+    for i = 1, b.n do
+        r:try_write(data)
+        r:try_read()
+    end
+end
+
+function bench_records(b)
+    local r, data = ring.new(1024, ring.RECORDS), ('x'):rep(64)
+    b:bytes(#data)
+    for i = 1, b.n do
+        r:try_write(data)
+        r:try_read()
+    end
+end
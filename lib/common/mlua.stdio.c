@@ -1,6 +1,8 @@
 // Copyright 2023 Remy Blank <remy@c-space.org>
 // SPDX-License-Identifier: MIT
 
+#include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "lua.h"
@@ -8,8 +10,15 @@
 #include "mlua/module.h"
 #include "mlua/util.h"
 
+// The default size of OutStream buffers.
+#ifndef MLUA_STDIO_BUFFER_SIZE
+#define MLUA_STDIO_BUFFER_SIZE 256
+#endif
+
 static char const InStream_name[] = "mlua.stdio.InStream";
 
+static void flush_std_streams(lua_State* ls);
+
 __attribute__((weak, noinline))
 int mlua_stdio_read(lua_State* ls, int fd, int arg) {
     lua_Integer len = luaL_checkinteger(ls, arg);
@@ -24,6 +33,7 @@ int mlua_stdio_read(lua_State* ls, int fd, int arg) {
 
 static int InStream_read(lua_State* ls) {
     int fd = *((int*)luaL_checkudata(ls, 1, InStream_name));
+    flush_std_streams(ls);
     return mlua_stdio_read(ls, fd, 2);
 }
 
@@ -43,20 +53,128 @@ int mlua_stdio_write(lua_State* ls, int fd, int arg) {
     return 1;
 }
 
+// Buffering modes of OutStream.
+typedef enum BufferMode {
+    BUF_NO,
+    BUF_LINE,
+    BUF_FULL,
+} BufferMode;
+
+// The state of an OutStream. The first field must be the file descriptor, to
+// match the layout of InStream. The buffer is a userdata stored as the first
+// user value.
+typedef struct OutStream {
+    int fd;
+    BufferMode mode;
+    char* buf;
+    size_t size;
+    size_t len;
+} OutStream;
+
+static inline OutStream* check_OutStream(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, OutStream_name);
+}
+
+// Write all the given data to a file descriptor. Returns false on error.
+static bool write_all(int fd, char const* s, size_t len) {
+    while (len > 0) {
+        ssize_t cnt = write(fd, s, len);
+        if (cnt < 0) return false;
+        s += cnt;
+        len -= cnt;
+    }
+    return true;
+}
+
+// Write the buffered data of a stream. Returns false on error, in which case
+// the data that wasn't written is kept in the buffer.
+static bool flush_stream(OutStream* s) {
+    size_t pos = 0;
+    while (pos < s->len) {
+        ssize_t cnt = write(s->fd, s->buf + pos, s->len - pos);
+        if (cnt < 0) {
+            memmove(s->buf, s->buf + pos, s->len - pos);
+            s->len -= pos;
+            return false;
+        }
+        pos += cnt;
+    }
+    s->len = 0;
+    return true;
+}
+
 static int OutStream_write(lua_State* ls) {
-    int fd = *((int*)luaL_checkudata(ls, 1, OutStream_name));
-    return mlua_stdio_write(ls, fd, 2);
+    OutStream* s = check_OutStream(ls, 1);
+    if (s->mode == BUF_NO) return mlua_stdio_write(ls, s->fd, 2);
+    size_t len;
+    char const* data = luaL_checklstring(ls, 2, &len);
+    if (s->len + len > s->size && !flush_stream(s)) {
+        return luaL_fileresult(ls, 0, NULL);
+    }
+    if (len >= s->size) {
+        if (!write_all(s->fd, data, len)) return luaL_fileresult(ls, 0, NULL);
+    } else {
+        memcpy(s->buf + s->len, data, len);
+        s->len += len;
+        if (s->mode == BUF_LINE && memchr(data, '\n', len) != NULL
+                && !flush_stream(s)) {
+            return luaL_fileresult(ls, 0, NULL);
+        }
+    }
+    lua_pushinteger(ls, len);
+    return 1;
+}
+
+static int OutStream_flush(lua_State* ls) {
+    OutStream* s = check_OutStream(ls, 1);
+    return luaL_fileresult(ls, flush_stream(s), NULL);
+}
+
+static int OutStream_setvbuf(lua_State* ls) {
+    static char const* const modes[] = {"no", "line", "full", NULL};
+    OutStream* s = check_OutStream(ls, 1);
+    BufferMode mode = luaL_checkoption(ls, 2, NULL, modes);
+    lua_Integer size = luaL_optinteger(ls, 3, MLUA_STDIO_BUFFER_SIZE);
+    luaL_argcheck(ls, size > 0, 3, "invalid size");
+    if (!flush_stream(s)) return luaL_fileresult(ls, 0, NULL);
+    if (mode == BUF_NO) {
+        lua_pushnil(ls);
+        s->buf = NULL;
+        s->size = 0;
+    } else {
+        s->buf = lua_newuserdatauv(ls, size, 0);
+        s->size = size;
+    }
+    lua_setiuservalue(ls, 1, 1);
+    s->mode = mode;
+    return lua_pushboolean(ls, true), 1;
+}
+
+static int OutStream___gc(lua_State* ls) {
+    flush_stream(check_OutStream(ls, 1));
+    return 0;
 }
 
 MLUA_SYMBOLS(OutStream_syms) = {
     MLUA_SYM_F(write, OutStream_),
+    MLUA_SYM_F(flush, OutStream_),
+    MLUA_SYM_F(setvbuf, OutStream_),
+};
+
+MLUA_SYMBOLS_NOHASH(OutStream_syms_nh) = {
+    MLUA_SYM_F_NH(__gc, OutStream_),
 };
 
 static void create_stream(lua_State* ls, char const* name, char const* cls,
                           int stream) {
     int mod = lua_gettop(ls);
-    int* v = lua_newuserdatauv(ls, sizeof(int), 0);
-    *v = stream;
+    if (cls == OutStream_name) {
+        OutStream* s = lua_newuserdatauv(ls, sizeof(OutStream), 1);
+        *s = (OutStream){.fd = stream, .mode = BUF_NO};
+    } else {
+        int* v = lua_newuserdatauv(ls, sizeof(int), 0);
+        *v = stream;
+    }
     luaL_getmetatable(ls, cls);
     lua_setmetatable(ls, -2);
     lua_pushvalue(ls, -1);
@@ -64,22 +182,40 @@ static void create_stream(lua_State* ls, char const* name, char const* cls,
     lua_setglobal(ls, name);
 }
 
-static void write_stdout(lua_State* ls, char const* s) {
-    lua_getglobal(ls, "stdout");
-    lua_getfield(ls, -1, "write");
-    lua_rotate(ls, -2, 1);
-    if (s != NULL) { lua_pushstring(ls, s); } else { lua_rotate(ls, -3, -1); }
-    lua_call(ls, 2, 0);
+// Flush the buffered data of stdout and stderr. Errors are ignored.
+static void flush_std_streams(lua_State* ls) {
+    lua_getfield(ls, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    if (lua_getfield(ls, -1, "mlua.stdio") == LUA_TTABLE) {
+        lua_getfield(ls, -1, "stdout");
+        OutStream* s = luaL_testudata(ls, -1, OutStream_name);
+        if (s != NULL) flush_stream(s);
+        lua_getfield(ls, -2, "stderr");
+        s = luaL_testudata(ls, -1, OutStream_name);
+        if (s != NULL) flush_stream(s);
+        lua_pop(ls, 2);
+    }
+    lua_pop(ls, 2);
 }
 
+// Flush stdout and stderr when the thread scheduler becomes idle. This
+// overrides the weak definition in mlua.thread.
+void mlua_thread_idle(lua_State* ls) { flush_std_streams(ls); }
+
 static int global_print(lua_State* ls) {
     int top = lua_gettop(ls);
+    lua_getglobal(ls, "stdout");
+    lua_getfield(ls, -1, "write");
+    lua_insert(ls, -2);
+    luaL_Buffer buf;
+    luaL_buffinit(ls, &buf);
     for (int i = 1; i <= top; ++i) {
-        if (i > 1) write_stdout(ls, "\t");
+        if (i > 1) luaL_addchar(&buf, '\t');
         luaL_tolstring(ls, i, NULL);
-        write_stdout(ls, NULL);
+        luaL_addvalue(&buf);
     }
-    write_stdout(ls, "\n");
+    luaL_addchar(&buf, '\n');
+    luaL_pushresult(&buf);
+    lua_call(ls, 2, 0);
     return 0;
 }
 
@@ -100,7 +236,7 @@ MLUA_OPEN_MODULE(mlua.stdio) {
     // Create the InStream and OutStream classes.
     mlua_new_class(ls, InStream_name, InStream_syms, mlua_nosyms);
     lua_pop(ls, 1);
-    mlua_new_class(ls, OutStream_name, OutStream_syms, mlua_nosyms);
+    mlua_new_class(ls, OutStream_name, OutStream_syms, OutStream_syms_nh);
     lua_pop(ls, 1);
 
     // Create objects for stdin, stdout and stderr. Set them in _G, too.
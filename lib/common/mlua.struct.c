@@ -0,0 +1,518 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/int64.h"
+#include "mlua/module.h"
+#include "mlua/util.h"
+
+// The kind of a field.
+typedef enum Kind {
+    KIND_INT,
+    KIND_UINT,
+    KIND_FLOAT,
+    KIND_DOUBLE,
+    KIND_BYTES,
+} Kind;
+
+// A compiled field. Bitfields are stored as separate fields sharing the same
+// offset, with a non-zero width.
+typedef struct Field {
+    uint32_t off;
+    uint32_t count;  // 0 for scalars, the number of elements for arrays
+    uint32_t size;   // The size of a single element
+    uint8_t kind;
+    uint8_t shift;
+    uint8_t width;
+} Field;
+
+// A compiled struct layout. The names of the fields are stored in the user
+// values, in the same order as the fields.
+typedef struct Struct {
+    uint32_t size;
+    uint32_t count;
+    bool big;
+    Field fields[];
+} Struct;
+
+static char const Struct_name[] = "mlua.struct.Struct";
+
+static inline Struct* check_Struct(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Struct_name);
+}
+
+static uint64_t load(uint8_t const* p, uint32_t size, bool big) {
+    uint64_t v = 0;
+    if (big) {
+        for (uint32_t i = 0; i < size; ++i) v = (v << 8) | p[i];
+    } else {
+        for (uint32_t i = size; i > 0; --i) v = (v << 8) | p[i - 1];
+    }
+    return v;
+}
+
+static void store(uint8_t* p, uint32_t size, bool big, uint64_t v) {
+    if (big) {
+        for (uint32_t i = size; i > 0; --i, v >>= 8) p[i - 1] = v;
+    } else {
+        for (uint32_t i = 0; i < size; ++i, v >>= 8) p[i] = v;
+    }
+}
+
+static inline uint64_t mask(uint32_t width) {
+    return width >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << width) - 1;
+}
+
+// Push the value of a single element of a field. Integers that don't fit a Lua
+// integer are pushed as Int64 values.
+static void push_elt(lua_State* ls, Struct const* st, Field const* f,
+                     uint8_t const* p) {
+    switch (f->kind) {
+    case KIND_BYTES:
+        lua_pushlstring(ls, (char const*)p, f->size);
+        return;
+    case KIND_FLOAT: {
+        uint32_t u = load(p, 4, st->big);
+        float v;
+        memcpy(&v, &u, sizeof(v));
+        lua_pushnumber(ls, v);
+        return;
+    }
+    case KIND_DOUBLE: {
+        uint64_t u = load(p, 8, st->big);
+        double v;
+        memcpy(&v, &u, sizeof(v));
+        lua_pushnumber(ls, v);
+        return;
+    }
+    }
+    uint64_t v = load(p, f->size, st->big);
+    if (f->width != 0) {
+        mlua_push_minint(ls, (v >> f->shift) & mask(f->width));
+        return;
+    }
+    if (f->kind == KIND_INT && f->size < 8) {
+        uint64_t sign = (uint64_t)1 << (f->size * 8 - 1);
+        v = (v ^ sign) - sign;
+    }
+    mlua_push_minint(ls, (int64_t)v);
+}
+
+// Return the number at the given index. The name of the field must be just
+// below it.
+static lua_Number check_number(lua_State* ls, int arg) {
+    int ok;
+    lua_Number v = lua_tonumberx(ls, arg, &ok);
+    if (!ok) {
+        luaL_error(ls, "invalid value for field '%s' (number expected)",
+                   lua_tostring(ls, -2));
+    }
+    return v;
+}
+
+// Store the value at the given index into a single element of a field. The
+// name of the field must be just below it.
+static void store_elt(lua_State* ls, Struct const* st, Field const* f,
+                      int arg, uint8_t* p) {
+    switch (f->kind) {
+    case KIND_BYTES: {
+        size_t len;
+        char const* s = lua_tolstring(ls, arg, &len);
+        if (s == NULL) {
+            luaL_error(ls, "invalid value for field '%s' (string expected)",
+                       lua_tostring(ls, -2));
+        }
+        if (len > f->size) {
+            luaL_error(ls, "invalid value for field '%s' (string too long)",
+                       lua_tostring(ls, -2));
+        }
+        memcpy(p, s, len);
+        memset(p + len, 0, f->size - len);
+        return;
+    }
+    case KIND_FLOAT: {
+        float v = check_number(ls, arg);
+        uint32_t u;
+        memcpy(&u, &v, sizeof(u));
+        store(p, 4, st->big, u);
+        return;
+    }
+    case KIND_DOUBLE: {
+        double v = check_number(ls, arg);
+        uint64_t u;
+        memcpy(&u, &v, sizeof(u));
+        store(p, 8, st->big, u);
+        return;
+    }
+    }
+    int ok;
+    uint64_t v = mlua_to_int64x(ls, arg, &ok);
+    if (!ok) {
+        luaL_error(ls, "invalid value for field '%s' (integer expected)",
+                   lua_tostring(ls, -2));
+    }
+    if (f->width != 0) {
+        uint64_t m = mask(f->width) << f->shift;
+        v = (load(p, f->size, st->big) & ~m) | ((v << f->shift) & m);
+    }
+    store(p, f->size, st->big, v);
+}
+
+// Get the buffer at the given index, and check that the struct fits at the
+// given offset. For buffers with a vtable, the struct is copied to or from a
+// temporary buffer, which is returned in *tmp.
+static uint8_t* get_data(lua_State* ls, Struct const* st, int arg, bool ro,
+                         lua_Unsigned off, MLuaBuffer* buf, uint8_t** tmp) {
+    if (ro) {
+        luaL_argexpected(ls, mlua_get_ro_buffer(ls, arg, buf), arg,
+                         "string or buffer");
+    } else {
+        luaL_argexpected(ls, mlua_get_buffer(ls, arg, buf), arg, "buffer");
+    }
+    luaL_argcheck(ls, off <= buf->size && st->size <= buf->size - off, arg,
+                  "out of bounds");
+    if (buf->vt == NULL) {
+        *tmp = NULL;
+        return (uint8_t*)buf->ptr + off;
+    }
+    *tmp = lua_newuserdatauv(ls, st->size, 0);
+    mlua_buffer_read(buf, off, st->size, *tmp);
+    return *tmp;
+}
+
+static int Struct_unpack(lua_State* ls) {
+    Struct const* st = check_Struct(ls, 1);
+    lua_Unsigned off = luaL_optinteger(ls, 3, 0);
+    if (lua_isnoneornil(ls, 4)) {
+        lua_settop(ls, 3);
+        lua_createtable(ls, 0, st->count);
+    } else {
+        luaL_checktype(ls, 4, LUA_TTABLE);
+        lua_settop(ls, 4);
+    }
+    MLuaBuffer buf;
+    uint8_t* tmp;
+    uint8_t const* data = get_data(ls, st, 2, true, off, &buf, &tmp);
+    for (uint32_t i = 0; i < st->count; ++i) {
+        Field const* f = &st->fields[i];
+        lua_getiuservalue(ls, 1, i + 1);
+        uint8_t const* p = data + f->off;
+        if (f->count == 0) {
+            push_elt(ls, st, f, p);
+        } else {
+            // Fill the existing list if there is one.
+            lua_pushvalue(ls, -1);
+            if (lua_rawget(ls, 4) != LUA_TTABLE) {
+                lua_pop(ls, 1);
+                lua_createtable(ls, f->count, 0);
+            }
+            for (uint32_t j = 0; j < f->count; ++j, p += f->size) {
+                push_elt(ls, st, f, p);
+                lua_rawseti(ls, -2, j + 1);
+            }
+        }
+        lua_rawset(ls, 4);
+    }
+    lua_settop(ls, 4);
+    return 1;
+}
+
+// Pack the values of the table at the given index into the given data.
+static void pack(lua_State* ls, Struct const* st, int arg, uint8_t* data) {
+    for (uint32_t i = 0; i < st->count; ++i) {
+        Field const* f = &st->fields[i];
+        lua_getiuservalue(ls, 1, i + 1);
+        lua_pushvalue(ls, -1);
+        lua_rawget(ls, arg);
+        uint8_t* p = data + f->off;
+        if (f->count == 0) {
+            store_elt(ls, st, f, -1, p);
+        } else {
+            if (!lua_istable(ls, -1)) {
+                luaL_error(ls, "invalid value for field '%s' (table expected)",
+                           lua_tostring(ls, -2));
+            }
+            for (uint32_t j = 0; j < f->count; ++j, p += f->size) {
+                lua_rawgeti(ls, -1, j + 1);
+                lua_pushvalue(ls, -3);  // Name, for error messages
+                lua_insert(ls, -2);
+                store_elt(ls, st, f, -1, p);
+                lua_pop(ls, 2);
+            }
+        }
+        lua_pop(ls, 2);
+    }
+}
+
+static int Struct_pack(lua_State* ls) {
+    Struct const* st = check_Struct(ls, 1);
+    luaL_checktype(ls, 3, LUA_TTABLE);
+    lua_Unsigned off = luaL_optinteger(ls, 4, 0);
+    lua_settop(ls, 4);
+    MLuaBuffer buf;
+    uint8_t* tmp;
+    uint8_t* data = get_data(ls, st, 2, false, off, &buf, &tmp);
+    pack(ls, st, 3, data);
+    if (tmp != NULL) mlua_buffer_write(&buf, off, st->size, tmp);
+    return 0;
+}
+
+static int Struct_encode(lua_State* ls) {
+    Struct const* st = check_Struct(ls, 1);
+    luaL_checktype(ls, 2, LUA_TTABLE);
+    lua_settop(ls, 2);
+    luaL_Buffer buf;
+    uint8_t* data = (uint8_t*)luaL_buffinitsize(ls, &buf, st->size);
+    memset(data, 0, st->size);
+    pack(ls, st, 2, data);
+    luaL_pushresultsize(&buf, st->size);
+    return 1;
+}
+
+static int Struct_size(lua_State* ls) {
+    return lua_pushinteger(ls, check_Struct(ls, 1)->size), 1;
+}
+
+static int Struct___len(lua_State* ls) {
+    return lua_pushinteger(ls, check_Struct(ls, 1)->size), 1;
+}
+
+static int Struct_offset(lua_State* ls) {
+    Struct const* st = check_Struct(ls, 1);
+    luaL_checkstring(ls, 2);
+    for (uint32_t i = 0; i < st->count; ++i) {
+        lua_getiuservalue(ls, 1, i + 1);
+        if (lua_rawequal(ls, 2, -1)) {
+            Field const* f = &st->fields[i];
+            lua_pushinteger(ls, f->off);
+            if (f->width == 0) return 1;
+            lua_pushinteger(ls, f->shift);
+            lua_pushinteger(ls, f->width);
+            return 3;
+        }
+        lua_pop(ls, 1);
+    }
+    return 0;
+}
+
+MLUA_SYMBOLS(Struct_syms) = {
+    MLUA_SYM_F(unpack, Struct_),
+    MLUA_SYM_F(pack, Struct_),
+    MLUA_SYM_F(encode, Struct_),
+    MLUA_SYM_F(size, Struct_),
+    MLUA_SYM_F(offset, Struct_),
+};
+
+MLUA_SYMBOLS_NOHASH(Struct_syms_nh) = {
+    MLUA_SYM_F_NH(__len, Struct_),
+};
+
+#define MAXINTSIZE 8
+
+// Parse a field format, following the conventions of string.pack().
+static bool parse_format(char const* fmt, Field* f) {
+    uint32_t def = 0;
+    switch (*fmt++) {
+    case 'b': f->kind = KIND_INT; f->size = 1; break;
+    case 'B': f->kind = KIND_UINT; f->size = 1; break;
+    case 'h': f->kind = KIND_INT; f->size = sizeof(short); break;
+    case 'H': f->kind = KIND_UINT; f->size = sizeof(short); break;
+    case 'l': f->kind = KIND_INT; f->size = sizeof(long); break;
+    case 'L': f->kind = KIND_UINT; f->size = sizeof(long); break;
+    case 'j': f->kind = KIND_INT; f->size = sizeof(lua_Integer); break;
+    case 'J': f->kind = KIND_UINT; f->size = sizeof(lua_Integer); break;
+    case 'T': f->kind = KIND_UINT; f->size = sizeof(size_t); break;
+    case 'f': f->kind = KIND_FLOAT; f->size = 4; break;
+    case 'd': f->kind = KIND_DOUBLE; f->size = 8; break;
+    case 'n':
+        f->kind = sizeof(lua_Number) == 4 ? KIND_FLOAT : KIND_DOUBLE;
+        f->size = sizeof(lua_Number);
+        break;
+    case 'i': f->kind = KIND_INT; def = sizeof(int); break;
+    case 'I': f->kind = KIND_UINT; def = sizeof(int); break;
+    case 'c': f->kind = KIND_BYTES; break;
+    default: return false;
+    }
+    if (f->size != 0) return *fmt == '\0';
+    uint32_t size = 0;
+    if (*fmt == '\0') {
+        size = def;
+    } else {
+        while (*fmt >= '0' && *fmt <= '9' && size < (1u << 24)) {
+            size = size * 10 + (*fmt++ - '0');
+        }
+    }
+    if (*fmt != '\0' || size == 0) return false;
+    if (f->kind != KIND_BYTES && size > MAXINTSIZE) return false;
+    f->size = size;
+    return true;
+}
+
+// Compile the field description at index -1, and append the resulting fields
+// to *fields. The names of the fields are pushed onto the stack.
+static void compile_field(lua_State* ls, int index, Field* fields,
+                          uint32_t* count, uint32_t* off) {
+    if (!lua_istable(ls, -1)) {
+        luaL_error(ls, "field %d: invalid description", index);
+    }
+    lua_rawgeti(ls, -1, 2);
+    char const* fmt = lua_tostring(ls, -1);
+    if (fmt == NULL) luaL_error(ls, "field %d: missing format", index);
+    lua_rawgeti(ls, -2, 3);
+    lua_Integer cnt = luaL_optinteger(ls, -1, 0);
+    lua_pop(ls, 1);
+    if (cnt < 0 || cnt > UINT16_MAX) {
+        luaL_error(ls, "field %d: invalid count", index);
+    }
+
+    // Padding.
+    if (fmt[0] == 'x' && fmt[1] == '\0') {
+        *off += cnt > 0 ? cnt : 1;
+        lua_pop(ls, 1);
+        return;
+    }
+    Field f = {.off = *off, .count = cnt};
+    if (!parse_format(fmt, &f)) {
+        luaL_error(ls, "field %d: invalid format '%s'", index, fmt);
+    }
+    lua_pop(ls, 1);
+    if (f.kind == KIND_BYTES && cnt > 0) {
+        luaL_error(ls, "field %d: arrays of strings are unsupported", index);
+    }
+    uint64_t end = *off + (uint64_t)f.size * (cnt > 0 ? cnt : 1);
+    if (end > UINT32_MAX) luaL_error(ls, "field %d: struct too large", index);
+
+    // Bitfields.
+    if (lua_getfield(ls, -1, "bits") != LUA_TNIL) {
+        if (!lua_istable(ls, -1)) {
+            luaL_error(ls, "field %d: invalid bits", index);
+        }
+        if ((f.kind != KIND_INT && f.kind != KIND_UINT) || cnt > 0) {
+            luaL_error(ls, "field %d: bitfields require an integer scalar",
+                       index);
+        }
+        uint32_t shift = 0;
+        lua_Integer n = luaL_len(ls, -1);
+        for (lua_Integer i = 1; i <= n; ++i) {
+            lua_rawgeti(ls, -1, i);
+            if (!lua_istable(ls, -1)) {
+                luaL_error(ls, "field %d: invalid bitfield %I", index, i);
+            }
+            lua_rawgeti(ls, -1, 1);
+            lua_rawgeti(ls, -2, 2);
+            lua_Integer width = lua_tointeger(ls, -1);
+            lua_pop(ls, 1);
+            if (width <= 0 || shift + width > f.size * 8) {
+                luaL_error(ls, "field %d: invalid bitfield %I", index, i);
+            }
+            if (lua_type(ls, -1) == LUA_TSTRING) {
+                luaL_checkstack(ls, 3, "too many fields");
+                lua_insert(ls, -4);  // Name
+                Field* bf = &fields[(*count)++];
+                *bf = f;
+                bf->kind = KIND_UINT;
+                bf->shift = shift;
+                bf->width = width;
+            } else {
+                lua_pop(ls, 1);  // Unnamed bits are skipped
+            }
+            shift += width;
+            lua_pop(ls, 1);
+        }
+        lua_pop(ls, 1);
+        *off = end;
+        return;
+    }
+    lua_pop(ls, 1);
+
+    // Regular fields.
+    lua_rawgeti(ls, -1, 1);
+    if (lua_type(ls, -1) != LUA_TSTRING) {
+        luaL_error(ls, "field %d: missing name", index);
+    }
+    luaL_checkstack(ls, 2, "too many fields");
+    lua_insert(ls, -2);
+    fields[(*count)++] = f;
+    *off = end;
+}
+
+// Return the maximum number of compiled fields for the given layout.
+static uint32_t max_fields(lua_State* ls, int arg) {
+    uint32_t cnt = 0;
+    lua_Integer n = luaL_len(ls, arg);
+    for (lua_Integer i = 1; i <= n; ++i) {
+        if (lua_rawgeti(ls, arg, i) == LUA_TTABLE) {
+            ++cnt;
+            if (lua_getfield(ls, -1, "bits") == LUA_TTABLE) {
+                cnt += luaL_len(ls, -1);
+            }
+            lua_pop(ls, 1);
+        }
+        lua_pop(ls, 1);
+    }
+    return cnt;
+}
+
+static int mod_new(lua_State* ls) {
+    luaL_checktype(ls, 1, LUA_TTABLE);
+    char const* endian = luaL_optstring(ls, 2, "=");
+    bool big;
+    if (strcmp(endian, "<") == 0) {
+        big = false;
+    } else if (strcmp(endian, ">") == 0) {
+        big = true;
+    } else if (strcmp(endian, "=") == 0) {
+        static union { int dummy; char little; } const native = {1};
+        big = !native.little;
+    } else {
+        return luaL_argerror(ls, 2, "invalid endianness");
+    }
+    lua_settop(ls, 1);
+
+    // Compile the fields into a temporary array, pushing their names onto the
+    // stack.
+    uint32_t max = max_fields(ls, 1);
+    Field* fields = lua_newuserdatauv(ls, max * sizeof(Field), 0);
+    uint32_t count = 0, off = 0;
+    lua_Integer n = luaL_len(ls, 1);
+    for (lua_Integer i = 1; i <= n; ++i) {
+        lua_rawgeti(ls, 1, i);
+        compile_field(ls, i, fields, &count, &off);
+        lua_pop(ls, 1);
+    }
+
+    // Create the struct, and move the names to its user values.
+    Struct* st = lua_newuserdatauv(ls, sizeof(Struct) + count * sizeof(Field),
+                                   count);
+    luaL_getmetatable(ls, Struct_name);
+    lua_setmetatable(ls, -2);
+    st->size = off;
+    st->count = count;
+    st->big = big;
+    memcpy(st->fields, fields, count * sizeof(Field));
+    for (uint32_t i = count; i > 0; --i) {
+        lua_rotate(ls, -2, 1);
+        lua_setiuservalue(ls, -2, i);
+    }
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.struct) {
+    mlua_require(ls, "mlua.int64", false);
+
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Struct class.
+    mlua_new_class(ls, Struct_name, Struct_syms, Struct_syms_nh);
+    lua_pop(ls, 1);
+    return 1;
+}
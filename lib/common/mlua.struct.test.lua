@@ -0,0 +1,166 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local int64 = require 'mlua.int64'
+local mem = require 'mlua.mem'
+local struct = require 'mlua.struct'
+local uf2 = require 'mlua.uf2'
+local string = require 'string'
+
+local layout = {
+    {'u32', 'I4'}, {'i16', 'h'}, {'str', 'c5'}, {'arr', 'B', 3}, {nil, 'x', 2},
+    {nil, 'H', bits = {{'lo', 4}, {nil, 4}, {'hi', 8}}},
+    {'flt', 'f'}, {'dbl', 'd'}, {'i64', 'j'},
+}
+
+local values = {
+    u32 = 0x12345678, i16 = -2, str = 'hey\0\0', arr = {1, 2, 3}, lo = 0xf,
+    hi = 0xab, flt = 1.5, dbl = -2.25, i64 = -1,
+}
+
+function test_new(t)
+    local s = struct.new(layout, '<')
+    t:expect(t.expr(s):size()):eq(38)
+    t:expect(#s):label("#s"):eq(38)
+    t:expect(t.expr(s):offset('i16')):eq(4)
+    t:expect(t.mexpr(s):offset('hi')):eq{16, 8, 8}
+    t:expect(t.expr(s):offset('missing')):eq(nil)
+    t:expect(t.expr(struct).new({{'a', 'q'}})):raises("invalid format 'q'")
+    t:expect(t.expr(struct).new({{'a', 'I9'}})):raises("invalid format")
+    t:expect(t.expr(struct).new({{'a'}})):raises("missing format")
+    t:expect(t.expr(struct).new({{nil, 'B'}})):raises("missing name")
+    t:expect(t.expr(struct).new({{'a', 'c4', 2}})):raises("arrays of strings")
+    t:expect(t.expr(struct).new({{nil, 'B', bits = {{'a', 9}}}}))
+        :raises("invalid bitfield")
+    t:expect(t.expr(struct).new({{nil, 'f', bits = {{'a', 1}}}}))
+        :raises("bitfields require an integer")
+    t:expect(t.expr(struct).new({}, '!')):raises("invalid endianness")
+end
+
+function test_encode_unpack(t)
+    local s = struct.new(layout, '<')
+    local data = s:encode(values)
+    t:expect(data):label("data"):eq(string.pack(
+        '<I4hc5BBBxxHfdj', 0x12345678, -2, 'hey', 1, 2, 3, 0xab0f, 1.5, -2.25,
+        -1))
+    t:expect(t.expr(s):unpack(data)):eq(values)
+
+    -- Unpacking into an existing table reuses nested lists.
+    local arr = {}
+    local tab = {arr = arr, other = true}
+    t:expect(s:unpack(data, 0, tab) == tab):label("unpack() == tab"):eq(true)
+    t:expect(tab.arr == arr):label("tab.arr == arr"):eq(true)
+    t:expect(arr):label("arr"):eq{1, 2, 3}
+    t:expect(tab.other):label("tab.other"):eq(true)
+
+    t:expect(t.expr(s):unpack(data, 1)):raises("out of bounds")
+    t:expect(t.expr(s):encode{}):raises("invalid value for field 'u32'")
+    local v = {}
+    for k, x in pairs(values) do v[k] = x end
+    v.str = ('x'):rep(6)
+    t:expect(t.expr(s):encode(v)):raises("string too long")
+end
+
+function test_endianness(t)
+    local fields = {{'a', 'I2'}, {'b', 'i3'}, {'c', 'f'}}
+    local v = {a = 0x0102, b = -3, c = 0.5}
+    local be, le = struct.new(fields, '>'), struct.new(fields, '<')
+    t:expect(t.expr(be):encode(v)):eq(string.pack('>I2i3f', 0x0102, -3, 0.5))
+    t:expect(t.expr(le):encode(v)):eq(string.pack('<I2i3f', 0x0102, -3, 0.5))
+    t:expect(t.expr(be):unpack(be:encode(v))):eq(v)
+    local native = struct.new(fields)
+    t:expect(t.expr(native):encode(v))
+        :eq(string.pack('=I2i3f', 0x0102, -3, 0.5))
+end
+
+function test_int64(t)
+    local s = struct.new({{'a', 'i8'}, {'b', 'I8'}, {'c', 'I4'},
+                          {nil, 'I8', bits = {{'d', 40}}}}, '<')
+    local v = {a = int64('0x123456789abcdef0'), b = int64.min, c = int64('0x87654321'),
+               d = int64('0xfedcba9876')}
+    local data = s:encode(v)
+    t:expect(data):label("data"):eq(
+        '\xf0\xde\xbc\x9a\x78\x56\x34\x12\0\0\0\0\0\0\0\x80'
+        .. '\x21\x43\x65\x87\x76\x98\xba\xdc\xfe\0\0\0')
+    t:expect(t.expr(s):unpack(data)):eq(v)
+    t:expect(t.expr(s):encode{a = 'x', b = 0, c = 0, d = 0})
+        :raises("invalid value for field 'a' %(integer expected%)")
+end
+
+function test_buffers(t)
+    local s = struct.new({{'a', 'I2'}, {nil, 'B', bits = {{'b', 3}}}}, '<')
+    local buf = mem.alloc(8)
+    mem.fill(buf, 0xff)
+    s:pack(buf, {a = 0x1234, b = 2}, 4)
+    t:expect(t.expr(mem).read(buf)):eq('\xff\xff\xff\xff\x34\x12\xfa\xff')
+    t:expect(t.expr(s):unpack(buf, 4)):eq{a = 0x1234, b = 2}
+    t:expect(t.expr(s):pack(buf, {a = 1, b = 1}, 6)):raises("out of bounds")
+    t:expect(t.expr(s):pack('abc', {a = 1, b = 1})):raises("buffer expected")
+end
+
+-- The layout of an UF2 block.
+local uf2_block = struct.new({
+    {'magic_start0', 'I4'}, {'magic_start1', 'I4'}, {'flags', 'I4'},
+    {'target_addr', 'I4'}, {'payload_size', 'I4'}, {'block_no', 'I4'},
+    {'num_blocks', 'I4'}, {'reserved', 'I4'}, {'data', 'c476'},
+    {'magic_end', 'I4'},
+}, '<')
+
+local function uf2_data()
+    return assert(uf2.serialize{
+        flags = uf2.flag_family_id_present, target_addr = 0x10000000,
+        block_no = 1, num_blocks = 2, reserved = uf2.family_id_rp2040,
+        data = ('x'):rep(256)})
+end
+
+function test_uf2(t)
+    local data = uf2_data()
+    local b = uf2_block:unpack(data)
+    local want = uf2.parse(data)
+    for k, v in pairs(want) do
+        t:expect(b[k]):label("b.%s", k):eq(v)
+    end
+end
+
+function bench_uf2_parse(b)
+    local data = uf2_data()
+    for i = 1, b.n do uf2.parse(data) end
+end
+
+function bench_uf2_string_unpack(b)
+    local data = uf2_data()
+    local fmt = '<I4I4I4I4I4I4I4I4c476I4'
+    for i = 1, b.n do
+        local ms0, ms1, f, a, s, bno, nb, res, d, me = fmt:unpack(data)
+        local _ = {flags = f, target_addr = a, payload_size = s,
+                   block_no = bno, num_blocks = nb, reserved = res, data = d}
+    end
+end
+
+function bench_uf2_struct_unpack(b)
+    local data = uf2_data()
+    for i = 1, b.n do uf2_block:unpack(data) end
+end
+
+function bench_uf2_struct_unpack_reuse(b)
+    local data, tab = uf2_data(), {}
+    for i = 1, b.n do uf2_block:unpack(data, 0, tab) end
+end
+
+function bench_uf2_string_pack(b)
+    local data = ('x'):rep(476)
+    local fmt = '<I4I4I4I4I4I4I4I4c476I4'
+    for i = 1, b.n do
+        fmt:pack(0x0a324655, 0x9e5d5157, 0, 0x10000000, 256, i, b.n, 0, data,
+                 0x0ab16f30)
+    end
+end
+
+function bench_uf2_struct_pack(b)
+    local buf = mem.alloc(uf2_block:size())
+    local v = uf2_block:unpack(uf2_data())
+    for i = 1, b.n do
+        v.block_no = i
+        uf2_block:pack(buf, v)
+    end
+end
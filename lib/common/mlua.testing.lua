@@ -16,6 +16,8 @@ local string = require 'string'
 
 local def_mod_pat = '^(.*)%.test$'
 local def_func_pat = '^test_'
+local def_bench_pat = '^bench_'
+local max_bench_n = 1000000000
 local blocking_pat = '_BNB$'
 local err_terminate = {}
 
@@ -566,6 +568,47 @@ function Test:_up(fn)
     return nil, level
 end
 
+Benchmark = oo.class('Benchmark', Test)
+
+function Benchmark:bytes(n) self._bytes = n end
+
+function Benchmark:reset_timer() self._start = time.ticks() end
+
+function Benchmark:_run(fn)
+    Test._run(self, function(b) return b:_measure(fn) end)
+    if not self._res then return end
+    local root = self._root
+    return io.afprintf(root._stdout, "@{+CYAN}BENCH@{NORM}: %s: %s\n",
+                       self:path(), self._res)
+end
+
+function Benchmark:_measure(fn)
+    local target = self._root._opts.bench_time * time.msec
+    local n = 1
+    while true do
+        self.n = n
+        collectgarbage()
+        self:reset_timer()
+        fn(self)
+        local dt = time.ticks() - self._start
+        if dt >= target or n >= max_bench_n then
+            self._res = self:_format(n, dt)
+            return
+        end
+        -- Aim slightly above the target time, but grow by at most 100x.
+        local next = dt > 0 and n * target * 6 // (5 * dt) or 100 * n
+        n = math.min(math.max(next, n + 1), 100 * n, max_bench_n)
+    end
+end
+
+function Benchmark:_format(n, dt)
+    local res = ('%d iterations, %.3f us/op'):format(n, dt / n)
+    if not self._bytes or dt <= 0 then return res end
+    return ('%s, %.3f MB/s'):format(res, self._bytes * n / dt)
+end
+
+function Test:bench(name, fn) return Benchmark(name, self):_run(fn) end
+
 local fn_comp = util.table_comp{1, 2}
 
 function Test:run_module(name, pat)
@@ -585,11 +628,14 @@ function Test:run_module(name, pat)
     local module = require(name)
     local ok, fn = pcall(function() return module.set_up end)
     if ok and fn then fn(self) end
-    local fns = list()
+    local fns, benches = list(), list()
+    local bench = util.get(root._opts, 'bench')
     for name, fn in pairs(module) do
-        if name:find(pat) then
+        local fl = name:find(pat) and fns
+                   or bench and name:find(def_bench_pat) and benches
+        if fl then
             local info = debug.getinfo(fn, 'S')
-            fns:append({info and info.linedefined or 0, name, fn})
+            fl:append({info and info.linedefined or 0, name, fn})
         end
     end
     for _, fn in fns:sort(fn_comp):ipairs() do
@@ -603,6 +649,7 @@ function Test:run_module(name, pat)
             end)
         end
     end
+    for _, fn in benches:sort(fn_comp):ipairs() do self:bench(fn[2], fn[3]) end
 end
 
 function Test:run_modules(mod_pat, func_pat)
@@ -695,6 +742,16 @@ end
 -- TODO: Terminate on first failure
 -- TODO: Launch repl on failure
 
+function Runner:cmd_b(time)
+    local opts = self.opts
+    if time then
+        opts.bench = true
+        opts.bench_time = math.tointeger(tonumber(time)) or opts.bench_time
+    else
+        opts.bench = not opts.bench
+    end
+end
+
 function Runner:cmd_out()
     self.opts.output = not self.opts.output
 end
@@ -737,6 +794,8 @@ local function pmain(opts, args)
     local argv = util.get(_G, 'arg')
     local opts, args = cli.parse_args(argv)
     cli.parse_opts(opts, {
+        bench = cli.bool_opt(false),
+        bench_time = cli.int_opt(1000),
         output = cli.bool_opt(false),
         prompt = cli.bool_opt(true),
         results = cli.int_opt(0),
@@ -507,6 +507,9 @@ static void reset_main_state(lua_State* ls, int arg) {
     lua_setupvalue(ls, arg, UV_NAMES);
 }
 
+__attribute__((weak))
+void mlua_thread_idle(lua_State* ls) {}
+
 static int main_done(lua_State* ls) {
     lua_settop(ls, 0);
 
@@ -546,6 +549,7 @@ static int mod_main(lua_State* ls) {
         } else if (timers != NULL) {
             deadline = thread_extra(timers)->deadline;
         }
+        if (deadline != MLUA_TICKS_MIN) mlua_thread_idle(ls);
         mlua_event_dispatch(ls, deadline);
 
         // Resume threads whose deadline has elapsed.
@@ -1,6 +1,7 @@
 -- Copyright 2023 Remy Blank <remy@c-space.org>
 -- SPDX-License-Identifier: MIT
 
+local math = require 'math'
 local string = require 'string'
 
 local magic_start0 = 0x0a324655
@@ -13,6 +14,7 @@ flag_md5_present = 0x00004000
 flag_ext_present = 0x00008000
 
 family_id_rp2040 = 0xe48bff56
+payload_size = 256
 
 local struct = '<I4I4I4I4I4I4I4I4c476I4'
 block_size = struct:packsize()
@@ -44,3 +46,29 @@ function serialize(block)
                        block.num_blocks, block.reserved or 0, block.data,
                        magic_end)
 end
+
+-- Serialize ranges of a memory image mapped at addr, as a sequence of UF2
+-- blocks. read(off, size) returns the content of the image at offset off.
+-- ranges is a list of {off, size} pairs.
+function serialize_ranges(read, addr, ranges, block)
+    local b = {flags = block and block.flags,
+               reserved = block and block.reserved, num_blocks = 0}
+    for _, r in ipairs(ranges) do
+        b.num_blocks = b.num_blocks + (r[2] + payload_size - 1) // payload_size
+    end
+    local ri, pos, no = 1, 0, 0
+    return function()
+        local r = ranges[ri]
+        while r and pos >= r[2] do
+            ri, pos = ri + 1, 0
+            r = ranges[ri]
+        end
+        if not r then return end
+        local off = r[1] + pos
+        b.target_addr = addr + off
+        b.block_no = no
+        b.data = read(off, math.min(payload_size, r[2] - pos))
+        pos, no = pos + payload_size, no + 1
+        return assert(serialize(b))
+    end
+end
@@ -0,0 +1,89 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local block_mem = require 'mlua.block.mem'
+local block_stats = require 'mlua.block.stats'
+local fs = require 'mlua.fs'
+local lfs = require 'mlua.fs.lfs'
+local mem = require 'mlua.mem'
+local uf2 = require 'mlua.uf2'
+local table = require 'table'
+
+function test_serialize_parse(t)
+    local data = ('abcd'):rep(64)
+    local block = assert(uf2.serialize{
+        flags = uf2.flag_family_id_present, target_addr = 0x10001000,
+        block_no = 3, num_blocks = 7, reserved = uf2.family_id_rp2040,
+        data = data})
+    t:expect(#block):label("#block"):eq(uf2.block_size)
+    local b = uf2.parse(block)
+    t:expect(b.data:sub(1, b.payload_size)):label("data"):eq(data)
+    b.data = nil
+    t:expect(b):label("block"):eq{
+        flags = uf2.flag_family_id_present, target_addr = 0x10001000,
+        payload_size = #data, block_no = 3, num_blocks = 7,
+        reserved = uf2.family_id_rp2040}
+    t:expect(t.mexpr(uf2).parse(block:sub(2)))
+        :eq{nil, "incomplete block", n = 2}
+    t:expect(t.mexpr(uf2).serialize{block_no = 0})
+        :eq{nil, "missing target_addr", n = 2}
+end
+
+function test_serialize_ranges(t)
+    local img = ('0123456789abcdef'):rep(128)
+    local function read(off, size) return img:sub(off + 1, off + size) end
+    local blocks, ranges = {}, {{256, 512}, {1536, 100}}
+    for block in uf2.serialize_ranges(read, 0x1000, ranges) do
+        table.insert(blocks, uf2.parse(block))
+    end
+    t:expect(#blocks):label("#blocks"):eq(3)
+    for i, b in ipairs(blocks) do
+        t:expect(b.block_no):label("blocks[%s].block_no", i):eq(i - 1)
+        t:expect(b.num_blocks):label("blocks[%s].num_blocks", i):eq(3)
+    end
+    t:expect(blocks[1].target_addr):label("blocks[1].target_addr")
+        :eq(0x1100)
+    t:expect(blocks[2].target_addr):label("blocks[2].target_addr")
+        :eq(0x1200)
+    t:expect(blocks[3].target_addr):label("blocks[3].target_addr")
+        :eq(0x1600)
+    t:expect(blocks[3].payload_size):label("blocks[3].payload_size"):eq(100)
+    t:expect(blocks[3].data:sub(1, 100)):label("blocks[3].data")
+        :eq(read(1536, 100))
+end
+
+function test_sparse_update(t)
+    -- Populate a filesystem.
+    local size, erase_size = 256 << 10, 4096
+    local data = mem.alloc(size)
+    local dev = block_stats.new(block_mem.new(data, 256, erase_size))
+    local f = lfs.new(dev)
+    t:assert(f:format())
+    t:assert(f:mount())
+    for i = 1, 20 do
+        local fh<close> = assert(f:open(('/file%d'):format(i),
+                                        fs.O_WRONLY | fs.O_CREAT))
+        assert(fh:write(('x'):rep(2000)))
+    end
+    t:assert(f:unmount())
+
+    -- Update a single file, and serialize the modified blocks.
+    block_stats.stats(dev, true)
+    t:assert(f:mount())
+    do
+        local fh<close> = assert(f:open('/file7', fs.O_WRONLY | fs.O_TRUNC))
+        assert(fh:write(('y'):rep(2000)))
+    end
+    t:assert(f:unmount())
+    local ranges = block_stats.changed(dev)
+    local function read(off, size) return mem.read(data, off, size) end
+    local cnt = 0
+    for _ in uf2.serialize_ranges(read, 0x10000000, ranges) do
+        cnt = cnt + 1
+    end
+    local full = size // uf2.payload_size
+    t:expect(cnt):label("blocks"):gt(0)
+    t:expect(cnt * 16):label("blocks * 16"):lte(full)
+    t:expect(cnt % (erase_size // uf2.payload_size)):label("blocks % sector")
+        :eq(0)
+end
@@ -3,11 +3,162 @@
 
 #include "mlua/thread.h"
 
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+
+#include "lstate.h"
 #include "mlua/module.h"
 #include "mlua/platform.h"
 
+pthread_mutex_t mlua_event_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The condition variable on which dispatchers wait. It is broadcast every time
+// an event is set, and is shared by all interpreters, so a dispatcher can be
+// woken up by an event of another interpreter. It then simply goes back to
+// sleep.
+static pthread_cond_t event_cond;
+
+static __attribute__((constructor)) void init(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&event_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// A pending event queue. Events that are made pending are pushed to the tail,
+// and event dispatching pops from the head. The queue is a linked list, where
+// the state of each pending event contains a pointer to the next pending event,
+// with the lower bits set to EVENT_PENDING.
+typedef struct EventQueue {
+    MLuaEvent* head;
+    MLuaEvent* tail;
+} EventQueue;
+
+static_assert(sizeof(EventQueue) <= LUA_EXTRASPACE, "LUA_EXTRASPACE too small");
+
+typedef enum EventState {
+    EVENT_IDLE = 0,
+    EVENT_PENDING = 1,
+    EVENT_ABANDONED = 2,
+    EVENT_MASK = 3,
+} EventState;
+
+static inline EventState event_state(MLuaEvent const* ev) {
+    return ev->state & EVENT_MASK;
+}
+
+static inline MLuaEvent* next_pending(MLuaEvent const* ev) {
+    return (MLuaEvent*)(ev->state & ~EVENT_MASK);
+}
+
+static inline EventQueue* get_queue(lua_State* ls) {
+#ifdef mainthread  // Defined in lstate.h in Lua >=5.5
+    lua_State* main = mainthread(G(ls));
+#else
+    lua_State* main = G(ls)->mainthread;
+#endif
+    return (EventQueue*)lua_getextraspace(main);
+}
+
+static void remove_pending_nolock(EventQueue* q, MLuaEvent const* ev) {
+    if (q->head == ev) {
+        q->head = next_pending(ev);
+        return;
+    }
+    for (MLuaEvent* cur = q->head;;) {
+        MLuaEvent* next = next_pending(cur);
+        if (next == NULL) break;
+        if (next == ev) {
+            cur->state = ev->state;
+            if (q->tail == ev) q->tail = cur;
+            break;
+        }
+        cur = next;
+    }
+}
+
+bool mlua_event_enable(lua_State* ls, MLuaEvent* ev) {
+    EventQueue* q = get_queue(ls);
+    mlua_event_lock();
+    if (ev->state != 0) {
+        mlua_event_unlock();
+        return false;
+    }
+    ev->state = (uintptr_t)q;
+    mlua_event_unlock();
+    return true;
+}
+
+static void disable_event(lua_State* ls, MLuaEvent* ev, uintptr_t state) {
+    mlua_event_lock();
+    if (ev->state == 0) {
+        mlua_event_unlock();
+        return;
+    }
+    if (event_state(ev) == EVENT_PENDING) {
+        remove_pending_nolock(get_queue(ls), ev);
+    }
+    ev->state = state;
+    mlua_event_unlock();
+    mlua_event_remove_watcher(ls, ev);
+}
+
+void mlua_event_abandon(lua_State* ls, MLuaEvent* ev) {
+    disable_event(ls, ev, EVENT_ABANDONED);
+}
+
+void mlua_event_disable(lua_State* ls, MLuaEvent* ev) {
+    disable_event(ls, ev, 0);
+}
+
+void mlua_event_set_nolock(MLuaEvent* ev) {
+    pthread_cond_broadcast(&event_cond);
+    if (ev->state == 0 || event_state(ev) != EVENT_IDLE) return;
+    EventQueue* q = (EventQueue*)ev->state;
+    ev->state = (uintptr_t)NULL | EVENT_PENDING;
+    if (q->head == NULL) {
+        q->head = q->tail = ev;
+    } else {
+        q->tail->state = (uintptr_t)ev | EVENT_PENDING;
+        q->tail = ev;
+    }
+}
+
+bool mlua_event_disable_abandoned(MLuaEvent* ev) {
+    mlua_event_lock();
+    bool res = ev->state == EVENT_ABANDONED;
+    if (res) ev->state = 0;
+    mlua_event_unlock();
+    return res;
+}
+
+bool mlua_event_wait_nolock(uint64_t deadline) {
+    if (deadline == MLUA_TICKS_MAX) {
+        pthread_cond_wait(&event_cond, &mlua_event_mutex);
+        return false;
+    }
+    // The ticks are based on a clock that may differ from the one used by the
+    // condition variable, so convert the deadline to a monotonic time.
+    uint64_t now = mlua_ticks64();
+    if (now >= deadline) return true;
+    uint64_t delta = deadline - now;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += delta / 1000000u;
+    ts.tv_nsec += (delta % 1000000u) * 1000u;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_nsec -= 1000000000;
+        ++ts.tv_sec;
+    }
+    return pthread_cond_timedwait(&event_cond, &mlua_event_mutex, &ts)
+           == ETIMEDOUT;
+}
+
 void mlua_event_dispatch(lua_State* ls, uint64_t deadline) {
     bool wake = deadline == MLUA_TICKS_MIN;
+    EventQueue* q = get_queue(ls);
 #if MLUA_THREAD_STATS
     MLuaGlobal* g = mlua_global(ls);
 #endif
@@ -16,6 +167,19 @@ void mlua_event_dispatch(lua_State* ls, uint64_t deadline) {
         ++g->thread_dispatches;
 #endif
 
+        // Check for pending events and resume their watchers.
+        for (;;) {
+            mlua_event_lock();
+            MLuaEvent* ev = q->head;
+            if (ev != NULL) {
+                q->head = next_pending(ev);
+                ev->state = (uintptr_t)q;
+            }
+            mlua_event_unlock();
+            if (ev == NULL) break;
+            if (mlua_event_resume_watcher(ls, ev)) wake = true;
+        }
+
         // Return if at least one thread was resumed or the deadline has passed.
         if (wake || mlua_ticks64_reached(deadline)) return;
         wake = false;
@@ -24,6 +188,8 @@ void mlua_event_dispatch(lua_State* ls, uint64_t deadline) {
 #if MLUA_THREAD_STATS
         ++g->thread_waits;
 #endif
-        mlua_wait(deadline);
+        mlua_event_lock();
+        if (q->head == NULL) mlua_event_wait_nolock(deadline);
+        mlua_event_unlock();
     }
 }
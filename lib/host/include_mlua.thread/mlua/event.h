@@ -4,6 +4,7 @@
 #ifndef _MLUA_LIB_HOST_MLUA_EVENT_H
 #define _MLUA_LIB_HOST_MLUA_EVENT_H
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -14,13 +15,74 @@
 extern "C" {
 #endif
 
-// An event.
+// Lock event handling. The lock is shared by all interpreters of the process.
+static inline void mlua_event_lock(void) {
+    extern pthread_mutex_t mlua_event_mutex;
+    pthread_mutex_lock(&mlua_event_mutex);
+}
+
+// Unlock event handling.
+static inline void mlua_event_unlock(void) {
+    extern pthread_mutex_t mlua_event_mutex;
+    pthread_mutex_unlock(&mlua_event_mutex);
+}
+
+// An event. The state has the same encoding as on the pico platform:
+//  - If the state is zero, the event is disabled.
+//  - If the lower bits are EVENT_IDLE, the event is enabled and the state
+//    contains a pointer to the pending event queue.
+//  - If the lower bits are EVENT_PENDING, the event is pending and the state
+//    contains a pointer to the next pending event in the queue.
+//  - If the lower bits are EVENT_ABANDONED, the event was abandoned, and can be
+//    disabled with mlua_event_disable_abandoned().
 typedef struct MLuaEvent {
-    uintptr_t dummy;
+    uintptr_t state;
 } MLuaEvent;
 
+// Initialize an event.
+static inline void mlua_event_init(MLuaEvent* ev) { ev->state = 0; }
+
+// Enable an event. Returns false iff the event was already enabled.
+bool mlua_event_enable(lua_State* ls, MLuaEvent* ev);
+
+// Abandon an event. This keeps the event enabled, but allows disabling it from
+// a non-Lua context with mlua_event_disable_abandoned().
+void mlua_event_abandon(lua_State* ls, MLuaEvent* ev);
+
+// Disable an event.
+void mlua_event_disable(lua_State* ls, MLuaEvent* ev);
+
+// Return true iff the event is enabled. Must be in a locked section.
+static inline bool mlua_event_enabled_nolock(MLuaEvent const* ev) {
+    return ev->state != 0;
+}
+
 // Return true iff the event is enabled.
-static inline bool mlua_event_enabled(MLuaEvent const* ev) { return false; }
+static inline bool mlua_event_enabled(MLuaEvent const* ev) {
+    mlua_event_lock();
+    bool en = ev->state != 0;
+    mlua_event_unlock();
+    return en;
+}
+
+// Set an event pending. Must be in a locked section. This can be called from
+// any OS thread.
+void mlua_event_set_nolock(MLuaEvent* ev);
+
+// Set an event pending.
+static inline void mlua_event_set(MLuaEvent* ev) {
+    mlua_event_lock();
+    mlua_event_set_nolock(ev);
+    mlua_event_unlock();
+}
+
+// Disable an event, and return true, iff the event has been abandoned.
+bool mlua_event_disable_abandoned(MLuaEvent* ev);
+
+// Wait until any event is set, or until the deadline is reached. Must be in a
+// locked section. Returns true iff the deadline was reached. Spurious wakeups
+// are possible, so the caller must re-check its condition.
+bool mlua_event_wait_nolock(uint64_t deadline);
 
 // Dispatch pending events.
 void mlua_event_dispatch(lua_State* ls, uint64_t deadline);
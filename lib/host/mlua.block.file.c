@@ -0,0 +1,367 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/block.h"
+#include "mlua/errors.h"
+#include "mlua/module.h"
+#include "mlua/thread.h"
+#include "mlua/util.h"
+
+static char const Mapping_name[] = "mlua.block.file.Mapping";
+
+// A memory mapping of a file. The mapping owns the file descriptor and the
+// worker thread performing asynchronous operations, and is unmapped when it is
+// closed or garbage-collected.
+//
+// "mutex" is held by the worker while it performs an operation, and by
+// synchronous operations. "pending" and "stop" are protected by "mutex", and
+// "done" and "result" by the event lock. "busy" is only accessed by the
+// interpreter. The staging buffer "buf" is kept until the mapping is
+// garbage-collected, so that an operation completed by close() can still be
+// collected by its waiter.
+typedef struct Mapping {
+    uint8_t* ptr;
+    size_t size;
+    int fd;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool started;
+    bool stop;
+    bool pending;
+    bool busy;
+    bool done;
+    MLuaBlockOp op;
+    uint64_t off;
+    size_t len;
+    int result;
+    uint8_t* buf;
+    size_t buf_size;
+    MLuaEvent event;
+} Mapping;
+
+static inline Mapping* to_Mapping(lua_State* ls, int arg) {
+    return luaL_checkudata(ls, arg, Mapping_name);
+}
+
+// A block device backed by a file mapping. The mapping is stored as the first
+// user value.
+typedef struct Dev {
+    MLuaBlockDev dev;
+    Mapping* map;
+} Dev;
+
+// Convert an errno value to an error code.
+static int errno_to_err(int err) {
+    switch (err) {
+    case EBADF: return MLUA_EBADF;
+    case EBUSY: return MLUA_EBUSY;
+    case EEXIST: return MLUA_EEXIST;
+    case EFBIG: return MLUA_EFBIG;
+    case EINVAL: return MLUA_EINVAL;
+    case EISDIR: return MLUA_EISDIR;
+    case ENAMETOOLONG: return MLUA_ENAMETOOLONG;
+    case ENOENT: return MLUA_ENOENT;
+    case ENOMEM: return MLUA_ENOMEM;
+    case ENOSPC: return MLUA_ENOSPC;
+    case ENOTDIR: return MLUA_ENOTDIR;
+    case EROFS: return MLUA_EROFS;
+    default: return MLUA_EIO;
+    }
+}
+
+// Perform an operation on a mapping. Must be called with the mutex held.
+static int run_op(Mapping* m, MLuaBlockOp op, uint64_t off, void* buf,
+                  size_t size) {
+    if (m->ptr == NULL) return MLUA_EBADF;
+    if (off + size > m->size) return MLUA_EINVAL;
+    switch (op) {
+    case MLUA_BLOCK_READ:
+        memcpy(buf, m->ptr + off, size);
+        break;
+    case MLUA_BLOCK_WRITE:
+        memcpy(m->ptr + off, buf, size);
+        break;
+    case MLUA_BLOCK_ERASE:
+        memset(m->ptr + off, 0xff, size);
+        break;
+    case MLUA_BLOCK_SYNC:
+        if (msync(m->ptr, m->size, MS_SYNC) < 0) return errno_to_err(errno);
+        break;
+    }
+    return MLUA_EOK;
+}
+
+static void* run_worker(void* arg) {
+    Mapping* m = arg;
+    pthread_mutex_lock(&m->mutex);
+    for (;;) {
+        while (!m->stop && !m->pending) pthread_cond_wait(&m->cond, &m->mutex);
+        // Complete the pending operation before stopping, so that its waiter
+        // gets a result.
+        if (!m->pending) break;
+        int res = run_op(m, m->op, m->off, m->buf, m->len);
+        m->pending = false;
+        mlua_event_lock();
+        m->result = res;
+        m->done = true;
+        mlua_event_set_nolock(&m->event);
+        mlua_event_unlock();
+    }
+    pthread_mutex_unlock(&m->mutex);
+    return NULL;
+}
+
+static int close_mapping(lua_State* ls, Mapping* m) {
+    if (m->fd < 0) return MLUA_EOK;
+    if (m->started) {
+        pthread_mutex_lock(&m->mutex);
+        m->stop = true;
+        pthread_cond_signal(&m->cond);
+        pthread_mutex_unlock(&m->mutex);
+        pthread_join(m->thread, NULL);
+        m->started = false;
+    }
+
+    // Wake up the waiter of the last operation, which has completed, before
+    // disabling the event.
+    if (m->busy) mlua_event_resume_watcher(ls, &m->event);
+    mlua_event_disable(ls, &m->event);
+    int err = MLUA_EOK;
+    if (m->ptr != NULL) {
+        if (msync(m->ptr, m->size, MS_SYNC) < 0) err = errno_to_err(errno);
+        munmap(m->ptr, m->size);
+    }
+    if (close(m->fd) < 0 && err == MLUA_EOK) err = errno_to_err(errno);
+    m->ptr = NULL;
+    m->size = 0;
+    m->fd = -1;
+    return err;
+}
+
+static int Mapping___len(lua_State* ls) {
+    return lua_pushinteger(ls, to_Mapping(ls, 1)->size), 1;
+}
+
+static int Mapping___buffer(lua_State* ls) {
+    Mapping* m = to_Mapping(ls, 1);
+    if (m->ptr == NULL) return 0;
+    lua_pushlightuserdata(ls, m->ptr);
+    lua_pushinteger(ls, m->size);
+    return 2;
+}
+
+static int Mapping___gc(lua_State* ls) {
+    Mapping* m = to_Mapping(ls, 1);
+    close_mapping(ls, m);
+    free(m->buf);
+    m->buf = NULL;
+    m->buf_size = 0;
+    pthread_cond_destroy(&m->cond);
+    pthread_mutex_destroy(&m->mutex);
+    return 0;
+}
+
+MLUA_SYMBOLS_NOHASH(Mapping_syms_nh) = {
+    MLUA_SYM_F_NH(__len, Mapping_),
+    MLUA_SYM_F_NH(__buffer, Mapping_),
+    MLUA_SYM_F_NH(__gc, Mapping_),
+};
+
+static int file_dev_op(MLuaBlockDev* dev, MLuaBlockOp op, uint64_t off,
+                       void* buf, size_t size) {
+    Mapping* m = ((Dev*)dev)->map;
+    pthread_mutex_lock(&m->mutex);
+    int res = run_op(m, op, off, buf, size);
+    pthread_mutex_unlock(&m->mutex);
+    return res;
+}
+
+static int file_dev_read(MLuaBlockDev* dev, uint64_t off, void* dst,
+                         size_t size) {
+    return file_dev_op(dev, MLUA_BLOCK_READ, off, dst, size);
+}
+
+static int file_dev_write(MLuaBlockDev* dev, uint64_t off, void const* src,
+                          size_t size) {
+    return file_dev_op(dev, MLUA_BLOCK_WRITE, off, (void*)src, size);
+}
+
+static int file_dev_erase(MLuaBlockDev* dev, uint64_t off, size_t size) {
+    return file_dev_op(dev, MLUA_BLOCK_ERASE, off, NULL, size);
+}
+
+static int file_dev_sync(MLuaBlockDev* dev) {
+    return file_dev_op(dev, MLUA_BLOCK_SYNC, 0, NULL, 0);
+}
+
+static int file_dev_start(MLuaBlockDev* dev, MLuaBlockOp op, uint64_t off,
+                          void const* src, size_t size) {
+    Mapping* m = ((Dev*)dev)->map;
+    if (m->ptr == NULL) return MLUA_EBADF;
+    if (m->busy) {
+        // The previous operation may have been abandoned by a killed thread.
+        mlua_event_lock();
+        bool done = m->done;
+        mlua_event_unlock();
+        if (!done) return MLUA_EBUSY;
+    }
+
+    // Start the worker thread on first use.
+    if (!m->started) {
+        if (pthread_create(&m->thread, NULL, &run_worker, m) != 0) {
+            return MLUA_ENOMEM;
+        }
+        m->started = true;
+    }
+
+    // Ensure that the staging buffer is large enough.
+    if (size > m->buf_size) {
+        uint8_t* buf = realloc(m->buf, size);
+        if (buf == NULL) return MLUA_ENOMEM;
+        m->buf = buf;
+        m->buf_size = size;
+    }
+    if (op == MLUA_BLOCK_WRITE) memcpy(m->buf, src, size);
+
+    // Submit the operation to the worker.
+    pthread_mutex_lock(&m->mutex);
+    m->op = op;
+    m->off = off;
+    m->len = size;
+    mlua_event_lock();
+    m->done = false;
+    mlua_event_unlock();
+    m->pending = true;
+    m->busy = true;
+    pthread_cond_signal(&m->cond);
+    pthread_mutex_unlock(&m->mutex);
+    return MLUA_EOK;
+}
+
+static bool file_dev_poll(MLuaBlockDev* dev, int* result, void const** data) {
+    Mapping* m = ((Dev*)dev)->map;
+    mlua_event_lock();
+    bool done = m->done;
+    *result = m->result;
+    mlua_event_unlock();
+    if (!done) return false;
+    m->busy = false;
+    *data = m->buf;
+    return true;
+}
+
+static struct MLuaEvent* file_dev_event(MLuaBlockDev* dev) {
+    return &((Dev*)dev)->map->event;
+}
+
+static MLuaBlockAsync const file_dev_async = {
+    .start = &file_dev_start,
+    .poll = &file_dev_poll,
+    .event = &file_dev_event,
+};
+
+static Dev* check_Dev(lua_State* ls, int arg) {
+    MLuaBlockDev* dev = mlua_block_check(ls, arg);
+    luaL_argexpected(ls, dev->read == &file_dev_read, arg, "file device");
+    return (Dev*)dev;
+}
+
+static int mod_new(lua_State* ls) {
+    char const* path = luaL_checkstring(ls, 1);
+    lua_Integer size = luaL_optinteger(ls, 2, 0);
+    lua_Integer write_size = luaL_optinteger(ls, 3, 256);
+    lua_Integer erase_size = luaL_optinteger(ls, 4, 256);
+    luaL_argcheck(ls, size >= 0, 2, "invalid size");
+    luaL_argcheck(ls, write_size > 0, 3, "invalid write size");
+    luaL_argcheck(ls, erase_size > 0 && erase_size % write_size == 0, 4,
+                  "invalid erase size");
+
+    // Create the device and the mapping first, so that the file descriptor is
+    // closed by the garbage collector if anything fails.
+    Dev* dev = mlua_block_push(ls, sizeof(Dev), 1);
+    Mapping* m = lua_newuserdatauv(ls, sizeof(Mapping), 0);
+    *m = (Mapping){.fd = -1};
+    pthread_mutex_init(&m->mutex, NULL);
+    pthread_cond_init(&m->cond, NULL);
+    mlua_event_init(&m->event);
+    luaL_getmetatable(ls, Mapping_name);
+    lua_setmetatable(ls, -2);
+    lua_setiuservalue(ls, -2, 1);
+    dev->map = m;
+
+    // Open the file, and extend it if necessary. The extension is filled with
+    // 0xff after mapping, so that it appears erased.
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) return mlua_err_push(ls, errno_to_err(errno));
+    m->fd = fd;
+    struct stat st;
+    if (fstat(fd, &st) < 0) return mlua_err_push(ls, errno_to_err(errno));
+    uint64_t fsize = st.st_size;
+    if (size == 0) size = fsize;
+    if (size == 0 || size % erase_size != 0) {
+        return mlua_err_push(ls, MLUA_EINVAL);
+    }
+    if ((uint64_t)size > fsize && ftruncate(fd, size) < 0) {
+        return mlua_err_push(ls, errno_to_err(errno));
+    }
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) return mlua_err_push(ls, errno_to_err(errno));
+    m->ptr = ptr;
+    m->size = size;
+    if ((uint64_t)size > fsize) memset(m->ptr + fsize, 0xff, size - fsize);
+
+    dev->dev.read = &file_dev_read;
+    dev->dev.write = &file_dev_write;
+    dev->dev.erase = &file_dev_erase;
+    dev->dev.sync = &file_dev_sync;
+    dev->dev.size = size;
+    dev->dev.read_size = 1;
+    dev->dev.write_size = write_size;
+    dev->dev.erase_size = erase_size;
+    dev->dev.async = &file_dev_async;
+    mlua_event_enable(ls, &m->event);
+    return 1;
+}
+
+static int mod_buffer(lua_State* ls) {
+    check_Dev(ls, 1);
+    lua_getiuservalue(ls, 1, 1);
+    return 1;
+}
+
+static int mod_close(lua_State* ls) {
+    Dev* dev = check_Dev(ls, 1);
+    int err = close_mapping(ls, dev->map);
+    if (err < 0) return mlua_err_push(ls, err);
+    return lua_pushboolean(ls, true), 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(new, mod_),
+    MLUA_SYM_F(buffer, mod_),
+    MLUA_SYM_F(close, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.block.file) {
+    mlua_thread_require(ls);
+    mlua_require(ls, "mlua.block", false);
+
+    mlua_new_module(ls, 0, module_syms);
+    mlua_new_class(ls, Mapping_name, mlua_nosyms, Mapping_syms_nh);
+    lua_pop(ls, 1);
+    return 1;
+}
@@ -0,0 +1,121 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local io = require 'io'
+local block_file = require 'mlua.block.file'
+local errors = require 'mlua.errors'
+local fs = require 'mlua.fs'
+local lfs = require 'mlua.fs.lfs'
+local mem = require 'mlua.mem'
+local thread = require 'mlua.thread'
+local os = require 'os'
+
+-- Return the path to a temporary file, which is removed at the end of the
+-- test.
+local function tmp_file(t)
+    local path = os.tmpname()
+    t:cleanup(function() os.remove(path) end)
+    return path
+end
+
+-- Return the content of a file.
+local function read_file(path)
+    local f<close> = assert(io.open(path, 'rb'))
+    return f:read('a')
+end
+
+function test_new(t)
+    local path = tmp_file(t)
+    t:expect(t.mexpr(block_file).new(path))
+        :eq{nil, "invalid argument", errors.EINVAL, n = 3}
+    t:expect(t.expr(block_file).new(path, 4096, 256, 1000))
+        :raises("invalid erase size")
+
+    local dev = block_file.new(path, 4096, 256, 1024)
+    t:expect(t.mexpr(dev):size()):eq{4096, 1, 256, 1024}
+    t:expect(t.expr(dev):read(0, 4)):eq('\xff\xff\xff\xff')
+    t:expect(t.expr(dev):write(256, 'abcd')):eq(true)
+    t:expect(t.expr(dev):erase(1024, 1024)):eq(true)
+    t:expect(t.expr(dev):sync()):eq(true)
+    t:expect(read_file(path):sub(257, 260)):label("file"):eq('abcd')
+    t:expect(t.expr(block_file).close(dev)):eq(true)
+    t:expect(t.mexpr(dev):read(0, 4))
+        :eq{nil, "bad file descriptor", errors.EBADF, n = 3}
+
+    dev = block_file.new(path, nil, 256, 1024)
+    t:expect(t.mexpr(dev):size()):eq{4096, 1, 256, 1024}
+    t:expect(t.expr(dev):read(256, 4)):eq('abcd')
+    t:expect(t.expr(block_file).close(mem.alloc(4)))
+        :raises("block.Dev expected")
+end
+
+function test_buffer(t)
+    local path = tmp_file(t)
+    local dev = block_file.new(path, 1024)
+    local buf = block_file.buffer(dev)
+    t:expect(#buf):label("#buf"):eq(1024)
+    mem.write(buf, 'hello', 100)
+    t:expect(t.expr(dev):read(100, 5)):eq('hello')
+    dev:write(200, 'world')
+    t:expect(t.expr(mem).read(buf, 200, 5)):eq('world')
+    block_file.close(dev)
+    t:expect(#buf):label("#buf"):eq(0)
+end
+
+function test_lfs(t)
+    local path = tmp_file(t)
+    do
+        local dev = block_file.new(path, 64 << 10, 256, 4096)
+        local f<close> = lfs.new(dev)
+        t:assert(f:format())
+        t:assert(f:mount())
+        local fh<close> = assert(f:open('/file', fs.O_WRONLY | fs.O_CREAT))
+        t:assert(fh:write('some data'))
+        t:assert(fh:close())
+        t:assert(f:unmount())
+        t:assert(block_file.close(dev))
+    end
+    local f<close> = lfs.new(block_file.new(path, nil, 256, 4096))
+    t:assert(f:mount())
+    local fh<close> = assert(f:open('/file', fs.O_RDONLY))
+    t:expect(t.expr(fh):read(100)):eq('some data')
+end
+
+function test_async(t)
+    local path = tmp_file(t)
+    local dev = block_file.new(path, 8192, 256, 4096)
+    t:expect(t.expr(dev):write(0, ('a'):rep(512))):eq(true)
+    t:expect(t.expr(dev):read(256, 4)):eq('aaaa')
+    t:expect(t.expr(dev):erase(4096, 4096)):eq(true)
+    t:expect(t.expr(dev):read(4094, 4)):eq('\xff\xff\xff\xff')
+    t:expect(t.expr(dev):sync()):eq(true)
+    t:expect(read_file(path):sub(1, 512)):label("file"):eq(('a'):rep(512))
+end
+
+function test_async_threads(t)
+    local path = tmp_file(t)
+    local dev = block_file.new(path, 8192, 256, 4096)
+
+    -- Run operations from two threads, so that they overlap.
+    local function run(c, off)
+        for i = 0, 7 do
+            local data = c:rep(256)
+            t:expect(t.expr(dev):write(off + i * 256, data)):eq(true)
+            t:expect(t.expr(dev):read(off + i * 256, 256)):eq(data)
+        end
+    end
+    local th<close> = thread.start(function() run('b', 4096) end)
+    run('a', 0)
+    th:join()
+    t:expect(t.expr(dev):read(2044, 8)):eq('aaaa\xff\xff\xff\xff')
+    t:expect(t.expr(dev):read(6140, 8)):eq('bbbb\xff\xff\xff\xff')
+
+    -- Closing the device completes the pending operation.
+    local res
+    local th<close> = thread.start(function() res = dev:write(0, 'cccc') end)
+    thread.yield()
+    t:expect(t.expr(block_file).close(dev)):eq(true)
+    th:join()
+    t:expect(res):label("res"):eq(true)
+    t:expect(read_file(path):sub(1, 4)):label("file"):eq('cccc')
+end
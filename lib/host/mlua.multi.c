@@ -0,0 +1,775 @@
+// Copyright 2025 Remy Blank <remy@c-space.org>
+// SPDX-License-Identifier: MIT
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "mlua/errors.h"
+#include "mlua/int64.h"
+#include "mlua/main.h"
+#include "mlua/module.h"
+#include "mlua/thread.h"
+#include "mlua/util.h"
+
+// The maximum nesting depth of tables in messages.
+#define MAX_DEPTH 32
+
+// A node of a lock-free multi-producer, single-consumer queue.
+typedef struct Node {
+    _Atomic(struct Node*) next;
+} Node;
+
+// A queue of nodes. Pushing is lock-free and can be done from any OS thread.
+// Popping must be done from a single consumer at a time.
+typedef struct Queue {
+    _Atomic(Node*) head;
+    Node* tail;
+    Node stub;
+} Queue;
+
+static void queue_init(Queue* q) {
+    atomic_init(&q->stub.next, NULL);
+    atomic_init(&q->head, &q->stub);
+    q->tail = &q->stub;
+}
+
+static void queue_push(Queue* q, Node* n) {
+    atomic_store_explicit(&n->next, NULL, memory_order_relaxed);
+    Node* prev = atomic_exchange_explicit(&q->head, n, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, n, memory_order_release);
+}
+
+// Pop a node from the queue. Returns NULL if the queue is empty, or if a push
+// is in progress. In the latter case, the producer sets the queue's event once
+// the push completes.
+static Node* queue_pop(Queue* q) {
+    Node* tail = q->tail;
+    Node* next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &q->stub) {
+        if (next == NULL) return NULL;
+        q->tail = tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&q->head, memory_order_acquire)) {
+        return NULL;
+    }
+    queue_push(q, &q->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next == NULL) return NULL;
+    q->tail = next;
+    return tail;
+}
+
+// A message, holding a sequence of serialized values.
+typedef struct Message {
+    Node node;
+    size_t size;
+    size_t cap;
+    size_t exports;  // The number of complete TAG_EXPORT records
+    char data[];
+} Message;
+
+typedef enum Tag {
+    TAG_END,
+    TAG_NIL,
+    TAG_FALSE,
+    TAG_TRUE,
+    TAG_INTEGER,
+    TAG_NUMBER,
+    TAG_STRING,
+    TAG_TABLE,
+    TAG_EXPORT,
+} Tag;
+
+// A channel, for passing messages between interpreters.
+typedef struct Channel {
+    atomic_int refs;
+    _Atomic(MLuaGlobal*) receiver;
+    Queue queue;
+    MLuaEvent event;
+} Channel;
+
+// Call a function for the next "count" exported handles referenced by the
+// serialized values starting at "p". The scan stops after the last handle, so
+// that an incomplete record following it is never read.
+static void each_export(char const* p, size_t count,
+                        void (*fn)(MLuaExportVt const*, void*)) {
+    while (count > 0) {
+        switch ((Tag)*p++) {
+        case TAG_INTEGER:
+            p += sizeof(lua_Integer);
+            break;
+        case TAG_NUMBER:
+            p += sizeof(lua_Number);
+            break;
+        case TAG_STRING: {
+            size_t len;
+            memcpy(&len, p, sizeof(len));
+            p += sizeof(len) + len;
+            break;
+        }
+        case TAG_EXPORT: {
+            MLuaExportVt const* vt;
+            void* handle;
+            memcpy(&vt, p, sizeof(vt));
+            p += sizeof(vt);
+            memcpy(&handle, p, sizeof(handle));
+            p += sizeof(handle);
+            fn(vt, handle);
+            --count;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+static void release_export(MLuaExportVt const* vt, void* handle) {
+    vt->release(handle);
+}
+
+static void commit_export(MLuaExportVt const* vt, void* handle) {
+    if (vt->commit != NULL) vt->commit(handle);
+}
+
+// Release the resources referenced by a message, then free it.
+static void free_message(Message* msg) {
+    if (msg == NULL) return;
+    each_export(msg->data, msg->exports, &release_export);
+    free(msg);
+}
+
+// Commit the transfer of the exported handles referenced by a message. This
+// must be done before the message is made available to the receiver.
+static void commit_message(Message* msg) {
+    each_export(msg->data, msg->exports, &commit_export);
+}
+
+typedef struct Encoder {
+    Message* msg;
+    char const* err;
+    char const* type;
+} Encoder;
+
+static bool put(Encoder* enc, void const* src, size_t size) {
+    Message* msg = enc->msg;
+    if (msg->size + size > msg->cap) {
+        size_t cap = 2 * msg->cap;
+        if (cap < msg->size + size) cap = msg->size + size;
+        msg = realloc(msg, sizeof(Message) + cap);
+        if (msg == NULL) {
+            enc->err = "out of memory";
+            return false;
+        }
+        msg->cap = cap;
+        enc->msg = msg;
+    }
+    memcpy(msg->data + msg->size, src, size);
+    msg->size += size;
+    return true;
+}
+
+static inline bool put_tag(Encoder* enc, Tag tag) {
+    char t = tag;
+    return put(enc, &t, 1);
+}
+
+static bool encode_value(lua_State* ls, Encoder* enc, int arg, int depth) {
+    switch (lua_type(ls, arg)) {
+    case LUA_TNIL:
+        return put_tag(enc, TAG_NIL);
+    case LUA_TBOOLEAN:
+        return put_tag(enc, lua_toboolean(ls, arg) ? TAG_TRUE : TAG_FALSE);
+    case LUA_TNUMBER:
+        if (lua_isinteger(ls, arg)) {
+            lua_Integer v = lua_tointeger(ls, arg);
+            return put_tag(enc, TAG_INTEGER) && put(enc, &v, sizeof(v));
+        } else {
+            lua_Number v = lua_tonumber(ls, arg);
+            return put_tag(enc, TAG_NUMBER) && put(enc, &v, sizeof(v));
+        }
+    case LUA_TSTRING: {
+        size_t len;
+        char const* s = lua_tolstring(ls, arg, &len);
+        return put_tag(enc, TAG_STRING) && put(enc, &len, sizeof(len))
+               && put(enc, s, len);
+    }
+    case LUA_TTABLE:
+        if (depth >= MAX_DEPTH || !lua_checkstack(ls, 3)) {
+            enc->err = "tables nested too deeply";
+            return false;
+        }
+        if (!put_tag(enc, TAG_TABLE)) return false;
+        arg = lua_absindex(ls, arg);
+        lua_pushnil(ls);
+        while (lua_next(ls, arg)) {
+            if (!encode_value(ls, enc, -2, depth + 1)
+                    || !encode_value(ls, enc, -1, depth + 1)) {
+                lua_pop(ls, 2);
+                return false;
+            }
+            lua_pop(ls, 1);
+        }
+        return put_tag(enc, TAG_END);
+    case LUA_TUSERDATA: {
+        void* handle;
+        MLuaExportVt const* vt = mlua_export(ls, arg, &handle);
+        if (vt == NULL) break;
+        if (!(put_tag(enc, TAG_EXPORT) && put(enc, &vt, sizeof(vt))
+              && put(enc, &handle, sizeof(handle)))) {
+            vt->release(handle);
+            return false;
+        }
+        ++enc->msg->exports;
+        return true;
+    }
+    }
+    enc->err = "unsupported value type";
+    enc->type = luaL_typename(ls, arg);
+    return false;
+}
+
+// Serialize the values at the given stack indexes into a message. Raises an
+// error if a value cannot be serialized.
+static Message* encode_values(lua_State* ls, int first, int last) {
+    Encoder enc = {.msg = malloc(sizeof(Message) + 64)};
+    if (enc.msg == NULL) luaL_error(ls, "out of memory");
+    enc.msg->size = 0;
+    enc.msg->cap = 64;
+    enc.msg->exports = 0;
+    for (int i = first; i <= last; ++i) {
+        if (!encode_value(ls, &enc, i, 0)) {
+            free_message(enc.msg);
+            if (enc.type != NULL) luaL_error(ls, "%s: %s", enc.err, enc.type);
+            luaL_error(ls, "%s", enc.err);
+        }
+    }
+    return enc.msg;
+}
+
+// Decode a value and push it onto the stack, and decrement "exports" for each
+// imported handle. Returns false if the stack cannot be grown, in which case
+// "pp" points to the first value that wasn't decoded.
+static bool decode_value(lua_State* ls, char const** pp, size_t* exports) {
+    char const* p = *pp;
+    switch ((Tag)*p++) {
+    case TAG_NIL:
+        lua_pushnil(ls);
+        break;
+    case TAG_FALSE:
+        lua_pushboolean(ls, false);
+        break;
+    case TAG_TRUE:
+        lua_pushboolean(ls, true);
+        break;
+    case TAG_INTEGER: {
+        lua_Integer v;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        lua_pushinteger(ls, v);
+        break;
+    }
+    case TAG_NUMBER: {
+        lua_Number v;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        lua_pushnumber(ls, v);
+        break;
+    }
+    case TAG_STRING: {
+        size_t len;
+        memcpy(&len, p, sizeof(len));
+        p += sizeof(len);
+        lua_pushlstring(ls, p, len);
+        p += len;
+        break;
+    }
+    case TAG_TABLE:
+        if (!lua_checkstack(ls, 3)) {
+            *pp = p;
+            return false;
+        }
+        lua_createtable(ls, 0, 0);
+        while ((Tag)*p != TAG_END) {
+            if (!(decode_value(ls, &p, exports)
+                  && decode_value(ls, &p, exports))) {
+                *pp = p;
+                return false;
+            }
+            lua_rawset(ls, -3);
+        }
+        ++p;
+        break;
+    case TAG_EXPORT: {
+        MLuaExportVt const* vt;
+        void* handle;
+        memcpy(&vt, p, sizeof(vt));
+        p += sizeof(vt);
+        memcpy(&handle, p, sizeof(handle));
+        p += sizeof(handle);
+        --*exports;
+        vt->import(ls, handle);
+        break;
+    }
+    default:
+        lua_pushnil(ls);
+        break;
+    }
+    *pp = p;
+    return true;
+}
+
+// Push the values of a message onto the stack, then free the message. Returns
+// the number of values pushed.
+static int decode_values(lua_State* ls, Message* msg) {
+    char const* p = msg->data;
+    char const* end = p + msg->size;
+    size_t exports = msg->exports;
+    int cnt = 0;
+    for (; p < end; ++cnt) {
+        bool grown = lua_checkstack(ls, 1);
+        if (!(grown && decode_value(ls, &p, &exports))) {
+            // Release the handles that weren't imported.
+            each_export(p, exports, &release_export);
+            free(msg);
+            return luaL_error(ls, grown ? "message too deep"
+                                        : "too many values");
+        }
+    }
+    free(msg);  // References have been transferred to the decoded values
+    return cnt;
+}
+
+static char const Channel_name[] = "mlua.multi.Channel";
+
+static void release_channel(void* handle) {
+    Channel* ch = handle;
+    if (atomic_fetch_sub(&ch->refs, 1) != 1) return;
+    for (;;) {
+        Node* n = queue_pop(&ch->queue);
+        if (n == NULL) break;
+        if (n != &ch->queue.stub) free_message((Message*)n);
+    }
+    free(ch);
+}
+
+static inline Channel* check_Channel(lua_State* ls, int arg) {
+    Channel* ch = *((Channel**)luaL_checkudata(ls, arg, Channel_name));
+    luaL_argcheck(ls, ch != NULL, arg, "closed channel");
+    return ch;
+}
+
+static inline Channel* to_Channel(lua_State* ls, int arg) {
+    return *((Channel**)lua_touserdata(ls, arg));
+}
+
+// Push the userdata for a channel. The reference is transferred to the
+// userdata. Each interpreter holds at most one userdata per channel, so that
+// the receiver can release the channel's event when the userdata is collected.
+static void push_channel(lua_State* ls, void* handle) {
+    Channel* ch = handle;
+    lua_rawgetp(ls, LUA_REGISTRYINDEX, Channel_name);
+    if (lua_rawgetp(ls, -1, ch) != LUA_TNIL) {
+        lua_remove(ls, -2);
+        release_channel(ch);
+        return;
+    }
+    lua_pop(ls, 1);
+    Channel** ud = lua_newuserdatauv(ls, sizeof(Channel*), 0);
+    *ud = ch;
+    luaL_getmetatable(ls, Channel_name);
+    lua_setmetatable(ls, -2);
+    lua_pushvalue(ls, -1);
+    lua_rawsetp(ls, -3, ch);
+    lua_remove(ls, -2);
+}
+
+static void import_channel(lua_State* ls, void* handle) {
+    mlua_require(ls, "mlua.multi", false);  // Ensure the class is defined
+    push_channel(ls, handle);
+}
+
+static MLuaExportVt const Channel_export_vt = {
+    .import = &import_channel,
+    .release = &release_channel,
+};
+
+static int Channel_send(lua_State* ls) {
+    Channel* ch = check_Channel(ls, 1);
+    Message* msg = encode_values(ls, 2, lua_gettop(ls));
+    commit_message(msg);
+    queue_push(&ch->queue, &msg->node);
+    mlua_event_set(&ch->event);
+    return 0;
+}
+
+// Make the interpreter the receiver of the channel. Only one interpreter can
+// receive from a given channel.
+static void claim_receiver(lua_State* ls, Channel* ch) {
+    MLuaGlobal* g = mlua_global(ls);
+    MLuaGlobal* cur = NULL;
+    if (atomic_compare_exchange_strong(&ch->receiver, &cur, g)) {
+        mlua_event_enable(ls, &ch->event);
+    } else if (cur != g) {
+        luaL_error(ls, "channel has a receiver in another interpreter");
+    }
+}
+
+static int recv_loop(lua_State* ls, bool timeout) {
+    Channel* ch = to_Channel(ls, 1);
+    Message* msg = (Message*)queue_pop(&ch->queue);
+    if (msg == NULL) {
+        if (!timeout) return -1;
+        return mlua_err_push(ls, MLUA_ETIMEDOUT);
+    }
+    lua_settop(ls, 0);
+    return decode_values(ls, msg);
+}
+
+static int Channel_recv(lua_State* ls) {
+    Channel* ch = check_Channel(ls, 1);
+    claim_receiver(ls, ch);
+    lua_settop(ls, 2);  // Ensure deadline is set
+    if (mlua_event_can_wait(ls, &ch->event, 0)) {
+        return mlua_event_wait(ls, &ch->event, 0, &recv_loop, 2);
+    }
+
+    // Block the whole interpreter until a message arrives.
+    uint64_t deadline = lua_isnil(ls, 2) ? MLUA_TICKS_MAX
+                        : (uint64_t)mlua_check_int64(ls, 2);
+    Message* msg;
+    bool timeout = false;
+    mlua_event_lock();
+    for (;;) {
+        msg = (Message*)queue_pop(&ch->queue);
+        if (msg != NULL || timeout) break;
+        timeout = mlua_event_wait_nolock(deadline);
+    }
+    mlua_event_unlock();
+    if (msg == NULL) return mlua_err_push(ls, MLUA_ETIMEDOUT);
+    lua_settop(ls, 0);
+    return decode_values(ls, msg);
+}
+
+static int Channel___export(lua_State* ls) {
+    Channel* ch = *((Channel**)luaL_checkudata(ls, 1, Channel_name));
+    if (ch == NULL) return 0;
+    atomic_fetch_add(&ch->refs, 1);
+    lua_pushlightuserdata(ls, ch);
+    lua_pushlightuserdata(ls, (void*)&Channel_export_vt);
+    return 2;
+}
+
+static int Channel___gc(lua_State* ls) {
+    Channel** ud = luaL_checkudata(ls, 1, Channel_name);
+    Channel* ch = *ud;
+    if (ch == NULL) return 0;
+    *ud = NULL;
+    if (atomic_load(&ch->receiver) == mlua_global(ls)) {
+        mlua_event_disable(ls, &ch->event);
+        atomic_store(&ch->receiver, NULL);
+    }
+    release_channel(ch);
+    return 0;
+}
+
+MLUA_SYMBOLS(Channel_syms) = {
+    MLUA_SYM_F(send, Channel_),
+    MLUA_SYM_F(recv, Channel_),
+};
+
+MLUA_SYMBOLS_NOHASH(Channel_syms_nh) = {
+    MLUA_SYM_F_NH(__export, Channel_),
+    MLUA_SYM_F_NH(__gc, Channel_),
+};
+
+// A worker interpreter, running in its own OS thread.
+typedef struct Worker {
+    atomic_int refs;
+    pthread_t thread;
+    lua_State* ls;
+    Message* args;
+    Message* results;
+    MLuaEvent done_event;
+    bool done;  // Protected by the event lock
+    bool failed;
+    bool joined;
+} Worker;
+
+static void release_worker(Worker* w) {
+    if (atomic_fetch_sub(&w->refs, 1) != 1) return;
+    free_message(w->args);
+    free_message(w->results);
+    free(w);
+}
+
+// Store the values at the top of the stack, starting at the given index, as
+// the results of the worker.
+static void store_results(lua_State* ls, Worker* w, int first, bool failed) {
+    w->failed = failed;
+    Encoder enc = {.msg = malloc(sizeof(Message) + 64)};
+    if (enc.msg == NULL) {
+        w->failed = true;
+        return;
+    }
+    enc.msg->size = 0;
+    enc.msg->cap = 64;
+    enc.msg->exports = 0;
+    int last = lua_gettop(ls);
+    for (int i = first; i <= last; ++i) {
+        if (encode_value(ls, &enc, i, 0)) continue;
+        // Replace the results with an error describing the failure.
+        each_export(enc.msg->data, enc.msg->exports, &release_export);
+        enc.msg->size = 0;
+        enc.msg->exports = 0;
+        w->failed = true;
+        lua_pushfstring(ls, "%s: %s", enc.err,
+                        enc.type != NULL ? enc.type : "?");
+        if (failed) luaL_tolstring(ls, first, NULL);
+        if (!encode_value(ls, &enc, -1, 0)) {
+            free_message(enc.msg);
+            return;
+        }
+        break;
+    }
+    commit_message(enc.msg);
+    w->results = enc.msg;
+}
+
+static int call_main(lua_State* ls) {
+    Worker* w = lua_touserdata(ls, 3);
+    lua_settop(ls, 2);
+    lua_getglobal(ls, "require");
+    lua_pushvalue(ls, 1);
+    lua_call(ls, 1, 1);
+    lua_pushvalue(ls, 2);
+    lua_gettable(ls, -2);
+    lua_replace(ls, 1);
+    lua_settop(ls, 1);
+    Message* args = w->args;
+    w->args = NULL;
+    int nargs = decode_values(ls, args);
+    return mlua_callk(ls, nargs, LUA_MULTRET, mlua_cont_return_results, 0);
+}
+
+static int run_main_2(lua_State* ls, int status, lua_KContext ctx);
+
+static int run_main(lua_State* ls) {
+    lua_settop(ls, 0);
+    lua_pushcfunction(ls, &call_main);
+    lua_pushvalue(ls, lua_upvalueindex(1));  // module
+    lua_pushvalue(ls, lua_upvalueindex(2));  // fn
+    lua_pushvalue(ls, lua_upvalueindex(3));  // worker
+    Worker* w = lua_touserdata(ls, -1);
+    return mlua_pcallk(ls, 3, LUA_MULTRET, 0, run_main_2, (lua_KContext)w);
+}
+
+static int run_main_2(lua_State* ls, int status, lua_KContext ctx) {
+    Worker* w = (Worker*)ctx;
+    store_results(ls, w, 1, !(status == LUA_OK || status == LUA_YIELD));
+
+    // Shut down the thread scheduler, so that the interpreter terminates even
+    // if other threads are still running.
+    if (!lua_isyieldable(ls)) return 0;
+    lua_settop(ls, 0);
+    mlua_thread_meta(ls, "shutdown");
+    return mlua_callk(ls, 0, 0, mlua_cont_return, 0);
+}
+
+static int find_main(lua_State* ls) {
+    lua_pushvalue(ls, lua_upvalueindex(1));
+    lua_pushvalue(ls, lua_upvalueindex(2));
+    lua_pushvalue(ls, lua_upvalueindex(3));
+    lua_pushcclosure(ls, &run_main, 3);
+    return 1;
+}
+
+static void* run_worker(void* arg) {
+    Worker* w = arg;
+    lua_State* ls = w->ls;
+    if (mlua_run_main(ls, 0, 0, 0) != LUA_OK && w->results == NULL) {
+        // The error occurred outside of the main function.
+        store_results(ls, w, lua_gettop(ls), true);
+    }
+    lua_settop(ls, 0);
+    mlua_close_interpreter(ls);
+    w->ls = NULL;
+    mlua_event_lock();
+    w->done = true;
+    mlua_event_set_nolock(&w->done_event);
+    mlua_event_unlock();
+    release_worker(w);
+    return NULL;
+}
+
+static char const Worker_name[] = "mlua.multi.Worker";
+
+static inline Worker* check_Worker(lua_State* ls, int arg) {
+    Worker* w = *((Worker**)luaL_checkudata(ls, arg, Worker_name));
+    luaL_argcheck(ls, w != NULL, arg, "invalid worker");
+    return w;
+}
+
+static inline Worker* to_Worker(lua_State* ls, int arg) {
+    return *((Worker**)lua_touserdata(ls, arg));
+}
+
+static int Worker_is_alive(lua_State* ls) {
+    Worker* w = check_Worker(ls, 1);
+    mlua_event_lock();
+    bool done = w->done;
+    mlua_event_unlock();
+    return lua_pushboolean(ls, !done), 1;
+}
+
+static int join_done(lua_State* ls, Worker* w) {
+    pthread_join(w->thread, NULL);
+    w->joined = true;
+    Message* res = w->results;
+    w->results = NULL;
+    lua_settop(ls, 0);
+    if (res == NULL) return luaL_error(ls, "worker failed");
+    int cnt = decode_values(ls, res);
+    if (w->failed) {
+        lua_settop(ls, 1);
+        return lua_error(ls);
+    }
+    return cnt;
+}
+
+static int join_loop(lua_State* ls, bool timeout) {
+    Worker* w = to_Worker(ls, 1);
+    mlua_event_lock();
+    bool done = w->done;
+    mlua_event_unlock();
+    if (!done) return -1;
+    return join_done(ls, w);
+}
+
+static int Worker_join(lua_State* ls) {
+    Worker* w = check_Worker(ls, 1);
+    if (w->joined) return luaL_error(ls, "worker already joined");
+    if (mlua_event_can_wait(ls, &w->done_event, 0)) {
+        return mlua_event_wait(ls, &w->done_event, 0, &join_loop, 0);
+    }
+    return join_done(ls, w);
+}
+
+static int Worker___gc(lua_State* ls) {
+    Worker** ud = luaL_checkudata(ls, 1, Worker_name);
+    Worker* w = *ud;
+    if (w == NULL) return 0;
+    *ud = NULL;
+    mlua_event_disable(ls, &w->done_event);
+    if (!w->joined) pthread_detach(w->thread);
+    release_worker(w);
+    return 0;
+}
+
+MLUA_SYMBOLS(Worker_syms) = {
+    MLUA_SYM_F(is_alive, Worker_),
+    MLUA_SYM_F(join, Worker_),
+};
+
+MLUA_SYMBOLS_NOHASH(Worker_syms_nh) = {
+    MLUA_SYM_F_NH(__gc, Worker_),
+};
+
+static int mod_start(lua_State* ls) {
+    size_t mlen, flen;
+    char const* module = luaL_checklstring(ls, 1, &mlen);
+    char const* fn = luaL_optlstring(ls, 2, "main", &flen);
+    if (lua_gettop(ls) < 2) lua_settop(ls, 2);
+    Worker** ud = lua_newuserdatauv(ls, sizeof(Worker*), 0);
+    *ud = NULL;
+    luaL_getmetatable(ls, Worker_name);
+    lua_setmetatable(ls, -2);
+    lua_insert(ls, 3);
+    Message* args = encode_values(ls, 4, lua_gettop(ls));
+
+    // Create the worker and its interpreter.
+    Worker* w = malloc(sizeof(Worker));
+    if (w == NULL) {
+        free_message(args);
+        return luaL_error(ls, "out of memory");
+    }
+    memset(w, 0, sizeof(*w));
+    w->args = args;
+    atomic_init(&w->refs, 1);
+    lua_State* ls1 = mlua_new_interpreter();
+    if (ls1 == NULL) {
+        release_worker(w);
+        return luaL_error(ls, "interpreter creation failed");
+    }
+    w->ls = ls1;
+    mlua_event_init(&w->done_event);
+    mlua_event_enable(ls, &w->done_event);
+    lua_pushlstring(ls1, module, mlen);
+    lua_pushlstring(ls1, fn, flen);
+    lua_pushlightuserdata(ls1, w);
+    lua_pushcclosure(ls1, &find_main, 3);
+
+    // Start the worker thread. The arguments are committed before, as they
+    // become accessible to the worker as soon as it starts.
+    commit_message(args);
+    atomic_store(&w->refs, 2);
+    if (pthread_create(&w->thread, NULL, &run_worker, w) != 0) {
+        mlua_close_interpreter(ls1);
+        mlua_event_disable(ls, &w->done_event);
+        free_message(w->args);
+        free(w);
+        return luaL_error(ls, "thread creation failed");
+    }
+    *ud = w;
+    lua_settop(ls, 3);
+    return 1;
+}
+
+static int mod_channel(lua_State* ls) {
+    Channel* ch = malloc(sizeof(Channel));
+    if (ch == NULL) return luaL_error(ls, "out of memory");
+    atomic_init(&ch->refs, 1);
+    atomic_init(&ch->receiver, NULL);
+    queue_init(&ch->queue);
+    mlua_event_init(&ch->event);
+    push_channel(ls, ch);
+    return 1;
+}
+
+MLUA_SYMBOLS(module_syms) = {
+    MLUA_SYM_F(start, mod_),
+    MLUA_SYM_F(channel, mod_),
+};
+
+MLUA_OPEN_MODULE(mlua.multi) {
+    mlua_thread_require(ls);
+    mlua_require(ls, "mlua.int64", false);
+
+    // Create the module.
+    mlua_new_module(ls, 0, module_syms);
+
+    // Create the Worker and Channel classes.
+    mlua_new_class(ls, Worker_name, Worker_syms, Worker_syms_nh);
+    lua_pop(ls, 1);
+    mlua_new_class(ls, Channel_name, Channel_syms, Channel_syms_nh);
+    lua_pop(ls, 1);
+
+    // Create the channel userdata cache, with weak values.
+    lua_createtable(ls, 0, 0);
+    lua_createtable(ls, 0, 1);
+    lua_pushliteral(ls, "v");
+    lua_setfield(ls, -2, "__mode");
+    lua_setmetatable(ls, -2);
+    lua_rawsetp(ls, LUA_REGISTRYINDEX, Channel_name);
+    return 1;
+}
@@ -0,0 +1,228 @@
+-- Copyright 2025 Remy Blank <remy@c-space.org>
+-- SPDX-License-Identifier: MIT
+
+local math = require 'math'
+local errors = require 'mlua.errors'
+local mem = require 'mlua.mem'
+local multi = require 'mlua.multi'
+local repr = require 'mlua.repr'
+local ring = require 'mlua.ring'
+local thread = require 'mlua.thread'
+local time = require 'mlua.time'
+local string = require 'string'
+local table = require 'table'
+
+local module_name = ...
+
+function test_start_join(t)
+    local w = multi.start(module_name, 'worker_sum', 1, 2, 3, 4)
+    t:expect(t.mexpr(w):join()):eq{10, 'done', n = 2}
+    t:expect(t.expr(w):is_alive()):eq(false)
+    t:expect(t.expr(w):join()):raises("already joined")
+end
+
+function test_start_values(t)
+    local w = multi.start(module_name, 'worker_echo', nil, true, false, 42,
+                          1.5, 'abc')
+    t:expect(t.mexpr(w):join()):eq{nil, true, false, 42, 1.5, 'abc', n = 6}
+    local tab = {1, 2, {a = 'b'}, x = {y = 'z'}}
+    w = multi.start(module_name, 'worker_echo', tab)
+    t:expect(repr(w:join())):label("table"):eq(repr(tab))
+    t:expect(t.expr(multi).start(module_name, 'worker_echo', print))
+        :raises("unsupported value type: function")
+end
+
+function test_start_errors(t)
+    local w = multi.start(module_name, 'worker_fail', 'boom')
+    t:expect(t.expr(w):join()):raises("boom")
+    w = multi.start('mlua.multi.test.unknown')
+    t:expect(t.expr(w):join()):raises("module 'mlua.multi.test.unknown'")
+end
+
+function test_Channel(t)
+    local ch, res = multi.channel(), multi.channel()
+    local w = multi.start(module_name, 'worker_double', ch, res)
+    for i = 1, 10 do ch:send(i, {i}) end
+    ch:send(nil)
+    for i = 1, 10 do
+        t:expect(t.mexpr(res):recv()):eq{2 * i, {2 * i}, n = 2}
+    end
+    t:expect(t.mexpr(w):join()):eq{10, n = 1}
+end
+
+function test_Channel_timeout(t)
+    local ch = multi.channel()
+    t:expect(t.mexpr(ch):recv(time.deadline(1000)))
+        :eq{nil, "timed out", errors.ETIMEDOUT, n = 3}
+end
+
+function test_Channel_receiver(t)
+    local ch = multi.channel()
+    ch:recv(time.deadline(0))  -- Become the receiver
+    local w = multi.start(module_name, 'worker_recv', ch)
+    t:expect(t.expr(w):join()):raises("receiver in another interpreter")
+end
+
+function test_Buffer_transfer(t)
+    local ch, res = multi.channel(), multi.channel()
+    local w = multi.start(module_name, 'worker_upper', ch, res)
+    local buf = mem.alloc(6, true)
+    mem.write(buf, 'abcdef')
+    local ptr = buf:ptr()
+    t:expect(t.expr(ch):send(buf, print))
+        :raises("unsupported value type: function")
+    t:expect(t.expr(ch):send(buf, buf))
+        :raises("unsupported value type: userdata")
+    t:expect(#buf):label("#buf after failed send"):eq(6)
+    t:expect(t.expr(mem).read(buf)):eq('abcdef')
+    ch:send(buf)
+    t:expect(#buf):label("#buf"):eq(0)
+    local got = res:recv()
+    t:expect(t.expr(got):ptr()):eq(ptr)
+    t:expect(t.expr(mem).read(got)):eq('ABCDEF')
+    t:expect(t.expr(ch):send(mem.alloc(4)))
+        :raises("unsupported value type: userdata")
+    w:join()
+end
+
+function test_nested_handles(t)
+    local ch, res = multi.channel(), multi.channel()
+    local w = multi.start(module_name, 'worker_nested', ch)
+    local buf = mem.alloc(3, true)
+    mem.write(buf, 'abc')
+    local ptr = buf:ptr()
+    ch:send({res}, {buf = buf})
+    t:expect(#buf):label("#buf"):eq(0)
+    local got = res:recv()
+    t:expect(t.expr(got)[1]:ptr()):eq(ptr)
+    t:expect(t.expr(mem).read(got[1])):eq('ABC')
+    w:join()
+end
+
+function test_parallel(t)
+    local ws = {}
+    for i = 1, 4 do
+        ws[i] = multi.start(module_name, 'worker_sum', i, i, i)
+    end
+    for i, w in ipairs(ws) do t:expect(t.expr(w):join()):eq(3 * i) end
+end
+
+function test_join_yields(t)
+    local ch = multi.channel()
+    local w = multi.start(module_name, 'worker_wait', ch)
+    local yielded = false
+    local th<close> = thread.start(function() yielded = true end)
+    ch:send('go')
+    t:expect(t.expr(w):join()):eq('go')
+    t:expect(yielded, "join() didn't yield")
+end
+
+function test_Ring_spsc(t)
+    local r = ring.new(64)
+    local w = multi.start(module_name, 'worker_write_bytes', r, 10000)
+    local want = 0
+    while want < 10000 do
+        local data = r:read()
+        for i = 1, #data do
+            if data:byte(i) ~= want % 251 then
+                t:fatal("byte %d: got %d, want %d", want, data:byte(i),
+                        want % 251)
+            end
+            want = want + 1
+        end
+    end
+    w:join()
+end
+
+function test_Ring_mpsc(t)
+    local r = ring.new(256, ring.MULTI_PRODUCER | ring.RECORDS)
+    local ws, next = {}, {}
+    for i = 1, 4 do
+        ws[i] = multi.start(module_name, 'worker_write_records', r, i, 1000)
+        next[i] = 1
+    end
+    for _ = 1, 4 * 1000 do
+        local id, cnt = r:read():match('^(%d+):(%d+)$')
+        id, cnt = tonumber(id), tonumber(cnt)
+        if cnt ~= next[id] then
+            t:fatal("worker %d: got record %d, want %d", id, cnt, next[id])
+        end
+        next[id] = cnt + 1
+    end
+    for _, w in ipairs(ws) do w:join() end
+end
+
+function bench_Ring_spsc(b)
+    local r, size = ring.new(4096), 256
+    b:bytes(size)
+    local w = multi.start(module_name, 'worker_write_bytes', r, b.n * size)
+    local cnt = 0
+    while cnt < b.n * size do cnt = cnt + #r:read() end
+    w:join()
+end
+
+function bench_Ring_mpsc(b)
+    local r = ring.new(4096, ring.MULTI_PRODUCER | ring.RECORDS)
+    local ws, n = {}, b.n // 4 + 1
+    for i = 1, 4 do
+        ws[i] = multi.start(module_name, 'worker_write_records', r, i, n)
+    end
+    for _ = 1, 4 * n do r:read() end
+    for _, w in ipairs(ws) do w:join() end
+end
+
+function worker_sum(...)
+    local sum = 0
+    for _, v in ipairs{...} do sum = sum + v end
+    return sum, 'done'
+end
+
+function worker_echo(...) return ... end
+
+function worker_fail(msg) error(msg, 0) end
+
+function worker_double(ch, res)
+    local cnt = 0
+    while true do
+        local v, tab = ch:recv()
+        if v == nil then return cnt end
+        res:send(2 * v, {2 * tab[1]})
+        cnt = cnt + 1
+    end
+end
+
+function worker_upper(ch, res)
+    local buf = ch:recv()
+    mem.write(buf, mem.read(buf):upper())
+    res:send(buf)
+end
+
+function worker_nested(ch)
+    local r, b = ch:recv()
+    local buf = b.buf
+    mem.write(buf, mem.read(buf):upper())
+    r[1]:send({buf})
+end
+
+function worker_recv(ch) return ch:recv() end
+
+function worker_wait(ch)
+    return ch:recv()
+end
+
+function worker_write_bytes(r, cnt)
+    local chunk = {}
+    for i = 0, 250 do chunk[i + 1] = string.char(i) end
+    chunk = table.concat(chunk):rep(2)
+    local pos = 0
+    while pos < cnt do
+        local len = math.min(cnt - pos, 32)
+        local off = pos % 251
+        r:write(chunk:sub(off + 1, off + len))
+        pos = pos + len
+    end
+end
+
+function worker_write_records(r, id, cnt)
+    for i = 1, cnt do r:write(('%d:%d'):format(id, i)) end
+end
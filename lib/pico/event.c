@@ -104,6 +104,7 @@ void mlua_event_disable(lua_State* ls, MLuaEvent* ev) {
 }
 
 void __time_critical_func(mlua_event_set_nolock)(MLuaEvent* ev) {
+    __sev();
     if (ev->state == 0 || event_state(ev) != EVENT_IDLE) return;
     EventQueue* q = (EventQueue*)ev->state;
     ev->state = (uintptr_t)NULL | EVENT_PENDING;
@@ -113,7 +114,13 @@ void __time_critical_func(mlua_event_set_nolock)(MLuaEvent* ev) {
         q->tail->state = (uintptr_t)ev | EVENT_PENDING;
         q->tail = ev;
     }
-    __sev();
+}
+
+bool mlua_event_wait_nolock(uint64_t deadline) {
+    mlua_event_unlock();
+    bool res = mlua_wait(deadline);
+    mlua_event_lock();
+    return res;
 }
 
 bool mlua_event_disable_abandoned(MLuaEvent* ev) {
@@ -85,6 +85,11 @@ static inline void mlua_event_set(MLuaEvent* ev) {
 // Disable an event, and return true, iff the event has been abandoned.
 bool mlua_event_disable_abandoned(MLuaEvent* ev);
 
+// Wait until any event is set, or until the deadline is reached. Must be in a
+// locked section. Returns true iff the deadline was reached. Spurious wakeups
+// are possible, so the caller must re-check its condition.
+bool mlua_event_wait_nolock(uint64_t deadline);
+
 // Dispatch pending events.
 void mlua_event_dispatch(lua_State* ls, uint64_t deadline);
 
@@ -58,6 +58,7 @@ void mlua_block_flash_init(MLuaBlockFlash* dev, uint32_t offset, size_t size) {
     dev->dev.read_size = 1;
     dev->dev.write_size = FLASH_PAGE_SIZE;
     dev->dev.erase_size = FLASH_SECTOR_SIZE;
+    dev->dev.async = NULL;
     dev->start = __flash_binary_start + offset;
 }
 
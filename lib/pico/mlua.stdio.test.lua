@@ -6,6 +6,9 @@ local list = require 'mlua.list'
 local repr = require 'mlua.repr'
 local stdio = require 'mlua.stdio'
 local testing_stdio = require 'mlua.testing.stdio'
+local pico_stdio = require 'pico.stdio'
+local string = require 'string'
+local table = require 'table'
 
 function test_streams_BNB(t)
     for _, test in ipairs{
@@ -30,6 +33,39 @@ function test_streams_BNB(t)
     end
 end
 
+-- Read the available characters from stdio, without flushing OutStreams.
+local function drain()
+    local parts = {}
+    while true do
+        local c = pico_stdio.getchar_timeout_us(1000)
+        if c < 0 then return table.concat(parts) end
+        table.insert(parts, string.char(c))
+    end
+end
+
+function test_buffering(t)
+    for _, test in ipairs{
+        {'line', {'a', 'bc\n', 'def'}, 'abc\n', 'def'},
+        {'full', {'a', 'bc\n', 'def'}, '', 'abc\ndef'},
+        {'full', {'abcd', 'efghijkl', 'm'}, 'abcdefghijkl', 'm'},
+    } do
+        local mode, writes, want_before, want_after = list.unpack(test)
+        local got_before, got_after
+        t:expect(pcall(function()  -- No output in this block
+            local done<close> = testing_stdio.enable_loopback(t, false)
+            local stream = stdio.stderr
+            stream:setvbuf(mode, 8)
+            local restore<close> = function() stream:setvbuf('no') end
+            for _, w in ipairs(writes) do stream:write(w) end
+            got_before = drain()
+            stream:flush()
+            got_after = drain()
+        end))
+        t:expect(got_before):label("%s: before flush", mode):eq(want_before)
+        t:expect(got_after):label("%s: after flush", mode):eq(want_after)
+    end
+end
+
 function test_print(t)
     local r = t:patch(_G, 'stdout', io.Recorder())
 
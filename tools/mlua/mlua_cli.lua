@@ -3,10 +3,14 @@
 
 local io = require 'io'
 local math = require 'math'
+local block_file = require 'mlua.block.file'
 local block_mem = require 'mlua.block.mem'
+local block_stats = require 'mlua.block.stats'
 local cli = require 'mlua.cli'
+local codec = require 'mlua.codec'
 local fs = require 'mlua.fs'
 local lfs = require 'mlua.fs.lfs'
+local romfs = require 'mlua.fs.romfs'
 local mio = require 'mlua.io'
 local list = require 'mlua.list'
 local mem = require 'mlua.mem'
@@ -17,6 +21,8 @@ local os = require 'os'
 local string = require 'string'
 local table = require 'table'
 
+local crc32 = codec.crc('crc32')
+
 local printf = mio.printf
 local check = util.check
 local raise = util.raise
@@ -79,19 +85,50 @@ local function read_uf2(path)
     return buf, start
 end
 
--- Write a memory buffer to an UF2 file.
-local function write_uf2(data, addr, path)
+-- Write a memory buffer to an UF2 file. If ranges is given, only the given
+-- {off, size} ranges of the buffer are written.
+local function write_uf2(data, addr, path, ranges)
     local f<close> = check(io.open(path, 'wb'))
-    local block = {flags = uf2.flag_family_id_present,
-                   reserved = uf2.family_id_rp2040,
-                   num_blocks = (#data + 255) // 256}
-    for i = 0, block.num_blocks - 1 do
-        local off = i * 256
-        block.target_addr = addr + off
-        block.block_no = i
-        block.data = mem.read(data, off, math.min(256, #data - off))
-        check(f:write(check(uf2.serialize(block))))
+    local function read(off, size) return mem.read(data, off, size) end
+    for block in uf2.serialize_ranges(read, addr, ranges or {{0, #data}}, {
+            flags = uf2.flag_family_id_present,
+            reserved = uf2.family_id_rp2040}) do
+        check(f:write(block))
+    end
+end
+
+-- Compute the CRC-32 of each block of a memory buffer.
+local function block_crcs(data, block_size)
+    local crcs = {}
+    for off = 0, #data - 1, block_size do
+        local size = math.min(block_size, #data - off)
+        crcs[off // block_size + 1] = crc32:checksum(data, off, size)
     end
+    return crcs
+end
+
+-- Remove the blocks whose content matches the given CRCs from a list of
+-- {off, size} ranges, merging the remaining adjacent blocks.
+local function drop_unchanged(data, block_size, crcs, ranges)
+    local res = list()
+    for _, r in ipairs(ranges) do
+        local off, e = r[1], r[1] + r[2]
+        while off < e do
+            local size = math.min(block_size - off % block_size, e - off)
+            if size ~= block_size
+                    or crc32:checksum(data, off, size)
+                       ~= crcs[off // block_size + 1] then
+                local last = res[#res]
+                if last and last[1] + last[2] == off then
+                    last[2] = last[2] + size
+                else
+                    res:append({off, size})
+                end
+            end
+            off = off + size
+        end
+    end
+    return res
 end
 
 -- Run a command as a sub-process and capture its output.
@@ -222,20 +259,55 @@ local function fs_op_list(efs, path)
 end
 
 local function fs_op_read(efs, src, dst)
-    -- TODO: Handle the case where src is a directory => recurse
-    printf("Reading %s to %s\n", src, dst)
-    local f<close> = check(efs:open(dst, fs.O_RDONLY))
-    local size = check(f:size())
-    write_file(dst, check(f:read(data)))
+    local function read(src, dst)
+        printf("Reading %s to %s\n", src, dst)
+        local f<close> = check(efs:open(src, fs.O_RDONLY))
+        write_file(dst, check(f:read()))
+    end
+    local _, type = check(efs:stat(src))
+    if type ~= fs.TYPE_DIR then return read(src, dst) end
+
+    -- Copy the directory tree recursively.
+    run{'mkdir', '-p', dst}
+    for path, type in check(efs:walk(src)) do
+        local p = dst .. path:sub(#src + 1)
+        if type == fs.TYPE_DIR then run{'mkdir', '-p', p} else read(path, p) end
+    end
 end
 
 local function fs_op_write(efs, src, dst)
-    -- TODO: Handle the case where src is a directory => recurse
-    local data = read_file(src)
+    -- Create the directories first, then write the files. When src is a file,
+    -- "find" returns src itself.
+    src = src:gsub('(.)/+$', '%1')
+    for path in run{'find', src, '-type', 'd'}:gmatch('[^\n]+') do
+        local p = dst .. path:sub(#src + 1)
+        create_parent_dirs(efs, p)
+        local ok, type = efs:stat(p)
+        if not (ok and type == fs.TYPE_DIR) then
+            printf("Creating directory %s\n", p)
+            check(efs:mkdir(p))
+        end
+    end
+    for path in run{'find', src, '-type', 'f'}:gmatch('[^\n]+') do
+        local p = dst .. path:sub(#src + 1)
+        local data = read_file(path)
+        create_parent_dirs(efs, p)
+        printf("Writing %s to %s\n", path, p)
+        local f<close> = check(efs:open(p, fs.O_WRONLY | fs.O_CREAT
+                                           | fs.O_TRUNC))
+        check(f:write(data))
+    end
+end
+
+local function fs_op_copy(efs, src, dst)
     create_parent_dirs(efs, dst)
-    printf("Writing %s to %s\n", src, dst)
-    local f<close> = check(efs:open(dst, fs.O_WRONLY | fs.O_CREAT | fs.O_TRUNC))
-    check(f:write(data))
+    printf("Copying %s to %s\n", src, dst)
+    local _, type = check(efs:stat(src))
+    if type == fs.TYPE_DIR then
+        check(efs:copy_tree(src, dst))
+    else
+        check(efs:copy(src, dst))
+    end
 end
 
 local function fs_op_mkdir(efs, path)
@@ -267,42 +339,89 @@ local fs_ops = {
     list = {fs_op_list, 1},
     read = {fs_op_read, 2},
     write = {fs_op_write, 2},
+    copy = {fs_op_copy, 2},
     mkdir = {fs_op_mkdir, 1},
     remove = {fs_op_remove, 1},
     rename = {fs_op_rename, 2},
 }
 
-local function count_true(values)
+local function count_true(...)
     local cnt = 0
-    for _, v in ipairs(values) do if v then cnt = cnt + 1 end end
+    for i = 1, select('#', ...) do
+        if select(i, ...) then cnt = cnt + 1 end
+    end
     return cnt
 end
 
+-- Mount the filesystem on a block device, perform the requested operations,
+-- and unmount it.
+local function run_fs_ops(dev, opts, args)
+    local efs<close> = lfs.new(dev)
+    if opts.format then
+        local ok, msg = efs:format()
+        if not ok then raise("failed to format filesystem: %s", msg) end
+    end
+    local ok, msg = efs:mount()
+    if not ok then raise("failed to mount filesystem: %s", msg) end
+
+    -- Perform the requested filesystem operations.
+    local i = 1
+    while i <= #args do
+        local op = fs_ops[args[i]]
+        if not op then raise("unknown filesystem operation: %s", args[i]) end
+        i = i + 1
+        local fn, nargs = table.unpack(op)
+        if i + nargs > #args + 1 then
+            raise("%s: not enough arguments", args[i])
+        end
+        fn(efs, table.unpack(args, i, i + nargs - 1))
+        i = i + nargs
+    end
+
+    ok, msg = efs:unmount()
+    if not ok then raise("failed to unmount filesystem: %s", msg) end
+end
+
 local function cmd_fs(opts, args)
     cli.parse_opts(opts, {
         -- Source
         device = device_opt(nil),
         program = cli.str_opt(nil),
         image = cli.str_opt(nil),
+        raw = cli.str_opt(nil),
         -- Destination
         output = cli.str_opt(nil),
         -- Options
         format = cli.bool_opt(false),
+        full = cli.bool_opt(false),
         block_size = cli.num_opt(4096),
+        size = cli.int_opt(nil),
         picotool = cli.str_opt('picotool'),
         -- TODO: --label, --reboot, --help
     })
 
     -- Check options.
-    local srcs = count_true{opts.device, opts.program, opts.image}
+    local srcs = count_true(opts.device, opts.program, opts.image, opts.raw)
     if srcs > 1 then
-        raise("--device, --program and --image are mutually exclusive")
+        raise("--device, --program, --image and --raw are mutually exclusive")
     end
     if opts.program and not opts.output then
         raise("--output is required with --program")
     end
     if opts.program then opts.format = true end
 
+    -- Raw images are mapped directly, and modified in place.
+    if opts.raw then
+        printf("Mapping filesystem image\n")
+        local dev = check(block_file.new(opts.raw, opts.size, 256,
+                                         opts.block_size))
+        local size = dev:size()
+        if opts.format then check(dev:erase(0, size)) end
+        printf("Filesystem: 0x%08x bytes\n", size)
+        run_fs_ops(dev, opts, args)
+        return check(block_file.close(dev))
+    end
+
     -- Read the block device data from the source.
     printf("Reading filesystem source\n")
     local addr, size, data
@@ -320,47 +439,90 @@ local function cmd_fs(opts, args)
         data = read_flash_range(opts, addr, size)
     end
     printf("Filesystem: 0x%08x bytes at 0x%08x\n", #data, addr)
-    local orig = mem.read(data)
-
-    -- Create the filesystem and mount it.
-    local efs<close> = lfs.new(block_mem.new(data, 256, opts.block_size))
-    if opts.format then
-        local ok, msg = efs:format()
-        if not ok then raise("failed to format filesystem: %s", msg) end
+    local crcs
+    if opts.device and not (opts.format or opts.full) then
+        crcs = block_crcs(data, opts.block_size)
     end
-    local ok, msg = efs:mount()
-    if not ok then raise("failed to mount filesystem: %s", msg) end
+    local dev = block_stats.new(block_mem.new(data, 256, opts.block_size))
+    run_fs_ops(dev, opts, args)
 
-    -- Perform the requested filesystem operations.
-    local i = 1
-    while i <= #args do
-        local op = fs_ops[args[i]]
-        if not op then raise("unknown filesystem operation: %s", args[i]) end
-        i = i + 1
-        local fn, nargs = table.unpack(op)
-        if i + nargs > #args + 1 then
-            raise("%s: not enough arguments", args[i])
-        end
-        fn(efs, table.unpack(args, i, i + nargs - 1))
-        i = i + nargs
+    -- Write the content of the block device to the destination if it was
+    -- modified. When updating a device, only the modified blocks are written,
+    -- unless --full is given. Blocks that were written with their original
+    -- content are skipped.
+    local ranges = block_stats.changed(dev)
+    if crcs then
+        ranges = drop_unchanged(data, opts.block_size, crcs, ranges)
     end
-
-    -- Unmount the filesystem and write the content of the block device to the
-    -- destination if it was modified.
-    ok, msg = efs:unmount()
-    if not ok then raise("failed to unmount filesystem: %s", msg) end
-    if mem.read(data) == orig then return end
-    printf("Writing modified filesystem\n")
+    if #ranges == 0 then return end
+    if not opts.device or opts.format or opts.full then
+        ranges = {{0, #data}}
+    end
+    local size = 0
+    for _, r in ipairs(ranges) do size = size + r[2] end
+    printf("Writing modified filesystem: 0x%08x bytes in %d range(s)\n",
+           size, #ranges)
     local out = opts.output or opts.image or os.tmpname()
     local done<close> = function()
         if not (opts.output or opts.image) then os.remove(out) end
     end
-    write_uf2(data, addr, out)
+    write_uf2(data, addr, out, ranges)
     if opts.device and not opts.output then write_flash_range(opts, out) end
 end
 
+-- Return the name of the module defined in a source file, given the path of
+-- the file relative to its root directory.
+local function module_name(rel)
+    local name = rel:gsub('%.lua$', ''):gsub('/init$', '')
+    return (name:gsub('/', '.'))
+end
+
+local function cmd_romfs(opts, args)
+    cli.parse_opts(opts, {
+        output = cli.str_opt(nil),
+        addr = cli.int_opt(nil),
+        compile = cli.bool_opt(false),
+        strip = cli.bool_opt(false),
+    })
+    if not opts.output then raise("--output is required") end
+    local is_uf2 = opts.output:match('%.uf2$')
+    if is_uf2 and not opts.addr then
+        raise("--addr is required for UF2 output")
+    end
+
+    -- Collect the modules below the given paths.
+    local files, cnt = {}, 0
+    for _, root in ipairs(args) do
+        root = root:gsub('/+$', '')
+        local paths = run{'find', root, '-type', 'f', '-name', '*.lua'}
+        for path in paths:gmatch('[^\n]+') do
+            local name = module_name(path == root and path:match('[^/]+$')
+                                     or path:sub(#root + 2))
+            if files[name] then raise("duplicate module: %s", name) end
+            local data = read_file(path)
+            if opts.compile then
+                data = string.dump(check(load(data, '@' .. name)), opts.strip)
+            end
+            files[name] = data
+            cnt = cnt + 1
+        end
+    end
+
+    -- Pack the modules and write the image.
+    local img = romfs.pack(files)
+    printf("Image: %d modules, 0x%08x bytes\n", cnt, #img)
+    if is_uf2 then
+        local data = mem.alloc(#img)
+        mem.write(data, img)
+        write_uf2(data, opts.addr, opts.output)
+    else
+        write_file(opts.output, img)
+    end
+end
+
 local commands = {
     fs = cmd_fs,
+    romfs = cmd_romfs,
 }
 
 function main() return cli.run(arg, commands) end